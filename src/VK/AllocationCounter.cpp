@@ -0,0 +1,94 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<bool>     counting{ false };
+static std::atomic<uint64_t> allocationCount{ 0 };
+
+void AllocationCounter::start()
+{
+	allocationCount = 0;
+	counting = true;
+}
+
+uint64_t AllocationCounter::stop()
+{
+	counting = false;
+	return allocationCount;
+}
+
+static void* countedAlloc(size_t size, size_t alignment)
+{
+	if (counting.load(std::memory_order_relaxed))
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	if (size == 0)
+		size = 1;
+	//	the aligned forms are freed with _aligned_free
+	return (alignment > 0) ? _aligned_malloc(size, alignment) : malloc(size);
+}
+
+//	global allocation functions
+//
+void* operator new(size_t size)
+{
+	void* p = countedAlloc(size, 0);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	void* p = countedAlloc(size, (size_t)alignment);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size, (size_t)alignment);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+//	over-aligned blocks come from _aligned_malloc
+void operator delete(void* p, std::align_val_t) noexcept { _aligned_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { _aligned_free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { _aligned_free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { _aligned_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { _aligned_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { _aligned_free(p); }
@@ -0,0 +1,12 @@
+#pragma once
+
+//  counts the heap allocations of every thread while enabled, through replacements of the global operator new.
+//  the benchmark uses it to check that steady-state frames don't allocate.
+class AllocationCounter
+{
+public:
+
+    static void start();
+    //  allocations since start
+    static uint64_t stop();
+};
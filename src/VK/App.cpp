@@ -1,4 +1,6 @@
 #include "Renderer.h"
+#include "AllocationCounter.h"
+#include "SceneTransforms.h"
 
 #include <iostream>
 #include <sstream>
@@ -11,6 +13,29 @@ const bool VALIDATION_ENABLED = false;
 
 #define APP_NAME "BIRT Caustics v0.1"
 
+//  caustics benchmark : time stamps lag behind the frames in flight, so the first frames of every run are not measured
+#define BENCHMARK_WARMUP_FRAMES 8
+#define BENCHMARK_BACKEND_COUNT 2
+
+//  window resize : the render extent catches up with the window once it held still this long (ms.)
+#define RESIZE_SETTLE_MS 250.0
+//  resize benchmark : window extents stepped through, frames per extent
+#define RESIZE_BENCHMARK_STEPS 8
+#define RESIZE_BENCHMARK_STEP_FRAMES 4
+
+//  render scale : extent the scene is rendered at, relative to the window (temporally upscaled below 1)
+#define RENDER_SCALE_COUNT 3
+//  scale benchmark : measured frames per scale, after warm-up
+#define SCALE_BENCHMARK_FRAMES 64
+
+//  multi-view : auxiliary views rendered after the main one, sharing its light-side passes
+#define MULTI_VIEW_MODE_COUNT 3
+//  stereo : eye separation (m.)
+#define STEREO_IPD 0.065f
+
+//  pass replay : measured frames unless given with -frames
+#define REPLAY_DEFAULT_FRAMES 256
+
 #define RESOURCES_PATH "..\\res\\"
 
 #ifdef USE_TEST_SCENE
@@ -45,6 +70,7 @@ protected:
     Device device;
 
     //  display
+    HWND hWnd = NULL;
     SwapChain swapChain;
     DisplayModes currentDisplayMode = DISPLAYMODE_SDR;
     std::vector<DisplayModes> availableDisplayModes;
@@ -52,6 +78,8 @@ protected:
 
     //  model loader (GLTF)
     SceneLoader* sceneLoader = nullptr;
+    SceneTransforms sceneTransforms; // world matrices of the loaded scene
+    std::vector<SceneTransforms::BenchmarkResult> transformBenchResults;
 
     //  renderer
     Renderer* renderer = nullptr;
@@ -61,6 +89,28 @@ protected:
     //  main camera
     Camera camera;
 
+    //  window resize : only the swap chain follows the window at once, the rendered image is stretched over it.
+    //  the render targets are re-allocated at the window extent (x render scale) once it settled (or at once if not deferred).
+    bool deferRenderResize = true;
+    int renderScaleIndex = 0; // see renderScales
+    double lastResizeTime = 0;
+    double resizeTime = 0; // ms, last OnResize (GPU flush included)
+    double renderResizeTime = 0; // ms, last re-allocation of the render targets
+    uint32_t renderResizeCount = 0;
+
+    void getRenderExtent(uint32_t* pWidth, uint32_t* pHeight) const;
+    bool isRenderExtentCurrent() const;
+    void updateRenderExtent(bool force);
+
+    //  multi-view : 0 off, 1 stereo (right eye at the render extent), 2 probes (3 yawed views at a quarter of it).
+    //  the auxiliary views follow the render extent, re-allocated along the render targets.
+    int multiViewMode = 0; // see multiViewModeNames
+    uint32_t auxViewsWidth = 0, auxViewsHeight = 0;
+    Camera auxCameras[Renderer::MaxAuxViews];
+
+    void updateAuxViews();
+    void updateAuxCameras();
+
     //  time (ms.)
     double deltaTime;
     double lastFrameTime;
@@ -71,8 +121,84 @@ protected:
     std::vector<float> accumProfTimes;
     unsigned int accumCount = 0;
     double accumInSec = 0;
+
+    //  caustics benchmark
+    //  a camera path is recorded once, then replayed with every backend in turn.
+    struct CameraKey
+    {
+        XMFLOAT4X4 world;
+        double deltaTime;
+    };
+    struct BenchmarkResult
+    {
+        float time = 0.f; // us.
+        VkDeviceSize memory = 0; // bytes
+        float allocations = 0.f; // heap allocations per frame, in Renderer::OnRender
+        bool valid = false;
+    };
+    std::vector<CameraKey> benchPath;
+    bool benchRecording = false;
+    int benchBackend = -1; // backend being replayed, -1 if idle
+    uint32_t benchFrame = 0;
+    double benchAccumTime = 0;
+    uint32_t benchAccumCount = 0;
+    uint64_t benchAllocations = 0;
+    XMFLOAT4X4 benchSavedCamera;
+    Caustics::Backend benchSavedBackend = Caustics::Backend::BIRT;
+    bool benchSavedBudget = false;
+    BenchmarkResult benchResults[BENCHMARK_BACKEND_COUNT];
+
+    void startBenchmarkRun();
+    void updateBenchmark();
+
+    //  resize benchmark : the window steps through a few extents, with immediate then deferred render resizes
+    struct ResizeBenchmarkResult
+    {
+        float resizeTime = 0.f; // ms, per resize
+        float maxFrameTime = 0.f; // ms, while resizing
+        float settleTime = 0.f; // ms, render targets re-allocated once the window settled
+        uint32_t reallocations = 0;
+        bool valid = false;
+    };
+    int resizeBenchMode = -1; // 0 : immediate, 1 : deferred, -1 if idle
+    uint32_t resizeBenchFrame = 0;
+    uint32_t resizeBenchStartCount = 0;
+    uint32_t resizeBenchSavedWidth = 0, resizeBenchSavedHeight = 0;
+    bool resizeBenchSavedDefer = true;
+    ResizeBenchmarkResult resizeBenchResults[2];
+
+    void resizeClient(uint32_t width, uint32_t height);
+    void startResizeBenchmarkRun();
+    void updateResizeBenchmark();
+
+    //  scale benchmark : GPU time of every pass (time stamp), averaged at every render scale in turn
+    struct ScaleBenchmarkResult
+    {
+        std::vector<TimeStamp> passes; // us.
+        bool valid = false;
+    };
+    int scaleBenchIndex = -1; // scale being measured, -1 if idle
+    uint32_t scaleBenchFrame = 0;
+    int scaleBenchSavedIndex = 0;
+    ScaleBenchmarkResult scaleBenchResults[RENDER_SCALE_COUNT];
+
+    void startScaleBenchmarkRun();
+    void updateScaleBenchmark();
+
+    //  pass replay (-replay <capture file> [-frames N]) : runs only the captured pass, then quits
+    std::string replayPath;
+    uint32_t replayFrames = REPLAY_DEFAULT_FRAMES;
+    bool replayStarted = false;
+
+    void updateReplay();
 };
 
+static const char* causticsBackendNames[BENCHMARK_BACKEND_COUNT] = { "BIRT", "Caustics Mapping" };
+static const char* resizeModeNames[2] = { "Immediate", "Deferred" };
+static const float renderScales[RENDER_SCALE_COUNT] = { 1.f, 0.67f, 0.5f };
+static const char* renderScaleNames[RENDER_SCALE_COUNT] = { "100%", "67%", "50%" };
+static const char* multiViewModeNames[MULTI_VIEW_MODE_COUNT] = { "Off", "Stereo", "3 Probes" };
+
 
 void App::OnParseCommandLine(LPSTR lpCmdLine, uint32_t* pWidth, uint32_t* pHeight, bool* pbFullScreen)
 {
@@ -80,10 +206,33 @@ void App::OnParseCommandLine(LPSTR lpCmdLine, uint32_t* pWidth, uint32_t* pHeigh
     /**pWidth = 1280;
     *pHeight = 720;*/
     *pbFullScreen = false;
+
+    std::istringstream args(lpCmdLine);
+    std::string arg;
+    while (args >> arg)
+    {
+        if (arg == "-replay")
+            args >> this->replayPath;
+        else if (arg == "-frames")
+            args >> this->replayFrames;
+    }
+
+    //  replay at the extent the pass was captured with
+    if (!this->replayPath.empty())
+    {
+        PassCapture::Pass pass;
+        if (!PassCapture::readFileInfo(this->replayPath.c_str(), &pass, pWidth, pHeight))
+        {
+            MessageBox(NULL, "The capture file couldn't be read", "Pass Replay", MB_ICONERROR);
+            exit(0);
+        }
+    }
 }
 
 void App::OnCreate(HWND hWnd)
 {
+    this->hWnd = hWnd;
+
     //  check if cauldron-media repo exists
     //  this repo contains default multimedia and scene files needed for the first phase of the development.
     /*DWORD dwAttrib = GetFileAttributes(CAULDRON_MEDIA_PATH);
@@ -153,6 +302,9 @@ void App::OnCreate(HWND hWnd)
         this->sceneLoader->AddLight(n, l);
     }
 #endif
+    //  the hierarchy is complete : world matrices are propagated from here on
+    this->sceneTransforms.OnCreate(this->sceneLoader, 0, this->renderer->getJobSystem());
+
     //  init GUI subsystem
     ImGUI_Init((void*)hWnd);
 }
@@ -167,11 +319,14 @@ void App::OnDestroy()
 
     //  destroy renderer
     this->renderer->unloadScene();
+    if (this->renderer->getRenderWidth() > 0)
+        this->renderer->OnDestroyRenderResources();
     this->renderer->OnDestroyWindowSizeDependentResources();
     this->renderer->OnDestroy();
     delete this->renderer;
 
     //  destroy scene loader
+    this->sceneTransforms.OnDestroy();
     delete this->sceneLoader;
 
     //  destroy swap chain
@@ -193,10 +348,25 @@ void App::OnRender()
     this->deltaTime = timeNow - this->lastFrameTime;
     this->lastFrameTime = timeNow;
 
+    //  the resize benchmark steps the window extent, before the GUI reads it
+    if (this->resizeBenchMode >= 0)
+        this->updateResizeBenchmark();
+    if (this->scaleBenchIndex >= 0)
+        this->updateScaleBenchmark();
+    this->updateRenderExtent(false);
+    this->updateAuxViews();
+
     //  initialize new GUI frame
     ImGUI_UpdateIO();
     ImGui::NewFrame();
 
+    //  replay mode : no scene, only the captured pass runs
+    if (!this->replayPath.empty())
+    {
+        this->updateReplay();
+        return;
+    }
+
     static int loadingStage = 0;
     static double cumulativeFrameTime = 0.;
     static float fps = 0.f;
@@ -242,7 +412,84 @@ void App::OnRender()
         if (ImGui::CollapsingHeader("General", ImGuiTreeNodeFlags_DefaultOpen))
         {
             ImGui::Text("Resolution\t: %i x %i", this->m_Width, this->m_Height);
+            ImGui::Text("Render Extent\t: %u x %u", this->renderer->getRenderWidth(), this->renderer->getRenderHeight());
             ImGui::Text("Frame rate\t: %.3f", fps);
+
+            //  render scale, re-allocates at once
+            if (this->scaleBenchIndex < 0)
+            {
+                if (ImGui::Combo("Render Scale", &this->renderScaleIndex, renderScaleNames, RENDER_SCALE_COUNT))
+                    this->updateRenderExtent(true);
+                if (ImGui::Button("Scale Benchmark"))
+                {
+                    this->scaleBenchSavedIndex = this->renderScaleIndex;
+                    this->scaleBenchIndex = 0;
+                    this->startScaleBenchmarkRun();
+                }
+            }
+            else
+            {
+                ImGui::Text("Benchmarking %s : %u / %u", renderScaleNames[this->scaleBenchIndex],
+                    this->scaleBenchFrame, BENCHMARK_WARMUP_FRAMES + SCALE_BENCHMARK_FRAMES);
+            }
+
+            //  auxiliary views, re-allocates at once
+            if (ImGui::Combo("Multi-View", &this->multiViewMode, multiViewModeNames, MULTI_VIEW_MODE_COUNT))
+                this->updateAuxViews();
+
+            //  per pass (us.), a column per scale (passes differ between scales, e.g. TAA / upscale)
+            if (this->scaleBenchResults[RENDER_SCALE_COUNT - 1].valid)
+            {
+                ImGui::Text("%-22s: %7s %7s %7s", "Pass", renderScaleNames[0], renderScaleNames[1], renderScaleNames[2]);
+                for (uint32_t i = 0; i < RENDER_SCALE_COUNT; i++)
+                {
+                    for (const TimeStamp& row : this->scaleBenchResults[i].passes)
+                    {
+                        //  a row per label, where it first appears
+                        float times[RENDER_SCALE_COUNT] = {};
+                        bool listed = false;
+                        for (uint32_t j = 0; j < RENDER_SCALE_COUNT; j++)
+                        {
+                            for (const TimeStamp& pass : this->scaleBenchResults[j].passes)
+                            {
+                                if (pass.m_label != row.m_label)
+                                    continue;
+                                times[j] = pass.m_microseconds;
+                                listed |= (j < i);
+                            }
+                        }
+                        if (!listed)
+                            ImGui::Text("%-22s: %7.1f %7.1f %7.1f", row.m_label.c_str(), times[0], times[1], times[2]);
+                    }
+                }
+            }
+
+            //  window resizes, render targets re-allocations (ms.)
+            ImGui::Checkbox("Deferred Render Resize", &this->deferRenderResize);
+            ImGui::Text("Resize %.1f, render targets %.1f", this->resizeTime, this->renderResizeTime);
+            if (this->resizeBenchMode < 0)
+            {
+                if (ImGui::Button("Resize Benchmark"))
+                {
+                    this->resizeBenchSavedWidth = this->m_Width;
+                    this->resizeBenchSavedHeight = this->m_Height;
+                    this->resizeBenchSavedDefer = this->deferRenderResize;
+                    this->resizeBenchMode = 0;
+                    this->startResizeBenchmarkRun();
+                }
+            }
+            else
+            {
+                ImGui::Text("Benchmarking %s : %u / %u", resizeModeNames[this->resizeBenchMode],
+                    this->resizeBenchFrame, RESIZE_BENCHMARK_STEPS * RESIZE_BENCHMARK_STEP_FRAMES);
+            }
+            for (uint32_t i = 0; i < 2; i++)
+            {
+                const ResizeBenchmarkResult& result = this->resizeBenchResults[i];
+                if (result.valid)
+                    ImGui::Text("%-9s: %6.1f / %6.1f max, settle %6.1f, %u re-alloc.", resizeModeNames[i],
+                        result.resizeTime, result.maxFrameTime, result.settleTime, result.reallocations);
+            }
         }
 
         if (ImGui::CollapsingHeader("Scene Config", ImGuiTreeNodeFlags_DefaultOpen))
@@ -261,8 +508,120 @@ void App::OnRender()
                 /*int light_node_idx = this->sceneLoader->m_lightInstances[0].m_nodeIndex;
                 this->sceneLoader->m_nodes[light_node_idx].m_tranform.LookAt(
                     this->renderer_state.sunDir * 20.5f, XMVectorSet(0, 0, 0, 0));
-                this->sceneLoader->m_animatedMats[light_node_idx] =
-                    this->sceneLoader->m_nodes[light_node_idx].m_tranform.GetWorldMat();*/
+                this->sceneTransforms.setLocalTransform(light_node_idx,
+                    this->sceneLoader->m_nodes[light_node_idx].m_tranform.GetWorldMat());*/
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Caustics", ImGuiTreeNodeFlags_DefaultOpen))
+        {
+            if (this->benchBackend < 0)
+            {
+                int backend = (int)this->renderer_state.causticsBackend;
+                if (ImGui::Combo("Backend", &backend, causticsBackendNames, BENCHMARK_BACKEND_COUNT))
+                    this->renderer_state.causticsBackend = (Caustics::Backend)backend;
+                ImGui::Checkbox("Ocean Phase Cache", &this->renderer_state.causticsPhaseCache);
+                if (!this->renderer_state.causticsPhaseCache)
+                    ImGui::Text("Light segments : %5.1f %% reused", this->renderer->getLightSegmentReuse() * 100.f);
+                ImGui::Checkbox("Water-Fitted RSM", &this->renderer_state.causticsFitWater);
+                //  density feedback only applies to the photons traced per emission block
+                const bool persistentThreads = this->renderer_state.causticsPersistentThreads && this->renderer->isPersistentThreadsSupported();
+                if (this->renderer_state.causticsPhaseCache || persistentThreads)
+                    ImGui::TextDisabled("View-Dependent Density : off with %s", this->renderer_state.causticsPhaseCache ? "phase cache" : "persistent threads");
+                else
+                    ImGui::Checkbox("View-Dependent Density", &this->renderer_state.causticsDensityFeedback);
+                if (this->renderer->isPersistentThreadsSupported())
+                    ImGui::Checkbox("Persistent Threads", &this->renderer_state.causticsPersistentThreads);
+                else
+                    ImGui::Text("Persistent Threads : no subgroup ops");
+                if (this->renderer->isFresnelPersistentThreadsSupported())
+                    ImGui::Checkbox("Fresnel Persistent Threads", &this->renderer_state.fresnelPersistentThreads);
+                else
+                    ImGui::Text("Fresnel Persistent Threads : no subgroup ops");
+
+                //  trace 1/N of the photons per frame
+                const char* amortizationNames[] = { "1", "1/2", "1/4" };
+                int amortizationIdx = (this->renderer_state.causticsAmortization == 4) ? 2 : (this->renderer_state.causticsAmortization == 2) ? 1 : 0;
+                if (ImGui::Combo("Photons / Frame", &amortizationIdx, amortizationNames, _countof(amortizationNames)))
+                    this->renderer_state.causticsAmortization = 1u << amortizationIdx;
+
+                //  hold caustics + Fresnel under a GPU time budget
+                ImGui::Checkbox("Time Budget", &this->renderer_state.qualityBudget);
+                if (this->renderer_state.qualityBudget)
+                {
+                    ImGui::SliderFloat("Budget (ms)", &this->renderer_state.qualityBudgetMs, 0.5f, 16.f);
+                    ImGui::Checkbox("Log Settings", &this->renderer_state.qualityBudgetLog);
+
+                    const BudgetController& budget = this->renderer->getBudgetController();
+                    const BudgetController::Settings& settings = budget.getSettings();
+                    ImGui::Text("Level %u / %u : %.2f ms", budget.getLevel(), BudgetController::LevelCount - 1, budget.getFilteredTime());
+                    ImGui::Text("Photons x%.2f, %u iter. / Fresnel x%.2f, %u iter.",
+                        settings.photonSampleScale, settings.causticsIterCount, settings.fresnelSampleScale, settings.fresnelIterCount);
+                }
+
+                //  record camera path
+                if (ImGui::Button(this->benchRecording ? "Stop Recording" : "Record Path"))
+                {
+                    if (!this->benchRecording)
+                        this->benchPath.clear();
+                    this->benchRecording = !this->benchRecording;
+                }
+
+                //  replay it with every backend
+                if (!this->benchRecording && this->benchPath.size() > BENCHMARK_WARMUP_FRAMES)
+                {
+                    ImGui::SameLine();
+                    if (ImGui::Button("Run Benchmark"))
+                    {
+                        XMStoreFloat4x4(&this->benchSavedCamera, XMMatrixInverse(nullptr, this->camera.GetView()));
+                        this->benchSavedBackend = this->renderer_state.causticsBackend;
+
+                        //  backends are compared at the same quality
+                        this->benchSavedBudget = this->renderer_state.qualityBudget;
+                        this->renderer_state.qualityBudget = false;
+
+                        this->benchBackend = 0;
+                        this->startBenchmarkRun();
+                    }
+                }
+                ImGui::Text("Path\t: %u frames", (uint32_t)this->benchPath.size());
+
+                //  save the inputs of a pass, to be replayed alone with -replay <file>
+                if (ImGui::Button("Capture Caustics"))
+                    this->renderer->requestCapture(PassCapture::Pass::Caustics, "capture_caustics.bin");
+                ImGui::SameLine();
+                if (ImGui::Button("Capture Fresnel"))
+                    this->renderer->requestCapture(PassCapture::Pass::Fresnel, "capture_fresnel.bin");
+            }
+            else
+            {
+                ImGui::Text("Benchmarking %s : %u / %u",
+                    causticsBackendNames[this->benchBackend], this->benchFrame, (uint32_t)this->benchPath.size());
+            }
+
+            for (uint32_t i = 0; i < BENCHMARK_BACKEND_COUNT; i++)
+            {
+                if (this->benchResults[i].valid)
+                    ImGui::Text("%-16s: %7.1f us, %6.1f MB, %5.1f allocs", causticsBackendNames[i],
+                        this->benchResults[i].time, this->benchResults[i].memory / (1024.f * 1024.f),
+                        this->benchResults[i].allocations);
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Culling", ImGuiTreeNodeFlags_DefaultOpen))
+        {
+            ImGui::Checkbox("GPU Culling", &this->renderer_state.gpuCulling);
+            if (this->renderer_state.gpuCulling)
+            {
+                ImGui::Checkbox("Occlusion (Hi-Z, 1 frame late)", &this->renderer_state.occlusionCulling);
+
+                const char* viewNames[] = { "G-Buffer", "RSM" };
+                for (uint32_t i = 0; i < (uint32_t)GPUCulling::View::Count; i++)
+                {
+                    const GPUCulling::Stats& stats = this->renderer->getCullingStats((GPUCulling::View)i);
+                    ImGui::Text("%-8s: %4u batches, %4u frustum, %4u occlusion", viewNames[i],
+                        stats.batchCount, stats.frustumCulled, stats.occlusionCulled);
+                }
             }
         }
 
@@ -306,12 +665,56 @@ void App::OnRender()
                     ImGui::Text("%-22s: %7.1f", timeStamps[i].m_label.c_str(), this->profTimes[i]);
                 }
             }
+
+            //  CPU recording, per thread (ms.)
+            ImGui::Checkbox("Parallel Recording", &this->renderer_state.parallelRecording);
+            ImGui::Text("%-22s: %7.3f", "Record: Main Thread", this->renderer->getMainRecordTime());
+
+            //  cost of the auxiliary views, GPU (us.) against the main view's & CPU recording (ms.)
+            if (this->renderer->getAuxViewCount() > 0)
+            {
+                float mainTime, auxTime;
+                this->renderer->getViewTimes(&mainTime, &auxTime);
+                ImGui::Text("Aux Views : %u x %7.1f, main %7.1f", this->renderer->getAuxViewCount(),
+                    auxTime / this->renderer->getAuxViewCount(), mainTime);
+                ImGui::Text("%-22s: %7.3f", "Record: Aux Views", this->renderer->getAuxRecordTime());
+            }
+            for (const ParallelRecorder::RecordTime& recordTime : this->renderer->getSectionRecordTimes())
+                ImGui::Text("Record: %-14s: %7.3f", recordTime.name, recordTime.milliseconds);
+
+            //  job system, over the last second
+            const std::vector<JobSystem::WorkerStats>& workerStats = this->renderer->getWorkerStats();
+            for (uint32_t i = 0; i < workerStats.size(); i++)
+                ImGui::Text("Worker %2u : %5.1f %%, %5u jobs, %4u stolen", i,
+                    workerStats[i].utilization * 100.f, workerStats[i].jobCount, workerStats[i].stealCount);
+
+            //  scene graph (ms.)
+            const SceneTransforms::Stats& transformStats = this->sceneTransforms.getStats();
+            ImGui::Text("%-22s: %7.3f", "Transforms", transformStats.milliseconds);
+            ImGui::Text("Nodes : %u / %u updated, %u levels",
+                transformStats.updatedCount, transformStats.nodeCount, transformStats.levelCount);
+
+            //  on synthetic hierarchies, per update (ms.)
+            if (ImGui::Button("Transform Benchmark"))
+                this->transformBenchResults = SceneTransforms::runBenchmark(this->renderer->getJobSystem());
+            for (const SceneTransforms::BenchmarkResult& result : this->transformBenchResults)
+            {
+                ImGui::Text("%u^%u (%u nodes)", result.branching, result.depth, result.nodeCount);
+                ImGui::Text("  recursive %.3f, full %.3f / %.3f (jobs)", result.recursive, result.full, result.fullJobs);
+                ImGui::Text("  1%% moved %.3f (%.0f nodes), still %.4f", result.incremental, result.incrementalNodes, result.still);
+            }
         }
 
         ImGui::End();
 
         //  manage key inputs
         ImGuiIO& io = ImGui::GetIO();
+        if (this->benchBackend >= 0)
+        {
+            //  camera is driven by the recorded path
+            this->updateBenchmark();
+        }
+        else
         {
             float newYaw = this->camera.GetYaw();
             float newPitch = this->camera.GetPitch();
@@ -333,6 +736,14 @@ void App::OnRender()
             //  WASD move
             //  P.S. multiplying deltaTime(ms.) is no diff. from multiplying its internal speed
             this->camera.UpdateCameraWASD(newYaw, newPitch, io.KeysDown, /*io.DeltaTime*/ this->deltaTime * 2.0e-3);
+
+            if (this->benchRecording)
+            {
+                CameraKey key;
+                XMStoreFloat4x4(&key.world, XMMatrixInverse(nullptr, this->camera.GetView()));
+                key.deltaTime = this->deltaTime;
+                this->benchPath.push_back(key);
+            }
         }
     }
     else
@@ -349,11 +760,23 @@ void App::OnRender()
         loadingStage = this->renderer->loadScene(this->sceneLoader, loadingStage);
     }
 
-    //  propagate initial transformation matrix for the enire scene heirarchy
-    this->sceneLoader->TransformScene(0, XMMatrixIdentity());
+    //  propagate the transformations of the moved nodes down the scene hierarchy
+    this->sceneTransforms.update();
+    this->renderer_state.sceneMoved = this->sceneTransforms.getStats().updatedCount > 0;
 
     //  command renderer to do its thing
+    //  (steady-state frames of the benchmark should not allocate)
+    const bool countAllocations = this->benchBackend >= 0 && this->benchFrame > BENCHMARK_WARMUP_FRAMES;
+    if (countAllocations)
+        AllocationCounter::start();
+    this->updateAuxCameras();
     this->renderer->OnRender(&this->swapChain, &this->camera, &this->renderer_state);
+    if (countAllocations)
+    {
+        const uint64_t allocations = AllocationCounter::stop();
+        assert(allocations == 0 && "a steady-state frame allocated");
+        this->benchAllocations += allocations;
+    }
 
     //  upon completed, present rendered frame to the front buffer
     this->swapChain.Present();
@@ -362,6 +785,92 @@ void App::OnRender()
     this->camera.UpdatePreviousMatrices();
 }
 
+void App::startBenchmarkRun()
+{
+    //  every run starts from the same ocean phase
+    this->renderer_state.causticsBackend = (Caustics::Backend)this->benchBackend;
+    this->renderer->resetAnimation();
+
+    this->benchFrame = 0;
+    this->benchAccumTime = 0;
+    this->benchAccumCount = 0;
+    this->benchAllocations = 0;
+}
+
+void App::updateBenchmark()
+{
+    if (this->benchFrame > BENCHMARK_WARMUP_FRAMES)
+    {
+        this->benchAccumTime += this->renderer->getCausticsTime();
+        this->benchAccumCount++;
+    }
+
+    //  current run is done
+    if (this->benchFrame == this->benchPath.size())
+    {
+        BenchmarkResult& result = this->benchResults[this->benchBackend];
+        result.time = (this->benchAccumCount > 0) ? (float)(this->benchAccumTime / this->benchAccumCount) : 0.f;
+        result.memory = this->renderer->getCausticsMemoryFootprint((Caustics::Backend)this->benchBackend);
+        result.allocations = (this->benchAccumCount > 0) ? (float)this->benchAllocations / this->benchAccumCount : 0.f;
+        result.valid = true;
+
+        std::stringstream msg;
+        msg << "Caustics benchmark [" << causticsBackendNames[this->benchBackend] << "] : "
+            << result.time << " us, " << result.memory / (1024.f * 1024.f) << " MB, "
+            << result.allocations << " allocations/frame (" << this->benchAccumCount << " frames)\n";
+        Trace(msg.str());
+
+        if (++this->benchBackend < BENCHMARK_BACKEND_COUNT)
+        {
+            this->startBenchmarkRun();
+        }
+        else
+        {
+            //  back to where the user was
+            this->benchBackend = -1;
+            this->camera.SetMatrix(XMLoadFloat4x4(&this->benchSavedCamera));
+            this->renderer_state.causticsBackend = this->benchSavedBackend;
+            this->renderer_state.qualityBudget = this->benchSavedBudget;
+            return;
+        }
+    }
+
+    const CameraKey& key = this->benchPath[this->benchFrame++];
+    this->camera.SetMatrix(XMLoadFloat4x4(&key.world));
+    this->renderer_state.deltaTime = key.deltaTime;
+}
+
+void App::updateReplay()
+{
+    if (!this->replayStarted)
+    {
+        //  the window has its final extent by now
+        this->replayStarted = true;
+        if (!this->renderer->startReplay(this->replayPath.c_str(), this->replayFrames))
+        {
+            Trace("Pass replay : cannot replay " + this->replayPath + "\n");
+            ImGui::EndFrame();
+            PostQuitMessage(0);
+            return;
+        }
+    }
+    else if (!this->renderer->isReplaying())
+    {
+        //  timings were traced by the renderer
+        ImGui::EndFrame();
+        PostQuitMessage(0);
+        return;
+    }
+
+    ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_Once);
+    ImGui::Begin("Info");
+    ImGui::Text("Replaying %s", this->replayPath.c_str());
+    ImGui::End();
+
+    this->renderer->OnRender(&this->swapChain, &this->camera, &this->renderer_state);
+    this->swapChain.Present();
+}
+
 bool App::OnEvent(MSG msg)
 {
     return ImGUI_WndProcHandler(msg.hwnd, msg.message, msg.wParam, msg.lParam) ? true : false;
@@ -369,6 +878,8 @@ bool App::OnEvent(MSG msg)
 
 void App::OnResize(uint32_t Width, uint32_t Height)
 {
+    const double start = MillisecondsNow();
+
     //  flush gpu command queues first
     this->device.GPUFlush();
 
@@ -398,8 +909,246 @@ void App::OnResize(uint32_t Width, uint32_t Height)
             this->renderer->OnCreateWindowSizeDependentResources(&this->swapChain, this->m_Width, this->m_Height);
     }
 
-    //  setup new camera settings
+    //  setup new camera settings (the aspect is the window's, whatever the render extent)
     this->camera.SetFov(XM_PI / 4, this->m_Width, this->m_Height, 0.1f, 1000.0f);
+
+    //  render targets follow now if not deferred (or not created yet)
+    this->lastResizeTime = MillisecondsNow();
+    this->updateRenderExtent(false);
+
+    this->resizeTime = MillisecondsNow() - start;
+}
+
+void App::getRenderExtent(uint32_t* pWidth, uint32_t* pHeight) const
+{
+    const float scale = renderScales[this->renderScaleIndex];
+    *pWidth = max(1u, (uint32_t)(this->m_Width * scale + 0.5f));
+    *pHeight = max(1u, (uint32_t)(this->m_Height * scale + 0.5f));
+}
+
+bool App::isRenderExtentCurrent() const
+{
+    uint32_t width, height;
+    this->getRenderExtent(&width, &height);
+    return this->renderer->getRenderWidth() == width && this->renderer->getRenderHeight() == height
+        && this->renderer->getUpscaledWidth() == this->m_Width && this->renderer->getUpscaledHeight() == this->m_Height;
+}
+
+void App::updateRenderExtent(bool force)
+{
+    if (this->renderer == nullptr || this->m_Width == 0 || this->m_Height == 0)
+        return;
+    if (this->isRenderExtentCurrent())
+        return;
+
+    //  wait for the window to settle (e.g. while its border is dragged)
+    const bool created = this->renderer->getRenderWidth() > 0;
+    if (!force && created && this->deferRenderResize && MillisecondsNow() - this->lastResizeTime < RESIZE_SETTLE_MS)
+        return;
+
+    //  not a constants update : a render scale change re-allocates too, see Renderer::OnCreateRenderResources
+    const double start = MillisecondsNow();
+    this->device.GPUFlush();
+    if (created)
+        this->renderer->OnDestroyRenderResources();
+    uint32_t width, height;
+    this->getRenderExtent(&width, &height);
+    this->renderer->OnCreateRenderResources(width, height, this->m_Width, this->m_Height);
+
+    this->renderResizeTime = MillisecondsNow() - start;
+    this->renderResizeCount++;
+}
+
+void App::updateAuxViews()
+{
+    if (this->renderer == nullptr || this->renderer->getRenderWidth() == 0)
+        return;
+
+    uint32_t count = 0, width = 0, height = 0;
+    if (this->multiViewMode == 1)
+    {
+        count = 1;
+        width = this->renderer->getRenderWidth();
+        height = this->renderer->getRenderHeight();
+    }
+    else if (this->multiViewMode == 2)
+    {
+        count = 3;
+        width = max(1u, this->renderer->getRenderWidth() / 4);
+        height = max(1u, this->renderer->getRenderHeight() / 4);
+    }
+
+    if (this->renderer->getAuxViewCount() == count && this->auxViewsWidth == width && this->auxViewsHeight == height)
+        return;
+
+    this->device.GPUFlush();
+    this->renderer->OnDestroyAuxViews();
+    if (count > 0)
+        this->renderer->OnCreateAuxViews(count, width, height);
+    this->auxViewsWidth = width;
+    this->auxViewsHeight = height;
+}
+
+void App::updateAuxCameras()
+{
+    const uint32_t count = this->renderer->getAuxViewCount();
+    this->renderer_state.pAuxCameras = this->auxCameras;
+    this->renderer_state.auxViewCount = count;
+    if (count == 0)
+        return;
+
+    //  the auxiliary cameras keep the main one's projection
+    const XMMATRIX world = XMMatrixInverse(nullptr, this->camera.GetView());
+    for (uint32_t i = 0; i < count; i++)
+    {
+        this->auxCameras[i] = this->camera;
+        if (this->multiViewMode == 1)
+        {
+            //  right eye, along the camera's right axis
+            XMMATRIX eye = world;
+            eye.r[3] += world.r[0] * STEREO_IPD;
+            this->auxCameras[i].SetMatrix(eye);
+        }
+        else
+        {
+            //  probes around the camera position, yawed by 90, 180 & 270 degrees
+            this->auxCameras[i].SetMatrix(XMMatrixRotationY(XM_PIDIV2 * (i + 1)) * world);
+        }
+    }
+}
+
+void App::resizeClient(uint32_t width, uint32_t height)
+{
+    //  the window rectangle includes the borders
+    RECT windowRect, clientRect;
+    GetWindowRect(this->hWnd, &windowRect);
+    GetClientRect(this->hWnd, &clientRect);
+    const int borderWidth = (windowRect.right - windowRect.left) - (clientRect.right - clientRect.left);
+    const int borderHeight = (windowRect.bottom - windowRect.top) - (clientRect.bottom - clientRect.top);
+
+    //  resized synchronously (OnResize is called before this returns)
+    SetWindowPos(this->hWnd, NULL, 0, 0, (int)width + borderWidth, (int)height + borderHeight,
+        SWP_NOMOVE | SWP_NOZORDER | SWP_NOACTIVATE);
+}
+
+void App::startResizeBenchmarkRun()
+{
+    //  every run starts from the same extent, with the render targets at it
+    this->resizeClient(this->resizeBenchSavedWidth, this->resizeBenchSavedHeight);
+    this->updateRenderExtent(true);
+
+    this->deferRenderResize = (this->resizeBenchMode == 1);
+    this->resizeBenchResults[this->resizeBenchMode] = ResizeBenchmarkResult();
+    this->resizeBenchFrame = 0;
+    this->resizeBenchStartCount = this->renderResizeCount;
+}
+
+void App::updateResizeBenchmark()
+{
+    //  ends off the starting extent, so that the deferred run re-allocates once
+    static const float scales[RESIZE_BENCHMARK_STEPS] = { 0.9f, 0.8f, 0.7f, 0.8f, 0.9f, 0.75f, 0.85f, 0.8f };
+    const uint32_t stepFrames = RESIZE_BENCHMARK_STEPS * RESIZE_BENCHMARK_STEP_FRAMES;
+
+    ResizeBenchmarkResult& result = this->resizeBenchResults[this->resizeBenchMode];
+    const uint32_t frame = this->resizeBenchFrame++;
+
+    //  duration of the previous frame, which may have resized
+    if (frame > 0 && frame <= stepFrames)
+        result.maxFrameTime = max(result.maxFrameTime, (float)this->deltaTime);
+
+    if (frame < stepFrames)
+    {
+        if (frame % RESIZE_BENCHMARK_STEP_FRAMES == 0)
+        {
+            const float scale = scales[frame / RESIZE_BENCHMARK_STEP_FRAMES];
+            this->resizeClient((uint32_t)(this->resizeBenchSavedWidth * scale), (uint32_t)(this->resizeBenchSavedHeight * scale));
+            result.resizeTime += (float)this->resizeTime / RESIZE_BENCHMARK_STEPS;
+        }
+        return;
+    }
+
+    //  done once the render targets caught up with the window
+    if (!this->isRenderExtentCurrent())
+        return;
+
+    result.reallocations = this->renderResizeCount - this->resizeBenchStartCount;
+    result.settleTime = (this->resizeBenchMode == 1 && result.reallocations > 0) ? (float)this->renderResizeTime : 0.f;
+    result.valid = true;
+
+    std::stringstream msg;
+    msg << "Resize benchmark [" << resizeModeNames[this->resizeBenchMode] << "] : "
+        << result.resizeTime << " ms per resize, " << result.maxFrameTime << " ms max. frame, "
+        << result.settleTime << " ms settle, " << result.reallocations << " re-allocations\n";
+    Trace(msg.str());
+
+    if (++this->resizeBenchMode < 2)
+    {
+        this->startResizeBenchmarkRun();
+    }
+    else
+    {
+        //  back to where the user was
+        this->resizeBenchMode = -1;
+        this->resizeClient(this->resizeBenchSavedWidth, this->resizeBenchSavedHeight);
+        this->deferRenderResize = this->resizeBenchSavedDefer;
+        this->updateRenderExtent(true);
+    }
+}
+
+void App::startScaleBenchmarkRun()
+{
+    this->renderScaleIndex = this->scaleBenchIndex;
+    this->updateRenderExtent(true);
+
+    this->scaleBenchResults[this->scaleBenchIndex] = ScaleBenchmarkResult();
+    this->scaleBenchFrame = 0;
+}
+
+void App::updateScaleBenchmark()
+{
+    ScaleBenchmarkResult& result = this->scaleBenchResults[this->scaleBenchIndex];
+    const uint32_t frame = this->scaleBenchFrame++;
+
+    //  time stamps of the previous frames, read back
+    if (frame > BENCHMARK_WARMUP_FRAMES)
+    {
+        const std::vector<TimeStamp>& timeStamps = this->renderer->getTimeStamps();
+        if (result.passes.size() != timeStamps.size())
+        {
+            result.passes = timeStamps;
+            for (TimeStamp& pass : result.passes)
+                pass.m_microseconds = 0;
+        }
+        for (uint32_t i = 0; i < timeStamps.size(); i++)
+            result.passes[i].m_microseconds += timeStamps[i].m_microseconds / SCALE_BENCHMARK_FRAMES;
+    }
+
+    if (frame < BENCHMARK_WARMUP_FRAMES + SCALE_BENCHMARK_FRAMES)
+        return;
+
+    result.valid = true;
+
+    uint32_t width, height;
+    this->getRenderExtent(&width, &height);
+
+    std::stringstream msg;
+    msg << "Scale benchmark [" << renderScaleNames[this->scaleBenchIndex] << ", "
+        << width << " x " << height << "] :\n";
+    for (const TimeStamp& pass : result.passes)
+        msg << "  " << pass.m_label << " : " << pass.m_microseconds << " us\n";
+    Trace(msg.str());
+
+    if (++this->scaleBenchIndex < RENDER_SCALE_COUNT)
+    {
+        this->startScaleBenchmarkRun();
+    }
+    else
+    {
+        //  back to where the user was
+        this->scaleBenchIndex = -1;
+        this->renderScaleIndex = this->scaleBenchSavedIndex;
+        this->updateRenderExtent(true);
+    }
 }
 
 void App::SetFullScreen(bool fullscreen)
@@ -0,0 +1,328 @@
+#include "AuxiliaryView.h"
+
+void AuxiliaryView::OnCreate(
+	Device* pDevice,
+	UploadHeap* pUploadHeap,
+	ResourceViewHeaps* pResourceViewHeaps,
+	DynamicBufferRing* pDynamicBufferRing,
+	StaticBufferPool* pStaticBufferPool,
+	VkRenderPass swapChainRenderPass,
+	GBuffer* pRSM,
+	VkImageView rsmDepthCacheSRV,
+	Caustics* pCaustics)
+{
+	this->pDevice = pDevice;
+	this->pCaustics = pCaustics;
+
+	//	G-buffer, same formats as the main view's
+	this->pGBuffer = new GBuffer();
+	this->pGBuffer->OnCreate(this->pDevice,
+		pResourceViewHeaps,
+		{
+			//  g-buffer
+			{ GBUFFER_DEPTH, VK_FORMAT_D32_SFLOAT_S8_UINT},
+			{ GBUFFER_WORLD_COORD, VK_FORMAT_R16G16B16A16_SFLOAT},
+			{ GBUFFER_NORMAL_BUFFER, VK_FORMAT_R16G16B16A16_SFLOAT},
+			{ GBUFFER_DIFFUSE, VK_FORMAT_R16G16B16A16_UNORM},
+			{ GBUFFER_SPECULAR_ROUGHNESS, VK_FORMAT_R16G16B16A16_UNORM},
+			{ GBUFFER_EMISSIVE_FLUX, VK_FORMAT_R8G8B8A8_UNORM},
+			{ GBUFFER_MOTION_VECTORS, VK_FORMAT_R16G16_SFLOAT},
+			//  final rt
+			{ GBUFFER_FORWARD, VK_FORMAT_R16G16B16A16_SFLOAT},
+		},
+		1
+	);
+	GBufferFlags fullGBuffer = GBUFFER_DEPTH |
+		GBUFFER_WORLD_COORD | GBUFFER_NORMAL_BUFFER |
+		GBUFFER_DIFFUSE | GBUFFER_SPECULAR_ROUGHNESS |
+		GBUFFER_EMISSIVE_FLUX | GBUFFER_MOTION_VECTORS;
+	this->rp_gBuffer_opaq.OnCreate(this->pGBuffer, fullGBuffer, true, "Aux G-Buffer RenderPass (Opaque)");
+	this->rp_gBuffer_trans.OnCreate(this->pGBuffer, fullGBuffer, false, "Aux G-Buffer RenderPass (Transparent)");
+	this->rp_skyDome.OnCreate(this->pGBuffer, GBUFFER_FORWARD, true, "Aux SkyDome RenderPass");
+
+	//	D-light, reading the shared RSM
+	this->dLighting.OnCreate(this->pDevice,
+		pUploadHeap,
+		pResourceViewHeaps,
+		pDynamicBufferRing,
+		pStaticBufferPool);
+
+	DLightInput::LightGBuffer lightGB;
+	lightGB.depthTransparent = pRSM->m_DepthBufferSRV;
+	lightGB.stencilTransparent = pRSM->m_StencilBufferSRV;
+	lightGB.depthOpaque = rsmDepthCacheSRV;
+	this->dLighting.setLightGBuffer(&lightGB);
+
+	this->shadowMask.OnCreate(this->pDevice,
+		pResourceViewHeaps,
+		pDynamicBufferRing,
+		pRSM->m_DepthBufferSRV);
+
+	this->toneMapping.OnCreate(this->pDevice, swapChainRenderPass,
+		pResourceViewHeaps, pStaticBufferPool, pDynamicBufferRing);
+
+	//	mips of the opaque depth, traced through by the caustics
+	this->depthMipmap.OnCreate(this->pDevice,
+		pResourceViewHeaps,
+		pDynamicBufferRing,
+		pStaticBufferPool,
+		VK_FORMAT_D32_SFLOAT_S8_UINT);
+}
+
+void AuxiliaryView::OnDestroy()
+{
+	this->depthMipmap.OnDestroy();
+	this->toneMapping.OnDestroy();
+	this->shadowMask.OnDestroy();
+	this->dLighting.OnDestroy();
+
+	this->rp_skyDome.OnDestroy();
+	this->rp_gBuffer_trans.OnDestroy();
+	this->rp_gBuffer_opaq.OnDestroy();
+	this->pGBuffer->OnDestroy();
+	delete this->pGBuffer;
+	this->pGBuffer = nullptr;
+}
+
+void AuxiliaryView::OnCreateWindowSizeDependentResources(SwapChain* pSwapChain, uint32_t Width, uint32_t Height)
+{
+	this->width = Width;
+	this->height = Height;
+	this->rect = { { 0, 0 }, { Width, Height } };
+
+	this->pGBuffer->OnCreateWindowSizeDependentResources(pSwapChain, Width, Height);
+	this->rp_gBuffer_opaq.OnCreateWindowSizeDependentResources(Width, Height);
+	this->rp_gBuffer_trans.OnCreateWindowSizeDependentResources(Width, Height);
+	this->rp_skyDome.OnCreateWindowSizeDependentResources(Width, Height);
+
+	this->dLighting.OnCreateWindowSizeDependentResources(Width, Height, this->pGBuffer);
+	{
+		DLightInput::CameraGBuffer camGB;
+		camGB.worldCoord = this->pGBuffer->m_WorldCoordSRV;
+		camGB.normal = this->pGBuffer->m_NormalBufferSRV;
+		camGB.diffuse = this->pGBuffer->m_DiffuseSRV;
+		camGB.specular = this->pGBuffer->m_SpecularRoughnessSRV;
+		camGB.emissive = this->pGBuffer->m_EmissiveFluxSRV;
+		this->dLighting.setCameraGBuffer(&camGB);
+	}
+	this->shadowMask.OnCreateWindowSizeDependentResources(Width, Height, this->pGBuffer);
+
+	//	caustics : the depth is read in place between the opaque & transparent passes (it holds the opaque
+	//	geometry only then), with as many mips as the main view's cache
+	const int numMipmaps = static_cast<int>(std::log2(Width > Height ? Height : Width)) - 1;
+	this->depthMipmap.OnCreateWindowSizeDependentResources(
+		Width, Height,
+		&this->pGBuffer->m_DepthBuffer, min(numMipmaps, 2));
+	this->pCaustics->OnCreateView(&this->causticsView, Width, Height,
+		this->pGBuffer, this->pGBuffer->m_DepthBufferSRV, this->depthMipmap.GetTexture());
+	{
+		DLightInput::Composite composite;
+		composite.fx0 = this->causticsView.irradianceMapSRV;
+		composite.shadowMask = this->shadowMask.GetTextureView();
+		this->dLighting.setComposite(&composite);
+	}
+}
+
+void AuxiliaryView::OnDestroyWindowSizeDependentResources()
+{
+	this->pCaustics->OnDestroyView(&this->causticsView);
+	this->depthMipmap.OnDestroyWindowSizeDependentResources();
+	this->shadowMask.OnDestroyWindowSizeDependentResources();
+	this->dLighting.OnDestroyWindowSizeDependentResources();
+
+	this->rp_skyDome.OnDestroyWindowSizeDependentResources();
+	this->rp_gBuffer_trans.OnDestroyWindowSizeDependentResources();
+	this->rp_gBuffer_opaq.OnDestroyWindowSizeDependentResources();
+	this->pGBuffer->OnDestroyWindowSizeDependentResources();
+
+	this->width = 0;
+	this->height = 0;
+}
+
+void AuxiliaryView::drawCaustics(VkCommandBuffer cmdBuf, const Caustics::Constants& constants)
+{
+	this->barrier_GO_C(cmdBuf);
+
+	this->depthMipmap.Draw(cmdBuf);
+	this->pCaustics->drawView(cmdBuf, &this->causticsView, constants);
+
+	this->barrier_C_GT(cmdBuf);
+}
+
+void AuxiliaryView::drawLighting(VkCommandBuffer cmdBuf, VkDescriptorBufferInfo* perFrameDesc, bool bCaustics)
+{
+	this->barrier_D(cmdBuf);
+
+	//	caustics irradiance is added on the fly, as in the main view
+	const float weights[4] = { 1.f, bCaustics ? 1.f : 0.f, 0.f, 0.f };
+	this->shadowMask.Draw(cmdBuf, perFrameDesc);
+	this->dLighting.Draw(cmdBuf, &this->rect, perFrameDesc, nullptr, weights);
+
+	this->barrier_Out(cmdBuf);
+}
+
+void AuxiliaryView::barrier_GO_GT(VkCommandBuffer cmdBuf)
+{
+	//	the transparent pass blends over & tests against the opaque one's attachments (no layout change)
+	VkMemoryBarrier barrier;
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = NULL;
+	barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+		0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+void AuxiliaryView::barrier_GO_C(VkCommandBuffer cmdBuf)
+{
+	//	the other attachments are blended over by the transparent pass
+	this->barrier_GO_GT(cmdBuf);
+
+	//	transition images
+	const uint32_t numBarriers = 2;
+	VkImageMemoryBarrier barriers[numBarriers];
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].pNext = NULL;
+	barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].subresourceRange.baseMipLevel = 0;
+	barriers[0].subresourceRange.levelCount = 1;
+	barriers[0].subresourceRange.baseArrayLayer = 0;
+	barriers[0].subresourceRange.layerCount = 1;
+
+	//	barrier 0 : depth
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+	barriers[0].image = this->pGBuffer->m_DepthBuffer.Resource();
+
+	//	barrier 1 : normal
+	barriers[1] = barriers[0];
+	barriers[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[1].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barriers[1].image = this->pGBuffer->m_NormalBuffer.Resource();
+
+	//	depth mips (fragment), photon tracing (compute)
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, NULL, 0, NULL,
+		numBarriers, barriers);
+}
+
+void AuxiliaryView::barrier_C_GT(VkCommandBuffer cmdBuf)
+{
+	//	transition images back
+	const uint32_t numBarriers = 2;
+	VkImageMemoryBarrier barriers[numBarriers];
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].pNext = NULL;
+	barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].subresourceRange.baseMipLevel = 0;
+	barriers[0].subresourceRange.levelCount = 1;
+	barriers[0].subresourceRange.baseArrayLayer = 0;
+	barriers[0].subresourceRange.layerCount = 1;
+
+	//	barrier 0 : depth
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+	barriers[0].image = this->pGBuffer->m_DepthBuffer.Resource();
+
+	//	barrier 1 : normal
+	barriers[1] = barriers[0];
+	barriers[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barriers[1].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barriers[1].image = this->pGBuffer->m_NormalBuffer.Resource();
+
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		0, 0, NULL, 0, NULL,
+		numBarriers, barriers);
+}
+
+void AuxiliaryView::barrier_D(VkCommandBuffer cmdBuf)
+{
+	//  transition images
+	const uint32_t numBarriers = 5;
+	VkImageMemoryBarrier barriers[numBarriers];
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].pNext = NULL;
+	barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].subresourceRange.baseMipLevel = 0;
+	barriers[0].subresourceRange.levelCount = 1;
+	barriers[0].subresourceRange.baseArrayLayer = 0;
+	barriers[0].subresourceRange.layerCount = 1;
+	barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	//	barrier 0 : world coord
+	barriers[0].image = this->pGBuffer->m_WorldCoord.Resource();
+
+	//	barrier 1 : normal
+	barriers[1] = barriers[0];
+	barriers[1].image = this->pGBuffer->m_NormalBuffer.Resource();
+
+	//	barrier 2 : diffuse
+	barriers[2] = barriers[0];
+	barriers[2].image = this->pGBuffer->m_Diffuse.Resource();
+
+	//	barrier 3 : specular
+	barriers[3] = barriers[0];
+	barriers[3].image = this->pGBuffer->m_SpecularRoughness.Resource();
+
+	//	barrier 4 : emissive/flux
+	barriers[4] = barriers[0];
+	barriers[4].image = this->pGBuffer->m_EmissiveFlux.Resource();
+
+	//	the shadow mask reads world coord
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, NULL, 0, NULL,
+		numBarriers, barriers);
+}
+
+void AuxiliaryView::barrier_Out(VkCommandBuffer cmdBuf)
+{
+	VkImageMemoryBarrier barriers[1];
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].pNext = NULL;
+	barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].subresourceRange.baseMipLevel = 0;
+	barriers[0].subresourceRange.levelCount = 1;
+	barriers[0].subresourceRange.baseArrayLayer = 0;
+	barriers[0].subresourceRange.layerCount = 1;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barriers[0].image = this->pGBuffer->m_HDR.Resource();
+
+	//	tone-mapped in the swap chain pass
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 0, NULL, 0, NULL,
+		1, barriers);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "DirectLighting.h"
+#include "ShadowMask.h"
+#include "Caustics.h"
+
+//  camera-side targets of a view rendered after the main one (second eye of a stereo pair, probe, thumbnail),
+//  sharing the main view's light-side work : RSM, its depth cache & mips, filtered through its own shadow mask.
+//  such a view is shaded by a single D-light pass over its opaque + transparent G-buffer, plus BIRT caustics
+//  traced against its opaque depth (reading the main view's light-space results) and splatted without denoising.
+//  no Fresnel, no temporal resolve : their screen-space histories are the main view's.
+//  views are recorded one after the other : Cauldron's glTF pipelines are built without view masks, so
+//  VK_KHR_multiview would need its shaders to pick the per-frame camera by gl_ViewIndex.
+class AuxiliaryView
+{
+public:
+
+    //  the G-buffer passes are compatible with the main view's, so that its pipelines draw into them
+    void OnCreate(
+        Device* pDevice,
+        UploadHeap* pUploadHeap,
+        ResourceViewHeaps* pResourceViewHeaps,
+        DynamicBufferRing* pDynamicBufferRing,
+        StaticBufferPool* pStaticBufferPool,
+        VkRenderPass swapChainRenderPass,
+        GBuffer* pRSM,
+        VkImageView rsmDepthCacheSRV,
+        Caustics* pCaustics);
+    void OnDestroy();
+
+    void OnCreateWindowSizeDependentResources(SwapChain* pSwapChain, uint32_t Width, uint32_t Height);
+    void OnDestroyWindowSizeDependentResources();
+
+    //  the swap chain's render pass was recreated
+    void UpdatePipelines(VkRenderPass swapChainRenderPass)
+    { this->toneMapping.UpdatePipelines(swapChainRenderPass); }
+
+    //  render passes, drawn into by the renderer : sky, then opaque & transparent geometry
+    GBufferRenderPass& getSkyDomePass() { return this->rp_skyDome; }
+    GBufferRenderPass& getOpaquePass() { return this->rp_gBuffer_opaq; }
+    GBufferRenderPass& getTransparentPass() { return this->rp_gBuffer_trans; }
+
+    //  batch lists built against this view's camera (they bind the per-frame constants they were built with),
+    //  kept across frames so that their storage is reused
+    std::vector<GltfPbrPass::BatchList>& getOpaqueBatches() { return this->batches_opaque; }
+    std::vector<GltfPbrPass::BatchList>& getTransparentBatches() { return this->batches_transparent; }
+
+    //  between the opaque & transparent G-buffer passes
+    void barrier_GO_GT(VkCommandBuffer cmdBuf);
+    //  same, tracing caustics in between (from the opaque depth & its mips, like the main view's)
+    void drawCaustics(VkCommandBuffer cmdBuf, const Caustics::Constants& constants);
+    //  shadow mask + D-light over the whole G-buffer (+ the caustics, if drawn this frame),
+    //  the HDR target is left in SHADER_READ_ONLY layout
+    void drawLighting(VkCommandBuffer cmdBuf, VkDescriptorBufferInfo* perFrameDesc, bool bCaustics);
+    //  tone-map the HDR target into the bound swap chain pass, over the current viewport
+    void drawToneMapped(VkCommandBuffer cmdBuf, uint32_t tonemappingMode)
+    { this->toneMapping.Draw(cmdBuf, this->pGBuffer->m_HDRSRV, 1.f, tonemappingMode); }
+
+    uint32_t getWidth() const
+    { return this->width; }
+    uint32_t getHeight() const
+    { return this->height; }
+    const VkRect2D& getRect() const
+    { return this->rect; }
+
+private:
+
+    Device*               pDevice = nullptr;
+
+    uint32_t              width = 0, height = 0;
+    VkRect2D              rect;
+
+    GBuffer*              pGBuffer = nullptr;
+    GBufferRenderPass     rp_skyDome, rp_gBuffer_opaq, rp_gBuffer_trans;
+
+    std::vector<GltfPbrPass::BatchList> batches_opaque, batches_transparent;
+
+    DirectLighting        dLighting;
+    ShadowMask            shadowMask;
+
+    Caustics*             pCaustics = nullptr;
+    Caustics::View        causticsView;
+    DownSamplePS          depthMipmap; // of the opaque depth, read in place
+    ToneMapping           toneMapping; // a descriptor set per view, in flight along the main view's
+
+    void barrier_GO_C(VkCommandBuffer cmdBuf);
+    void barrier_C_GT(VkCommandBuffer cmdBuf);
+    void barrier_D(VkCommandBuffer cmdBuf);
+    void barrier_Out(VkCommandBuffer cmdBuf);
+};
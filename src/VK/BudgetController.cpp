@@ -0,0 +1,83 @@
+#include "BudgetController.h"
+
+#include <algorithm>
+
+//	hysteresis : step down once over budget for a few frames,
+//	step up only after a longer while with enough headroom
+#define SETTLE_FRAME_COUNT 8
+#define STEP_DOWN_FRAME_COUNT 4
+#define STEP_UP_FRAME_COUNT 60
+#define STEP_UP_HEADROOM 0.8f
+
+//	exponential moving average of the measured time
+#define FILTER_WEIGHT 0.1f
+
+//	known level times fade out slowly, so that a level rejected long ago is tried again
+#define LEVEL_TIME_DECAY 0.999f
+
+const BudgetController::Settings& BudgetController::getSettings(uint32_t level)
+{
+	//	from cheapest to most expensive.
+	//	(caustics' photon count is capped by MAX_PHOTON_COUNT, see Caustics.cpp)
+	static const Settings levels[LevelCount] =
+	{
+		{ 2.9f,  2, 2.0f,  2 },
+		{ 2.9f,  4, 1.5f,  2 },
+		{ 2.45f, 4, 1.5f,  4 },
+		{ 2.0f,  4, 1.25f, 4 }, // DefaultLevel
+		{ 1.7f,  4, 1.25f, 4 },
+		{ 1.45f, 4, 1.0f,  4 },
+	};
+
+	assert(level < LevelCount);
+	return levels[level];
+}
+
+void BudgetController::reset(uint32_t level)
+{
+	assert(level < LevelCount);
+	this->level = level;
+	this->filteredTime = 0.f;
+	this->settleFrames = SETTLE_FRAME_COUNT;
+	this->overFrames = this->underFrames = 0;
+	std::fill(std::begin(this->levelTimes), std::end(this->levelTimes), 0.f);
+}
+
+bool BudgetController::update(float timeMs, float budgetMs)
+{
+	//	skip the frames still rendered with the previous settings
+	if (this->settleFrames > 0)
+	{
+		this->settleFrames--;
+		this->filteredTime = timeMs;
+		return false;
+	}
+
+	this->filteredTime += FILTER_WEIGHT * (timeMs - this->filteredTime);
+	this->levelTimes[this->level] = this->filteredTime;
+
+	this->overFrames = (this->filteredTime > budgetMs) ? this->overFrames + 1 : 0;
+	this->underFrames = (this->filteredTime < budgetMs * STEP_UP_HEADROOM) ? this->underFrames + 1 : 0;
+
+	uint32_t newLevel = this->level;
+	if (this->overFrames >= STEP_DOWN_FRAME_COUNT && this->level > 0)
+	{
+		newLevel = this->level - 1;
+	}
+	else if (this->underFrames >= STEP_UP_FRAME_COUNT && this->level + 1 < LevelCount)
+	{
+		//	the next level is either unknown, or known to fit
+		float& nextTime = this->levelTimes[this->level + 1];
+		nextTime *= LEVEL_TIME_DECAY;
+		if (nextTime < budgetMs)
+			newLevel = this->level + 1;
+	}
+
+	if (newLevel == this->level)
+		return false;
+
+	this->level = newLevel;
+	this->settleFrames = SETTLE_FRAME_COUNT;
+	this->overFrames = this->underFrames = 0;
+	return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+//  closed-loop quality controller : holds the GPU time of caustics + Fresnel under a budget,
+//  by walking a ladder of quality levels. it's fed with the time stamps of past frames.
+class BudgetController
+{
+public:
+
+    //  knobs driven by the controller
+    struct Settings
+    {
+        float    photonSampleScale;  // caustics' samplingMapScale (larger = fewer photons)
+        uint32_t causticsIterCount;  // SVGF a-trous iterations (even)
+        float    fresnelSampleScale; // Fresnel's samplingMapScale
+        uint32_t fresnelIterCount;   // SVGF a-trous iterations (even)
+    };
+
+    static constexpr uint32_t LevelCount = 6;
+    static constexpr uint32_t DefaultLevel = 3; // hand-tuned settings used without a budget
+
+    static const Settings& getSettings(uint32_t level);
+
+    //  restart from the given level, forgetting every measurement
+    void reset(uint32_t level = DefaultLevel);
+
+    //  feed the measured time (ms.) of the latest frame.
+    //  return true if the level changed.
+    bool update(float timeMs, float budgetMs);
+
+    uint32_t getLevel() const { return this->level; }
+    const Settings& getSettings() const { return getSettings(this->level); }
+    float getFilteredTime() const { return this->filteredTime; }
+
+private:
+
+    uint32_t level = DefaultLevel;
+    float    filteredTime = 0.f;
+
+    //  frames left before measuring again, since time stamps lag behind the frames in flight
+    uint32_t settleFrames = 0;
+    uint32_t overFrames = 0, underFrames = 0;
+
+    //  latest filtered time of each level, 0 if unknown.
+    //  keeps the controller from stepping up into a level it just left for being too slow.
+    float    levelTimes[LevelCount] = {};
+};
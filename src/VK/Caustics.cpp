@@ -1,9 +1,47 @@
 #include "Caustics.h"
+#include "SamplingSequence.h"
 
-#include <random>
+#include <algorithm>
 
 #define BLOCK_SIZE 16
 #define MAX_PHOTON_COUNT (1u << 20) // 2e20 ~ 1M
+#define SAMPLING_SEED_COUNT 8 // period of the sampling sequence (power of two), one light segment slice each
+#define LIGHT_SEGMENT_RELEASE_FRAMES 64 // fused traces in a row before the light segment buffer is freed
+#define PHASE_CACHE_SAMPLE_SCALE 2.0f // samplingMapScale the phases are traced with (BudgetController's default level)
+#define MAX_BLOCK_COUNT (MAX_PHOTON_COUNT / (BLOCK_SIZE * BLOCK_SIZE))
+
+//	density feedback : visible photons per screen pixel aimed at, and the fewest photons an emission block traces
+//	(rounded up to whole subgroups)
+#define DENSITY_TARGET 0.5f
+#define DENSITY_MIN_PHOTONS 64u
+
+//	persistent threads : workgroups launched to drain the ray queue (enough to fill the GPU)
+#define PERSISTENT_GROUP_COUNT 256
+
+#ifdef PHOTON_TRACER_STATS
+static const uint32_t statsReportInterval = 240;
+static const uint32_t statsReportLatency = 4;
+#endif
+
+//	see PhotonTracer.glsl
+struct PhotonTracerPushConstants
+{
+	int seed;
+	int phase;
+	int blockStride[2];
+	int blockOffset[2];
+	int densityFeedback;
+};
+
+//	see RayQueueHeader in PhotonTracer.glsl
+struct RayQueueHeader
+{
+	VkDrawIndirectCommand draw; // vertexCount : queued photon count
+	uint32_t queueHead;
+	uint32_t laneSteps;
+	uint32_t subgroupSteps;
+	uint32_t padding;
+};
 
 void Caustics::OnCreate(
 	Device* pDevice, 
@@ -25,7 +63,8 @@ void Caustics::OnCreate(
 		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 		&att_desc[0]);
 	this->pm_renderPass = CreateRenderPassOptimal(this->pDevice->GetDevice(), 1, att_desc, nullptr);
-#ifdef USE_BIRT
+
+	//	BIRT
 	this->rsmWidth = pRSM->m_EmissiveFlux.GetWidth() / 2;
 	this->rsmHeight = pRSM->m_EmissiveFlux.GetHeight() / 2;
 	
@@ -41,6 +80,105 @@ void Caustics::OnCreate(
 		assert(res);
 	}
 
+	//	the light segment buffer (one slice per sampling seed) and the phase cache are allocated on first use
+	//	(see allocateLightSegments / allocatePhaseCache). until then, their bindings point to the hitpoint buffer,
+	//	which the pipelines of the other modes never access through them.
+	this->lightSegmentDescInfo = this->hitPosDescInfo;
+	this->phaseCacheDescInfo = this->hitPosDescInfo;
+
+	//	a phase holds every photon emitted at PHASE_CACHE_SAMPLE_SCALE, so that none is dropped
+	{
+		const uint32_t sampleDimPerBlock = (uint32_t)(BLOCK_SIZE * PHASE_CACHE_SAMPLE_SCALE);
+		const uint32_t numBlocks_x = (this->rsmWidth + sampleDimPerBlock - 1) / sampleDimPerBlock,
+						numBlocks_y = (this->rsmHeight + sampleDimPerBlock - 1) / sampleDimPerBlock;
+		this->phaseCacheCapacity = min(BLOCK_SIZE * BLOCK_SIZE * numBlocks_x * numBlocks_y, MAX_PHOTON_COUNT);
+
+		this->phaseCacheCountBuffer.OnCreateEx(this->pDevice, Ocean::PhaseCount * sizeof(uint32_t), StaticBufferPool::STATIC_BUFFER_USAGE_GPU, "Phase Cache Count Buffer");
+
+		bool res = this->phaseCacheCountBuffer.AllocBuffer(Ocean::PhaseCount, sizeof(uint32_t), (void*)nullptr, &this->phaseCacheCountDescInfo);
+		assert(res);
+	}
+
+	//	define persistent buffer storing photon counts per emission block (density feedback)
+	{
+		this->densityBuffer.OnCreateEx(this->pDevice, MAX_BLOCK_COUNT * sizeof(uint32_t), StaticBufferPool::STATIC_BUFFER_USAGE_GPU, "Density Feedback Buffer");
+
+		bool res = this->densityBuffer.AllocBuffer(MAX_BLOCK_COUNT, sizeof(uint32_t), (void*)nullptr, &this->densityDescInfo);
+		assert(res);
+	}
+
+	//	define buffers of the ray queue (persistent threads).
+	//	its head is also read by the indirect draw, which static buffer pools don't allow.
+	{
+		this->rayQueueBuffer.OnCreateEx(this->pDevice, MAX_PHOTON_COUNT * sizeof(uint32_t), StaticBufferPool::STATIC_BUFFER_USAGE_GPU, "Ray Queue Buffer");
+
+		bool pass = this->rayQueueBuffer.AllocBuffer(MAX_PHOTON_COUNT, sizeof(uint32_t), (void*)nullptr, &this->rayQueueDescInfo);
+		assert(pass);
+
+		VkBufferCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		info.size = sizeof(RayQueueHeader);
+		info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | 
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		VkResult res = vkCreateBuffer(this->pDevice->GetDevice(), &info, NULL, &this->rayQueueHeader);
+		assert(res == VK_SUCCESS);
+
+		VkMemoryRequirements memReqs;
+		vkGetBufferMemoryRequirements(this->pDevice->GetDevice(), this->rayQueueHeader, &memReqs);
+
+		VkMemoryAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memReqs.size;
+		VkPhysicalDeviceMemoryProperties memProps = this->pDevice->GetPhysicalDeviceMemoryProperties();
+		pass = memory_type_from_properties(memProps, memReqs.memoryTypeBits,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&allocInfo.memoryTypeIndex);
+		assert(pass);
+
+		res = vkAllocateMemory(this->pDevice->GetDevice(), &allocInfo, NULL, &this->rayQueueHeaderMemory);
+		assert(res == VK_SUCCESS);
+		res = vkBindBufferMemory(this->pDevice->GetDevice(), this->rayQueueHeader, this->rayQueueHeaderMemory, 0);
+		assert(res == VK_SUCCESS);
+
+#ifdef PHOTON_TRACER_STATS
+		info.size = sizeof(RayQueueHeader);
+		info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		res = vkCreateBuffer(this->pDevice->GetDevice(), &info, NULL, &this->stats_Readback);
+		assert(res == VK_SUCCESS);
+
+		vkGetBufferMemoryRequirements(this->pDevice->GetDevice(), this->stats_Readback, &memReqs);
+		allocInfo.allocationSize = memReqs.size;
+		pass = memory_type_from_properties(memProps, memReqs.memoryTypeBits,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&allocInfo.memoryTypeIndex);
+		assert(pass);
+
+		res = vkAllocateMemory(this->pDevice->GetDevice(), &allocInfo, NULL, &this->stats_ReadbackMemory);
+		assert(res == VK_SUCCESS);
+		res = vkBindBufferMemory(this->pDevice->GetDevice(), this->stats_Readback, this->stats_ReadbackMemory, 0);
+		assert(res == VK_SUCCESS);
+#endif
+	}
+
+	//	subgroups : the persistent threads (+ tracer stats) elect / broadcast / reduce in the compute stage,
+	//	density feedback keeps whole subgroups of photons
+	{
+		VkPhysicalDeviceSubgroupProperties subgroupProps = {};
+		subgroupProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+		VkPhysicalDeviceProperties2 props = {};
+		props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		props.pNext = &subgroupProps;
+		vkGetPhysicalDeviceProperties2(pDevice->GetPhysicalDevice(), &props);
+
+		const VkSubgroupFeatureFlags requiredOps = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+		this->subgroupSize = min(max(subgroupProps.subgroupSize, 1u), (uint32_t)(BLOCK_SIZE * BLOCK_SIZE));
+		this->subgroupSupported = (subgroupProps.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0 &&
+			(subgroupProps.supportedOperations & requiredOps) == requiredOps;
+		if (!this->subgroupSupported)
+			this->persistentThreads = false;
+	}
+
 	//	photon tracing pass
 	{
 		//  create default sampler
@@ -76,36 +214,54 @@ void Caustics::OnCreate(
 		this->createPhotonTracerDescriptors(&defines);
 
 		// Use helper class to create the compute pass
-		this->photonTracer.OnCreate(this->pDevice, "PhotonTracer.glsl", "main", "", this->descriptorSetLayout, 0, 0, 0, &defines, sizeof(int));
+		defines["SEGMENT_SLICE_SIZE"] = std::to_string(MAX_PHOTON_COUNT);
+		defines["PHASE_CACHE_CAPACITY"] = std::to_string(this->phaseCacheCapacity) + "u";
+		defines["DENSITY_TARGET"] = std::to_string(DENSITY_TARGET);
+		defines["DENSITY_MIN_PHOTONS"] = std::to_string((DENSITY_MIN_PHOTONS + this->subgroupSize - 1) / this->subgroupSize * this->subgroupSize) + "u";
+		defines["SUBGROUP_SIZE"] = std::to_string(this->subgroupSize) + "u";
+#ifdef PHOTON_TRACER_STATS
+		if (this->subgroupSupported)
+			defines["TRACE_STATS"] = "1";
+#endif
+		this->photonTracer.OnCreate(this->pDevice, "PhotonTracer.glsl", "main", "", this->descriptorSetLayout, 0, 0, 0, &defines, sizeof(PhotonTracerPushConstants));
+
+		//	phase cache reprojection
+		DefineList phaseDefines = defines;
+		phaseDefines["PHASE_CACHE"] = "1";
+		this->photonTracer_phaseReproj.OnCreate(this->pDevice, "PhotonTracer.glsl", "main", "", this->descriptorSetLayout, 0, 0, 0, &phaseDefines, sizeof(PhotonTracerPushConstants));
+
+		//	persistent threads : ray compaction + camera-space stage draining the queue
+		if (this->subgroupSupported)
+		{
+			DefineList queueDefines = defines;
+			queueDefines["RAY_COMPACTION"] = "1";
+			this->photonTracer_compact.OnCreate(this->pDevice, "PhotonTracer.glsl", "main", "", this->descriptorSetLayout, 0, 0, 0, &queueDefines, sizeof(PhotonTracerPushConstants));
+
+			queueDefines = defines;
+			queueDefines["PERSISTENT_THREADS"] = "1";
+			this->photonTracer_persistent.OnCreate(this->pDevice, "PhotonTracer.glsl", "main", "", this->descriptorSetLayout, 0, 0, 0, &queueDefines, sizeof(PhotonTracerPushConstants));
+		}
+
+		//	both stages in a single dispatch, while the slices can't be reused
+		DefineList fusedDefines = defines;
+		fusedDefines["FUSED_STAGES"] = "1";
+		this->photonTracer_fused.OnCreate(this->pDevice, "PhotonTracer.glsl", "main", "", this->descriptorSetLayout, 0, 0, 0, &fusedDefines, sizeof(PhotonTracerPushConstants));
+
+		//	light-space stage (+ phase cache filling)
+		defines["LIGHT_SPACE_STAGE"] = "1";
+		this->photonTracer_light.OnCreate(this->pDevice, "PhotonTracer.glsl", "main", "", this->descriptorSetLayout, 0, 0, 0, &defines, sizeof(PhotonTracerPushConstants));
+
+		phaseDefines["LIGHT_SPACE_STAGE"] = "1";
+		this->photonTracer_phaseFill.OnCreate(this->pDevice, "PhotonTracer.glsl", "main", "", this->descriptorSetLayout, 0, 0, 0, &phaseDefines, sizeof(PhotonTracerPushConstants));
 
 		//	create image view for rsm depth (opaque)
 		this->mipCount_rsm = mipCount;
 		pRSMDepthOpaque1N->CreateSRV(&this->rsmDepthOpaque1NSRV);
 
 		//	update desc set (except gbuf depth)
-		this->pDynamicBufferRing->SetDescriptorSet(0, sizeof(Caustics::Constants), this->descriptorSet);
-		SetDescriptorSet(this->pDevice->GetDevice(), 1, this->samplingMapSRV, &this->sampler_noise, this->descriptorSet);
-
-		SetDescriptorSet(this->pDevice->GetDevice(), 2, pRSM->m_WorldCoordSRV, &this->sampler_default, this->descriptorSet);
-		SetDescriptorSet(this->pDevice->GetDevice(), 3, pRSM->m_NormalBufferSRV, &this->sampler_default, this->descriptorSet);
-		SetDescriptorSet(this->pDevice->GetDevice(), 4, pRSM->m_SpecularRoughnessSRV, &this->sampler_default, this->descriptorSet);
-		SetDescriptorSet(this->pDevice->GetDevice(), 5, pRSM->m_EmissiveFluxSRV, &this->sampler_default, this->descriptorSet);
-
-		SetDescriptorSetForDepth(this->pDevice->GetDevice(), 6, rsmDepthOpaque0SRV, &this->sampler_depth, this->descriptorSet);
-		SetDescriptorSet(this->pDevice->GetDevice(), 7, this->rsmDepthOpaque1NSRV, &this->sampler_depth, this->descriptorSet);
-
-		{
-			VkWriteDescriptorSet write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-			write.pNext = NULL;
-			write.dstSet = this->descriptorSet;
-			write.descriptorCount = 1;
-			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-			write.pBufferInfo = &this->hitPosDescInfo;
-			write.dstBinding = 11;
-			write.dstArrayElement = 0;
-
-			vkUpdateDescriptorSets(this->pDevice->GetDevice(), 1, &write, 0, NULL);
-		}
+		this->pRSM = pRSM;
+		this->rsmDepthOpaque0SRV = rsmDepthOpaque0SRV;
+		this->setSharedDescriptors(this->descriptorSet);
 	}
 
 	//	photon map (point rendering) pass
@@ -117,9 +273,9 @@ void Caustics::OnCreate(
 	}
 
 	//	denoiser
-	this->denoiser.OnCreate(pDevice, pResourceViewHeaps, pDynamicBufferRing);
-#else
-	//	use caustics mapping instead
+	this->denoiser.OnCreate(pDevice, pResourceViewHeaps, pDynamicBufferRing, SVGF::Formats::Packed, "Caustics");
+
+	//	caustics mapping
 	this->causticsMap.OnCreate(
 		pDevice, pUploadHeap,
 		pResourceViewHeaps,
@@ -129,12 +285,13 @@ void Caustics::OnCreate(
 		pRSM, rsmDepthOpaque0SRV,
 		this->pm_renderPass
 	);
-#endif
 }
 
 void Caustics::OnDestroy()
 {
-#ifdef USE_BIRT
+	//	caustics mapping
+	this->causticsMap.OnDestroy();
+
 	//	denoiser
 	this->denoiser.OnDestroy();
 
@@ -149,6 +306,15 @@ void Caustics::OnDestroy()
 		vkDestroyImageView(this->pDevice->GetDevice(), this->rsmDepthOpaque1NSRV, nullptr);
 
 		this->photonTracer.OnDestroy();
+		this->photonTracer_fused.OnDestroy();
+		this->photonTracer_light.OnDestroy();
+		this->photonTracer_phaseFill.OnDestroy();
+		this->photonTracer_phaseReproj.OnDestroy();
+		if (this->subgroupSupported)
+		{
+			this->photonTracer_compact.OnDestroy();
+			this->photonTracer_persistent.OnDestroy();
+		}
 
 		this->pResourceViewHeaps->FreeDescriptor(this->descriptorSet);
 		vkDestroyDescriptorSetLayout(this->pDevice->GetDevice(), this->descriptorSetLayout, nullptr);
@@ -162,15 +328,46 @@ void Caustics::OnDestroy()
 	}
 
 	this->hitpointBuffer.OnDestroy();
+	if (this->lightSegmentAllocated)
+		this->lightSegmentBuffer.OnDestroy();
+	this->lightSegmentAllocated = false;
+	this->lightSegmentValidMask = 0;
+	this->lightSegmentStillFrames = 0;
+	this->lightSegmentFusedFrames = 0;
+	if (this->phaseCacheAllocated)
+		this->phaseCacheBuffer.OnDestroy();
+	this->phaseCacheAllocated = false;
+	this->phaseCache = false;
+	this->phaseCacheCountBuffer.OnDestroy();
+	this->phaseCacheValidMask = 0;
+	this->phaseCacheCapacity = 0;
+	this->densityBuffer.OnDestroy();
+	this->densityValid = false;
+
+	this->rayQueueBuffer.OnDestroy();
+	vkDestroyBuffer(this->pDevice->GetDevice(), this->rayQueueHeader, nullptr);
+	this->rayQueueHeader = VK_NULL_HANDLE;
+	vkFreeMemory(this->pDevice->GetDevice(), this->rayQueueHeaderMemory, nullptr);
+	this->rayQueueHeaderMemory = VK_NULL_HANDLE;
+
+#ifdef PHOTON_TRACER_STATS
+	vkDestroyBuffer(this->pDevice->GetDevice(), this->stats_Readback, nullptr);
+	this->stats_Readback = VK_NULL_HANDLE;
+	vkFreeMemory(this->pDevice->GetDevice(), this->stats_ReadbackMemory, nullptr);
+	this->stats_ReadbackMemory = VK_NULL_HANDLE;
+	this->stats_ReadbackFrame = UINT32_MAX;
+#endif
 	
 	this->pResourceViewHeaps = nullptr;
 	this->pDynamicBufferRing = nullptr;
 
 	this->rsmWidth = 0;
 	this->rsmHeight = 0;
-#else
-	this->causticsMap.OnDestroy();
-#endif
+
+	assert(this->views.empty() && "auxiliary views outlive the caustics");
+	this->pRSM = nullptr;
+	this->rsmDepthOpaque0SRV = VK_NULL_HANDLE;
+
 	vkDestroyRenderPass(this->pDevice->GetDevice(), this->pm_renderPass, NULL);
 	this->pm_renderPass = VK_NULL_HANDLE;
 
@@ -192,7 +389,7 @@ void Caustics::OnCreateWindowSizeDependentResources(
 			VK_FORMAT_R16G16B16A16_SFLOAT/*VK_FORMAT_R16G16B16A16_UNORM*/,
 			VK_SAMPLE_COUNT_1_BIT,
 			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
-			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
 			false,
 			"Caustics Output"
 		);
@@ -210,7 +407,7 @@ void Caustics::OnCreateWindowSizeDependentResources(
 			Width, Height
 		);
 	}
-#ifdef USE_BIRT
+
 	this->outWidth = Width;
 	this->outHeight = Height;
 
@@ -233,17 +430,19 @@ void Caustics::OnCreateWindowSizeDependentResources(
 		this->outWidth, this->outHeight,
 		&this->pm_irradianceMap, this->pm_irradianceMapSRV,
 		gbufDepthOpaque0SRV, pGBuffer);
-#else
+
+	//	caustics mapping
 	this->causticsMap.OnCreateWindowSizeDependentResources(
 		Width, Height,
 		pGBuffer, gbufDepthOpaque0SRV,
 		this->pm_framebuffer);
-#endif
 }
 
 void Caustics::OnDestroyWindowSizeDependentResources()
 {
-#ifdef USE_BIRT
+	//	caustics mapping
+	this->causticsMap.OnDestroyWindowSizeDependentResources();
+
 	//	denoiser
 	this->denoiser.OnDestroyWindowSizeDependentResources();
 
@@ -255,9 +454,6 @@ void Caustics::OnDestroyWindowSizeDependentResources()
 	this->pGBuffer = nullptr;
 	this->outWidth = 0;
 	this->outHeight = 0;
-#else
-	this->causticsMap.OnDestroyWindowSizeDependentResources();
-#endif
 
 	//	photon map (point rendering) pass
 	{
@@ -275,96 +471,464 @@ void Caustics::OnDestroyWindowSizeDependentResources()
 void Caustics::Draw(VkCommandBuffer commandBuffer, const VkRect2D& renderArea, const Caustics::Constants& constants)
 {
 	SetPerfMarkerBegin(commandBuffer, "Caustics");
-#ifdef USE_BIRT
+	if (this->backend == Caustics::Backend::BIRT)
+	{
+		this->drawBIRT(commandBuffer, renderArea, constants);
+	}
+	else
+	{
+		this->drawCausticsMapping(commandBuffer, renderArea, constants);
+		this->densityValid = false; // restart from full density when back to BIRT
+	}
+	SetPerfMarkerEnd(commandBuffer);
+}
+
+VkDeviceSize Caustics::getMemoryFootprint(Caustics::Backend backend) const
+{
+	//	shared output (r16g16b16a16f)
+	VkDeviceSize size = (VkDeviceSize)this->outWidth * this->outHeight * 8;
+
+	if (backend == Caustics::Backend::BIRT)
+	{
+		size += (VkDeviceSize)MAX_PHOTON_COUNT * sizeof(float) * 4;	// hitpoint buffer
+		if (this->lightSegmentAllocated)
+			size += (VkDeviceSize)SAMPLING_SEED_COUNT * MAX_PHOTON_COUNT * sizeof(float);	// light segment buffer
+		if (this->phaseCacheAllocated)
+			size += (VkDeviceSize)Ocean::PhaseCount * this->phaseCacheCapacity * sizeof(float) * 4;	// phase cache
+		size += (VkDeviceSize)Ocean::PhaseCount * sizeof(uint32_t);	// phase cache counts
+		size += (VkDeviceSize)MAX_BLOCK_COUNT * sizeof(uint32_t);	// density feedback
+		size += (VkDeviceSize)MAX_PHOTON_COUNT * sizeof(uint32_t) + sizeof(RayQueueHeader);	// ray queue
+		size += (VkDeviceSize)BLOCK_SIZE * BLOCK_SIZE * SAMPLING_SEED_COUNT * sizeof(float) * 2;	// sampling map
+		size += this->denoiser.getMemoryFootprint();
+	}
+	else
+	{
+		size += this->causticsMap.getMemoryFootprint();
+	}
+
+	return size;
+}
+
+void Caustics::drawBIRT(VkCommandBuffer commandBuffer, const VkRect2D& renderArea, const Caustics::Constants& constants)
+{
 	//	Opt.1 : BIRT Caustics
+	//	the phase cache is traced at a fixed sample scale, which its capacity is sized for
+	Caustics::Constants tracedConstants = constants;
+	if (this->phaseCache)
+		tracedConstants.samplingMapScale = PHASE_CACHE_SAMPLE_SCALE;
+	tracedConstants.viewExtent[0] = (int)renderArea.extent.width;
+	tracedConstants.viewExtent[1] = (int)renderArea.extent.height;
+
 	//  update constants
 	VkDescriptorBufferInfo descInfo_constants;
 	{
 		Caustics::Constants* pAllocData;
 		this->pDynamicBufferRing->AllocConstantBuffer(sizeof(Caustics::Constants), (void**)&pAllocData, &descInfo_constants);
-		*pAllocData = constants;
+		*pAllocData = tracedConstants;
 	}
 
-	const uint32_t sampleDimPerBlock = BLOCK_SIZE * constants.samplingMapScale;
+#ifdef PHOTON_TRACER_STATS
+	this->reportTracerStats();
+	this->stats_Frame++;
+#endif
+
+	const uint32_t sampleDimPerBlock = BLOCK_SIZE * tracedConstants.samplingMapScale;
 	const uint32_t numBlocks_x = (this->rsmWidth + sampleDimPerBlock - 1) / sampleDimPerBlock,
 					numBlocks_y = (this->rsmHeight + sampleDimPerBlock - 1) / sampleDimPerBlock;
-	const uint32_t numPhotons = BLOCK_SIZE * BLOCK_SIZE * numBlocks_x * numBlocks_y;
+	uint32_t photonCount = BLOCK_SIZE * BLOCK_SIZE * numBlocks_x * numBlocks_y;
+	bool bIndirectDraw = false; // photon count is the ray queue's (persistent threads)
+	const VkDescriptorBufferInfo rayQueueHeaderDescInfo = { this->rayQueueHeader, 0, sizeof(RayQueueHeader) };
 
 	//	photon tracing pass
 	{
 		SetPerfMarkerBegin(commandBuffer, "Photon Tracing");
 
-		//  dispatch
-		//
-		this->photonTracer.Draw(commandBuffer, &descInfo_constants, this->descriptorSet, numBlocks_x, numBlocks_y, 1, &this->samplingSeed);
-		this->samplingSeed = (this->samplingSeed + 1) % 8; // ToDo: need variable for 8
-
-		this->pGPUTimeStamps->GetTimeStamp(commandBuffer, "BIRT: Photon Tracing");
+		//	light-space results are only valid for the lights (and RSM) they were traced with
+		if (memcmp(tracedConstants.lights, this->lightSegmentConstants.lights, sizeof(tracedConstants.lights)) != 0 ||
+			tracedConstants.emissionLightIndex != this->lightSegmentConstants.emissionLightIndex ||
+			tracedConstants.samplingMapScale != this->lightSegmentConstants.samplingMapScale ||
+			tracedConstants.IOR != this->lightSegmentConstants.IOR ||
+			tracedConstants.tMax != this->lightSegmentConstants.tMax)
+		{
+			this->invalidateLightSegments();
+			this->lightSegmentConstants = tracedConstants;
+		}
 
-		SetPerfMarkerEnd(commandBuffer);
-	}
+		if (this->phaseCache)
+		{
+			//	every phase uses its own sampling seed, to vary the sampling over the loop
+			PhotonTracerPushConstants pushConst = { (int)(this->oceanPhase % SAMPLING_SEED_COUNT), (int)this->oceanPhase, { 1, 1 }, { 0, 0 }, 0 };
+
+			//  fill this phase once
+			const uint32_t phaseBit = 1u << this->oceanPhase;
+			if ((this->phaseCacheValidMask & phaseBit) == 0)
+			{
+				this->barrier_PhotonBuffer(commandBuffer, this->phaseCacheDescInfo, 
+					VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+				this->barrier_PhotonBuffer(commandBuffer, this->phaseCacheCountDescInfo,
+					VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+				vkCmdFillBuffer(commandBuffer, this->phaseCacheCountDescInfo.buffer, 
+					this->phaseCacheCountDescInfo.offset + this->oceanPhase * sizeof(uint32_t), sizeof(uint32_t), 0);
+				this->barrier_PhotonBuffer(commandBuffer, this->phaseCacheCountDescInfo,
+					VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+				this->photonTracer_phaseFill.Draw(commandBuffer, &descInfo_constants, this->descriptorSet, numBlocks_x, numBlocks_y, 1, &pushConst);
+
+				this->barrier_PhotonBuffer(commandBuffer, this->phaseCacheDescInfo,
+					VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+				this->barrier_PhotonBuffer(commandBuffer, this->phaseCacheCountDescInfo,
+					VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+				this->phaseCacheValidMask |= phaseBit;
+
+				this->pGPUTimeStamps->GetTimeStamp(commandBuffer, "BIRT: Phases");
+			}
+
+			//	no feedback : the density counts would be stale once it resumes
+			this->densityValid = false;
+
+			//	reproject the cached phase
+			const uint32_t numCacheBlocks = this->phaseCacheCapacity / (BLOCK_SIZE * BLOCK_SIZE);
+			this->photonTracer_phaseReproj.Draw(commandBuffer, &descInfo_constants, this->descriptorSet, numCacheBlocks, 1, 1, &pushConst);
+			photonCount = this->phaseCacheCapacity;
+		}
+		else
+		{
+			PhotonTracerPushConstants pushConst = { this->samplingSeed, (int)this->oceanPhase, { 1, 1 }, { 0, 0 }, 0 };
+			this->tracedSeed = this->samplingSeed;
+
+			//	a slice is only read again SAMPLING_SEED_COUNT frames after it's traced. until the light, the RSM
+			//	and the ocean phase held still that long, both stages run fused in one dispatch, and no slice is kept.
+			//	persistent threads always split : their queue is compacted from the light-space stage's results.
+			const uint32_t seedBit = 1u << this->samplingSeed;
+			const bool reused = (this->lightSegmentValidMask & seedBit) != 0;
+			const bool split = reused || this->persistentThreads || this->lightSegmentStillFrames >= SAMPLING_SEED_COUNT;
+			this->lightSegmentReuse += ((reused ? 1.f : 0.f) - this->lightSegmentReuse) / 64.f;
+			this->lightSegmentStillFrames++;
+
+			//	the slices only take memory while they may be reused
+			//	(not freed between the phase steps of a fast enough frame rate, they're reused there)
+			this->lightSegmentFusedFrames = split ? 0 : this->lightSegmentFusedFrames + 1;
+			if (split && !this->lightSegmentAllocated)
+				this->allocateLightSegments(true);
+			else if (this->lightSegmentAllocated && this->lightSegmentFusedFrames >= LIGHT_SEGMENT_RELEASE_FRAMES)
+				this->allocateLightSegments(false);
+
+			//	light-space stage, only if this seed's slice is out of date
+			//	(it depends on the light and RSM only, see PhotonTracer.glsl)
+			if (split && !reused)
+			{
+				this->barrier_PhotonBuffer(commandBuffer, this->lightSegmentDescInfo,
+					VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+				this->photonTracer_light.Draw(commandBuffer, &descInfo_constants, this->descriptorSet, numBlocks_x, numBlocks_y, 1, &pushConst);
+				this->barrier_PhotonBuffer(commandBuffer, this->lightSegmentDescInfo,
+					VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+				this->lightSegmentValidMask |= seedBit;
+
+				this->pGPUTimeStamps->GetTimeStamp(commandBuffer, "BIRT: Light Seg");
+			}
+
+			//	camera-space stage
+			//	amortization : trace an interleaved 1/N subset of the emission blocks,
+			//	(2, 1) blocks apart for N = 2 and (2, 2) for N = 4. the subsets are visited in turn.
+			static const int blockOffsets[4][2] = { { 0, 0 }, { 1, 1 }, { 1, 0 }, { 0, 1 } };
+			pushConst.blockStride[0] = (this->amortization >= 2) ? 2 : 1;
+			pushConst.blockStride[1] = (this->amortization >= 4) ? 2 : 1;
+			pushConst.blockOffset[0] = (this->amortization >= 4) ? blockOffsets[this->amortizationSubset][0] : this->amortizationSubset;
+			pushConst.blockOffset[1] = (this->amortization >= 4) ? blockOffsets[this->amortizationSubset][1] : 0;
+
+			const uint32_t subsetBlocks_x = (numBlocks_x - pushConst.blockOffset[0] + pushConst.blockStride[0] - 1) / pushConst.blockStride[0],
+							subsetBlocks_y = (numBlocks_y - pushConst.blockOffset[1] + pushConst.blockStride[1] - 1) / pushConst.blockStride[1];
+
+			//	the ray queue is reset every frame, so are the stats
+#ifndef PHOTON_TRACER_STATS
+			if (this->persistentThreads)
+#endif
+			{
+				this->barrier_PhotonBuffer(commandBuffer, rayQueueHeaderDescInfo,
+					VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+				const RayQueueHeader header = { { 0, 1, 0, 0 }, 0, 0, 0, 0 };
+				vkCmdUpdateBuffer(commandBuffer, this->rayQueueHeader, 0, sizeof(header), &header);
+				this->barrier_PhotonBuffer(commandBuffer, rayQueueHeaderDescInfo,
+					VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+			}
+
+			if (this->persistentThreads)
+			{
+				//	compact the photons which survived the light-space stage,
+				//	then drain them with a fixed number of workgroups
+				this->barrier_PhotonBuffer(commandBuffer, this->rayQueueDescInfo,
+					VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+				this->photonTracer_compact.Draw(commandBuffer, &descInfo_constants, this->descriptorSet, subsetBlocks_x, subsetBlocks_y, 1, &pushConst);
+				this->barrier_PhotonBuffer(commandBuffer, this->rayQueueDescInfo,
+					VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+				this->barrier_PhotonBuffer(commandBuffer, rayQueueHeaderDescInfo,
+					VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+				this->pGPUTimeStamps->GetTimeStamp(commandBuffer, "BIRT: Compact");
+
+				this->photonTracer_persistent.Draw(commandBuffer, &descInfo_constants, this->descriptorSet, PERSISTENT_GROUP_COUNT, 1, 1, &pushConst);
+				bIndirectDraw = true;
+				this->densityValid = false;
+			}
+			else
+			{
+				//	density feedback : photon counts of the previous frames, all blocks start at full density
+				if (this->densityFeedback)
+				{
+					if (!this->densityValid)
+					{
+						this->barrier_PhotonBuffer(commandBuffer, this->densityDescInfo,
+							VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+						vkCmdFillBuffer(commandBuffer, this->densityDescInfo.buffer, this->densityDescInfo.offset, this->densityDescInfo.range, BLOCK_SIZE * BLOCK_SIZE);
+						this->barrier_PhotonBuffer(commandBuffer, this->densityDescInfo,
+							VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+						this->densityValid = true;
+					}
+					else
+					{
+						this->barrier_PhotonBuffer(commandBuffer, this->densityDescInfo,
+							VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+					}
+					pushConst.densityFeedback = 1;
+				}
+				else
+					this->densityValid = false;
+
+				PostProcCS& tracer = split ? this->photonTracer : this->photonTracer_fused;
+				tracer.Draw(commandBuffer, &descInfo_constants, this->descriptorSet, subsetBlocks_x, subsetBlocks_y, 1, &pushConst);
+				photonCount = BLOCK_SIZE * BLOCK_SIZE * subsetBlocks_x * subsetBlocks_y;
+			}
+
+			//	the queued photon count feeds the indirect draw (+ the stats readback)
+#ifndef PHOTON_TRACER_STATS
+			if (this->persistentThreads)
+#endif
+			{
+				this->barrier_PhotonBuffer(commandBuffer, rayQueueHeaderDescInfo,
+					VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
+			}
+#ifdef PHOTON_TRACER_STATS
+			if (this->stats_ReadbackFrame == UINT32_MAX && (this->stats_Frame % statsReportInterval) == 0)
+			{
+				VkBufferCopy region = { 0, 0, sizeof(RayQueueHeader) };
+				vkCmdCopyBuffer(commandBuffer, this->rayQueueHeader, this->stats_Readback, 1, &region);
+
+				const VkDescriptorBufferInfo readbackDescInfo = { this->stats_Readback, 0, sizeof(RayQueueHeader) };
+				this->barrier_PhotonBuffer(commandBuffer, readbackDescInfo,
+					VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+				this->stats_ReadbackFrame = this->stats_Frame;
+			}
+#endif
 
-	//	photon map (point rendering) pass
-	{
-		//	start render pass
-		VkClearValue cv{};
-		cv.color = {0.f, 0.f, 0.f, 0.f};
-
-		VkRenderPassBeginInfo rp_begin{};
-		rp_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		rp_begin.pNext = NULL;
-		rp_begin.renderPass = this->pm_renderPass;
-		rp_begin.framebuffer = this->pm_framebuffer;
-		rp_begin.renderArea.offset.x = 0;
-		rp_begin.renderArea.offset.y = 0;
-		rp_begin.renderArea.extent.width = this->outWidth;
-		rp_begin.renderArea.extent.height = this->outHeight;
-		rp_begin.clearValueCount = 1;
-		rp_begin.pClearValues = &cv;
-		vkCmdBeginRenderPass(commandBuffer, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
-
-		SetPerfMarkerBegin(commandBuffer, "Photon Mapping");
-
-		SetViewportAndScissor(commandBuffer, 
-			renderArea.offset.x, renderArea.offset.y,
-			renderArea.extent.width, renderArea.extent.height);
-
-		// Bind vertices 
-        //
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &hitPosDescInfo.buffer, &hitPosDescInfo.offset);
-
-		// Bind Pipeline
-        //
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pm_pipeline);
-
-		// Draw
-        //
-		vkCmdDraw(commandBuffer, numPhotons, 1, 0, 0);
+			//	every subset sees every seed
+			this->amortizationSubset = (this->amortizationSubset + 1) % this->amortization;
+			if (this->amortizationSubset == 0)
+				this->samplingSeed = (this->samplingSeed + 1) % SAMPLING_SEED_COUNT;
+		}
 
-		SetPerfMarkerEnd(commandBuffer);
+		this->pGPUTimeStamps->GetTimeStamp(commandBuffer, "BIRT: Tracing");
 
-		//	end render pass
-		vkCmdEndRenderPass(commandBuffer);
+		//	the photon map reads the hitpoints as vertices
+		this->barrier_PhotonBuffer(commandBuffer, this->hitPosDescInfo,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 
-		this->pGPUTimeStamps->GetTimeStamp(commandBuffer, "BIRT: Photon Mapping");
+		SetPerfMarkerEnd(commandBuffer);
 	}
 
+	//	photon map (point rendering) pass
+	this->drawPhotonMap(commandBuffer, this->pm_framebuffer, this->outWidth, this->outHeight, renderArea, photonCount, bIndirectDraw);
+	this->pGPUTimeStamps->GetTimeStamp(commandBuffer, "BIRT: Mapping");
+
 	//	denoising
 	{
+		//	amortization : each frame carries 1/N of the photons, so keep N times more history
+		const float historyScale = this->phaseCache ? 1.f : (float)this->amortization;
+
 		SVGF::Constants svgfConst;
-		svgfConst.alphaColor = 0.2f;
-		svgfConst.alphaMoments = 0.2f;
+		svgfConst.alphaColor = 0.2f / historyScale;
+		svgfConst.alphaMoments = 0.2f / historyScale;
 		svgfConst.nearPlane = constants.camera.nearPlane;
 		svgfConst.farPlane = constants.camera.farPlane;
 		svgfConst.sigmaDepth = 1.f;
 		svgfConst.sigmaNormal = 128.f;
 		svgfConst.sigmaLuminance = 4.f;
+		svgfConst.viewExtent[0] = (int)renderArea.extent.width;
+		svgfConst.viewExtent[1] = (int)renderArea.extent.height;
 
 		this->denoiser.Draw(commandBuffer, svgfConst);
 
 		this->pGPUTimeStamps->GetTimeStamp(commandBuffer, "BIRT: Denoising");
 	}
-#else
+}
+
+void Caustics::drawPhotonMap(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer, uint32_t width, uint32_t height,
+	const VkRect2D& renderArea, uint32_t photonCount, bool bIndirectDraw)
+{
+	//	start render pass
+	VkClearValue cv{};
+	cv.color = {0.f, 0.f, 0.f, 0.f};
+
+	VkRenderPassBeginInfo rp_begin{};
+	rp_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	rp_begin.pNext = NULL;
+	rp_begin.renderPass = this->pm_renderPass;
+	rp_begin.framebuffer = framebuffer;
+	rp_begin.renderArea.offset.x = 0;
+	rp_begin.renderArea.offset.y = 0;
+	rp_begin.renderArea.extent.width = width;
+	rp_begin.renderArea.extent.height = height;
+	rp_begin.clearValueCount = 1;
+	rp_begin.pClearValues = &cv;
+	vkCmdBeginRenderPass(commandBuffer, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
+
+	SetPerfMarkerBegin(commandBuffer, "Photon Mapping");
+
+	SetViewportAndScissor(commandBuffer, 
+		renderArea.offset.x, renderArea.offset.y,
+		renderArea.extent.width, renderArea.extent.height);
+
+	// Bind vertices 
+	//
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &this->hitPosDescInfo.buffer, &this->hitPosDescInfo.offset);
+
+	// Bind Pipeline
+	//
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pm_pipeline);
+
+	// Draw
+	//
+	if (bIndirectDraw)
+		vkCmdDrawIndirect(commandBuffer, this->rayQueueHeader, 0, 1, sizeof(VkDrawIndirectCommand));
+	else
+		vkCmdDraw(commandBuffer, photonCount, 1, 0, 0);
+
+	SetPerfMarkerEnd(commandBuffer);
+
+	//	end render pass
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+void Caustics::OnCreateView(Caustics::View* pView, uint32_t Width, uint32_t Height,
+	GBuffer* pGBuffer, VkImageView gbufDepthOpaque0SRV, Texture* pGBufDepthOpaque1N)
+{
+	pView->width = Width;
+	pView->height = Height;
+
+	//	irradiance target of the photon map pass
+	pView->irradianceMap.InitRenderTarget(
+		this->pDevice,
+		Width, Height,
+		VK_FORMAT_R16G16B16A16_SFLOAT,
+		VK_SAMPLE_COUNT_1_BIT,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		false,
+		"Caustics Output (Aux)"
+	);
+	pView->irradianceMap.CreateSRV(&pView->irradianceMapSRV);
+
+	std::vector<VkImageView> attachments = {
+		pView->irradianceMapSRV
+	};
+	pView->framebuffer = CreateFrameBuffer(
+		this->pDevice->GetDevice(),
+		this->pm_renderPass,
+		&attachments,
+		Width, Height
+	);
+
+	//	same bindings as the main view's, but the camera side (gbuf depth & normal)
+	this->pResourceViewHeaps->AllocDescriptor(this->descriptorSetLayout, &pView->descriptorSet);
+	this->setSharedDescriptors(pView->descriptorSet);
+
+	pGBufDepthOpaque1N->CreateSRV(&pView->gbufDepthOpaque1NSRV);
+	SetDescriptorSetForDepth(this->pDevice->GetDevice(), 8, gbufDepthOpaque0SRV, &this->sampler_depth, pView->descriptorSet);
+	SetDescriptorSet(this->pDevice->GetDevice(), 9, pView->gbufDepthOpaque1NSRV, &this->sampler_depth, pView->descriptorSet);
+	SetDescriptorSet(this->pDevice->GetDevice(), 10, pGBuffer->m_NormalBufferSRV, &this->sampler_default, pView->descriptorSet);
+
+	this->views.push_back(pView);
+}
+
+void Caustics::OnDestroyView(Caustics::View* pView)
+{
+	this->views.erase(std::find(this->views.begin(), this->views.end(), pView));
+
+	this->pResourceViewHeaps->FreeDescriptor(pView->descriptorSet);
+	pView->descriptorSet = VK_NULL_HANDLE;
+	vkDestroyImageView(this->pDevice->GetDevice(), pView->gbufDepthOpaque1NSRV, nullptr);
+	pView->gbufDepthOpaque1NSRV = VK_NULL_HANDLE;
+
+	vkDestroyFramebuffer(this->pDevice->GetDevice(), pView->framebuffer, nullptr);
+	pView->framebuffer = VK_NULL_HANDLE;
+	vkDestroyImageView(this->pDevice->GetDevice(), pView->irradianceMapSRV, nullptr);
+	pView->irradianceMapSRV = VK_NULL_HANDLE;
+	pView->irradianceMap.OnDestroy();
+
+	pView->width = 0;
+	pView->height = 0;
+}
+
+void Caustics::drawView(VkCommandBuffer commandBuffer, Caustics::View* pView, const Caustics::Constants& constants)
+{
+	SetPerfMarkerBegin(commandBuffer, "Caustics (Aux)");
+
+	//	traced like the main view this frame : same sample scale, seed and ocean phase
+	Caustics::Constants tracedConstants = constants;
+	if (this->phaseCache)
+		tracedConstants.samplingMapScale = PHASE_CACHE_SAMPLE_SCALE;
+	tracedConstants.viewExtent[0] = (int)pView->width;
+	tracedConstants.viewExtent[1] = (int)pView->height;
+
+	VkDescriptorBufferInfo descInfo_constants;
+	{
+		Caustics::Constants* pAllocData;
+		this->pDynamicBufferRing->AllocConstantBuffer(sizeof(Caustics::Constants), (void**)&pAllocData, &descInfo_constants);
+		*pAllocData = tracedConstants;
+	}
+
+	//	the main view's photon map read the hitpoints
+	this->barrier_PhotonBuffer(commandBuffer, this->hitPosDescInfo,
+		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	uint32_t photonCount = 0;
+	if (this->phaseCache)
+	{
+		//	this phase was filled by the main view
+		PhotonTracerPushConstants pushConst = { (int)(this->oceanPhase % SAMPLING_SEED_COUNT), (int)this->oceanPhase, { 1, 1 }, { 0, 0 }, 0 };
+		const uint32_t numCacheBlocks = this->phaseCacheCapacity / (BLOCK_SIZE * BLOCK_SIZE);
+		this->photonTracer_phaseReproj.Draw(commandBuffer, &descInfo_constants, pView->descriptorSet, numCacheBlocks, 1, 1, &pushConst);
+		photonCount = this->phaseCacheCapacity;
+	}
+	else
+	{
+		//	every emission block at full density (no history to amortize over, no feedback of this view's own).
+		//	the main view's slice of this seed is read if valid, else both stages run fused.
+		const uint32_t sampleDimPerBlock = BLOCK_SIZE * tracedConstants.samplingMapScale;
+		const uint32_t numBlocks_x = (this->rsmWidth + sampleDimPerBlock - 1) / sampleDimPerBlock,
+						numBlocks_y = (this->rsmHeight + sampleDimPerBlock - 1) / sampleDimPerBlock;
+
+		PhotonTracerPushConstants pushConst = { this->tracedSeed, (int)this->oceanPhase, { 1, 1 }, { 0, 0 }, 0 };
+		const bool reused = (this->lightSegmentValidMask & (1u << this->tracedSeed)) != 0;
+		PostProcCS& tracer = reused ? this->photonTracer : this->photonTracer_fused;
+		tracer.Draw(commandBuffer, &descInfo_constants, pView->descriptorSet, numBlocks_x, numBlocks_y, 1, &pushConst);
+		photonCount = BLOCK_SIZE * BLOCK_SIZE * numBlocks_x * numBlocks_y;
+	}
+
+	this->barrier_PhotonBuffer(commandBuffer, this->hitPosDescInfo,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+	//	splatted as is : without a history of its own, the view isn't denoised
+	const VkRect2D renderArea = { { 0, 0 }, { pView->width, pView->height } };
+	this->drawPhotonMap(commandBuffer, pView->framebuffer, pView->width, pView->height, renderArea, photonCount, false);
+
+	SetPerfMarkerEnd(commandBuffer);
+}
+
+void Caustics::drawCausticsMapping(VkCommandBuffer commandBuffer, const VkRect2D& renderArea, const Caustics::Constants& constants)
+{
 	//	Opt.2 : Caustics Mapping
 	{
 		//	construct projection matrix
@@ -399,15 +963,13 @@ void Caustics::Draw(VkCommandBuffer commandBuffer, const VkRect2D& renderArea, c
 		//	For cmConst.world -> it will be filled inside the CausticsMapping::Draw method.
 		this->causticsMap.Draw(commandBuffer, renderArea, cmConst);
 
-		this->pGPUTimeStamps->GetTimeStamp(commandBuffer, "Caustics Mapping");
+		this->pGPUTimeStamps->GetTimeStamp(commandBuffer, "Caustics Map");
 	}
-#endif
-	SetPerfMarkerEnd(commandBuffer);
 }
-#ifdef USE_BIRT
+
 void Caustics::createPhotonTracerDescriptors(DefineList* pDefines)
 {
-	const uint32_t bindingCount = 12;
+	const uint32_t bindingCount = 18;
 	std::vector<VkDescriptorSetLayoutBinding> layoutBindings(bindingCount);
 	uint32_t bindingIdx = 0;
 	//	input
@@ -499,6 +1061,48 @@ void Caustics::createPhotonTracerDescriptors(DefineList* pDefines)
 	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
 	(*pDefines)["ID_HitPosIrradiance"] = std::to_string(bindingIdx++);
+	//	12. Light segment buffer (written by light-space stage, read by camera-space stage)
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	(*pDefines)["ID_LightSegment"] = std::to_string(bindingIdx++);
+	//	13. Phase cache (light-space photon hits per ocean phase)
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	(*pDefines)["ID_PhaseCache"] = std::to_string(bindingIdx++);
+	//	14. Phase cache photon counts
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	(*pDefines)["ID_PhaseCacheCount"] = std::to_string(bindingIdx++);
+	//	15. Density feedback (photon count per emission block)
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	(*pDefines)["ID_DensityFeedback"] = std::to_string(bindingIdx++);
+
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	(*pDefines)["ID_RayQueue"] = std::to_string(bindingIdx++);
+
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	(*pDefines)["ID_RayQueueHeader"] = std::to_string(bindingIdx++);
 
 	assert(bindingIdx == bindingCount);
 	this->pResourceViewHeaps->CreateDescriptorSetLayoutAndAllocDescriptorSet(
@@ -726,38 +1330,154 @@ void Caustics::createPhotonMapperPipeline(const DefineList& defines)
 
 void Caustics::generateSamplingPoints(UploadHeap& uploadHeap)
 {
-	//  initialize randomizer using uniform dist. w/ elem in [0,1]
-	std::default_random_engine generator;
-	std::uniform_real_distribution<float> distribution;
+	//  one slice of sampling points per seed (see SamplingSequence)
+	SamplingSequence::createTexture(this->pDevice, uploadHeap, BLOCK_SIZE, SAMPLING_SEED_COUNT, 0, &this->samplingMap, "Sampling Map");
 
-	//  setup sampling function
-	auto sample_points = [&distribution, &generator]() -> std::pair<float, float>
-	{ return { distribution(generator), distribution(generator) }; };
+	//  upload noise data to GPU
+	uploadHeap.FlushAndFinish();
 
-	//  generate noise texture in host
-	const int noiseDim = BLOCK_SIZE;
-	std::vector<std::pair<float,float>> noises(noiseDim * noiseDim);
-	for (std::pair<float, float>& noise : noises)
-		noise = sample_points();
+	//  create image view
+	this->samplingMap.CreateSRV(&this->samplingMapSRV);
+}
+
+#ifdef PHOTON_TRACER_STATS
+void Caustics::reportTracerStats()
+{
+	//  wait until the command buffer which recorded the readback has surely completed
+	if (this->stats_ReadbackFrame == UINT32_MAX || this->stats_Frame - this->stats_ReadbackFrame < statsReportLatency)
+		return;
+
+	RayQueueHeader* pHeader = nullptr;
+	VkResult res = vkMapMemory(this->pDevice->GetDevice(), this->stats_ReadbackMemory, 0, VK_WHOLE_SIZE, 0, (void**)&pHeader);
+	assert(res == VK_SUCCESS);
+	const RayQueueHeader header = *pHeader;
+	vkUnmapMemory(this->pDevice->GetDevice(), this->stats_ReadbackMemory);
+
+	const double utilization = (header.subgroupSteps > 0) ? 100.0 * header.laneSteps / header.subgroupSteps : 0.0;
+
+	char msg[256];
+	snprintf(msg, sizeof(msg), "Photon Tracer [%s] : %u queued, %u lane steps, %u subgroup steps, SIMD utilization %.1f %%\n",
+		this->persistentThreads ? "persistent" : "per block",
+		header.draw.vertexCount, header.laneSteps, header.subgroupSteps, utilization);
+	Trace(msg);
 
-	//  init noise texture object
+	this->stats_ReadbackFrame = UINT32_MAX;
+}
+#endif
+
+void Caustics::setPhaseCache(bool enabled)
+{
+	if (enabled != this->phaseCacheAllocated)
+		this->allocatePhaseCache(enabled);
+	this->phaseCache = enabled;
+}
+
+void Caustics::allocateLightSegments(bool allocate)
+{
+	//	the descriptor set may be in use by the frames in flight
+	this->pDevice->GPUFlush();
+
+	if (allocate)
 	{
-		IMG_INFO texInfo;
-		texInfo.width = noiseDim;
-		texInfo.height = noiseDim;
-		texInfo.depth = 1;
-		texInfo.mipMapCount = 1;
-		texInfo.arraySize = 1;
-		texInfo.format = DXGI_FORMAT_R32G32_FLOAT;
-		texInfo.bitCount = 64;
-
-		this->samplingMap.InitFromData(this->pDevice, uploadHeap, texInfo, noises.data(), "Sampling Map");
+		const uint32_t lightSegmentBufferMemSize = SAMPLING_SEED_COUNT * MAX_PHOTON_COUNT * sizeof(float);
+		this->lightSegmentBuffer.OnCreateEx(this->pDevice, lightSegmentBufferMemSize, StaticBufferPool::STATIC_BUFFER_USAGE_GPU, "Light Segment Buffer");
+
+		bool res = this->lightSegmentBuffer.AllocBuffer(SAMPLING_SEED_COUNT * MAX_PHOTON_COUNT, sizeof(float), (void*)nullptr, &this->lightSegmentDescInfo);
+		assert(res);
 	}
+	else
+	{
+		this->lightSegmentBuffer.OnDestroy();
+		this->lightSegmentDescInfo = this->hitPosDescInfo;
+	}
+	this->lightSegmentAllocated = allocate;
+	this->lightSegmentValidMask = 0;
 
-	//  upload noise data to GPU
-	uploadHeap.FlushAndFinish();
+	this->setBufferDescriptor(this->descriptorSet, 12, this->lightSegmentDescInfo);
+	for (Caustics::View* pView : this->views)
+		this->setBufferDescriptor(pView->descriptorSet, 12, this->lightSegmentDescInfo);
+}
 
-	//  create image view
-	this->samplingMap.CreateSRV(&this->samplingMapSRV);
+void Caustics::allocatePhaseCache(bool allocate)
+{
+	//	the descriptor set may be in use by the frames in flight
+	this->pDevice->GPUFlush();
+
+	if (allocate)
+	{
+		const uint32_t phaseCacheBufferMemSize = Ocean::PhaseCount * this->phaseCacheCapacity * sizeof(float) * 4;
+		this->phaseCacheBuffer.OnCreateEx(this->pDevice, phaseCacheBufferMemSize, StaticBufferPool::STATIC_BUFFER_USAGE_GPU, "Phase Cache Buffer");
+
+		bool res = this->phaseCacheBuffer.AllocBuffer(Ocean::PhaseCount * this->phaseCacheCapacity, sizeof(float) * 4, (void*)nullptr, &this->phaseCacheDescInfo);
+		assert(res);
+	}
+	else
+	{
+		this->phaseCacheBuffer.OnDestroy();
+		this->phaseCacheDescInfo = this->hitPosDescInfo;
+	}
+	this->phaseCacheAllocated = allocate;
+	this->phaseCacheValidMask = 0;
+
+	this->setBufferDescriptor(this->descriptorSet, 13, this->phaseCacheDescInfo);
+	for (Caustics::View* pView : this->views)
+		this->setBufferDescriptor(pView->descriptorSet, 13, this->phaseCacheDescInfo);
+}
+
+void Caustics::setSharedDescriptors(VkDescriptorSet descriptorSet)
+{
+	this->pDynamicBufferRing->SetDescriptorSet(0, sizeof(Caustics::Constants), descriptorSet);
+	SetDescriptorSet(this->pDevice->GetDevice(), 1, this->samplingMapSRV, &this->sampler_noise, descriptorSet);
+
+	SetDescriptorSet(this->pDevice->GetDevice(), 2, this->pRSM->m_WorldCoordSRV, &this->sampler_default, descriptorSet);
+	SetDescriptorSet(this->pDevice->GetDevice(), 3, this->pRSM->m_NormalBufferSRV, &this->sampler_default, descriptorSet);
+	SetDescriptorSet(this->pDevice->GetDevice(), 4, this->pRSM->m_SpecularRoughnessSRV, &this->sampler_default, descriptorSet);
+	SetDescriptorSet(this->pDevice->GetDevice(), 5, this->pRSM->m_EmissiveFluxSRV, &this->sampler_default, descriptorSet);
+
+	SetDescriptorSetForDepth(this->pDevice->GetDevice(), 6, this->rsmDepthOpaque0SRV, &this->sampler_depth, descriptorSet);
+	SetDescriptorSet(this->pDevice->GetDevice(), 7, this->rsmDepthOpaque1NSRV, &this->sampler_depth, descriptorSet);
+
+	this->setBufferDescriptor(descriptorSet, 11, this->hitPosDescInfo);
+	this->setBufferDescriptor(descriptorSet, 12, this->lightSegmentDescInfo);
+	this->setBufferDescriptor(descriptorSet, 13, this->phaseCacheDescInfo);
+	this->setBufferDescriptor(descriptorSet, 14, this->phaseCacheCountDescInfo);
+	this->setBufferDescriptor(descriptorSet, 15, this->densityDescInfo);
+	this->setBufferDescriptor(descriptorSet, 16, this->rayQueueDescInfo);
+	const VkDescriptorBufferInfo headerDescInfo = { this->rayQueueHeader, 0, sizeof(RayQueueHeader) };
+	this->setBufferDescriptor(descriptorSet, 17, headerDescInfo);
+}
+
+void Caustics::setBufferDescriptor(VkDescriptorSet descriptorSet, uint32_t binding, const VkDescriptorBufferInfo& bufferInfo)
+{
+	VkWriteDescriptorSet write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+	write.pNext = NULL;
+	write.dstSet = descriptorSet;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.pBufferInfo = &bufferInfo;
+	write.dstBinding = binding;
+	write.dstArrayElement = 0;
+
+	vkUpdateDescriptorSets(this->pDevice->GetDevice(), 1, &write, 0, NULL);
+}
+
+void Caustics::barrier_PhotonBuffer(VkCommandBuffer cmdBuf, const VkDescriptorBufferInfo& bufferInfo,
+	VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+	VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask)
+{
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext = NULL;
+	barrier.srcAccessMask = srcAccessMask;
+	barrier.dstAccessMask = dstAccessMask;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = bufferInfo.buffer;
+	barrier.offset = bufferInfo.offset;
+	barrier.size = bufferInfo.range;
+
+	vkCmdPipelineBarrier(cmdBuf,
+		srcStageMask,
+		dstStageMask,
+		0, 0, NULL, 1, &barrier, 0, NULL);
 }
-#endif
\ No newline at end of file
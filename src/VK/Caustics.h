@@ -1,16 +1,27 @@
 #pragma once
 
 #include "CausticsMapping.h"
+#include "Ocean.h"
 
 #include "SVGF.h"
 #include "ISRTCommon.h"
 
-#define USE_BIRT
+//  uncomment to count the traversal steps of the photon tracer, and periodically print
+//  its SIMD utilization (steps of all the lanes / steps their subgroups took).
+//#define PHOTON_TRACER_STATS
 
 class Caustics
 {
 public:
 
+    //  both backends are always created, so they can be switched (and compared) at runtime.
+    //  they render into the same output texture.
+    enum class Backend
+    {
+        BIRT,           // photon tracing (image-space RT) + photon mapping + SVGF
+        CausticsMapping // alternate algorithm, just to evaluate
+    };
+
     struct Constants
     {
         ISRTTransform camera;
@@ -20,6 +31,13 @@ public:
         float IOR;
         float rayThickness;
         float tMax = 100.f;
+
+        //  RSM quarter the photons are emitted from (0 = the shadow RSM itself)
+        int emissionLightIndex = 0;
+        int padding;
+
+        //  extent of the view, from the top-left corner of its G-buffer (set by Draw/drawView)
+        int viewExtent[2];
     };
 
     void OnCreate(
@@ -38,20 +56,105 @@ public:
         VkImageView gbufDepthOpaque0SRV, Texture* pGBufDepthOpaque1N, int mipCount);
     void OnDestroyWindowSizeDependentResources();
 
-    //  if BIRT is not utilized, these two methods have no effect.
+    //  camera side of an auxiliary view (see AuxiliaryView) : its descriptor set (G-buffer opaque depth, its mips
+    //  & normal) and irradiance target. the light side (slices, phase cache) is the main view's of the frame.
+    struct View
+    {
+        VkDescriptorSet       descriptorSet = VK_NULL_HANDLE;
+        VkImageView           gbufDepthOpaque1NSRV = VK_NULL_HANDLE;
+        Texture               irradianceMap;
+        VkImageView           irradianceMapSRV = VK_NULL_HANDLE;
+        VkFramebuffer         framebuffer = VK_NULL_HANDLE;
+        uint32_t              width = 0, height = 0;
+    };
+
+    void OnCreateView(Caustics::View* pView, uint32_t Width, uint32_t Height,
+        GBuffer* pGBuffer, VkImageView gbufDepthOpaque0SRV, Texture* pGBufDepthOpaque1N);
+    void OnDestroyView(Caustics::View* pView);
+
+    //  BIRT only, after this frame's Draw : camera-space stage (every block, full density) + photon map,
+    //  into the view's target. no denoising : the SVGF history is the main view's.
+    void drawView(VkCommandBuffer commandBuffer, Caustics::View* pView, const Caustics::Constants& constants);
+
+    //  only caustics mapping depends on the scene (water surface geometry).
     void registerScene(GLTFTexturesAndBuffers* pGLTFTexturesAndBuffers)
+    { this->causticsMap.registerScene(pGLTFTexturesAndBuffers); }
+    void deregisterScene()
+    { this->causticsMap.deregisterScene(); }
+
+    //  light-space photon tracing results are cached, and must be re-traced
+    //  when the RSM changes without the light moving (e.g. scene reload, moved geometry).
+    void invalidateLightSegments()
     {
-#ifndef USE_BIRT
-        this->causticsMap.registerScene(pGLTFTexturesAndBuffers);
-#endif
+        this->lightSegmentValidMask = 0;
+        this->lightSegmentStillFrames = 0;
+        this->phaseCacheValidMask = 0;
+        this->densityValid = false; // emission blocks may have moved
     }
-    void deregisterScene()
+
+    //  the water surface in the RSM depends on the ocean animation phase (< Ocean::PhaseCount)
+    //  : a phase change invalidates every light-space slice.
+    void setOceanPhase(uint32_t phase)
     {
-#ifndef USE_BIRT
-        this->causticsMap.deregisterScene();
-#endif
+        if (phase != this->oceanPhase)
+        {
+            this->lightSegmentValidMask = 0;
+            this->lightSegmentStillFrames = 0;
+        }
+        this->oceanPhase = phase;
+    }
+
+    //  share of the recent frames (moving average) whose light-space stage reused its slice.
+    //  the seed changes every frame, so a slice is only reused once the light, the RSM and the ocean phase
+    //  held still over SAMPLING_SEED_COUNT (8) frames : with the water animating at 24 phases / s, never
+    //  below 192 fps. in the default scene, it pays off with a paused ocean (or see the phase cache).
+    //  until then, the fused tracer runs instead (one dispatch, no slice written).
+    float getLightSegmentReuse() const { return this->lightSegmentReuse; }
+
+    //  phase cache : photons are traced in light space once per ocean phase, then only reprojected.
+    //  only for static light & receivers. the phases are traced at a fixed sample scale (not the constants' one),
+    //  and hold every photon emitted at it. the cache is allocated when enabled, and freed when disabled
+    //  (the GPU idles meanwhile).
+    void setPhaseCache(bool enabled);
+
+    //  amortization : trace 1/N (1, 2 or 4) of the emission blocks per frame,
+    //  weighting their photons by N and lengthening the denoiser's history accordingly.
+    void setAmortization(uint32_t N)
+    {
+        assert(N == 1 || N == 2 || N == 4);
+        if (N != this->amortization)
+        {
+            this->amortizationSubset = 0;
+            this->densityValid = false;
+        }
+        this->amortization = N;
+    }
+
+    void setDenoiserIterations(uint32_t count) { this->denoiser.setIterationCount(count); }
+
+    //  persistent threads : the photons surviving the light-space stage are compacted into a queue,
+    //  which a fixed number of workgroups drain in subgroup-wide batches. ignored by the phase cache,
+    //  and where compute subgroups lack basic / ballot / arithmetic ops.
+    void setPersistentThreads(bool enabled) { this->persistentThreads = enabled && this->subgroupSupported; }
+    bool isPersistentThreadsSupported() const { return this->subgroupSupported; }
+
+    //  density feedback : each emission block traces as many photons as its caustics
+    //  needed on screen the previous time (view-dependent density). ignored by the phase cache and
+    //  by persistent threads (their queue isn't per block) : the counts restart from full density
+    //  after any frame traced without feedback.
+    void setDensityFeedback(bool enabled)
+    {
+        if (enabled != this->densityFeedback)
+            this->densityValid = false;
+        this->densityFeedback = enabled;
     }
 
+    void setBackend(Caustics::Backend backend) { this->backend = backend; }
+    Caustics::Backend getBackend() const { return this->backend; }
+
+    //  device memory (bytes) owned by the given backend, including the shared output.
+    VkDeviceSize getMemoryFootprint(Caustics::Backend backend) const;
+
     Texture* GetTexture() { return &this->pm_irradianceMap; }
     const Texture* GetTexture() const { return &this->pm_irradianceMap; }
     VkImageView GetTextureView() {return this->pm_irradianceMapSRV; }
@@ -72,16 +175,26 @@ protected:
     VkRenderPass          pm_renderPass;
 
     VkFramebuffer         pm_framebuffer;
-#ifdef USE_BIRT
+
+    Caustics::Backend     backend = Caustics::Backend::BIRT;
+
+    //  BIRT
+    //
     ResourceViewHeaps* pResourceViewHeaps = nullptr;
     DynamicBufferRing* pDynamicBufferRing = nullptr;
 
     GBuffer* pGBuffer = nullptr;
 
+    //  light side, shared by the auxiliary views' descriptor sets
+    GBuffer*              pRSM = nullptr;
+    VkImageView           rsmDepthOpaque0SRV = VK_NULL_HANDLE;
+    std::vector<Caustics::View*> views;
+
     uint32_t              rsmWidth = 0, rsmHeight = 0;
     uint32_t              outWidth = 0, outHeight = 0;
 
-    PostProcCS photonTracer;
+    PostProcCS photonTracer;       // camera-space stage
+    PostProcCS photonTracer_fused; // light-space + camera-space stages
 
     int                   mipCount_rsm = 0;
     int                   mipCount_gbuf = 0;
@@ -91,6 +204,10 @@ protected:
     Texture               samplingMap;
     VkImageView           samplingMapSRV = VK_NULL_HANDLE;
     int                   samplingSeed = 0;
+    int                   tracedSeed = 0; // of this frame's camera-space stage (read by the views)
+
+    uint32_t              amortization = 1;
+    uint32_t              amortizationSubset = 0; // subset of emission blocks traced this frame
 
     VkImageView           rsmDepthOpaque1NSRV = VK_NULL_HANDLE;
     VkImageView           gbufDepthOpaque1NSRV = VK_NULL_HANDLE;
@@ -99,6 +216,65 @@ protected:
     VkDescriptorBufferInfo hitPosDescInfo;
     VkDescriptorBufferInfo hitDirDescInfo;
 
+    //  light-space stage : ray parameter where each photon leaves the RSM, one slice per sampling seed.
+    //  a slice is traced again only once it's invalidated. the buffer is allocated on the first split trace,
+    //  and freed once the fused tracer ran for a while (the GPU idles meanwhile).
+    PostProcCS            photonTracer_light;
+    StaticBufferPool      lightSegmentBuffer;
+    VkDescriptorBufferInfo lightSegmentDescInfo;
+    uint32_t              lightSegmentValidMask = 0;
+    uint32_t              lightSegmentStillFrames = 0; // traced since the last invalidation
+    uint32_t              lightSegmentFusedFrames = 0; // fused traces in a row
+    bool                  lightSegmentAllocated = false;
+    Caustics::Constants   lightSegmentConstants{};
+    float                 lightSegmentReuse = 0.f;
+
+    //  phase cache : light-space photon hits per ocean phase + their counts
+    PostProcCS            photonTracer_phaseFill;
+    PostProcCS            photonTracer_phaseReproj;
+    StaticBufferPool      phaseCacheBuffer;
+    StaticBufferPool      phaseCacheCountBuffer;
+    VkDescriptorBufferInfo phaseCacheDescInfo;
+    VkDescriptorBufferInfo phaseCacheCountDescInfo;
+    uint32_t              phaseCacheValidMask = 0;
+    uint32_t              phaseCacheCapacity = 0; // photons per phase
+    bool                  phaseCache = false;
+    bool                  phaseCacheAllocated = false;
+    uint32_t              oceanPhase = 0;
+
+    //  density feedback : photon count per emission block
+    StaticBufferPool      densityBuffer;
+    VkDescriptorBufferInfo densityDescInfo;
+    bool                  densityFeedback = false;
+    bool                  densityValid = false;
+
+    //  persistent threads : compacted emission indices + queue head (also the photon map's indirect draw)
+    PostProcCS            photonTracer_compact;
+    PostProcCS            photonTracer_persistent;
+    StaticBufferPool      rayQueueBuffer;
+    VkDescriptorBufferInfo rayQueueDescInfo;
+    VkBuffer              rayQueueHeader = VK_NULL_HANDLE;
+    VkDeviceMemory        rayQueueHeaderMemory = VK_NULL_HANDLE;
+    bool                  persistentThreads = false;
+
+    //  of the compute stage (VkPhysicalDeviceSubgroupProperties)
+    uint32_t              subgroupSize = 32;
+    bool                  subgroupSupported = false;
+
+#ifdef PHOTON_TRACER_STATS
+    //  host-visible copy of the queue head
+    VkBuffer              stats_Readback = VK_NULL_HANDLE;
+    VkDeviceMemory        stats_ReadbackMemory = VK_NULL_HANDLE;
+    uint32_t              stats_Frame = 0;
+    uint32_t              stats_ReadbackFrame = UINT32_MAX;
+
+    void reportTracerStats();
+#endif
+
+    void barrier_PhotonBuffer(VkCommandBuffer cmdBuf, const VkDescriptorBufferInfo& bufferInfo,
+        VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+        VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask);
+
     VkSampler             sampler_default = VK_NULL_HANDLE;
     VkSampler             sampler_depth = VK_NULL_HANDLE;
     VkSampler             sampler_noise = VK_NULL_HANDLE;
@@ -107,6 +283,13 @@ protected:
     VkDescriptorSetLayout descriptorSetLayout;
 
     void createPhotonTracerDescriptors(DefineList* pDefines);
+    //  every binding but the camera side's (8 - 10)
+    void setSharedDescriptors(VkDescriptorSet descriptorSet);
+    void setBufferDescriptor(VkDescriptorSet descriptorSet, uint32_t binding, const VkDescriptorBufferInfo& bufferInfo);
+
+    //  (re-)allocate or free a lazily allocated buffer, and re-point its binding
+    void allocateLightSegments(bool allocate);
+    void allocatePhaseCache(bool allocate);
 
     //  photon mapping (point renderer) stuff
     //
@@ -114,15 +297,19 @@ protected:
     VkPipelineLayout      pm_pipelineLayout;
 
     void createPhotonMapperPipeline(const DefineList& defines);
+    void drawPhotonMap(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer, uint32_t width, uint32_t height,
+        const VkRect2D& renderArea, uint32_t photonCount, bool bIndirectDraw);
 
     //  denoiser
     SVGF denoiser;
 
     void generateSamplingPoints(UploadHeap& uploadHeap);
-#else
+    void drawBIRT(VkCommandBuffer commandBuffer, const VkRect2D& renderArea, const Caustics::Constants& constants);
+
     //  alternate algorithm for caustics
     //  WARNING : just to evaluete ONLY!!
     CausticsMapping       causticsMap;
-#endif
+
+    void drawCausticsMapping(VkCommandBuffer commandBuffer, const VkRect2D& renderArea, const Caustics::Constants& constants);
 };
 
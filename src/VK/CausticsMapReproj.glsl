@@ -16,6 +16,9 @@ struct CMParams
     float lightInvTanHalfFovV;
 	float lightFRange;
     float lightNearZ;
+
+    //  the view covers this many texels of the G-buffer, from its top-left corner
+    ivec2 viewExtent;
 };
 layout (std140, binding = ID_Params) uniform Params 
 {
@@ -76,7 +79,7 @@ void main()
 		0, 0, u_params.lightNearZ * u_params.lightFRange, 0
 	);
 
-    vec4 worldPos = texture(u_gbufWorldCoord, inTexCoord);
+    vec4 worldPos = texture(u_gbufWorldCoord, inTexCoord * vec2(u_params.viewExtent) / vec2(textureSize(u_gbufWorldCoord, 0)));
     //  super workaround : avoid painting caustics fragment on the irrelevant geometry (non-receiver)
     if (worldPos.a == 0 || worldPos.y > 0.05f)
         discard;
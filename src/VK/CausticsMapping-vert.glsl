@@ -17,6 +17,8 @@ struct CMParams
     float lightInvTanHalfFovV;
 	float lightFRange;
     float lightNearZ;
+
+    ivec2 viewExtent; // unused here, see CausticsMapReproj.glsl
 };
 layout (std140, binding = ID_Params) uniform Params 
 {
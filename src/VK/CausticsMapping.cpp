@@ -248,6 +248,8 @@ void CausticsMapping::Draw(
 
 		//	workaround : fill world mattrix manually from inside this class
 		pAllocData->world = this->geomWorld;
+		pAllocData->viewExtent[0] = (int)renderArea.extent.width;
+		pAllocData->viewExtent[1] = (int)renderArea.extent.height;
 	}
 
 	//	start render pass
@@ -307,10 +309,7 @@ void CausticsMapping::Draw(
 		rp_begin.pNext = NULL;
 		rp_begin.renderPass = this->reproj_renderPass;
 		rp_begin.framebuffer = this->reproj_framebuffer;
-		rp_begin.renderArea.offset.x = 0;
-		rp_begin.renderArea.offset.y = 0;
-		rp_begin.renderArea.extent.width = this->screenWidth;
-		rp_begin.renderArea.extent.height = this->screenHeight;
+		rp_begin.renderArea = renderArea;
 		rp_begin.clearValueCount = 1;
 		rp_begin.pClearValues = &cv;
 		vkCmdBeginRenderPass(commandBuffer, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
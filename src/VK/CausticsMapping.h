@@ -15,6 +15,10 @@ public:
         float lightInvTanHalfFovV;
         float lightFRange;
         float lightNearZ;
+
+        //  extent of the view, from the top-left corner of the G-buffer (set by Draw)
+        int viewExtent[2];
+        int padding[2];
     };
 
     void OnCreate(
@@ -40,6 +44,10 @@ public:
     const Texture* GetTexture() const { return &this->causticsMap; }
     VkImageView GetTextureView() { return this->causticsMapSRV; }
 
+    //  device memory (bytes) of the caustics map
+    VkDeviceSize getMemoryFootprint() const
+    { return (VkDeviceSize)this->causticsMapWidth * this->causticsMapHeight * 8; }
+
     void Draw(VkCommandBuffer commandBuffer, const VkRect2D& renderArea, const CausticsMapping::Constants& constants);
     
 protected:
@@ -5,6 +5,10 @@
 
 precision highp float;
 
+//  force stencil test before shading, so only pixels marked by the G-buffer passes
+//  (stencil ref 1) pay for the PBR evaluation
+layout (early_fragment_tests) in;
+
 //--------------------------------------------------------------------------------------
 //  FS inputs
 //--------------------------------------------------------------------------------------
@@ -16,8 +20,14 @@ layout (location = 0) in vec2 UV;
 //  set 0 : uniform data
 //  set 1 : RSM samplers
 //  set 2 : G-BUffer input attachments
+//  set 3 : composite inputs
 //--------------------------------------------------------------------------------------
 
+layout (push_constant) uniform pushConstants
+{
+    layout (offset = 0) vec4 u_fxWeights; // lighting, fx0, -, -
+};
+
 #include "perFrameStruct.h"
 
 layout (std140, set = 0, binding = ID_PER_FRAME) uniform perFrame 
@@ -37,6 +47,10 @@ layout (set = 2, binding = 2) uniform sampler2D gcam_Diffuse;
 layout (set = 2, binding = 3) uniform sampler2D gcam_Specular;
 layout (set = 2, binding = 4) uniform sampler2D gcam_Emissive;
 
+// composite sampler
+layout (set = 3, binding = 0) uniform sampler2D u_fx0;
+layout (set = 3, binding = ID_shadowMask) uniform sampler2D u_shadowMask;
+
 //--------------------------------------------------------------------------------------
 //  FS outputs
 //--------------------------------------------------------------------------------------
@@ -77,4 +91,9 @@ void main()
                         cam_PerceptualRoughness
                     ) * cam_AO + cam_Emissive, 
                     cam_Alpha);
+
+    //  composite screen-space effects (e.g. caustics)
+    out_color.rgb *= u_fxWeights.x;
+    if (u_fxWeights.y > 0)
+        out_color.rgb += texture(u_fx0, screenCoord).rgb * u_fxWeights.y;
 }
\ No newline at end of file
@@ -226,7 +226,38 @@ void DirectLighting::setLightGBuffer(DLightInput::LightGBuffer* pLightSRVs)
     vkUpdateDescriptorSets(pDevice->GetDevice(), write.size(), write.data(), 0, NULL);
 }
 
-void DirectLighting::Draw(VkCommandBuffer commandBuffer, VkRect2D* renderArea, VkDescriptorBufferInfo* perFrameDesc)
+void DirectLighting::setComposite(DLightInput::Composite* pCompositeSRVs)
+{
+    //  define input image view descriptions
+    uint32_t numImages = DLightInput::Composite::numImageViews;
+    std::vector<VkDescriptorImageInfo> desc_image(numImages);
+    desc_image[0].sampler = this->sampler_default;
+    desc_image[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    desc_image[0].imageView = pCompositeSRVs->fx0;
+    desc_image[1].sampler = this->sampler_default;
+    desc_image[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    desc_image[1].imageView = pCompositeSRVs->shadowMask;
+
+    //  update decriptor
+    std::vector<VkWriteDescriptorSet> write(numImages);
+    for (unsigned int att = 0; att < write.size(); att++)
+    {
+        write[att] = {};
+        write[att].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write[att].pNext = NULL;
+        write[att].dstSet = this->descriptorSets[3]; // set 3: Composite
+        write[att].descriptorCount = 1;
+        write[att].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write[att].pImageInfo = &desc_image[att];
+        write[att].dstBinding = (uint32_t)att;
+        write[att].dstArrayElement = 0;
+    }
+
+    vkUpdateDescriptorSets(pDevice->GetDevice(), write.size(), write.data(), 0, NULL);
+}
+
+void DirectLighting::Draw(VkCommandBuffer commandBuffer, VkRect2D* renderArea, VkDescriptorBufferInfo* perFrameDesc, 
+    const VkRect2D* pScissor, const float fxWeights[4])
 {
     //  begin render pass
     {
@@ -235,10 +266,17 @@ void DirectLighting::Draw(VkCommandBuffer commandBuffer, VkRect2D* renderArea, V
         rp_begin.pNext = NULL;
         rp_begin.renderPass = this->renderPass;
         rp_begin.framebuffer = this->framebuffer;
-        rp_begin.renderArea.offset.x = 0;
-        rp_begin.renderArea.offset.y = 0;
-        rp_begin.renderArea.extent.width = this->hdrWidth;
-        rp_begin.renderArea.extent.height = this->hdrHeight;
+        if (pScissor)
+        {
+            rp_begin.renderArea = *pScissor;
+        }
+        else
+        {
+            rp_begin.renderArea.offset.x = 0;
+            rp_begin.renderArea.offset.y = 0;
+            rp_begin.renderArea.extent.width = this->hdrWidth;
+            rp_begin.renderArea.extent.height = this->hdrHeight;
+        }
         rp_begin.pClearValues = NULL;
         rp_begin.clearValueCount = 0;
         vkCmdBeginRenderPass(commandBuffer, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
@@ -250,6 +288,8 @@ void DirectLighting::Draw(VkCommandBuffer commandBuffer, VkRect2D* renderArea, V
     SetViewportAndScissor(commandBuffer,
         renderArea->offset.x, renderArea->offset.y,
         renderArea->extent.width, renderArea->extent.height);
+    if (pScissor)
+        vkCmdSetScissor(commandBuffer, 0, 1, pScissor);
 
     //  bind descriptor sets
     uint32_t numUniformOffsets = 1;
@@ -259,6 +299,11 @@ void DirectLighting::Draw(VkCommandBuffer commandBuffer, VkRect2D* renderArea, V
     //  bind pipeline
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline);
 
+    //  composite weights
+    const float defaultWeights[4] = { 1.f, 0.f, 0.f, 0.f };
+    vkCmdPushConstants(commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, 
+        4 * sizeof(float), fxWeights ? fxWeights : defaultWeights);
+
     //  draw
     //  ref : https://www.saschawillems.de/blog/2016/08/13/vulkan-tutorial-on-rendering-a-fullscreen-quad-without-buffers/
     vkCmdDraw(commandBuffer, 3, 1, 0, 0);
@@ -325,13 +370,29 @@ void DirectLighting::createDescriptors(DefineList* pAttributeDefines)
             &this->descriptorSets[2]);
     }
 
+    //  set 3 (Composite)
+    {
+        uint32_t numCompositeViews = DLightInput::Composite::numImageViews;
+        (*pAttributeDefines)["ID_shadowMask"] = std::to_string(1);
+        this->pResourceViewHeaps->AllocDescriptor(
+            numCompositeViews,
+            nullptr,
+            &this->descriptorSetLayouts[3],
+            &this->descriptorSets[3]);
+    }
+
     //  create the pipeline layout
     {
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = 4 * sizeof(float); // fx weights
+
         VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo = {};
         pPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         pPipelineLayoutCreateInfo.pNext = NULL;
-        pPipelineLayoutCreateInfo.pushConstantRangeCount = 0;
-        pPipelineLayoutCreateInfo.pPushConstantRanges = NULL;
+        pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pPipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
         pPipelineLayoutCreateInfo.setLayoutCount = DLIGHT_NUM_DESCRIPTOR_SETS;
         pPipelineLayoutCreateInfo.pSetLayouts = this->descriptorSetLayouts;
 
@@ -1,6 +1,6 @@
 #pragma once
 
-#define DLIGHT_NUM_DESCRIPTOR_SETS 3
+#define DLIGHT_NUM_DESCRIPTOR_SETS 4
 
 struct DLightInput
 {
@@ -23,6 +23,16 @@ struct DLightInput
             stencilTransparent,
             depthOpaque;
     };
+
+    //  screen-space effects composited on top of the lighting result,
+    //  so they don't need an extra read-modify-write pass over HDR target
+    struct Composite
+    {
+        static const uint32_t numImageViews = 2;
+
+        VkImageView fx0; // caustics irradiance
+        VkImageView shadowMask; // filtered shadow map visibility, see ShadowMask
+    };
 };
 
 class DirectLighting
@@ -48,8 +58,13 @@ public:
 
     void setCameraGBuffer(DLightInput::CameraGBuffer* pCamSRVs);
     void setLightGBuffer(DLightInput::LightGBuffer* pLightSRVs);
+    void setComposite(DLightInput::Composite* pCompositeSRVs);
 
-    void Draw(VkCommandBuffer commandBuffer, VkRect2D* renderArea, VkDescriptorBufferInfo* perFrameDesc);
+    //  pScissor (optional) narrows the shaded region, e.g. to the transparent geometry's
+    //  screen bounds. pixels outside of stencil ref 1 are rejected before shading anyway.
+    //  fxWeights (optional) : { lighting, fx0, -, - }, same as Aggregator. default is { 1, 0, 0, 0 }.
+    void Draw(VkCommandBuffer commandBuffer, VkRect2D* renderArea, VkDescriptorBufferInfo* perFrameDesc, 
+        const VkRect2D* pScissor = nullptr, const float fxWeights[4] = nullptr);
 
 protected:
 
@@ -66,7 +81,7 @@ protected:
     VkPipeline pipeline = VK_NULL_HANDLE;
     VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
 
-    //  set 0: general, set 1: RSM, set 2: GeomBuffer
+    //  set 0: general, set 1: RSM, set 2: GeomBuffer, set 3: Composite
     VkDescriptorSet descriptorSets[DLIGHT_NUM_DESCRIPTOR_SETS];
     VkDescriptorSetLayout descriptorSetLayouts[DLIGHT_NUM_DESCRIPTOR_SETS];
 
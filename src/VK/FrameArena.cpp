@@ -0,0 +1,31 @@
+#include "FrameArena.h"
+
+void FrameArena::OnCreate(size_t size)
+{
+	this->pBase = (char*)_aligned_malloc(size, 64);
+	assert(this->pBase);
+	this->size = size;
+	this->offset = 0;
+	this->peak = 0;
+}
+
+void FrameArena::OnDestroy()
+{
+	_aligned_free(this->pBase);
+	this->pBase = nullptr;
+	this->size = 0;
+}
+
+void* FrameArena::alloc(size_t size, size_t alignment)
+{
+	const size_t begin = (this->offset + alignment - 1) & ~(alignment - 1);
+
+	//	sized for the worst frame : running out is a bug, not a case to recover from
+	assert(begin + size <= this->size);
+	if (begin + size > this->size)
+		return nullptr;
+
+	this->offset = begin + size;
+	this->peak = max(this->peak, this->offset);
+	return this->pBase + begin;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <type_traits>
+
+//  linear allocator for data living one frame (e.g. the closures of parallel sections) : allocations bump an offset
+//  into a block reserved once, and reset() releases them all. objects are never destroyed, so they must be trivially destructible.
+class FrameArena
+{
+public:
+
+    void OnCreate(size_t size);
+    void OnDestroy();
+
+    //  call once the previous frame's objects are no longer used
+    void reset() { this->offset = 0; }
+
+    void* alloc(size_t size, size_t alignment);
+
+    template<class T, class... Args>
+    T* create(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new (this->alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    size_t getUsedSize() const { return this->offset; }
+    size_t getPeakSize() const { return this->peak; }
+
+private:
+
+    char*  pBase = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+    size_t peak = 0;
+};
@@ -1,8 +1,11 @@
 #include "Fresnel.h"
-
-#include <random>
+#include "SamplingSequence.h"
 
 #define BLOCK_SIZE 16
+#define SAMPLING_PERIOD 8 // power of two
+
+//	persistent threads : workgroups launched to trace all the blocks (enough to fill the GPU)
+#define PERSISTENT_GROUP_COUNT 256
 
 void Fresnel::OnCreate(
 	Device* pDevice, 
@@ -42,6 +45,50 @@ void Fresnel::OnCreate(
 	//	generate smpling points
 	this->generateSamplingPoints(*pUploadHeap);
 
+	//	subgroups : the persistent threads elect / broadcast in the compute stage
+	{
+		VkPhysicalDeviceSubgroupProperties subgroupProps = {};
+		subgroupProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+		VkPhysicalDeviceProperties2 props = {};
+		props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		props.pNext = &subgroupProps;
+		vkGetPhysicalDeviceProperties2(pDevice->GetPhysicalDevice(), &props);
+
+		const VkSubgroupFeatureFlags requiredOps = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+		this->subgroupSupported = (subgroupProps.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0 &&
+			(subgroupProps.supportedOperations & requiredOps) == requiredOps;
+		if (!this->subgroupSupported)
+			this->persistentThreads = false;
+	}
+
+	//	queue head of the persistent threads, reset every frame
+	{
+		VkBufferCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		info.size = sizeof(uint32_t);
+		info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		VkResult res = vkCreateBuffer(pDevice->GetDevice(), &info, NULL, &this->queueHead);
+		assert(res == VK_SUCCESS);
+
+		VkMemoryRequirements memReqs;
+		vkGetBufferMemoryRequirements(pDevice->GetDevice(), this->queueHead, &memReqs);
+
+		VkMemoryAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memReqs.size;
+		VkPhysicalDeviceMemoryProperties memProps = pDevice->GetPhysicalDeviceMemoryProperties();
+		bool pass = memory_type_from_properties(memProps, memReqs.memoryTypeBits,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&allocInfo.memoryTypeIndex);
+		assert(pass);
+
+		res = vkAllocateMemory(pDevice->GetDevice(), &allocInfo, NULL, &this->queueHeadMemory);
+		assert(res == VK_SUCCESS);
+		res = vkBindBufferMemory(pDevice->GetDevice(), this->queueHead, this->queueHeadMemory, 0);
+		assert(res == VK_SUCCESS);
+	}
+
 	DefineList defines;
 
 	// Create Descriptor Set (for each mip level we will create later on the individual Descriptor Sets)
@@ -50,13 +97,34 @@ void Fresnel::OnCreate(
 	// Use helper class to create the compute pass
 	this->pathTracer.OnCreate(this->pDevice, "PathTracer.glsl", "main", "", this->descriptorSetLayout, 
 		0, 0, 0, &defines, sizeof(int));
+	if (this->subgroupSupported)
+	{
+		DefineList persistentDefines = defines;
+		persistentDefines["PERSISTENT_THREADS"] = "1";
+		this->pathTracer_persistent.OnCreate(this->pDevice, "PathTracer.glsl", "main", "", this->descriptorSetLayout,
+			0, 0, 0, &persistentDefines, sizeof(int));
+	}
 
 	//	update desc set (except gbuf depth)
 	this->pDynamicBufferRing->SetDescriptorSet(0, sizeof(Fresnel::Constants), this->descriptorSet);
 	SetDescriptorSet(this->pDevice->GetDevice(), 1, this->samplingMapSRV, &this->sampler_noise, this->descriptorSet);
+	{
+		VkDescriptorBufferInfo bufferInfo = { this->queueHead, 0, sizeof(uint32_t) };
+
+		VkWriteDescriptorSet write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write.pNext = NULL;
+		write.dstSet = this->descriptorSet;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = &bufferInfo;
+		write.dstBinding = 9;
+		write.dstArrayElement = 0;
+
+		vkUpdateDescriptorSets(this->pDevice->GetDevice(), 1, &write, 0, NULL);
+	}
 
 	//	denoiser
-	this->denoiser.OnCreate(pDevice, pResourceViewHeaps, pDynamicBufferRing);
+	this->denoiser.OnCreate(pDevice, pResourceViewHeaps, pDynamicBufferRing, SVGF::Formats::Packed, "Fresnel");
 }
 
 void Fresnel::OnDestroy()
@@ -64,6 +132,13 @@ void Fresnel::OnDestroy()
 	this->denoiser.OnDestroy();
 
 	this->pathTracer.OnDestroy();
+	if (this->subgroupSupported)
+		this->pathTracer_persistent.OnDestroy();
+
+	vkDestroyBuffer(this->pDevice->GetDevice(), this->queueHead, nullptr);
+	this->queueHead = VK_NULL_HANDLE;
+	vkFreeMemory(this->pDevice->GetDevice(), this->queueHeadMemory, nullptr);
+	this->queueHeadMemory = VK_NULL_HANDLE;
 
 	this->pResourceViewHeaps->FreeDescriptor(this->descriptorSet);
 	vkDestroyDescriptorSetLayout(this->pDevice->GetDevice(), this->descriptorSetLayout, nullptr);
@@ -93,7 +168,7 @@ void Fresnel::OnCreateWindowSizeDependentResources(
 		this->outWidth, this->outHeight,
 		VK_FORMAT_R16G16B16A16_SFLOAT,
 		VK_SAMPLE_COUNT_1_BIT,
-		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
 		false,
 		"Fresnel Radiance Map"
 	);
@@ -168,11 +243,13 @@ void Fresnel::Draw(VkCommandBuffer commandBuffer,
 		Fresnel::Constants* pAllocData;
 		this->pDynamicBufferRing->AllocConstantBuffer(sizeof(Fresnel::Constants), (void**)&pAllocData, &descInfo_constants);
 		*pAllocData = constants;
+		pAllocData->viewExtent[0] = (int)renderArea.extent.width;
+		pAllocData->viewExtent[1] = (int)renderArea.extent.height;
 	}
 
 	const uint32_t sampleDimPerBlock = BLOCK_SIZE * constants.samplingMapScale;
-	const uint32_t numBlocks_x = (this->outWidth + sampleDimPerBlock - 1) / sampleDimPerBlock,
-		numBlocks_y = (this->outHeight + sampleDimPerBlock - 1) / sampleDimPerBlock;
+	const uint32_t numBlocks_x = (renderArea.extent.width + sampleDimPerBlock - 1) / sampleDimPerBlock,
+		numBlocks_y = (renderArea.extent.height + sampleDimPerBlock - 1) / sampleDimPerBlock;
 	const uint32_t numPhotons = BLOCK_SIZE * BLOCK_SIZE * numBlocks_x * numBlocks_y;
 
 	this->barrier_In(commandBuffer);
@@ -194,8 +271,23 @@ void Fresnel::Draw(VkCommandBuffer commandBuffer,
 
 		//  dispatch
 		//
-		this->pathTracer.Draw(commandBuffer, &descInfo_constants, this->descriptorSet, numBlocks_x, numBlocks_y, 1, &this->samplingSeed);
-		this->samplingSeed = (this->samplingSeed + 1) % 8; // ToDo: need variable for 8
+		if (this->persistentThreads)
+		{
+			//	the blocks are pulled from the queue head : restart it
+			this->barrier_QueueHead(commandBuffer,
+				VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+			vkCmdFillBuffer(commandBuffer, this->queueHead, 0, sizeof(uint32_t), 0);
+			this->barrier_QueueHead(commandBuffer,
+				VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+			this->pathTracer_persistent.Draw(commandBuffer, &descInfo_constants, this->descriptorSet,
+				min(numBlocks_x * numBlocks_y, (uint32_t)PERSISTENT_GROUP_COUNT), 1, 1, &this->samplingSeed);
+		}
+		else
+			this->pathTracer.Draw(commandBuffer, &descInfo_constants, this->descriptorSet, numBlocks_x, numBlocks_y, 1, &this->samplingSeed);
+		this->samplingSeed = (this->samplingSeed + 1) % SAMPLING_PERIOD;
 
 		SetPerfMarkerEnd(commandBuffer);
 	}
@@ -212,6 +304,8 @@ void Fresnel::Draw(VkCommandBuffer commandBuffer,
 		svgfConst.sigmaDepth = 1.f;
 		svgfConst.sigmaNormal = 128.f;
 		svgfConst.sigmaLuminance = 4.f;
+		svgfConst.viewExtent[0] = (int)renderArea.extent.width;
+		svgfConst.viewExtent[1] = (int)renderArea.extent.height;
 
 		this->denoiser.Draw(commandBuffer, svgfConst);
 	}
@@ -221,7 +315,7 @@ void Fresnel::Draw(VkCommandBuffer commandBuffer,
 
 void Fresnel::createDescriptors(DefineList& defines)
 {
-	const uint32_t bindingCount = 9;
+	const uint32_t bindingCount = 10;
 	std::vector<VkDescriptorSetLayoutBinding> layoutBindings(bindingCount);
 	uint32_t bindingIdx = 0;
 
@@ -241,7 +335,7 @@ void Fresnel::createDescriptors(DefineList& defines)
 	defines["ID_SamplingMap"] = std::to_string(bindingIdx++);
 
 	//	copy texture binding signature to the remaining
-	for (uint32_t i = bindingIdx; i < bindingCount - 1; i++)
+	for (uint32_t i = bindingIdx; i < bindingCount - 2; i++)
 	{
 		layoutBindings[i] = layoutBindings[1];
 		layoutBindings[i].binding = i;
@@ -269,6 +363,14 @@ void Fresnel::createDescriptors(DefineList& defines)
 	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
 	defines["ID_Target"] = std::to_string(bindingIdx++);
 
+	//	9. Queue head (persistent threads)
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	defines["ID_QueueHead"] = std::to_string(bindingIdx++);
+
 	assert(bindingIdx == bindingCount);
 	this->pResourceViewHeaps->CreateDescriptorSetLayoutAndAllocDescriptorSet(
 		&layoutBindings,
@@ -278,90 +380,13 @@ void Fresnel::createDescriptors(DefineList& defines)
 
 void Fresnel::generateSamplingPoints(UploadHeap& uploadHeap)
 {
-	const int noiseDim = BLOCK_SIZE;
-	std::vector<std::pair<char, char>> noises(noiseDim * noiseDim);
-
-	//	workaround : fix the image properties
-	const uint32_t bytePerPixel = 4;
-
-	//	buffer for loaded image file
-	char texData[noiseDim * noiseDim * bytePerPixel];
-
-	//	use blue noise from file
-	IMG_INFO img_header;
-	static const auto noiseFile_r = "..\\res\\BlueNoise\\noise_r.png";
-	static const auto noiseFile_g = "..\\res\\BlueNoise\\noise_g.png";
-
-	//	load r-component first
-	ImgLoader* img = CreateImageLoader(noiseFile_r);
-	bool result = img->Load(noiseFile_r, 1.f, &img_header);
-	if (result)
-	{
-		img->CopyPixels(texData, img_header.width * bytePerPixel, img_header.width * bytePerPixel, img_header.height);
-
-		//	pick only one channel element to be our coordinate
-		char* pixItr = texData;
-		for (std::pair<char, char>& noise : noises)
-		{
-			//	R-component
-			noise.first = (*pixItr);
-			pixItr += bytePerPixel;
-		}
-	}
-	delete(img);
-
-	//	then load g-component
-	img = CreateImageLoader(noiseFile_g);
-	result = img->Load(noiseFile_g, 1.f, &img_header);
-	if (result)
-	{
-		img->CopyPixels(texData, img_header.width * bytePerPixel, img_header.width * bytePerPixel, img_header.height);
-
-		//	pick only one channel element to be our coordinate
-		char* pixItr = texData;
-		for (std::pair<char, char>& noise : noises)
-		{
-			//	G-component
-			noise.second = (*pixItr);
-			pixItr += bytePerPixel;
-		}
-	}
-	delete(img);
-
-	//OutputDebugStringW(L"My output string.");
-
-	////  initialize randomizer using uniform dist. w/ elem in [0,1]
-	//std::default_random_engine generator;
-	//std::uniform_real_distribution<float> distribution;
-
-	////  setup sampling function
-	//auto sample_points = [&distribution, &generator]() -> std::pair<float, float>
-	//{ return { distribution(generator), distribution(generator) }; };
-
-	////  generate noise texture in host
-	//const int noiseDim = BLOCK_SIZE;
-	//std::vector<std::pair<float, float>> noises(noiseDim * noiseDim);
-	//for (std::pair<float, float>& noise : noises)
-	//	noise = sample_points();
-
-	//	noise data is ready, initialize image object!
-	{
-		IMG_INFO texInfo;
-		texInfo.width = noiseDim;
-		texInfo.height = noiseDim;
-		texInfo.depth = 1;
-		texInfo.mipMapCount = 1;
-		texInfo.arraySize = 1;
-		texInfo.format = DXGI_FORMAT_R8G8_UNORM;
-		texInfo.bitCount = 16;
-
-		this->samplingMap.InitFromData(this->pDevice, uploadHeap, texInfo, noises.data(), "Blue-Noise Sampling Map");
-	}
+	//  one slice of sampling points per seed (see SamplingSequence),
+	//  scrambled apart from the caustics' ones
+	SamplingSequence::createTexture(this->pDevice, uploadHeap, BLOCK_SIZE, SAMPLING_PERIOD, 1, &this->samplingMap, "Sampling Map");
 
 	//  upload noise data to GPU
 	uploadHeap.FlushAndFinish();
 
-	//this->samplingMap.InitFromFile(pDevice, &uploadHeap, "blue_noise.png", false);
 	this->samplingMap.CreateSRV(&this->samplingMapSRV);
 }
 
@@ -413,4 +438,25 @@ void Fresnel::barrier_Out(VkCommandBuffer cmdBuf)
 		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 		0, 0, NULL, 0, NULL,
 		1, barriers);
+}
+
+void Fresnel::barrier_QueueHead(VkCommandBuffer cmdBuf,
+	VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+	VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask)
+{
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext = NULL;
+	barrier.srcAccessMask = srcAccessMask;
+	barrier.dstAccessMask = dstAccessMask;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = this->queueHead;
+	barrier.offset = 0;
+	barrier.size = sizeof(uint32_t);
+
+	vkCmdPipelineBarrier(cmdBuf,
+		srcStageMask,
+		dstStageMask,
+		0, 0, NULL, 1, &barrier, 0, NULL);
 }
\ No newline at end of file
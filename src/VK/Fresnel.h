@@ -15,6 +15,10 @@ public:
         float IOR;
         float rayThickness;
         float tMax = 100.f;
+
+        //  extent of the view, from the top-left corner of its G-buffer (set by Draw)
+        int viewExtent[2];
+        int padding[2];
     };
 
     void OnCreate(
@@ -37,6 +41,13 @@ public:
         const VkRect2D& renderArea, 
         const Fresnel::Constants& constants);
 
+    void setDenoiserIterations(uint32_t count) { this->denoiser.setIterationCount(count); }
+
+    //  persistent threads : a fixed number of workgroups pull the sampling points in subgroup-wide batches,
+    //  rather than a workgroup per block. ignored where compute subgroups lack basic / ballot ops.
+    void setPersistentThreads(bool enabled) { this->persistentThreads = enabled && this->subgroupSupported; }
+    bool isPersistentThreadsSupported() const { return this->subgroupSupported; }
+
     Texture* GetTexture() { return &this->radianceMap; }
     const Texture* GetTexture() const { return &this->radianceMap; }
     VkImageView GetTextureView() { return this->radianceMapSRV; }
@@ -67,6 +78,13 @@ protected:
 
     PostProcCS pathTracer;
 
+    //  persistent threads : queue head over the sampling points of all the blocks
+    PostProcCS            pathTracer_persistent;
+    VkBuffer              queueHead = VK_NULL_HANDLE;
+    VkDeviceMemory        queueHeadMemory = VK_NULL_HANDLE;
+    bool                  persistentThreads = false;
+    bool                  subgroupSupported = false;
+
     VkDescriptorSet       descriptorSet;
     VkDescriptorSetLayout descriptorSetLayout;
 
@@ -79,4 +97,7 @@ protected:
 
     void barrier_In(VkCommandBuffer cmdBuf);
     void barrier_Out(VkCommandBuffer cmdBuf);
+    void barrier_QueueHead(VkCommandBuffer cmdBuf,
+        VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+        VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask);
 };
\ No newline at end of file
@@ -0,0 +1,665 @@
+#include "GPUCulling.h"
+
+#include <cfloat>
+
+#define GROUP_SIZE 64
+#define HIZ_GROUP_SIZE 8
+#define MAX_BATCH_COUNT 4096 // per view, the remaining batches are drawn without culling
+#define MAX_HIZ_LEVEL_COUNT 16
+
+//	the counters are read back this many frames after the copy was recorded
+static const uint32_t statsLatency = 4;
+
+//	see GPUCulling.glsl
+struct CullingBatch
+{
+	XMFLOAT3 boxMin;
+	uint32_t indexCount;
+	XMFLOAT3 boxMax;
+	uint32_t flags;
+};
+
+enum CullingBatchFlags : uint32_t
+{
+	CULLING_ALWAYS_VISIBLE = 1u
+};
+
+struct CullingConstants
+{
+	XMMATRIX viewProj;
+	XMMATRIX hiZViewProj;
+	float hiZSize[2];
+	int hiZLevelCount; // 0 : no occlusion test
+	uint32_t batchCount;
+};
+
+struct CullingCounters
+{
+	uint32_t frustumCulled;
+	uint32_t occlusionCulled;
+};
+
+//	see HiZ.glsl
+struct HiZPushConstants
+{
+	int srcOffset[2];
+	int srcSize[2];
+	int dstSize[2];
+};
+
+void GPUCulling::OnCreate(
+	Device* pDevice,
+	ResourceViewHeaps* pResourceViewHeaps,
+	DynamicBufferRing* pDynamicBufferRing)
+{
+	this->pDevice = pDevice;
+	this->pResourceViewHeaps = pResourceViewHeaps;
+	this->pDynamicBufferRing = pDynamicBufferRing;
+
+	//  create sampler for depth & pyramid (texel fetches only)
+	this->sampler_depth = CreateSampler(pDevice->GetDevice(), false);
+
+	//	culling pass
+	{
+		DefineList defines;
+		this->createDescriptors(defines);
+
+		this->culler.OnCreate(this->pDevice, "GPUCulling.glsl", "main", "", this->descriptorSetLayout,
+			0, 0, 0, &defines);
+	}
+
+	//	depth pyramid pass
+	{
+		DefineList defines;
+		this->createHiZDescriptors(defines);
+
+		this->hiZBuilder.OnCreate(this->pDevice, "HiZ.glsl", "main", "", this->hiZDescriptorSetLayout,
+			0, 0, 0, &defines, sizeof(HiZPushConstants));
+	}
+
+	//	buffers of each view
+	for (ViewData& view : this->views)
+	{
+		this->createBuffer(MAX_BATCH_COUNT * sizeof(CullingBatch),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&view.batches, &view.batchesMemory);
+		this->createBuffer(MAX_BATCH_COUNT * sizeof(VkDrawIndexedIndirectCommand),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&view.drawCommands, &view.drawCommandsMemory);
+		this->createBuffer(sizeof(CullingCounters),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&view.counters, &view.countersMemory);
+
+		this->pResourceViewHeaps->AllocDescriptor(this->descriptorSetLayout, &view.descriptorSet);
+		this->pDynamicBufferRing->SetDescriptorSet(0, sizeof(CullingConstants), view.descriptorSet);
+
+		VkDescriptorBufferInfo bufferInfos[3] = {
+			{ view.batches, 0, VK_WHOLE_SIZE },
+			{ view.drawCommands, 0, VK_WHOLE_SIZE },
+			{ view.counters, 0, VK_WHOLE_SIZE }
+		};
+
+		VkWriteDescriptorSet write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write.pNext = NULL;
+		write.dstSet = view.descriptorSet;
+		write.descriptorCount = 3;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = bufferInfos;
+		write.dstBinding = 1;
+		write.dstArrayElement = 0;
+
+		vkUpdateDescriptorSets(this->pDevice->GetDevice(), 1, &write, 0, NULL);
+	}
+
+	//	readback of the counters (one slot per view)
+	this->createBuffer((uint32_t)View::Count * sizeof(CullingCounters),
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&this->stats_Readback, &this->stats_ReadbackMemory);
+}
+
+void GPUCulling::OnDestroy()
+{
+	for (ViewData& view : this->views)
+	{
+		this->pResourceViewHeaps->FreeDescriptor(view.descriptorSet);
+
+		vkDestroyBuffer(this->pDevice->GetDevice(), view.batches, nullptr);
+		vkFreeMemory(this->pDevice->GetDevice(), view.batchesMemory, nullptr);
+		vkDestroyBuffer(this->pDevice->GetDevice(), view.drawCommands, nullptr);
+		vkFreeMemory(this->pDevice->GetDevice(), view.drawCommandsMemory, nullptr);
+		vkDestroyBuffer(this->pDevice->GetDevice(), view.counters, nullptr);
+		vkFreeMemory(this->pDevice->GetDevice(), view.countersMemory, nullptr);
+		view.batches = view.drawCommands = view.counters = VK_NULL_HANDLE;
+		view.batchesMemory = view.drawCommandsMemory = view.countersMemory = VK_NULL_HANDLE;
+	}
+
+	vkDestroyBuffer(this->pDevice->GetDevice(), this->stats_Readback, nullptr);
+	this->stats_Readback = VK_NULL_HANDLE;
+	vkFreeMemory(this->pDevice->GetDevice(), this->stats_ReadbackMemory, nullptr);
+	this->stats_ReadbackMemory = VK_NULL_HANDLE;
+
+	this->hiZBuilder.OnDestroy();
+	vkDestroyDescriptorSetLayout(this->pDevice->GetDevice(), this->hiZDescriptorSetLayout, nullptr);
+
+	this->culler.OnDestroy();
+	vkDestroyDescriptorSetLayout(this->pDevice->GetDevice(), this->descriptorSetLayout, nullptr);
+
+	vkDestroySampler(this->pDevice->GetDevice(), this->sampler_depth, nullptr);
+}
+
+void GPUCulling::createHiZ(GPUCulling::View view, VkImageView depthSRV, const VkRect2D& region)
+{
+	ViewData& v = this->views[(uint32_t)view];
+
+	v.hiZRegion = region;
+	v.hiZWidth = max(1u, (region.extent.width + 1) / 2);
+	v.hiZHeight = max(1u, (region.extent.height + 1) / 2);
+	v.hiZLevelCount = 1;
+	while (v.hiZLevelCount < MAX_HIZ_LEVEL_COUNT && ((v.hiZWidth >> v.hiZLevelCount) > 0 || (v.hiZHeight >> v.hiZLevelCount) > 0))
+		v.hiZLevelCount++;
+
+	//	create the pyramid
+	{
+		VkImageCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		info.pNext = NULL;
+		info.imageType = VK_IMAGE_TYPE_2D;
+		info.format = VK_FORMAT_R32_SFLOAT;
+		info.extent.width = v.hiZWidth;
+		info.extent.height = v.hiZHeight;
+		info.extent.depth = 1;
+		info.mipLevels = v.hiZLevelCount;
+		info.arrayLayers = 1;
+		info.samples = VK_SAMPLE_COUNT_1_BIT;
+		info.queueFamilyIndexCount = 0;
+		info.pQueueFamilyIndices = NULL;
+		info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+		info.flags = 0;
+		info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		v.hiZ.Init(this->pDevice, &info, (view == View::GBuffer) ? "Hi-Z (G-Buffer)" : "Hi-Z (RSM)");
+	}
+	v.hiZ.CreateSRV(&v.hiZSRV);
+
+	//	one descriptor set per level : previous level (or depth) -> level
+	v.hiZLevelViews.resize(v.hiZLevelCount);
+	v.hiZDescriptorSets.resize(v.hiZLevelCount);
+	for (uint32_t i = 0; i < v.hiZLevelCount; i++)
+	{
+		v.hiZ.CreateRTV(&v.hiZLevelViews[i], i);
+		this->pResourceViewHeaps->AllocDescriptor(this->hiZDescriptorSetLayout, &v.hiZDescriptorSets[i]);
+
+		VkDescriptorImageInfo imgInfos[2];
+		imgInfos[0].sampler = this->sampler_depth;
+		imgInfos[0].imageLayout = (i == 0) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+		imgInfos[0].imageView = (i == 0) ? depthSRV : v.hiZLevelViews[i - 1];
+		imgInfos[1].sampler = VK_NULL_HANDLE;
+		imgInfos[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imgInfos[1].imageView = v.hiZLevelViews[i];
+
+		VkWriteDescriptorSet writes[2];
+		for (uint32_t w = 0; w < 2; w++)
+		{
+			writes[w] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+			writes[w].pNext = NULL;
+			writes[w].dstSet = v.hiZDescriptorSets[i];
+			writes[w].descriptorCount = 1;
+			writes[w].pImageInfo = &imgInfos[w];
+			writes[w].dstBinding = w;
+			writes[w].dstArrayElement = 0;
+		}
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+		vkUpdateDescriptorSets(this->pDevice->GetDevice(), 2, writes, 0, NULL);
+	}
+
+	//	whole pyramid, for the culling pass
+	{
+		VkDescriptorImageInfo imgInfo;
+		imgInfo.sampler = this->sampler_depth;
+		imgInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imgInfo.imageView = v.hiZSRV;
+
+		VkWriteDescriptorSet write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write.pNext = NULL;
+		write.dstSet = v.descriptorSet;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &imgInfo;
+		write.dstBinding = 4;
+		write.dstArrayElement = 0;
+
+		vkUpdateDescriptorSets(this->pDevice->GetDevice(), 1, &write, 0, NULL);
+	}
+
+	v.hiZValid = false;
+}
+
+void GPUCulling::destroyHiZ(GPUCulling::View view)
+{
+	ViewData& v = this->views[(uint32_t)view];
+
+	for (uint32_t i = 0; i < v.hiZLevelCount; i++)
+	{
+		this->pResourceViewHeaps->FreeDescriptor(v.hiZDescriptorSets[i]);
+		vkDestroyImageView(this->pDevice->GetDevice(), v.hiZLevelViews[i], nullptr);
+	}
+	v.hiZDescriptorSets.clear();
+	v.hiZLevelViews.clear();
+	v.hiZLevelCount = 0;
+
+	vkDestroyImageView(this->pDevice->GetDevice(), v.hiZSRV, nullptr);
+	v.hiZSRV = VK_NULL_HANDLE;
+	v.hiZ.OnDestroy();
+
+	v.hiZValid = false;
+}
+
+void GPUCulling::registerScene(GLTFTexturesAndBuffers* pGLTFTexturesAndBuffers)
+{
+	this->pGLTFTexturesAndBuffers = pGLTFTexturesAndBuffers;
+	this->primitives.clear();
+
+	const json& j3 = pGLTFTexturesAndBuffers->m_pGLTFCommon->j3;
+	if (j3.find("meshes") == j3.end() || j3.find("accessors") == j3.end())
+		return;
+
+	const json& meshes = j3["meshes"];
+	const json& accessors = j3["accessors"];
+
+	//	the passes share the index buffer of a primitive (GLTFTexturesAndBuffers caches it per accessor),
+	//	so it identifies the primitive of a batch
+	std::vector<tfNode>* pNodes = &pGLTFTexturesAndBuffers->m_pGLTFCommon->m_nodes;
+	for (uint32_t i = 0; i < pNodes->size(); i++)
+	{
+		tfNode* pNode = &pNodes->at(i);
+		if ((pNode == NULL) || (pNode->meshIndex < 0))
+			continue;
+
+		const json& primitives = meshes[pNode->meshIndex]["primitives"];
+		for (uint32_t p = 0; p < primitives.size(); p++)
+		{
+			const json& primitive = primitives[p];
+			if (primitive.find("indices") == primitive.end())
+				continue;
+
+			//	bounds of the positions
+			const json& attributes = primitive["attributes"];
+			if (attributes.find("POSITION") == attributes.end())
+				continue;
+			const json& position = accessors[attributes["POSITION"].get<int>()];
+			if (position.find("min") == position.end() || position.find("max") == position.end())
+				continue;
+
+			uint32_t numIndices;
+			VkIndexType indexType;
+			VkDescriptorBufferInfo IBV;
+			pGLTFTexturesAndBuffers->CreateIndexBuffer(primitive["indices"].get<int>(), &numIndices, &indexType, &IBV);
+
+			auto key = std::make_pair(IBV.buffer, IBV.offset);
+			auto it = this->primitives.find(key);
+			if (it != this->primitives.end())
+			{
+				it->second.instanced = true;
+				continue;
+			}
+
+			const json& boxMin = position["min"];
+			const json& boxMax = position["max"];
+
+			Primitive& prim = this->primitives[key];
+			prim.boxMin = XMVectorSet(boxMin[0].get<float>(), boxMin[1].get<float>(), boxMin[2].get<float>(), 1.f);
+			prim.boxMax = XMVectorSet(boxMax[0].get<float>(), boxMax[1].get<float>(), boxMax[2].get<float>(), 1.f);
+			prim.nodeIndex = i;
+			prim.instanced = false;
+		}
+	}
+}
+
+void GPUCulling::deregisterScene()
+{
+	this->primitives.clear();
+	this->pGLTFTexturesAndBuffers = nullptr;
+}
+
+void GPUCulling::update()
+{
+	this->frameIdx++;
+
+	//  wait until the command buffer which recorded the readback has surely completed
+	CullingCounters* pCounters = nullptr;
+	for (uint32_t i = 0; i < (uint32_t)View::Count; i++)
+	{
+		ViewData& view = this->views[i];
+		if (view.statsReadbackFrame == UINT32_MAX || this->frameIdx - view.statsReadbackFrame < statsLatency)
+			continue;
+
+		if (!pCounters)
+		{
+			VkResult res = vkMapMemory(this->pDevice->GetDevice(), this->stats_ReadbackMemory, 0, VK_WHOLE_SIZE, 0, (void**)&pCounters);
+			assert(res == VK_SUCCESS);
+		}
+
+		view.stats.batchCount = view.statsBatchCount;
+		view.stats.frustumCulled = pCounters[i].frustumCulled;
+		view.stats.occlusionCulled = pCounters[i].occlusionCulled;
+		view.statsReadbackFrame = UINT32_MAX;
+	}
+
+	if (pCounters)
+		vkUnmapMemory(this->pDevice->GetDevice(), this->stats_ReadbackMemory);
+}
+
+void GPUCulling::cull(VkCommandBuffer commandBuffer, GPUCulling::View view,
+	const std::vector<GltfPbrPass::BatchList>& batches, const XMMATRIX& viewProj, bool occlusion)
+{
+	ViewData& v = this->views[(uint32_t)view];
+
+	v.culledCount = min((uint32_t)batches.size(), (uint32_t)MAX_BATCH_COUNT);
+	if (v.culledCount == 0)
+		return;
+
+	SetPerfMarkerBegin(commandBuffer, "GPU Culling");
+
+	//	world-space bounds of the batches (the staging storage is kept across frames)
+	this->batchStaging.resize(v.culledCount * sizeof(CullingBatch));
+	CullingBatch* cullingBatches = (CullingBatch*)this->batchStaging.data();
+	for (uint32_t i = 0; i < v.culledCount; i++)
+	{
+		const Geometry& geometry = batches[i].m_pPrimitive->m_geometry;
+
+		CullingBatch& batch = cullingBatches[i];
+		batch.indexCount = geometry.m_NumIndices;
+		batch.flags = CULLING_ALWAYS_VISIBLE;
+
+		auto it = this->primitives.find(std::make_pair(geometry.m_IBV.buffer, geometry.m_IBV.offset));
+		if (it == this->primitives.end() || it->second.instanced)
+			continue;
+
+		const Primitive& prim = it->second;
+		const XMMATRIX world = this->pGLTFTexturesAndBuffers->m_pGLTFCommon->m_worldSpaceMats.data()[prim.nodeIndex].GetCurrent();
+
+		XMVECTOR boxMin = XMVectorReplicate(FLT_MAX), boxMax = XMVectorReplicate(-FLT_MAX);
+		for (uint32_t c = 0; c < 8; c++)
+		{
+			const XMVECTOR corner = XMVectorSelect(prim.boxMin, prim.boxMax,
+				XMVectorSelectControl(c & 1, (c >> 1) & 1, (c >> 2) & 1, 0));
+			const XMVECTOR worldCorner = XMVector3Transform(corner, world);
+			boxMin = XMVectorMin(boxMin, worldCorner);
+			boxMax = XMVectorMax(boxMax, worldCorner);
+		}
+		XMStoreFloat3(&batch.boxMin, boxMin);
+		XMStoreFloat3(&batch.boxMax, boxMax);
+		batch.flags = 0;
+	}
+
+	//	the previous frame's culling & draws are done with the buffers
+	this->barrier_Buffer(commandBuffer, v.batches,
+		VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	this->barrier_Buffer(commandBuffer, v.counters,
+		VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	this->barrier_Buffer(commandBuffer, v.drawCommands,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	//	upload the batches (vkCmdUpdateBuffer takes up to 64KB at once)
+	{
+		const VkDeviceSize size = v.culledCount * sizeof(CullingBatch);
+		const VkDeviceSize chunkSize = 65536;
+		for (VkDeviceSize offset = 0; offset < size; offset += chunkSize)
+		{
+			vkCmdUpdateBuffer(commandBuffer, v.batches, offset, min(chunkSize, size - offset),
+				this->batchStaging.data() + offset);
+		}
+		vkCmdFillBuffer(commandBuffer, v.counters, 0, VK_WHOLE_SIZE, 0);
+	}
+
+	this->barrier_Buffer(commandBuffer, v.batches,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	this->barrier_Buffer(commandBuffer, v.counters,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	//  update constants
+	VkDescriptorBufferInfo descInfo_constants;
+	{
+		CullingConstants* pAllocData;
+		this->pDynamicBufferRing->AllocConstantBuffer(sizeof(CullingConstants), (void**)&pAllocData, &descInfo_constants);
+		pAllocData->viewProj = viewProj;
+		pAllocData->hiZViewProj = v.hiZViewProj;
+		pAllocData->hiZSize[0] = (float)v.hiZWidth;
+		pAllocData->hiZSize[1] = (float)v.hiZHeight;
+		pAllocData->hiZLevelCount = (occlusion && v.hiZValid) ? (int)v.hiZLevelCount : 0;
+		pAllocData->batchCount = v.culledCount;
+	}
+
+	//	the pyramid of the previous frame is complete (see buildHiZ)
+	this->culler.Draw(commandBuffer, &descInfo_constants, v.descriptorSet,
+		(v.culledCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+	this->barrier_Buffer(commandBuffer, v.drawCommands,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+
+	//	read back the counters
+	if (v.statsReadbackFrame == UINT32_MAX)
+	{
+		this->barrier_Buffer(commandBuffer, v.counters,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+		VkBufferCopy region = { 0, (uint32_t)view * sizeof(CullingCounters), sizeof(CullingCounters) };
+		vkCmdCopyBuffer(commandBuffer, v.counters, this->stats_Readback, 1, &region);
+
+		this->barrier_Buffer(commandBuffer, this->stats_Readback,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+
+		v.statsBatchCount = v.culledCount;
+		v.statsReadbackFrame = this->frameIdx;
+	}
+
+	SetPerfMarkerEnd(commandBuffer);
+}
+
+void GPUCulling::drawIndirect(VkCommandBuffer commandBuffer, GPUCulling::View view, uint32_t batchIndex)
+{
+	const ViewData& v = this->views[(uint32_t)view];
+	vkCmdDrawIndexedIndirect(commandBuffer, v.drawCommands, batchIndex * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void GPUCulling::buildHiZ(VkCommandBuffer commandBuffer, GPUCulling::View view, const XMMATRIX& viewProj)
+{
+	ViewData& v = this->views[(uint32_t)view];
+	if (v.hiZLevelCount == 0)
+		return;
+
+	SetPerfMarkerBegin(commandBuffer, "Hi-Z");
+
+	//	this frame's culling is done reading the previous pyramid
+	this->barrier_HiZ(commandBuffer, v, VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	uint32_t srcWidth = v.hiZRegion.extent.width, srcHeight = v.hiZRegion.extent.height;
+	for (uint32_t i = 0; i < v.hiZLevelCount; i++)
+	{
+		HiZPushConstants pushConst;
+		pushConst.srcOffset[0] = (i == 0) ? v.hiZRegion.offset.x : 0;
+		pushConst.srcOffset[1] = (i == 0) ? v.hiZRegion.offset.y : 0;
+		pushConst.srcSize[0] = srcWidth;
+		pushConst.srcSize[1] = srcHeight;
+		pushConst.dstSize[0] = max(1u, v.hiZWidth >> i);
+		pushConst.dstSize[1] = max(1u, v.hiZHeight >> i);
+
+		this->hiZBuilder.Draw(commandBuffer, nullptr, v.hiZDescriptorSets[i],
+			(pushConst.dstSize[0] + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+			(pushConst.dstSize[1] + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+			1, &pushConst);
+
+		//	next level reads this one (the last barrier is for the next frame's culling)
+		this->barrier_HiZ(commandBuffer, v, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		srcWidth = pushConst.dstSize[0];
+		srcHeight = pushConst.dstSize[1];
+	}
+
+	v.hiZViewProj = viewProj;
+	v.hiZValid = true;
+
+	SetPerfMarkerEnd(commandBuffer);
+}
+
+void GPUCulling::createDescriptors(DefineList& defines)
+{
+	const uint32_t bindingCount = 5;
+	std::vector<VkDescriptorSetLayoutBinding> layoutBindings(bindingCount);
+	uint32_t bindingIdx = 0;
+
+	//	0. per-view constants
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	defines["ID_Params"] = std::to_string(bindingIdx++);
+	//	1. Batches
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	defines["ID_Batches"] = std::to_string(bindingIdx++);
+	//	2. Draw commands
+	layoutBindings[bindingIdx] = layoutBindings[1];
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	defines["ID_DrawCommands"] = std::to_string(bindingIdx++);
+	//	3. Culled counters
+	layoutBindings[bindingIdx] = layoutBindings[1];
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	defines["ID_Counters"] = std::to_string(bindingIdx++);
+
+	//	4. Depth pyramid
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	defines["ID_HiZ"] = std::to_string(bindingIdx++);
+
+	assert(bindingIdx == bindingCount);
+	this->pResourceViewHeaps->CreateDescriptorSetLayout(
+		&layoutBindings,
+		&this->descriptorSetLayout);
+}
+
+void GPUCulling::createHiZDescriptors(DefineList& defines)
+{
+	const uint32_t bindingCount = 2;
+	std::vector<VkDescriptorSetLayoutBinding> layoutBindings(bindingCount);
+	uint32_t bindingIdx = 0;
+
+	//	0. Previous level (or depth)
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	defines["ID_Source"] = std::to_string(bindingIdx++);
+
+	//	1. Target level
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	defines["ID_Target"] = std::to_string(bindingIdx++);
+
+	assert(bindingIdx == bindingCount);
+	this->pResourceViewHeaps->CreateDescriptorSetLayout(
+		&layoutBindings,
+		&this->hiZDescriptorSetLayout);
+}
+
+void GPUCulling::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+	VkBuffer* pBuffer, VkDeviceMemory* pMemory)
+{
+	VkBufferCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	info.size = size;
+	info.usage = usage;
+	info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	VkResult res = vkCreateBuffer(this->pDevice->GetDevice(), &info, NULL, pBuffer);
+	assert(res == VK_SUCCESS);
+
+	VkMemoryRequirements memReqs;
+	vkGetBufferMemoryRequirements(this->pDevice->GetDevice(), *pBuffer, &memReqs);
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = memReqs.size;
+	VkPhysicalDeviceMemoryProperties memProps = this->pDevice->GetPhysicalDeviceMemoryProperties();
+	bool pass = memory_type_from_properties(memProps, memReqs.memoryTypeBits,
+		properties,
+		&allocInfo.memoryTypeIndex);
+	assert(pass);
+
+	res = vkAllocateMemory(this->pDevice->GetDevice(), &allocInfo, NULL, pMemory);
+	assert(res == VK_SUCCESS);
+	res = vkBindBufferMemory(this->pDevice->GetDevice(), *pBuffer, *pMemory, 0);
+	assert(res == VK_SUCCESS);
+}
+
+void GPUCulling::barrier_Buffer(VkCommandBuffer cmdBuf, VkBuffer buffer,
+	VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+	VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask)
+{
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext = NULL;
+	barrier.srcAccessMask = srcAccessMask;
+	barrier.dstAccessMask = dstAccessMask;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(cmdBuf,
+		srcStageMask,
+		dstStageMask,
+		0, 0, NULL, 1, &barrier, 0, NULL);
+}
+
+void GPUCulling::barrier_HiZ(VkCommandBuffer cmdBuf, ViewData& view, VkImageLayout oldLayout,
+	VkAccessFlags srcAccessMask, VkPipelineStageFlags srcStageMask)
+{
+	VkImageMemoryBarrier barriers[1];
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].pNext = NULL;
+	barriers[0].srcAccessMask = srcAccessMask;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].subresourceRange.baseMipLevel = 0;
+	barriers[0].subresourceRange.levelCount = view.hiZLevelCount;
+	barriers[0].subresourceRange.baseArrayLayer = 0;
+	barriers[0].subresourceRange.layerCount = 1;
+	barriers[0].oldLayout = oldLayout;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barriers[0].image = view.hiZ.Resource();
+
+	vkCmdPipelineBarrier(cmdBuf,
+		srcStageMask,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, NULL, 0, NULL,
+		1, barriers);
+}
@@ -0,0 +1,162 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_ARB_compute_shader  : enable
+
+//--------------------------------------------------------------------------------------
+//  CS workgroup definition
+//--------------------------------------------------------------------------------------
+
+layout (local_size_x = 64) in;
+
+//--------------------------------------------------------------------------------------
+//  uniform data
+//  set 0 : input data
+//--------------------------------------------------------------------------------------
+
+layout (std140, binding = ID_Params) uniform Params
+{
+    mat4  u_viewProj;      // frustum test
+    mat4  u_hiZViewProj;   // occlusion test : the view the pyramid was built from (previous frame)
+    vec2  u_hiZSize;       // level 0
+    int   u_hiZLevelCount; // 0 : no occlusion test
+    uint  u_batchCount;
+};
+
+#define CULLING_ALWAYS_VISIBLE 1u
+
+struct Batch
+{
+    vec3 boxMin; // world space
+    uint indexCount;
+    vec3 boxMax;
+    uint flags;
+};
+
+layout (std430, binding = ID_Batches) readonly buffer Batches
+{
+    Batch batches[];
+};
+
+//  VkDrawIndexedIndirectCommand
+struct DrawCommand
+{
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int  vertexOffset;
+    uint firstInstance;
+};
+
+layout (std430, binding = ID_DrawCommands) writeonly buffer DrawCommands
+{
+    DrawCommand drawCommands[];
+};
+
+layout (std430, binding = ID_Counters) buffer Counters
+{
+    uint frustumCulled;
+    uint occlusionCulled;
+};
+
+//  max. depth pyramid
+layout (binding = ID_HiZ) uniform sampler2D u_hiZ;
+
+//--------------------------------------------------------------------------------------
+//  main function
+//--------------------------------------------------------------------------------------
+
+vec3 getCorner(Batch batch, int i)
+{
+    return vec3(
+        (i & 1) != 0 ? batch.boxMax.x : batch.boxMin.x,
+        (i & 2) != 0 ? batch.boxMax.y : batch.boxMin.y,
+        (i & 4) != 0 ? batch.boxMax.z : batch.boxMin.z);
+}
+
+bool isOutsideFrustum(Batch batch)
+{
+    //  all corners outside of the same plane
+    uvec3 below = uvec3(0), above = uvec3(0);
+    for (int i = 0; i < 8; i++)
+    {
+        const vec4 clipPos = u_viewProj * vec4(getCorner(batch, i), 1.0f);
+        below += uvec3(lessThan(clipPos.xyz, vec3(-clipPos.w, -clipPos.w, 0.0f)));
+        above += uvec3(greaterThan(clipPos.xyz, vec3(clipPos.w)));
+    }
+    return any(equal(below, uvec3(8))) || any(equal(above, uvec3(8)));
+}
+
+bool isOccluded(Batch batch)
+{
+    //  screen bounds & nearest depth in the previous view
+    vec2 uvMin = vec2(1.0f), uvMax = vec2(0.0f);
+    float nearestDepth = 1.0f;
+    for (int i = 0; i < 8; i++)
+    {
+        const vec4 clipPos = u_hiZViewProj * vec4(getCorner(batch, i), 1.0f);
+        if (clipPos.w <= 0.0f)
+            return false; // crossing the near plane
+
+        const vec3 ndc = clipPos.xyz / clipPos.w;
+        const vec2 uv = vec2(ndc.x * 0.5f + 0.5f, 0.5f - ndc.y * 0.5f); // y is flipped by the viewport
+        uvMin = min(uvMin, uv);
+        uvMax = max(uvMax, uv);
+        nearestDepth = min(nearestDepth, ndc.z);
+    }
+    if (nearestDepth <= 0.0f)
+        return false;
+
+    uvMin = clamp(uvMin, 0.0f, 1.0f);
+    uvMax = clamp(uvMax, 0.0f, 1.0f);
+
+    //  the level where the bounds cover 2x2 texels at most
+    const vec2 extent = (uvMax - uvMin) * u_hiZSize;
+    const int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0f)))), 0, u_hiZLevelCount - 1);
+
+    const ivec2 levelSize = max(ivec2(u_hiZSize) >> level, ivec2(1)); // as built, see HiZ.glsl
+    const ivec2 first = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);
+    const ivec2 last = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+    float farthestDepth = 0.0f;
+    for (int y = first.y; y <= last.y; y++)
+    {
+        for (int x = first.x; x <= last.x; x++)
+            farthestDepth = max(farthestDepth, texelFetch(u_hiZ, ivec2(x, y), level).r);
+    }
+
+    return nearestDepth > farthestDepth;
+}
+
+void main()
+{
+    const uint index = gl_GlobalInvocationID.x;
+    if (index >= u_batchCount)
+        return;
+
+    const Batch batch = batches[index];
+
+    bool visible = true;
+    if ((batch.flags & CULLING_ALWAYS_VISIBLE) == 0)
+    {
+        if (isOutsideFrustum(batch))
+        {
+            visible = false;
+            atomicAdd(frustumCulled, 1);
+        }
+        else if (u_hiZLevelCount > 0 && isOccluded(batch))
+        {
+            visible = false;
+            atomicAdd(occlusionCulled, 1);
+        }
+    }
+
+    DrawCommand command;
+    command.indexCount = batch.indexCount;
+    command.instanceCount = visible ? 1 : 0;
+    command.firstIndex = 0;
+    command.vertexOffset = 0;
+    command.firstInstance = 0;
+    drawCommands[index] = command;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+//  GPU visibility culling of the batches of a GltfPbrPass, per view (camera G-buffer, RSM) :
+//  a compute pass tests the world-space bounds of every batch against the view's frustum
+//  and against the depth pyramid (Hi-Z) of the previous frame, then writes one indirect draw per batch
+//  (instance count 0 when culled). the culled counts are read back a few frames later.
+//  there is no second phase re-testing the occluded batches against the current depth : a batch disoccluded
+//  this frame is only drawn from the next one on.
+//  batches keep their own pipeline & descriptor sets, bound by their pass : the indirect draws are issued one by one.
+class GPUCulling
+{
+public:
+
+    enum class View : uint32_t
+    {
+        GBuffer,
+        RSM,
+        Count
+    };
+
+    struct Stats
+    {
+        uint32_t batchCount = 0;
+        uint32_t frustumCulled = 0;
+        uint32_t occlusionCulled = 0;
+    };
+
+    void OnCreate(
+        Device* pDevice,
+        ResourceViewHeaps* pResourceViewHeaps,
+        DynamicBufferRing* pDynamicBufferRing);
+    void OnDestroy();
+
+    //  depth pyramid of a view, built from a region of its depth (e.g. a RSM quarter)
+    void createHiZ(GPUCulling::View view, VkImageView depthSRV, const VkRect2D& region);
+    void destroyHiZ(GPUCulling::View view);
+
+    //  bounds of the primitives of the scene
+    void registerScene(GLTFTexturesAndBuffers* pGLTFTexturesAndBuffers);
+    void deregisterScene();
+
+    //  call once a frame : consumes the culled counts read back
+    void update();
+
+    //  record the culling of the batches (outside of a render pass)
+    void cull(VkCommandBuffer commandBuffer, GPUCulling::View view,
+        const std::vector<GltfPbrPass::BatchList>& batches, const XMMATRIX& viewProj, bool occlusion);
+    //  record the draws of the batches just culled (inside the view's render pass).
+    //  drawPassBatches(commandBuffer, pBatches) is the pass's own DrawBatchList, with its arguments (e.g. the RSM index) :
+    //  it is called on each batch alone with its index count zeroed, so that it binds the batch's state and draws nothing,
+    //  then the draw is taken from the culling result. the batches beyond the culled ones are drawn by it as is.
+    //  (the pass must not be drawn from another thread meanwhile : the G-buffer & RSM passes own separate primitives)
+    template<typename F>
+    void drawBatchList(VkCommandBuffer commandBuffer, GPUCulling::View view,
+        const std::vector<GltfPbrPass::BatchList>& batches, const F& drawPassBatches)
+    {
+        ViewData& v = this->views[(uint32_t)view];
+        for (uint32_t i = 0; i < v.culledCount; i++)
+        {
+            Geometry& geometry = batches[i].m_pPrimitive->m_geometry;
+            const uint32_t indexCount = geometry.m_NumIndices;
+
+            v.singleBatch[0] = batches[i];
+            geometry.m_NumIndices = 0;
+            drawPassBatches(commandBuffer, &v.singleBatch);
+            geometry.m_NumIndices = indexCount;
+
+            this->drawIndirect(commandBuffer, view, i);
+        }
+
+        if (v.culledCount < batches.size())
+        {
+            v.remainingBatches.assign(batches.begin() + v.culledCount, batches.end());
+            drawPassBatches(commandBuffer, &v.remainingBatches);
+        }
+    }
+
+    //  record the depth pyramid the next frame's occlusion test reads,
+    //  once the view's depth is readable. viewProj is the matrix the depth was rendered with.
+    void buildHiZ(VkCommandBuffer commandBuffer, GPUCulling::View view, const XMMATRIX& viewProj);
+
+    const GPUCulling::Stats& getStats(GPUCulling::View view) const
+    { return this->views[(uint32_t)view].stats; }
+
+protected:
+
+    Device* pDevice = nullptr;
+
+    ResourceViewHeaps* pResourceViewHeaps = nullptr;
+    DynamicBufferRing* pDynamicBufferRing = nullptr;
+
+    //  scene primitives, keyed by their index buffer (shared by the passes' geometries)
+    struct Primitive
+    {
+        XMVECTOR boxMin, boxMax; // object space
+        uint32_t nodeIndex;
+        bool     instanced;      // mesh used by several nodes : never culled
+    };
+    GLTFTexturesAndBuffers* pGLTFTexturesAndBuffers = nullptr;
+    std::map<std::pair<VkBuffer, VkDeviceSize>, Primitive> primitives;
+
+    //  per view
+    struct ViewData
+    {
+        VkBuffer              batches = VK_NULL_HANDLE; // bounds + index count
+        VkDeviceMemory        batchesMemory = VK_NULL_HANDLE;
+        VkBuffer              drawCommands = VK_NULL_HANDLE;
+        VkDeviceMemory        drawCommandsMemory = VK_NULL_HANDLE;
+        VkBuffer              counters = VK_NULL_HANDLE;
+        VkDeviceMemory        countersMemory = VK_NULL_HANDLE;
+
+        VkDescriptorSet       descriptorSet = VK_NULL_HANDLE;
+
+        //  depth pyramid (max. depth), level 0 is half the depth region
+        Texture               hiZ;
+        VkImageView           hiZSRV = VK_NULL_HANDLE;
+        std::vector<VkImageView>     hiZLevelViews;
+        std::vector<VkDescriptorSet> hiZDescriptorSets;
+        VkRect2D              hiZRegion{};
+        uint32_t              hiZWidth = 0, hiZHeight = 0, hiZLevelCount = 0;
+        bool                  hiZValid = false;
+        XMMATRIX              hiZViewProj{ XMMatrixIdentity() };
+
+        //  batches culled this frame (more are drawn directly)
+        uint32_t              culledCount = 0;
+        //  lists handed to the pass's DrawBatchList, kept so that their storage is reused
+        std::vector<GltfPbrPass::BatchList> singleBatch = std::vector<GltfPbrPass::BatchList>(1), remainingBatches;
+
+        //  readback of the counters
+        uint32_t              statsBatchCount = 0;
+        uint32_t              statsReadbackFrame = UINT32_MAX;
+        GPUCulling::Stats     stats;
+    };
+    ViewData views[(uint32_t)View::Count];
+
+    //  bounds uploaded by cull, as CullingBatch
+    std::vector<char>     batchStaging;
+
+    VkBuffer              stats_Readback = VK_NULL_HANDLE;
+    VkDeviceMemory        stats_ReadbackMemory = VK_NULL_HANDLE;
+    uint32_t              frameIdx = 0;
+
+    VkSampler             sampler_depth = VK_NULL_HANDLE;
+
+    PostProcCS            culler;
+    VkDescriptorSetLayout descriptorSetLayout;
+
+    PostProcCS            hiZBuilder;
+    VkDescriptorSetLayout hiZDescriptorSetLayout;
+
+    //  the indirect draw of a culled batch, its state bound
+    void drawIndirect(VkCommandBuffer commandBuffer, GPUCulling::View view, uint32_t batchIndex);
+
+    void createDescriptors(DefineList& defines);
+    void createHiZDescriptors(DefineList& defines);
+
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+        VkBuffer* pBuffer, VkDeviceMemory* pMemory);
+
+    void barrier_Buffer(VkCommandBuffer cmdBuf, VkBuffer buffer,
+        VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+        VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask);
+    void barrier_HiZ(VkCommandBuffer cmdBuf, ViewData& view, VkImageLayout oldLayout,
+        VkAccessFlags srcAccessMask, VkPipelineStageFlags srcStageMask);
+};
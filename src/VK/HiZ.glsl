@@ -0,0 +1,53 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_ARB_compute_shader  : enable
+
+//--------------------------------------------------------------------------------------
+//  CS workgroup definition
+//--------------------------------------------------------------------------------------
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+//--------------------------------------------------------------------------------------
+//  uniform data
+//  set 0 : input data
+//--------------------------------------------------------------------------------------
+
+layout (push_constant) uniform pushConstants
+{
+    layout (offset = 0) ivec2 u_srcOffset; // region of the depth (level 0 only)
+    layout (offset = 8) ivec2 u_srcSize;
+    layout (offset = 16) ivec2 u_dstSize;
+};
+
+//  depth, or the previous level of the pyramid
+layout (binding = ID_Source) uniform sampler2D u_source;
+
+layout (r32f, binding = ID_Target) uniform writeonly image2D img_target;
+
+//--------------------------------------------------------------------------------------
+//  main function
+//--------------------------------------------------------------------------------------
+
+void main()
+{
+    const ivec2 dst = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(dst, u_dstSize)))
+        return;
+
+    //  source texels covered by the target texel (up to 3x3 when the source extent is odd),
+    //  the farthest depth is kept so that the pyramid stays conservative
+    const ivec2 first = (dst * u_srcSize) / u_dstSize;
+    const ivec2 last = min(((dst + 1) * u_srcSize + u_dstSize - 1) / u_dstSize, u_srcSize) - 1;
+
+    float depth = 0.0f;
+    for (int y = first.y; y <= last.y; y++)
+    {
+        for (int x = first.x; x <= last.x; x++)
+            depth = max(depth, texelFetch(u_source, u_srcOffset + ivec2(x, y), 0).r);
+    }
+
+    imageStore(img_target, dst, vec4(depth));
+}
@@ -8,6 +8,11 @@ float randFromCoord(vec2 st) {
 
 #define USE_NEW_TRACE
 
+#ifdef TRACE_STATS
+//  traversal steps taken by traceOnView(), accumulated until reset by the caller
+uint g_traceSteps = 0;
+#endif
+
 // Exact, unpolarized Fresnel equation
 float fresnelUnpolarized(
     float cosI, // cosIncident
@@ -329,6 +334,9 @@ bool traceOnView(
     int traverseLevel = minTraverseLevel;
     while (traverseLevel >= minTraverseLevel)
     {
+#ifdef TRACE_STATS
+        g_traceSteps++;
+#endif
         const vec2 nextBasis = vec2(1) / (bCamera ? getGBufDepthSize(traverseLevel) : getRSMDepthSize(traverseLevel));
         const vec2 nextCoord = startCoord + unitMoveDir * (nextBasis.x < nextBasis.y ? nextBasis.x : nextBasis.y);
 
@@ -0,0 +1,348 @@
+#include "JobSystem.h"
+
+//	jobs a queue holds at most, beyond that they run as they are pushed
+static const uint32_t QUEUE_CAPACITY = 1024;
+
+struct JobSystem::Job
+{
+	JobSystem*            pOwner = nullptr;
+	std::function<void()> function;
+
+	std::atomic<uint32_t> refCount{ 0 };
+	//	+1 until the job is scheduled, so that it doesn't start while its dependencies are registered
+	std::atomic<uint32_t> dependencyCount{ 1 };
+
+	std::mutex            mutex; // guards the following
+	bool                  done = false;
+	std::vector<Job*>     continuations; // each holding a reference
+};
+
+//	index of the queue owned by the calling thread, UINT32_MAX for non-worker threads
+static thread_local uint32_t workerIndex = UINT32_MAX;
+
+//	handles
+//
+JobSystem::Handle::Handle(Job* pJob) : pJob(pJob)
+{
+}
+
+JobSystem::Handle::Handle(const Handle& other) : pJob(other.pJob)
+{
+	if (this->pJob)
+		this->pJob->refCount++;
+}
+
+JobSystem::Handle::Handle(Handle&& other) noexcept : pJob(other.pJob)
+{
+	other.pJob = nullptr;
+}
+
+JobSystem::Handle& JobSystem::Handle::operator=(Handle other)
+{
+	std::swap(this->pJob, other.pJob);
+	return *this;
+}
+
+JobSystem::Handle::~Handle()
+{
+	if (this->pJob)
+		JobSystem::release(this->pJob);
+}
+
+//	scheduler
+//
+void JobSystem::OnCreate(uint32_t workerCount)
+{
+	if (workerCount == 0)
+	{
+		const uint32_t threadCount = std::thread::hardware_concurrency(); // 0 if unknown
+		workerCount = (threadCount > 1) ? threadCount - 1 : 1;
+	}
+
+	this->exiting = false;
+	this->queues.resize(workerCount + 1);
+	for (std::unique_ptr<Queue>& queue : this->queues)
+	{
+		queue.reset(new Queue());
+		queue->ring.resize(QUEUE_CAPACITY);
+	}
+
+	this->workers.resize(workerCount);
+	for (uint32_t i = 0; i < workerCount; i++)
+		this->workers[i] = std::thread(&JobSystem::workerLoop, this, i);
+
+	this->workerStats.resize(workerCount);
+	this->windowStart = MillisecondsNow();
+}
+
+void JobSystem::OnDestroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->sleepMutex);
+		this->exiting = true;
+	}
+	this->sleepCondition.notify_all();
+
+	for (std::thread& worker : this->workers)
+		worker.join();
+
+	//	every handle is expected to be gone
+	assert(this->freeJobs.size() == this->jobs.size());
+
+	this->workers.clear();
+	this->queues.clear();
+	for (Job* pJob : this->jobs)
+		delete pJob;
+	this->freeJobs.clear();
+	this->jobs.clear();
+	this->workerStats.clear();
+}
+
+JobSystem::Handle JobSystem::schedule(std::function<void()> function,
+	const JobSystem::Handle* pDependencies, uint32_t dependencyCount)
+{
+	Job* pJob = this->allocJob();
+	pJob->function = std::move(function);
+	pJob->refCount = 1; // the returned handle
+
+	for (uint32_t i = 0; i < dependencyCount; i++)
+	{
+		Job* pDependency = pDependencies[i].pJob;
+		if (!pDependency)
+			continue;
+
+		std::lock_guard<std::mutex> lock(pDependency->mutex);
+		if (!pDependency->done)
+		{
+			pJob->dependencyCount++;
+			pJob->refCount++;
+			pDependency->continuations.push_back(pJob);
+		}
+	}
+
+	if (--pJob->dependencyCount == 0)
+	{
+		pJob->refCount++;
+		this->push(pJob);
+	}
+	return Handle(pJob);
+}
+
+bool JobSystem::isDone(const JobSystem::Handle& job) const
+{
+	std::lock_guard<std::mutex> lock(job.pJob->mutex);
+	return job.pJob->done;
+}
+
+void JobSystem::wait(const JobSystem::Handle& job)
+{
+	const uint32_t queueIndex = this->getQueueIndex();
+	while (!this->isDone(job))
+	{
+		Job* pOther = this->pop(queueIndex);
+		if (pOther)
+			this->execute(pOther, queueIndex);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& function)
+{
+	if (count == 0)
+		return;
+
+	grainSize = max(1u, grainSize);
+	const uint32_t rangeCount = (count + grainSize - 1) / grainSize;
+	if (rangeCount == 1 || this->workers.empty())
+	{
+		function(0, count);
+		return;
+	}
+
+	//	the caller takes the first range, then helps until the others are done
+	std::atomic<uint32_t> remaining{ rangeCount - 1 };
+	for (uint32_t i = 1; i < rangeCount; i++)
+	{
+		const uint32_t begin = i * grainSize;
+		this->schedule([&function, &remaining, begin, count, grainSize]()
+		{
+			function(begin, min(count, begin + grainSize));
+			remaining--;
+		});
+	}
+	function(0, min(count, grainSize));
+
+	const uint32_t queueIndex = this->getQueueIndex();
+	while (remaining > 0)
+	{
+		Job* pOther = this->pop(queueIndex);
+		if (pOther)
+			this->execute(pOther, queueIndex);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::updateStats()
+{
+	const double now = MillisecondsNow();
+	const double window = now - this->windowStart;
+	if (window < 1000.0)
+		return;
+
+	for (uint32_t i = 0; i < this->workers.size(); i++)
+	{
+		Queue* pQueue = this->queues[i].get();
+		WorkerStats& stats = this->workerStats[i];
+		stats.utilization = (float)(pQueue->busyMicroseconds.exchange(0) / (window * 1000.0));
+		stats.jobCount = pQueue->jobCount.exchange(0);
+		stats.stealCount = pQueue->stealCount.exchange(0);
+	}
+	this->windowStart = now;
+}
+
+JobSystem::Job* JobSystem::allocJob()
+{
+	std::lock_guard<std::mutex> lock(this->poolMutex);
+	if (this->freeJobs.empty())
+	{
+		Job* pJob = new Job();
+		pJob->pOwner = this;
+		this->jobs.push_back(pJob);
+		this->freeJobs.reserve(this->jobs.size());
+		return pJob;
+	}
+
+	Job* pJob = this->freeJobs.back();
+	this->freeJobs.pop_back();
+	return pJob;
+}
+
+void JobSystem::release(Job* pJob)
+{
+	if (--pJob->refCount > 0)
+		return;
+
+	pJob->function = nullptr;
+	pJob->dependencyCount = 1;
+	pJob->done = false;
+	pJob->continuations.clear(); // keeps its capacity
+
+	JobSystem* pOwner = pJob->pOwner;
+	std::lock_guard<std::mutex> lock(pOwner->poolMutex);
+	pOwner->freeJobs.push_back(pJob);
+}
+
+uint32_t JobSystem::getQueueIndex() const
+{
+	return (workerIndex == UINT32_MAX) ? (uint32_t)this->workers.size() : workerIndex;
+}
+
+void JobSystem::push(Job* pJob)
+{
+	//	counted first, so that a pop never sees fewer pending jobs than it takes
+	{
+		std::lock_guard<std::mutex> lock(this->sleepMutex);
+		this->pendingCount++;
+	}
+
+	const uint32_t queueIndex = this->getQueueIndex();
+	Queue* pQueue = this->queues[queueIndex].get();
+	{
+		std::lock_guard<std::mutex> lock(pQueue->mutex);
+		if (pQueue->tail - pQueue->head < QUEUE_CAPACITY)
+		{
+			pQueue->ring[pQueue->tail++ % QUEUE_CAPACITY] = pJob;
+			pJob = nullptr;
+		}
+	}
+
+	//	queue full
+	if (pJob)
+	{
+		this->pendingCount--;
+		this->execute(pJob, queueIndex);
+		return;
+	}
+
+	this->sleepCondition.notify_one();
+}
+
+JobSystem::Job* JobSystem::pop(uint32_t queueIndex)
+{
+	Job* pJob = nullptr;
+
+	//	own jobs first, latest first (its data is still in cache)
+	{
+		Queue* pQueue = this->queues[queueIndex].get();
+		std::lock_guard<std::mutex> lock(pQueue->mutex);
+		if (pQueue->tail != pQueue->head)
+			pJob = pQueue->ring[--pQueue->tail % QUEUE_CAPACITY];
+	}
+
+	//	then steal the oldest job of another queue
+	const uint32_t queueCount = (uint32_t)this->queues.size();
+	for (uint32_t i = 1; !pJob && i < queueCount; i++)
+	{
+		Queue* pVictim = this->queues[(queueIndex + i) % queueCount].get();
+		std::lock_guard<std::mutex> lock(pVictim->mutex);
+		if (pVictim->tail != pVictim->head)
+		{
+			pJob = pVictim->ring[pVictim->head++ % QUEUE_CAPACITY];
+			this->queues[queueIndex]->stealCount++;
+		}
+	}
+
+	if (pJob)
+		this->pendingCount--;
+	return pJob;
+}
+
+void JobSystem::execute(Job* pJob, uint32_t queueIndex)
+{
+	const double start = MillisecondsNow();
+	pJob->function();
+
+	Queue* pQueue = this->queues[queueIndex].get();
+	pQueue->busyMicroseconds += (uint64_t)((MillisecondsNow() - start) * 1000.0);
+	pQueue->jobCount++;
+
+	//	no continuation is added once done
+	{
+		std::lock_guard<std::mutex> lock(pJob->mutex);
+		pJob->done = true;
+	}
+	for (Job* pContinuation : pJob->continuations)
+	{
+		//	the reference of the dependency moves to the queue
+		if (--pContinuation->dependencyCount == 0)
+			this->push(pContinuation);
+		else
+			JobSystem::release(pContinuation);
+	}
+	pJob->continuations.clear();
+
+	//	reference of the queue
+	JobSystem::release(pJob);
+}
+
+void JobSystem::workerLoop(uint32_t queueIndex)
+{
+	workerIndex = queueIndex;
+
+	for (;;)
+	{
+		Job* pJob = this->pop(queueIndex);
+		if (pJob)
+		{
+			this->execute(pJob, queueIndex);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(this->sleepMutex);
+		this->sleepCondition.wait(lock, [this]() { return this->exiting || this->pendingCount > 0; });
+		if (this->exiting)
+			return;
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+//  work-stealing job scheduler for engine-side CPU tasks (e.g. command recording).
+//  every worker owns a deque : it pushes & pops its own jobs at the back, idle workers steal at the front.
+//  a job runs once all its dependencies are done. threads waiting on a job execute pending jobs meanwhile.
+//  jobs are recycled and queues are fixed rings, so scheduling doesn't allocate once warm
+//  (as long as the function's captures fit std::function's local storage).
+//  Cauldron's loaders (textures, pipelines) still take an AsyncPool.
+class JobSystem
+{
+public:
+
+    struct Job;
+
+    //  reference to a job, which is recycled once no handle is left
+    class Handle
+    {
+    public:
+        Handle() = default;
+        Handle(const Handle& other);
+        Handle(Handle&& other) noexcept;
+        Handle& operator=(Handle other);
+        ~Handle();
+
+        explicit operator bool() const { return this->pJob != nullptr; }
+
+    private:
+        friend class JobSystem;
+        explicit Handle(Job* pJob); // takes a reference
+        Job* pJob = nullptr;
+    };
+
+    //  utilization of a worker over the last window (see updateStats)
+    struct WorkerStats
+    {
+        float    utilization = 0; // busy time / window
+        uint32_t jobCount = 0;
+        uint32_t stealCount = 0;
+    };
+
+    //  workerCount = 0 : one per hardware thread, but the caller's
+    void OnCreate(uint32_t workerCount = 0);
+    void OnDestroy();
+
+    //  run function once the dependencies are done (null handles are ignored)
+    JobSystem::Handle schedule(std::function<void()> function,
+        const JobSystem::Handle* pDependencies = nullptr, uint32_t dependencyCount = 0);
+    bool isDone(const JobSystem::Handle& job) const;
+    //  execute pending jobs until the job is done
+    void wait(const JobSystem::Handle& job);
+
+    //  function(begin, end) over [0, count) in ranges of up to grainSize, returns when all ranges are done
+    void parallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& function);
+
+    uint32_t getWorkerCount() const
+    { return (uint32_t)this->workers.size(); }
+
+    //  call once a frame : closes the measurement window once it is over a second long
+    void updateStats();
+    const std::vector<JobSystem::WorkerStats>& getWorkerStats() const
+    { return this->workerStats; }
+
+private:
+
+    //  fixed ring of jobs, each holding a reference
+    struct Queue
+    {
+        std::mutex            mutex;
+        std::vector<Job*>     ring;
+        uint32_t              head = 0, tail = 0; // pop front at head, push back at tail
+
+        //  counters since the beginning of the window, written by the threads executing the jobs
+        std::atomic<uint64_t> busyMicroseconds{ 0 };
+        std::atomic<uint32_t> jobCount{ 0 };
+        std::atomic<uint32_t> stealCount{ 0 };
+    };
+
+    //  one per worker thread, the last is shared by the other threads (e.g. the main thread)
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::atomic<uint32_t> pendingCount{ 0 };
+    std::mutex            sleepMutex;
+    std::condition_variable sleepCondition;
+    bool                  exiting = false;
+
+    //  job pool
+    std::mutex            poolMutex;
+    std::vector<Job*>     jobs; // all of them, deleted by OnDestroy
+    std::vector<Job*>     freeJobs;
+
+    std::vector<JobSystem::WorkerStats> workerStats;
+    double                windowStart = 0;
+
+    Job* allocJob();
+    static void release(Job* pJob);
+
+    uint32_t getQueueIndex() const;
+    void push(Job* pJob);
+    Job* pop(uint32_t queueIndex);
+    void execute(Job* pJob, uint32_t queueIndex);
+    void workerLoop(uint32_t queueIndex);
+};
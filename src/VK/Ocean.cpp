@@ -19,7 +19,7 @@ void Ocean::OnCreate(
 
 	// upload textures
     constexpr uint32_t fileStart = 1;
-    constexpr uint32_t fileEnd = 20;
+    constexpr uint32_t fileEnd = fileStart + Ocean::PhaseCount - 1;
     bool res = m_normalMapArray.InitFromSeries(
         pDevice,
         pUploadHeap,
@@ -98,12 +98,21 @@ void Ocean::OnDestroy()
 
 void Ocean::Draw(VkCommandBuffer cmdBuf, const Ocean::Constants& constants, uint32_t iter, int32_t rsmLightIndex)
 {
-    SetPerfMarkerBegin(cmdBuf, "Ocean");
+    Draw(cmdBuf, SetConstants(constants), iter, rsmLightIndex);
+}
 
+VkDescriptorBufferInfo Ocean::SetConstants(const Ocean::Constants& constants)
+{
     Ocean::Constants* cbPerDraw;
     VkDescriptorBufferInfo constantBuffer;
     m_pDynamicBufferRing->AllocConstantBuffer(sizeof(Ocean::Constants), (void**)&cbPerDraw, &constantBuffer);
     *cbPerDraw = constants;
+    return constantBuffer;
+}
+
+void Ocean::Draw(VkCommandBuffer cmdBuf, const VkDescriptorBufferInfo& constantBuffer, uint32_t iter, int32_t rsmLightIndex)
+{
+    SetPerfMarkerBegin(cmdBuf, "Ocean");
 
     // Bind Descriptor sets
     const uint32_t numUniformOffsets = 1;
@@ -125,6 +134,97 @@ void Ocean::Draw(VkCommandBuffer cmdBuf, const Ocean::Constants& constants, uint
     SetPerfMarkerEnd(cmdBuf);
 }
 
+VkRect2D Ocean::Constants::calculateScreenBounds(uint32_t width, uint32_t height, uint32_t padding) const
+{
+    VkRect2D fullScreen{ { 0, 0 }, { width, height } };
+
+    //  must match 'positionList' in Ocean-vert.glsl
+    static const XMVECTOR corners[4] = {
+        XMVectorSet(-1, 0, -1, 1),
+        XMVectorSet(-1, 0, 1, 1),
+        XMVectorSet(1, 0, 1, 1),
+        XMVectorSet(1, 0, -1, 1)
+    };
+
+    float minX = 1.f, minY = 1.f, maxX = -1.f, maxY = -1.f;
+    for (const XMVECTOR& corner : corners)
+    {
+        XMVECTOR clipPos = XMVector4Transform(XMVector4Transform(corner, this->currWorld), this->currViewProj);
+        const float w = XMVectorGetW(clipPos);
+        if (w <= 0.f)
+            return fullScreen; // crossing near plane, be conservative
+
+        const float x = XMVectorGetX(clipPos) / w, y = XMVectorGetY(clipPos) / w;
+        minX = min(minX, x); maxX = max(maxX, x);
+        minY = min(minY, y); maxY = max(maxY, y);
+    }
+
+    //  clamp to NDC then map to framebuffer coord. (y is flipped by the viewport)
+    minX = max(minX, -1.f); maxX = min(maxX, 1.f);
+    minY = max(minY, -1.f); maxY = min(maxY, 1.f);
+    if (minX >= maxX || minY >= maxY)
+        return VkRect2D{ { 0, 0 }, { 0, 0 } }; // off-screen
+
+    //  padded, so that pixels rasterized on the edges are kept whatever the rounding / sub-pixel offsets
+    const int32_t pad = (int32_t)padding;
+    const int32_t left = max((int32_t)floorf((minX * 0.5f + 0.5f) * width) - pad, 0);
+    const int32_t right = min((int32_t)ceilf((maxX * 0.5f + 0.5f) * width) + pad, (int32_t)width);
+    const int32_t top = max((int32_t)floorf((0.5f - maxY * 0.5f) * height) - pad, 0);
+    const int32_t bottom = min((int32_t)ceilf((0.5f - minY * 0.5f) * height) + pad, (int32_t)height);
+
+    VkRect2D bounds;
+    bounds.offset = { left, top };
+    bounds.extent = { (uint32_t)(right - left), (uint32_t)(bottom - top) };
+    return bounds;
+}
+
+bool Ocean::Constants::calculateLightProjection(const XMMATRIX& lightView, const XMMATRIX& lightProj, bool perspective,
+    float nearPlane, float farPlane, XMMATRIX* pFittedProj) const
+{
+    //  must match 'positionList' in Ocean-vert.glsl
+    static const XMVECTOR corners[4] = {
+        XMVectorSet(-1, 0, -1, 1),
+        XMVectorSet(-1, 0, 1, 1),
+        XMVectorSet(1, 0, 1, 1),
+        XMVectorSet(1, 0, -1, 1)
+    };
+
+    //  bounds on the near plane (perspective) or in view space (orthographic)
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    for (const XMVECTOR& corner : corners)
+    {
+        XMVECTOR viewPos = XMVector4Transform(XMVector4Transform(corner, this->currWorld), lightView);
+        float x = XMVectorGetX(viewPos), y = XMVectorGetY(viewPos);
+        if (perspective)
+        {
+            const float depth = -XMVectorGetZ(viewPos);
+            if (depth <= nearPlane)
+                return false; // crossing near plane
+            x *= nearPlane / depth;
+            y *= nearPlane / depth;
+        }
+        minX = min(minX, x); maxX = max(maxX, x);
+        minY = min(minY, y); maxY = max(maxY, y);
+    }
+
+    //  clip to the original frustum
+    float extentX = 1.f / XMVectorGetX(lightProj.r[0]), extentY = 1.f / XMVectorGetY(lightProj.r[1]);
+    if (perspective)
+    {
+        extentX *= nearPlane;
+        extentY *= nearPlane;
+    }
+    minX = max(minX, -extentX); maxX = min(maxX, extentX);
+    minY = max(minY, -extentY); maxY = min(maxY, extentY);
+    if (minX >= maxX || minY >= maxY)
+        return false; // out of the light
+
+    *pFittedProj = perspective ?
+        XMMatrixPerspectiveOffCenterRH(minX, maxX, minY, maxY, nearPlane, farPlane) :
+        XMMatrixOrthographicOffCenterRH(minX, maxX, minY, maxY, nearPlane, farPlane);
+    return true;
+}
+
 void Ocean::createDescriptors(DefineList& defines)
 {
 	const uint32_t bindingCount = 2;
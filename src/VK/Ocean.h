@@ -3,6 +3,9 @@
 class Ocean
 {
 public:
+    //  number of normal map slices, the animation loops over them
+    static constexpr uint32_t PhaseCount = 20;
+
     struct Constants
     {
         XMMATRIX currWorld;
@@ -29,6 +32,16 @@ public:
 
             return world;
         }
+
+        //  screen-space bounds of the surface under currWorld/currViewProj, grown by padding pixels on each side
+        //  (the surface is flat, the waves are in its normal maps : no vertex displacement to account for).
+        //  falls back to full screen if the surface crosses the near plane
+        VkRect2D calculateScreenBounds(uint32_t width, uint32_t height, uint32_t padding) const;
+
+        //  light projection fitted to the surface under currWorld, seen from lightView,
+        //  and clipped to lightProj (symmetric). false if the surface crosses the near plane or is out of lightProj.
+        bool calculateLightProjection(const XMMATRIX& lightView, const XMMATRIX& lightProj, bool perspective,
+            float nearPlane, float farPlane, XMMATRIX* pFittedProj) const;
     };
 
     void OnCreate(
@@ -43,6 +56,10 @@ public:
     void OnDestroy();
     void Draw(VkCommandBuffer cmdBuf, const Ocean::Constants& constants, uint32_t iter, int32_t rsmLightIndex = -1);
 
+    //  split version, for a draw recorded on another thread : the constants are allocated beforehand
+    VkDescriptorBufferInfo SetConstants(const Ocean::Constants& constants);
+    void Draw(VkCommandBuffer cmdBuf, const VkDescriptorBufferInfo& constantBuffer, uint32_t iter, int32_t rsmLightIndex = -1);
+
 protected:
     Device* m_pDevice{ nullptr };
     ResourceViewHeaps* m_pResourceViewHeaps{ nullptr };
@@ -159,35 +159,40 @@ vec3 getSpotLightFlux(Light light, vec3 pointToLight)
 }
 
 // shadowmap filtering
+// 5x5 bilinear PCF taps cover 6x6 texels with separable weights (1-f, 1, 1, 1, 1, f),
+// so the same result is gathered from 3x3 textureGather footprints of 2x2 texels.
 float FilterShadow(vec3 uv)
 {
     float shadow = 0.0;
 #ifdef ID_shadowMap
-    ivec2 texDim = textureSize(u_shadowMap, 0);
-    float scale = 1.0;
-    float dx = scale * 1.0 / float(texDim.x);
-    float dy = scale * 1.0 / float(texDim.y);
-
-    int kernelLevel = 2;
-    int kernelWidth = 2 * kernelLevel + 1;
-    for (int i = -kernelLevel; i <= kernelLevel; i++)
-    {
-        for (int j = -kernelLevel; j <= kernelLevel; j++)
-        {
-            float visibility = texture(u_shadowMap, uv + vec3(dx * i, dy * j, 0)).r;
-            uint isOpaque = texture(u_opacityMap, uv.xy + vec2(dx * i, dy * j)).r;
+    vec2 texDim = vec2(textureSize(u_shadowMap, 0));
+
+    //  bilinear footprint of the center tap, in texel space
+    vec2 st = uv.xy * texDim - 0.5;
+    vec2 base = floor(st);
+    vec2 f = st - base;
 
-            //if (visibility == 0 && isOpaque == 0)
-            //{
-            //    float decay = 0.99f; // ToDo : decay = alpha (fetched from rsm-Flux)
-            //    visibility = texture(u_shadowMapBase, uv + vec3(dx * i, dy * j, 0)).r * (1.0f - decay);
-            //}
+    //  weights of the 6 texels (base - 2 .. base + 3) per axis
+    float wx[6] = { 1.0 - f.x, 1.0, 1.0, 1.0, 1.0, f.x };
+    float wy[6] = { 1.0 - f.y, 1.0, 1.0, 1.0, 1.0, f.y };
 
-            shadow += visibility;
+    for (int j = 0; j < 3; j++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            //  shared corner of texels (base - 2 + 2i, base - 1 + 2i), same along y
+            vec2 corner = base + vec2(2 * i - 1, 2 * j - 1);
+            vec4 visibility = textureGather(u_shadowMap, corner / texDim, uv.z);
+
+            //  gathered as (x0, y1), (x1, y1), (x1, y0), (x0, y0)
+            int x0 = 2 * i, y0 = 2 * j;
+            shadow += dot(visibility, vec4(
+                wx[x0] * wy[y0 + 1], wx[x0 + 1] * wy[y0 + 1],
+                wx[x0 + 1] * wy[y0], wx[x0] * wy[y0]));
         }
     }
 
-    shadow /= (kernelWidth * kernelWidth);
+    shadow /= 25.0;
 #endif
     return shadow;
 }
@@ -241,6 +246,19 @@ float DoSpotShadow(vec3 vPosition, Light light)
 #endif
 }
 
+//  visibility of the shaded pixel from the light
+float getShadow(vec3 worldPos, Light light)
+{
+#ifdef ID_shadowMask
+    //  already filtered by the shadow mask pass (see ShadowMask)
+    if (light.shadowMapIndex < 0 || light.shadowMapIndex >= 4)
+        return 1.0f;
+    return texelFetch(u_shadowMask, ivec2(gl_FragCoord.xy), 0)[light.shadowMapIndex];
+#else
+    return DoSpotShadow(worldPos, light);
+#endif
+}
+
 //  this function does closely to what GLTFPBRLighting.h::doPbrLighting(VS2PS Input, ...) do
 vec3 doPbrLighting(vec3 worldPos, vec3 normal, vec3 diffuseColor, vec3 specularColor, float perceptualRoughness)
 {
@@ -282,7 +300,7 @@ vec3 doPbrLighting(vec3 worldPos, vec3 normal, vec3 diffuseColor, vec3 specularC
         {
             vec3 pointToLight = light.direction;
             vec3 shade = getPointShade(pointToLight, materialInfo, normal, view);
-            float shadow = DoSpotShadow(worldPos, light);
+            float shadow = getShadow(worldPos, light);
             intensity += getDirectionalLightFlux(light) * shade * shadow;
         }
         else if (light.type == LightType_Point)
@@ -295,7 +313,7 @@ vec3 doPbrLighting(vec3 worldPos, vec3 normal, vec3 diffuseColor, vec3 specularC
         {
             vec3 pointToLight = light.position - worldPos;
             vec3 shade = getPointShade(pointToLight, materialInfo, normal, view);
-            float shadow = DoSpotShadow(worldPos, light);
+            float shadow = getShadow(worldPos, light);
             intensity += getSpotLightFlux(light, pointToLight) * shade * shadow;
         }
     }
@@ -0,0 +1,132 @@
+#include "ParallelRecorder.h"
+
+void ParallelRecorder::OnCreate(Device* pDevice, JobSystem* pJobSystem, uint32_t backBufferCount, uint32_t sectionsPerFrame)
+{
+	this->pDevice = pDevice;
+	this->pJobSystem = pJobSystem;
+	this->backBufferCount = backBufferCount;
+	this->sectionsPerFrame = sectionsPerFrame;
+
+	const uint32_t slotCount = backBufferCount * sectionsPerFrame;
+	this->commandPools.resize(slotCount);
+	this->commandBuffers.resize(slotCount);
+
+	for (uint32_t i = 0; i < slotCount; i++)
+	{
+		VkCommandPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = pDevice->GetGraphicsQueueFamilyIndex();
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		VkResult res = vkCreateCommandPool(pDevice->GetDevice(), &poolInfo, NULL, &this->commandPools[i]);
+		assert(res == VK_SUCCESS);
+
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = this->commandPools[i];
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		res = vkAllocateCommandBuffers(pDevice->GetDevice(), &allocInfo, &this->commandBuffers[i]);
+		assert(res == VK_SUCCESS);
+	}
+
+	this->submitOrder.reserve(2 * sectionsPerFrame + 1);
+	this->submitted.reserve(2 * sectionsPerFrame + 1);
+	this->pendingSections.resize(sectionsPerFrame);
+	this->pendingTimes.resize(sectionsPerFrame);
+	this->recordTimes.reserve(sectionsPerFrame);
+	this->jobs.reserve(sectionsPerFrame);
+}
+
+void ParallelRecorder::OnDestroy()
+{
+	for (const JobSystem::Handle& job : this->jobs)
+		this->pJobSystem->wait(job);
+	this->jobs.clear();
+
+	for (uint32_t i = 0; i < this->commandPools.size(); i++)
+	{
+		vkFreeCommandBuffers(this->pDevice->GetDevice(), this->commandPools[i], 1, &this->commandBuffers[i]);
+		vkDestroyCommandPool(this->pDevice->GetDevice(), this->commandPools[i], NULL);
+	}
+	this->commandPools.clear();
+	this->commandBuffers.clear();
+}
+
+void ParallelRecorder::OnBeginFrame()
+{
+	this->frameIndex = (this->frameIndex + 1) % this->backBufferCount;
+	this->sectionCount = 0;
+
+	//	the command buffers of this back buffer were executed (see CommandListRing)
+	for (uint32_t i = 0; i < this->sectionsPerFrame; i++)
+	{
+		VkResult res = vkResetCommandPool(this->pDevice->GetDevice(),
+			this->commandPools[this->frameIndex * this->sectionsPerFrame + i], 0);
+		assert(res == VK_SUCCESS);
+	}
+}
+
+void ParallelRecorder::queue(VkCommandBuffer cmdBuf)
+{
+	this->submitOrder.push_back(cmdBuf);
+}
+
+void ParallelRecorder::record(const std::vector<Section>& sections, bool parallel)
+{
+	assert(this->sectionCount + sections.size() <= this->sectionsPerFrame);
+
+	for (const Section& section : sections)
+	{
+		//	slots are filled before the job starts, so that jobs don't touch shared containers
+		const uint32_t slot = this->sectionCount++;
+		this->pendingSections[slot] = section;
+		this->submitOrder.push_back(this->commandBuffers[this->frameIndex * this->sectionsPerFrame + slot]);
+
+		if (parallel)
+			this->jobs.push_back(this->pJobSystem->schedule([this, slot]() { this->recordSection(slot); }));
+		else
+			this->recordSection(slot);
+	}
+}
+
+void ParallelRecorder::recordSection(uint32_t slot)
+{
+	const double start = MillisecondsNow();
+
+	const Section& section = this->pendingSections[slot];
+	VkCommandBuffer cmdBuf = this->commandBuffers[this->frameIndex * this->sectionsPerFrame + slot];
+
+	VkCommandBufferBeginInfo cmd_buf_info;
+	cmd_buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cmd_buf_info.pNext = NULL;
+	cmd_buf_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	cmd_buf_info.pInheritanceInfo = NULL;
+	VkResult res = vkBeginCommandBuffer(cmdBuf, &cmd_buf_info);
+	assert(res == VK_SUCCESS);
+
+	section.record(cmdBuf, section.pContext);
+
+	res = vkEndCommandBuffer(cmdBuf);
+	assert(res == VK_SUCCESS);
+
+	this->pendingTimes[slot] = { section.name, MillisecondsNow() - start };
+}
+
+void ParallelRecorder::wait()
+{
+	//	the main thread helps recording meanwhile
+	for (const JobSystem::Handle& job : this->jobs)
+		this->pJobSystem->wait(job);
+	this->jobs.clear();
+}
+
+const std::vector<VkCommandBuffer>& ParallelRecorder::finish()
+{
+	this->wait();
+
+	this->recordTimes.assign(this->pendingTimes.begin(), this->pendingTimes.begin() + this->sectionCount);
+
+	this->submitted.swap(this->submitOrder);
+	this->submitOrder.clear();
+	return this->submitted;
+}
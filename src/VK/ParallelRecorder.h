@@ -0,0 +1,77 @@
+#pragma once
+
+#include "JobSystem.h"
+#include "FrameArena.h"
+
+//  records independent sections of a frame (e.g. the opaque G-buffer & RSM passes) concurrently on worker threads.
+//  every section gets its own primary command buffer, from a command pool per section slot & back buffer
+//  (pools are externally synchronized), and is submitted in the order it was queued among the main thread's ones.
+//  sections must not allocate from shared per-frame rings (constant buffers, time stamps) : prepare those beforehand.
+class ParallelRecorder
+{
+public:
+
+    struct Section
+    {
+        const char* name;
+        void (*record)(VkCommandBuffer cmdBuf, void* pContext);
+        void* pContext;
+
+        //  the closure is copied into the frame arena (no heap allocation)
+        template<class F>
+        static Section make(const char* name, FrameArena* pArena, const F& function)
+        {
+            return { name, [](VkCommandBuffer cmdBuf, void* pContext) { (*(F*)pContext)(cmdBuf); },
+                pArena->create<F>(function) };
+        }
+    };
+
+    //  CPU time spent recording a section, last frame
+    struct RecordTime
+    {
+        const char* name;
+        double      milliseconds;
+    };
+
+    void OnCreate(Device* pDevice, JobSystem* pJobSystem, uint32_t backBufferCount, uint32_t sectionsPerFrame);
+    void OnDestroy();
+
+    //  call along CommandListRing::OnBeginFrame
+    void OnBeginFrame();
+
+    //  queue a command buffer recorded (and ended) by the main thread
+    void queue(VkCommandBuffer cmdBuf);
+    //  queue the sections, recorded on worker threads if parallel, inline otherwise
+    void record(const std::vector<Section>& sections, bool parallel);
+
+    //  wait for the sections queued so far (e.g. before changing what they read while recording)
+    void wait();
+    //  wait for the sections of the frame, then return every command buffer queued in submission order
+    const std::vector<VkCommandBuffer>& finish();
+
+    const std::vector<RecordTime>& getRecordTimes() const
+    { return this->recordTimes; }
+
+private:
+
+    Device*               pDevice = nullptr;
+    JobSystem*            pJobSystem = nullptr;
+
+    //  per back buffer, per section slot
+    std::vector<VkCommandPool>   commandPools;
+    std::vector<VkCommandBuffer> commandBuffers;
+    uint32_t              backBufferCount = 0;
+    uint32_t              sectionsPerFrame = 0;
+    uint32_t              frameIndex = 0;
+    uint32_t              sectionCount = 0; // this frame
+
+    //  sections of this frame, by slot
+    std::vector<Section>         pendingSections;
+    std::vector<RecordTime>      recordTimes, pendingTimes;
+
+    std::vector<VkCommandBuffer> submitOrder, submitted;
+
+    void recordSection(uint32_t slot);
+
+    std::vector<JobSystem::Handle> jobs; // this frame
+};
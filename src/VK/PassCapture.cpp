@@ -0,0 +1,757 @@
+#include "PassCapture.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <sstream>
+
+//	the capture is written this many frames after its readback was recorded,
+//	which must be larger than the number of frames in flight.
+static const uint32_t captureLatency = 4;
+
+//	replayed frames not measured : time stamps lag behind the frames in flight,
+//	and caches (light segments, denoiser history) settle first.
+static const uint32_t replayWarmupFrames = 16;
+
+static const char* replayUploadLabel = "Replay: Upload";
+
+static const uint32_t captureMagic = 0x50415242; // "BRAP"
+static const uint32_t captureVersion = 2;
+
+//	file : header, image records, settings, then the pixels of every image (tightly packed, in record order)
+struct CaptureHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t pass;
+	uint32_t imageCount;
+	uint32_t width, height; // window extent
+	uint32_t settingsSize;
+	uint32_t settingsVersion; // of the pass's settings, see PassCapture::capture
+};
+
+struct CaptureImage
+{
+	uint32_t width, height;
+	uint32_t bytesPerTexel;
+	uint32_t aspect;
+};
+
+static VkDeviceSize getImageSize(const CaptureImage& image)
+{
+	return (VkDeviceSize)image.width * image.height * image.bytesPerTexel;
+}
+
+//	depth-stencil images are transitioned as a whole, even though only their depth is copied
+static VkImageAspectFlags getBarrierAspect(VkImageAspectFlags aspect)
+{
+	return (aspect & VK_IMAGE_ASPECT_DEPTH_BIT) ? (VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT) : aspect;
+}
+
+//	color formats copied by shaders, in the order of PassCapture's readers & writers
+struct TexelFormat
+{
+	VkFormat format;
+	uint32_t bytesPerTexel;
+	const char* define;
+};
+
+static const TexelFormat texelFormats[PASS_CAPTURE_FORMAT_COUNT] = {
+	{ VK_FORMAT_R16G16B16A16_SFLOAT, 8, "FORMAT_RGBA16F" },
+	{ VK_FORMAT_R16G16B16A16_UNORM, 8, "FORMAT_RGBA16_UNORM" },
+	{ VK_FORMAT_R8G8B8A8_UNORM, 4, "FORMAT_RGBA8_UNORM" },
+	{ VK_FORMAT_R16G16_SFLOAT, 4, "FORMAT_RG16F" },
+};
+
+static uint32_t findTexelFormat(VkFormat format)
+{
+	uint32_t i = 0;
+	while (i < PASS_CAPTURE_FORMAT_COUNT && texelFormats[i].format != format)
+		i++;
+	assert(i < PASS_CAPTURE_FORMAT_COUNT);
+	return i;
+}
+
+static bool isCopiedByShaders(const PassCapture::Image& image)
+{
+	return image.aspect == VK_IMAGE_ASPECT_COLOR_BIT;
+}
+
+//	of the copied aspect (the depth of depth-stencil images is d32)
+static uint32_t getBytesPerTexel(const PassCapture::Image& image)
+{
+	return isCopiedByShaders(image) ? texelFormats[findTexelFormat(image.format)].bytesPerTexel : 4;
+}
+
+//	see PassCaptureRead.glsl
+struct ReaderPushConstants
+{
+	uint32_t base;
+	uint32_t width;
+	uint32_t height;
+};
+
+//	see PassCaptureWrite.glsl
+struct WriterConstants
+{
+	uint32_t base;
+	uint32_t width;
+};
+
+void PassCapture::OnCreate(Device* pDevice, ResourceViewHeaps* pResourceViewHeaps, DynamicBufferRing* pDynamicBufferRing)
+{
+	this->pDevice = pDevice;
+	this->pResourceViewHeaps = pResourceViewHeaps;
+	this->pDynamicBufferRing = pDynamicBufferRing;
+
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(pDevice->GetPhysicalDevice(), &props);
+	this->stagingAlignment = props.limits.minStorageBufferOffsetAlignment;
+
+	//  create sampler (texel fetches only)
+	this->sampler = CreateSampler(pDevice->GetDevice(), false);
+
+	//	reader : 0. image, 1. texels
+	DefineList defines;
+	{
+		std::vector<VkDescriptorSetLayoutBinding> layoutBindings(2);
+		layoutBindings[0].binding = 0;
+		layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		layoutBindings[0].descriptorCount = 1;
+		layoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		layoutBindings[0].pImmutableSamplers = NULL;
+		defines["ID_Source"] = std::to_string(0);
+
+		layoutBindings[1].binding = 1;
+		layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layoutBindings[1].descriptorCount = 1;
+		layoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		layoutBindings[1].pImmutableSamplers = NULL;
+		defines["ID_Texels"] = std::to_string(1);
+
+		this->pResourceViewHeaps->CreateDescriptorSetLayout(&layoutBindings, &this->readerLayout);
+	}
+
+	//	writer : 0. constants, 1. texels
+	DefineList writerDefines;
+	{
+		std::vector<VkDescriptorSetLayoutBinding> layoutBindings(2);
+		layoutBindings[0].binding = 0;
+		layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		layoutBindings[0].descriptorCount = 1;
+		layoutBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		layoutBindings[0].pImmutableSamplers = NULL;
+		writerDefines["ID_Params"] = std::to_string(0);
+
+		layoutBindings[1].binding = 1;
+		layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layoutBindings[1].descriptorCount = 1;
+		layoutBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		layoutBindings[1].pImmutableSamplers = NULL;
+		writerDefines["ID_Texels"] = std::to_string(1);
+
+		this->pResourceViewHeaps->CreateDescriptorSetLayout(&layoutBindings, &this->writerLayout);
+	}
+
+	for (uint32_t i = 0; i < PASS_CAPTURE_FORMAT_COUNT; i++)
+	{
+		DefineList formatDefines = defines;
+		formatDefines[texelFormats[i].define] = "1";
+		formatDefines["TEXEL_WORDS"] = std::to_string(texelFormats[i].bytesPerTexel / 4);
+		this->readers[i].OnCreate(this->pDevice, "PassCaptureRead.glsl", "main", "", this->readerLayout,
+			0, 0, 0, &formatDefines, sizeof(ReaderPushConstants));
+
+		//	the whole image is written, and read by the pass next
+		VkAttachmentDescription att_desc[1];
+		AttachBlending(
+			texelFormats[i].format,
+			(VkSampleCountFlagBits)1,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			&att_desc[0]);
+		this->writerRenderPasses[i] = CreateRenderPassOptimal(this->pDevice->GetDevice(), 1, att_desc, nullptr);
+
+		DefineList formatWriterDefines = writerDefines;
+		formatWriterDefines[texelFormats[i].define] = "1";
+		formatWriterDefines["TEXEL_WORDS"] = std::to_string(texelFormats[i].bytesPerTexel / 4);
+		this->writers[i].OnCreate(
+			this->pDevice, this->writerRenderPasses[i],
+			"PassCaptureWrite.glsl", "main", "", nullptr,
+			this->pDynamicBufferRing, this->writerLayout,
+			0, VK_SAMPLE_COUNT_1_BIT, &formatWriterDefines
+		);
+	}
+}
+
+void PassCapture::OnDestroy()
+{
+	this->destroyImageCopies();
+	this->destroyStaging();
+
+	for (uint32_t i = 0; i < PASS_CAPTURE_FORMAT_COUNT; i++)
+	{
+		this->readers[i].OnDestroy();
+		this->writers[i].OnDestroy();
+		vkDestroyRenderPass(this->pDevice->GetDevice(), this->writerRenderPasses[i], nullptr);
+		this->writerRenderPasses[i] = VK_NULL_HANDLE;
+	}
+
+	vkDestroyDescriptorSetLayout(this->pDevice->GetDevice(), this->readerLayout, nullptr);
+	vkDestroyDescriptorSetLayout(this->pDevice->GetDevice(), this->writerLayout, nullptr);
+	vkDestroySampler(this->pDevice->GetDevice(), this->sampler, nullptr);
+}
+
+void PassCapture::createStaging(VkDeviceSize size)
+{
+	this->destroyStaging();
+
+	VkBufferCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	info.size = size;
+	info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	VkResult res = vkCreateBuffer(this->pDevice->GetDevice(), &info, NULL, &this->staging);
+	assert(res == VK_SUCCESS);
+
+	VkMemoryRequirements memReqs;
+	vkGetBufferMemoryRequirements(this->pDevice->GetDevice(), this->staging, &memReqs);
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = memReqs.size;
+	VkPhysicalDeviceMemoryProperties memProps = this->pDevice->GetPhysicalDeviceMemoryProperties();
+	bool pass = memory_type_from_properties(memProps, memReqs.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&allocInfo.memoryTypeIndex);
+	assert(pass);
+
+	res = vkAllocateMemory(this->pDevice->GetDevice(), &allocInfo, NULL, &this->stagingMemory);
+	assert(res == VK_SUCCESS);
+	res = vkBindBufferMemory(this->pDevice->GetDevice(), this->staging, this->stagingMemory, 0);
+	assert(res == VK_SUCCESS);
+
+	this->stagingSize = size;
+}
+
+void PassCapture::destroyStaging()
+{
+	if (this->staging == VK_NULL_HANDLE)
+		return;
+
+	vkDestroyBuffer(this->pDevice->GetDevice(), this->staging, nullptr);
+	this->staging = VK_NULL_HANDLE;
+	vkFreeMemory(this->pDevice->GetDevice(), this->stagingMemory, nullptr);
+	this->stagingMemory = VK_NULL_HANDLE;
+	this->stagingSize = 0;
+}
+
+void PassCapture::createImageCopies(const std::vector<Image>& images, bool bReplay)
+{
+	this->destroyImageCopies();
+	this->imageCopies.resize(images.size());
+
+	VkDeviceSize offset = 0;
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		const Image& image = images[i];
+		const VkDeviceSize size = (VkDeviceSize)image.pTexture->GetWidth() * image.pTexture->GetHeight() * getBytesPerTexel(image);
+		ImageCopy& copy = this->imageCopies[i];
+		copy.image = image.pTexture->Resource();
+
+		if (isCopiedByShaders(image))
+		{
+			//	only the image's range is bound, from an aligned offset (whole captures may exceed the max. range)
+			const VkDeviceSize rangeOffset = offset - offset % this->stagingAlignment;
+			copy.base = (uint32_t)((offset - rangeOffset) / 4);
+
+			this->pResourceViewHeaps->AllocDescriptor(bReplay ? this->writerLayout : this->readerLayout, &copy.descriptorSet);
+			if (bReplay)
+				this->pDynamicBufferRing->SetDescriptorSet(0, sizeof(WriterConstants), copy.descriptorSet);
+			else
+				SetDescriptorSet(this->pDevice->GetDevice(), 0, image.srv, &this->sampler, copy.descriptorSet);
+
+			VkDescriptorBufferInfo bufferInfo = { this->staging, rangeOffset, offset + size - rangeOffset };
+			VkWriteDescriptorSet write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+			write.pNext = NULL;
+			write.dstSet = copy.descriptorSet;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.pBufferInfo = &bufferInfo;
+			write.dstBinding = 1;
+			write.dstArrayElement = 0;
+			vkUpdateDescriptorSets(this->pDevice->GetDevice(), 1, &write, 0, NULL);
+
+			if (bReplay)
+			{
+				image.pTexture->CreateRTV(&copy.rtv, 0);
+				std::vector<VkImageView> attachments = { copy.rtv };
+				copy.framebuffer = CreateFrameBuffer(
+					this->pDevice->GetDevice(),
+					this->writerRenderPasses[findTexelFormat(image.format)],
+					&attachments,
+					image.pTexture->GetWidth(), image.pTexture->GetHeight()
+				);
+			}
+		}
+
+		offset += size;
+	}
+}
+
+void PassCapture::destroyImageCopies()
+{
+	for (ImageCopy& copy : this->imageCopies)
+	{
+		if (copy.descriptorSet != VK_NULL_HANDLE)
+			this->pResourceViewHeaps->FreeDescriptor(copy.descriptorSet);
+		if (copy.framebuffer != VK_NULL_HANDLE)
+			vkDestroyFramebuffer(this->pDevice->GetDevice(), copy.framebuffer, nullptr);
+		if (copy.rtv != VK_NULL_HANDLE)
+			vkDestroyImageView(this->pDevice->GetDevice(), copy.rtv, nullptr);
+	}
+	this->imageCopies.clear();
+}
+
+void PassCapture::requestCapture(PassCapture::Pass pass, const char* path)
+{
+	//	one capture at a time, and none while replaying (staging buffer is shared)
+	if (this->captureFrame != UINT32_MAX || this->isReplaying())
+		return;
+
+	this->capturePass = pass;
+	this->capturePath = path;
+}
+
+void PassCapture::capture(VkCommandBuffer cmdBuf, const std::vector<Image>& images, const void* pSettings, uint32_t settingsSize, uint32_t settingsVersion)
+{
+	//	header + records, the settings follow
+	CaptureHeader header = {};
+	header.magic = captureMagic;
+	header.version = captureVersion;
+	header.pass = (uint32_t)this->capturePass;
+	header.imageCount = (uint32_t)images.size();
+	header.width = this->width;
+	header.height = this->height;
+	header.settingsSize = settingsSize;
+	header.settingsVersion = settingsVersion;
+
+	this->captureHeader.resize(sizeof(CaptureHeader) + images.size() * sizeof(CaptureImage) + settingsSize);
+	char* pHeader = this->captureHeader.data();
+	memcpy(pHeader, &header, sizeof(CaptureHeader));
+
+	VkDeviceSize totalSize = 0;
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		CaptureImage record;
+		record.width = images[i].pTexture->GetWidth();
+		record.height = images[i].pTexture->GetHeight();
+		record.bytesPerTexel = getBytesPerTexel(images[i]);
+		record.aspect = images[i].aspect;
+		memcpy(pHeader + sizeof(CaptureHeader) + i * sizeof(CaptureImage), &record, sizeof(CaptureImage));
+
+		totalSize += getImageSize(record);
+	}
+	memcpy(pHeader + sizeof(CaptureHeader) + images.size() * sizeof(CaptureImage), pSettings, settingsSize);
+
+	this->createStaging(totalSize);
+	this->createImageCopies(images, false);
+
+	//	depth : transitioned for the copy
+	//
+	std::vector<VkImageMemoryBarrier> barriers;
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		if (isCopiedByShaders(images[i]))
+			continue;
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.pNext = NULL;
+		barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.oldLayout = images[i].layout;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange.aspectMask = getBarrierAspect(images[i].aspect);
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.image = images[i].pTexture->Resource();
+		barriers.push_back(barrier);
+	}
+
+	//	color : the writes of its passes made visible to the readers
+	VkMemoryBarrier memoryBarrier = {};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &memoryBarrier, 0, NULL,
+		(uint32_t)barriers.size(), barriers.data());
+
+	//	mip 0 of every input, one after another.
+	//	color is sampled as the pass reads it (already in the layout for it), depth is copied.
+	VkDeviceSize offset = 0;
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		const uint32_t width = images[i].pTexture->GetWidth(), height = images[i].pTexture->GetHeight();
+		if (isCopiedByShaders(images[i]))
+		{
+			ReaderPushConstants pushConst = { this->imageCopies[i].base, width, height };
+			this->readers[findTexelFormat(images[i].format)].Draw(cmdBuf, nullptr, this->imageCopies[i].descriptorSet,
+				(width + 8 - 1) / 8, (height + 8 - 1) / 8, 1, &pushConst);
+		}
+		else
+		{
+			VkBufferImageCopy region = {};
+			region.bufferOffset = offset;
+			region.imageSubresource.aspectMask = images[i].aspect;
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent = { width, height, 1 };
+			vkCmdCopyImageToBuffer(cmdBuf, images[i].pTexture->Resource(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, this->staging, 1, &region);
+		}
+
+		offset += (VkDeviceSize)width * height * getBytesPerTexel(images[i]);
+	}
+
+	//	depth back to be read by the pass
+	//
+	for (VkImageMemoryBarrier& barrier : barriers)
+	{
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		std::swap(barrier.oldLayout, barrier.newLayout);
+	}
+
+	VkBufferMemoryBarrier bufferBarrier = {};
+	bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.buffer = this->staging;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0, 0, NULL, 1, &bufferBarrier,
+		(uint32_t)barriers.size(), barriers.data());
+
+	this->captureFrame = this->frameIdx;
+}
+
+void PassCapture::writeCapture()
+{
+	void* pData = nullptr;
+	VkResult res = vkMapMemory(this->pDevice->GetDevice(), this->stagingMemory, 0, VK_WHOLE_SIZE, 0, &pData);
+	assert(res == VK_SUCCESS);
+
+	std::ofstream file(this->capturePath, std::ios::binary);
+	if (file)
+	{
+		file.write(this->captureHeader.data(), this->captureHeader.size());
+		file.write((const char*)pData, this->stagingSize);
+	}
+
+	vkUnmapMemory(this->pDevice->GetDevice(), this->stagingMemory);
+
+	std::stringstream msg;
+	if (file)
+		msg << "Pass capture : " << this->capturePath << " (" << (this->captureHeader.size() + this->stagingSize) / (1024.f * 1024.f) << " MB)\n";
+	else
+		msg << "Pass capture : cannot write " << this->capturePath << "\n";
+	Trace(msg.str());
+
+	this->destroyImageCopies();
+	this->destroyStaging();
+	this->captureHeader.clear();
+	this->capturePass = PassCapture::Pass::Count;
+	this->captureFrame = UINT32_MAX;
+}
+
+bool PassCapture::readFileInfo(const char* path, PassCapture::Pass* pPass, uint32_t* pWidth, uint32_t* pHeight)
+{
+	std::ifstream file(path, std::ios::binary);
+	CaptureHeader header;
+	if (!file.read((char*)&header, sizeof(CaptureHeader)))
+		return false;
+	if (header.magic != captureMagic || header.version != captureVersion || header.pass >= (uint32_t)PassCapture::Pass::Count)
+		return false;
+
+	*pPass = (PassCapture::Pass)header.pass;
+	*pWidth = header.width;
+	*pHeight = header.height;
+	return true;
+}
+
+bool PassCapture::startReplay(const char* path, uint32_t frameCount)
+{
+	if (this->captureFrame != UINT32_MAX || frameCount == 0)
+		return false;
+
+	std::ifstream file(path, std::ios::binary);
+	CaptureHeader header;
+	if (!file.read((char*)&header, sizeof(CaptureHeader)))
+		return false;
+	if (header.magic != captureMagic || header.version != captureVersion || header.pass >= (uint32_t)PassCapture::Pass::Count)
+		return false;
+
+	std::vector<CaptureImage> records(header.imageCount);
+	if (!file.read((char*)records.data(), records.size() * sizeof(CaptureImage)))
+		return false;
+
+	this->replaySettings.resize(header.settingsSize);
+	if (!file.read(this->replaySettings.data(), header.settingsSize))
+		return false;
+	this->replaySettingsVersion = header.settingsVersion;
+
+	VkDeviceSize totalSize = 0;
+	this->replayExtents.clear();
+	for (const CaptureImage& record : records)
+	{
+		this->replayExtents.push_back(record.width);
+		this->replayExtents.push_back(record.height);
+		totalSize += getImageSize(record);
+	}
+
+	//	pixels straight into the staging buffer, uploaded from there every frame
+	this->createStaging(totalSize);
+
+	void* pData = nullptr;
+	VkResult res = vkMapMemory(this->pDevice->GetDevice(), this->stagingMemory, 0, VK_WHOLE_SIZE, 0, &pData);
+	assert(res == VK_SUCCESS);
+	const bool complete = (bool)file.read((char*)pData, totalSize);
+	vkUnmapMemory(this->pDevice->GetDevice(), this->stagingMemory);
+
+	if (!complete)
+	{
+		this->destroyStaging();
+		return false;
+	}
+
+	this->replayPass = (PassCapture::Pass)header.pass;
+	this->replayFrameCount = frameCount;
+	this->replayFrame = 0;
+	this->replayTimes.clear();
+	this->replayTotal = 0;
+	this->replayMin = DBL_MAX;
+	this->replayMax = 0;
+	this->replayMeasured = 0;
+	return true;
+}
+
+void PassCapture::stopReplay()
+{
+	//	the last replayed frames may still be in flight
+	this->pDevice->GPUFlush();
+	this->destroyImageCopies();
+	this->destroyStaging();
+	this->replaySettings.clear();
+	this->replaySettingsVersion = 0;
+	this->replayExtents.clear();
+	this->replayPass = PassCapture::Pass::Count;
+	this->replayFrameCount = 0;
+}
+
+bool PassCapture::getReplaySettings(void* pSettings, uint32_t settingsSize, uint32_t settingsVersion) const
+{
+	//	settings of another build (e.g. constants grew or were reordered) aren't replayed
+	if (this->replaySettings.size() != settingsSize || this->replaySettingsVersion != settingsVersion)
+		return false;
+
+	memcpy(pSettings, this->replaySettings.data(), settingsSize);
+	return true;
+}
+
+void PassCapture::upload(VkCommandBuffer cmdBuf, const std::vector<Image>& images)
+{
+	//	inputs must match the capture (same pass & window extent)
+	bool match = (images.size() * 2 == this->replayExtents.size());
+	for (size_t i = 0; match && i < images.size(); i++)
+	{
+		match = images[i].pTexture->GetWidth() == this->replayExtents[i * 2]
+			&& images[i].pTexture->GetHeight() == this->replayExtents[i * 2 + 1];
+	}
+	assert(match);
+
+	//	descriptors & framebuffers over the images, again if these were recreated
+	bool current = (this->imageCopies.size() == images.size());
+	for (size_t i = 0; current && i < images.size(); i++)
+		current = this->imageCopies[i].image == images[i].pTexture->Resource();
+	if (match && !current)
+		this->createImageCopies(images, true);
+
+	//	contents are overwritten : previous ones are discarded.
+	//	color is rendered to, depth is copied into.
+	//
+	std::vector<VkImageMemoryBarrier> barriers(images.size());
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		const bool bShaders = isCopiedByShaders(images[i]);
+
+		VkImageMemoryBarrier& barrier = barriers[i];
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.pNext = NULL;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.dstAccessMask = bShaders ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = bShaders ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange.aspectMask = getBarrierAspect(images[i].aspect);
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.image = images[i].pTexture->Resource();
+	}
+
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		0, 0, NULL, 0, NULL,
+		(uint32_t)barriers.size(), barriers.data());
+
+	VkDeviceSize offset = 0;
+	for (size_t i = 0; match && i < images.size(); i++)
+	{
+		const uint32_t width = images[i].pTexture->GetWidth(), height = images[i].pTexture->GetHeight();
+		if (isCopiedByShaders(images[i]))
+		{
+			//	the render pass leaves it in the layout the pass reads it
+			assert(images[i].layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			const uint32_t format = findTexelFormat(images[i].format);
+
+			VkDescriptorBufferInfo descInfo_constants;
+			{
+				WriterConstants* pAllocData;
+				this->pDynamicBufferRing->AllocConstantBuffer(sizeof(WriterConstants), (void**)&pAllocData, &descInfo_constants);
+				pAllocData->base = this->imageCopies[i].base;
+				pAllocData->width = width;
+			}
+
+			VkRenderPassBeginInfo rp_begin{};
+			rp_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			rp_begin.pNext = NULL;
+			rp_begin.renderPass = this->writerRenderPasses[format];
+			rp_begin.framebuffer = this->imageCopies[i].framebuffer;
+			rp_begin.renderArea.offset = { 0, 0 };
+			rp_begin.renderArea.extent = { width, height };
+			rp_begin.clearValueCount = 0;
+			rp_begin.pClearValues = NULL;
+			vkCmdBeginRenderPass(cmdBuf, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
+
+			SetViewportAndScissor(cmdBuf, 0, 0, width, height);
+			this->writers[format].Draw(cmdBuf, &descInfo_constants, this->imageCopies[i].descriptorSet);
+
+			vkCmdEndRenderPass(cmdBuf);
+		}
+		else
+		{
+			VkBufferImageCopy region = {};
+			region.bufferOffset = offset;
+			region.imageSubresource.aspectMask = images[i].aspect;
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent = { width, height, 1 };
+			vkCmdCopyBufferToImage(cmdBuf, this->staging, images[i].pTexture->Resource(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		}
+
+		offset += (VkDeviceSize)width * height * getBytesPerTexel(images[i]);
+	}
+
+	//	depth into the layout the pass reads it, color is waited for (the render pass did its transition)
+	//
+	std::vector<VkImageMemoryBarrier> depthBarriers;
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		if (isCopiedByShaders(images[i]))
+			continue;
+
+		VkImageMemoryBarrier barrier = barriers[i];
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = images[i].layout;
+		depthBarriers.push_back(barrier);
+	}
+
+	VkMemoryBarrier memoryBarrier = {};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		0, 1, &memoryBarrier, 0, NULL,
+		(uint32_t)depthBarriers.size(), depthBarriers.data());
+}
+
+void PassCapture::beginPass(VkCommandBuffer cmdBuf, GPUTimestamps* pGPUTimeStamps)
+{
+	pGPUTimeStamps->GetTimeStamp(cmdBuf, replayUploadLabel);
+}
+
+void PassCapture::update(const std::vector<TimeStamp>& timeStamps)
+{
+	this->frameIdx++;
+
+	//	wait until the command buffer which recorded the readback has surely completed
+	if (this->captureFrame != UINT32_MAX && this->frameIdx - this->captureFrame >= captureLatency)
+		this->writeCapture();
+
+	if (!this->isReplaying())
+		return;
+
+	if (this->replayFrame++ < replayWarmupFrames)
+		return;
+
+	//	every time stamp holds the time since the previous one : sum up those after the upload
+	double total = 0;
+	bool afterUpload = false;
+	for (const TimeStamp& timeStamp : timeStamps)
+	{
+		if (afterUpload)
+		{
+			auto it = std::find_if(this->replayTimes.begin(), this->replayTimes.end(),
+				[&timeStamp](const std::pair<std::string, double>& entry) { return entry.first == timeStamp.m_label; });
+			if (it == this->replayTimes.end())
+				it = this->replayTimes.insert(this->replayTimes.end(), { timeStamp.m_label, 0.0 });
+			it->second += timeStamp.m_microseconds;
+
+			total += timeStamp.m_microseconds;
+		}
+		if (timeStamp.m_label == replayUploadLabel)
+			afterUpload = true;
+	}
+	if (!afterUpload)
+		return;
+
+	this->replayTotal += total;
+	this->replayMin = std::min(this->replayMin, total);
+	this->replayMax = std::max(this->replayMax, total);
+
+	if (++this->replayMeasured == this->replayFrameCount)
+	{
+		this->reportReplay();
+		this->stopReplay();
+	}
+}
+
+void PassCapture::reportReplay()
+{
+	static const char* passNames[] = { "Caustics", "Fresnel" };
+
+	std::stringstream msg;
+	msg << "Pass replay [" << passNames[(uint32_t)this->replayPass] << "] : "
+		<< this->replayTotal / this->replayMeasured << " us (min " << this->replayMin << ", max " << this->replayMax << ", "
+		<< this->replayMeasured << " frames)\n";
+	for (const std::pair<std::string, double>& entry : this->replayTimes)
+		msg << "  " << entry.first << " : " << entry.second / this->replayMeasured << " us\n";
+	Trace(msg.str());
+}
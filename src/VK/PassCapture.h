@@ -0,0 +1,133 @@
+#pragma once
+
+//  color formats copied by shaders (see PassCaptureRead.glsl & PassCaptureWrite.glsl)
+#define PASS_CAPTURE_FORMAT_COUNT 4
+
+//  pass-level capture & replay, to benchmark a pass (caustics, Fresnel) in isolation.
+//  - capture : the input images and settings of the pass in one frame are read back, then saved into a binary file.
+//  - replay : the file is uploaded back into the same images every frame, and only the pass runs.
+//    the time stamps recorded after the upload are averaged over the replayed frames.
+//  images keep the extent & format they were captured with (same window size).
+//  color images are copied by shaders : sampled to capture, rendered to to replay, as the G-buffer targets allow.
+//  depth images are copied by transfers, and must allow them (source to capture, destination to replay).
+class PassCapture
+{
+public:
+
+    enum class Pass : uint32_t
+    {
+        Caustics,
+        Fresnel,
+        Count
+    };
+
+    //  an input image of the pass, in the layout the pass reads it
+    //  (shader read-only for color images)
+    struct Image
+    {
+        Texture*           pTexture;
+        VkImageView        srv;    // sampled to capture color images
+        VkFormat           format;
+        VkImageAspectFlags aspect; // copied aspect, the depth of depth-stencil images only
+        VkImageLayout      layout;
+    };
+
+    void OnCreate(Device* pDevice, ResourceViewHeaps* pResourceViewHeaps, DynamicBufferRing* pDynamicBufferRing);
+    void OnDestroy();
+
+    //  capture
+    //
+    void requestCapture(PassCapture::Pass pass, const char* path);
+    bool isCaptureRequested(PassCapture::Pass pass) const
+    { return this->capturePass == pass && this->captureFrame == UINT32_MAX; }
+
+    //  record the readback of the pass's inputs, right before it runs.
+    //  the settings are saved raw : settingsVersion is the caller's layout version of them.
+    void capture(VkCommandBuffer cmdBuf, const std::vector<Image>& images, const void* pSettings, uint32_t settingsSize, uint32_t settingsVersion);
+
+    //  replay
+    //
+    bool startReplay(const char* path, uint32_t frameCount);
+    void stopReplay();
+    bool isReplaying() const { return this->replayFrameCount > 0; }
+    PassCapture::Pass getReplayPass() const { return this->replayPass; }
+    //  false unless saved with the same size & version
+    bool getReplaySettings(void* pSettings, uint32_t settingsSize, uint32_t settingsVersion) const;
+
+    //  record the upload of the captured inputs
+    void upload(VkCommandBuffer cmdBuf, const std::vector<Image>& images);
+    //  record the time stamp the replayed pass is timed from (after anything derived from the inputs, e.g. mipmaps)
+    void beginPass(VkCommandBuffer cmdBuf, GPUTimestamps* pGPUTimeStamps);
+
+    //  call once a frame with the latest time stamps :
+    //  writes the pending capture, and accumulates (then reports) the replayed frames.
+    void update(const std::vector<TimeStamp>& timeStamps);
+
+    //  read the pass & window extent of a capture file (e.g. to size the window before replaying it)
+    static bool readFileInfo(const char* path, PassCapture::Pass* pPass, uint32_t* pWidth, uint32_t* pHeight);
+
+    //  window extent of the frame being captured
+    void setExtent(uint32_t width, uint32_t height) { this->width = width; this->height = height; }
+
+private:
+
+    Device*               pDevice = nullptr;
+    ResourceViewHeaps*    pResourceViewHeaps = nullptr;
+    DynamicBufferRing*    pDynamicBufferRing = nullptr;
+    uint32_t              width = 0, height = 0;
+    uint32_t              frameIdx = 0;
+
+    //  host-visible staging buffer, for either a capture or a replay
+    VkBuffer              staging = VK_NULL_HANDLE;
+    VkDeviceMemory        stagingMemory = VK_NULL_HANDLE;
+    VkDeviceSize          stagingSize = 0;
+    VkDeviceSize          stagingAlignment = 1; // of the storage buffer ranges
+
+    void createStaging(VkDeviceSize size);
+    void destroyStaging();
+
+    //  copies of color images, a reader (image -> staging buffer) & a writer (staging buffer -> image) per format
+    VkSampler             sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout readerLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout writerLayout = VK_NULL_HANDLE;
+    PostProcCS            readers[PASS_CAPTURE_FORMAT_COUNT];
+    VkRenderPass          writerRenderPasses[PASS_CAPTURE_FORMAT_COUNT] = {};
+    PostProcPS            writers[PASS_CAPTURE_FORMAT_COUNT];
+
+    //  descriptor set (& framebuffer to replay) of each color image being copied
+    struct ImageCopy
+    {
+        VkImage           image = VK_NULL_HANDLE;
+        VkDescriptorSet   descriptorSet = VK_NULL_HANDLE;
+        VkImageView       rtv = VK_NULL_HANDLE;
+        VkFramebuffer     framebuffer = VK_NULL_HANDLE;
+        uint32_t          base = 0; // first word of the image in the descriptor's range
+    };
+    std::vector<ImageCopy> imageCopies;
+
+    void createImageCopies(const std::vector<Image>& images, bool bReplay);
+    void destroyImageCopies();
+
+    //  capture
+    PassCapture::Pass     capturePass = PassCapture::Pass::Count;
+    std::string           capturePath;
+    uint32_t              captureFrame = UINT32_MAX; // frame the readback was recorded in
+    std::vector<char>     captureHeader; // file header + image records, the pixels follow from the staging buffer
+
+    void writeCapture();
+
+    //  replay
+    PassCapture::Pass     replayPass = PassCapture::Pass::Count;
+    std::vector<char>     replaySettings;
+    uint32_t              replaySettingsVersion = 0;
+    std::vector<uint32_t> replayExtents; // width, height per image
+    uint32_t              replayFrameCount = 0;
+    uint32_t              replayFrame = 0;
+
+    //  time of every label after the upload, summed over the measured frames
+    std::vector<std::pair<std::string, double>> replayTimes;
+    double                replayTotal = 0, replayMin = 0, replayMax = 0;
+    uint32_t              replayMeasured = 0;
+
+    void reportReplay();
+};
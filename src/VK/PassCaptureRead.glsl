@@ -0,0 +1,58 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_ARB_compute_shader  : enable
+
+//--------------------------------------------------------------------------------------
+//  CS workgroup definition
+//--------------------------------------------------------------------------------------
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+//--------------------------------------------------------------------------------------
+//  uniform data
+//  set 0 : input data
+//--------------------------------------------------------------------------------------
+
+layout (push_constant) uniform pushConstants
+{
+    layout (offset = 0) uint u_base; // first word of the image in the bound range
+    layout (offset = 4) uint u_width;
+    layout (offset = 8) uint u_height;
+};
+
+layout (binding = ID_Source) uniform sampler2D u_source;
+
+//  texels laid out as a buffer-image copy would (tightly packed rows, components in order),
+//  TEXEL_WORDS words each
+layout (std430, binding = ID_Texels) writeonly buffer Texels
+{
+    uint texels[];
+};
+
+//--------------------------------------------------------------------------------------
+//  main function
+//--------------------------------------------------------------------------------------
+
+void main()
+{
+    const uvec2 pixel = gl_GlobalInvocationID.xy;
+    if (pixel.x >= u_width || pixel.y >= u_height)
+        return;
+
+    //  the packing rounds the sampled values back to the bits they were read from
+    const vec4 texel = texelFetch(u_source, ivec2(pixel), 0);
+    const uint index = u_base + (pixel.y * u_width + pixel.x) * TEXEL_WORDS;
+#if defined(FORMAT_RGBA16F)
+    texels[index] = packHalf2x16(texel.xy);
+    texels[index + 1] = packHalf2x16(texel.zw);
+#elif defined(FORMAT_RGBA16_UNORM)
+    texels[index] = packUnorm2x16(texel.xy);
+    texels[index + 1] = packUnorm2x16(texel.zw);
+#elif defined(FORMAT_RGBA8_UNORM)
+    texels[index] = packUnorm4x8(texel);
+#elif defined(FORMAT_RG16F)
+    texels[index] = packHalf2x16(texel.xy);
+#endif
+}
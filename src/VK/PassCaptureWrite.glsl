@@ -0,0 +1,37 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+precision highp float;
+
+layout (location = 0) in vec2 inTexCoord;
+
+layout (std140, binding = ID_Params) uniform Params
+{
+    uint u_base; // first word of the image in the bound range
+    uint u_width;
+};
+
+//  texels as PassCaptureRead.glsl wrote them, TEXEL_WORDS words each
+layout (std430, binding = ID_Texels) readonly buffer Texels
+{
+    uint texels[];
+};
+
+layout (location = 0) out vec4 out_color;
+
+void main()
+{
+    const uvec2 pixel = uvec2(gl_FragCoord.xy);
+    const uint index = u_base + (pixel.y * u_width + pixel.x) * TEXEL_WORDS;
+#if defined(FORMAT_RGBA16F)
+    out_color = vec4(unpackHalf2x16(texels[index]), unpackHalf2x16(texels[index + 1]));
+#elif defined(FORMAT_RGBA16_UNORM)
+    out_color = vec4(unpackUnorm2x16(texels[index]), unpackUnorm2x16(texels[index + 1]));
+#elif defined(FORMAT_RGBA8_UNORM)
+    out_color = unpackUnorm4x8(texels[index]);
+#elif defined(FORMAT_RG16F)
+    out_color = vec4(unpackHalf2x16(texels[index]), 0.0f, 0.0f);
+#endif
+}
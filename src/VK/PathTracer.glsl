@@ -4,6 +4,11 @@
 #extension GL_ARB_shading_language_420pack : enable
 #extension GL_ARB_compute_shader  : enable
 
+#ifdef PERSISTENT_THREADS
+#extension GL_KHR_shader_subgroup_basic : enable
+#extension GL_KHR_shader_subgroup_ballot : enable
+#endif
+
 //--------------------------------------------------------------------------------------
 //  CS workgroup definition
 //--------------------------------------------------------------------------------------
@@ -30,6 +35,9 @@ struct SSRParams
     float IOR;
     float rayThickness;
     float tMax;
+
+    //  the view covers this many texels of the G-buffer, from its top-left corner
+    ivec2 viewExtent;
 };
 layout (std140, binding = ID_Params) uniform Params 
 {
@@ -44,21 +52,34 @@ layout (binding = ID_GBufSpecular) uniform sampler2D u_gbufSpecular;
 
 layout (binding = ID_GBufDepth_0) uniform sampler2D u_gbufDepth0;
 layout (binding = ID_GBufDepth_1toN) uniform sampler2D u_gbufDepth1N;
+//  view coordinate -> G-buffer coordinate
+vec2 toGBufCoord(vec2 coord)
+{
+    return coord * vec2(u_params.viewExtent) / vec2(textureSize(u_gbufDepth0, 0));
+}
 float fetchGBufDepth(vec2 coord, int mipLevel)
 {
+    coord = toGBufCoord(coord);
     return mipLevel == 0 ? texture(u_gbufDepth0, coord).r :
         textureLod(u_gbufDepth1N, coord, float(mipLevel - 1)).r;
 }
 ivec2 getGBufDepthSize(int mipLevel)
 {
-    return mipLevel == 0 ? textureSize(u_gbufDepth0, 0) :
-        textureSize(u_gbufDepth1N, mipLevel - 1);
+    return max(u_params.viewExtent >> mipLevel, ivec2(1));
 }
 
 layout (binding = ID_BackColor) uniform sampler2D u_backColor;
 
 layout (rgba16f, binding = ID_Target) uniform image2D img_target;
 
+#ifdef PERSISTENT_THREADS
+//  persistent threads : next sampling point to trace, over all the blocks (reset every frame)
+layout (std430, binding = ID_QueueHead) buffer QueueHead
+{
+    uint io_queueHead;
+};
+#endif
+
 //--------------------------------------------------------------------------------------
 //  main function
 //--------------------------------------------------------------------------------------
@@ -74,38 +95,24 @@ ivec2 getRSMDepthSize(int mipLevel)
 
 const float epsilon = 1e-4;
 
-vec2 sampleNoise()
+vec2 sampleNoise(uvec2 localID)
 {
-    const int offset_x[4] = {1, 0, -1, 0};
-    const int offset_y[4] = {0, -1, 0, 1};
-
-    vec2 coord = gl_LocalInvocationID.xy + 0.5f;
-
-    const int seed_x = int(mod(seed, 4));
-    coord.x += offset_x[seed_x];
-    coord.y += offset_y[seed_x];
-    const float noise_x = texture(u_samplingMap, coord).r;
-
-    const int seed_y = int(mod(seed_x + 1, 4));
-    coord.x += offset_x[seed_y];
-    coord.y += offset_y[seed_y];
-    const float noise_y = texture(u_samplingMap, coord).g;
-
-    return (seed / 4 < 1) ? vec2(noise_x, noise_y) : vec2(noise_y, noise_x);
+    //  the seed's slice of the spatiotemporal sequence (see SamplingSequence)
+    const vec2 coord = localID + vec2(0, seed * int(gl_WorkGroupSize.y)) + 0.5f;
+    return texture(u_samplingMap, coord).rg;
 }
 
-//  retrieve the sample point from RSM and construct ray payload
-int retrieveSample(out vec3 origin, out vec3 direction, out vec2 texCoord)
+//  retrieve the sample point of a block's thread from the G-buffer and construct ray payload
+int retrieveSample(ivec2 blockID, uvec2 localID, out vec3 origin, out vec3 direction, out vec2 texCoord)
 {
     //  retrieve sampling coordinate (texture space, not normalized yet)
-    const vec2 localSamplingCoord = sampleNoise();
-    const vec2 samplingCoord = (localSamplingCoord + gl_WorkGroupID.xy) * ivec2(gl_WorkGroupSize.xy * u_params.samplingMapScale);
-    const ivec2 gbufDim = textureSize(u_gbufSpecular, 0);
-    if (samplingCoord.x >= gbufDim.x || samplingCoord.y >= gbufDim.y)
+    const vec2 localSamplingCoord = sampleNoise(localID);
+    const vec2 samplingCoord = (localSamplingCoord + blockID) * ivec2(gl_WorkGroupSize.xy * u_params.samplingMapScale);
+    if (samplingCoord.x >= u_params.viewExtent.x || samplingCoord.y >= u_params.viewExtent.y)
         return 1; // out-of-bound coordinate
 
-    //  normalize coordinate
-    const vec2 normSamplingCoord = samplingCoord / uvec2(gbufDim.x, gbufDim.y);
+    //  normalize coordinate (G-buffer space)
+    const vec2 normSamplingCoord = samplingCoord / vec2(textureSize(u_gbufSpecular, 0));
 
     //  sample ray payload
     const vec3 worldPos = texture(u_gbufWorldCoord, normSamplingCoord).rgb;
@@ -167,21 +174,64 @@ vec4 trace(vec3 origin, vec3 direction)
             t, hitCoord);
     
     //  sampling color from the last hit coordinate
-    const vec3 color = bHit ? texture(u_backColor, hitCoord).rgb : vec3(0);
+    const vec3 color = bHit ? texture(u_backColor, toGBufCoord(hitCoord)).rgb : vec3(0);
 
     return vec4(color, 1);
 }
 
-void main()
+void traceSample(ivec2 blockID, uvec2 localID)
 {
     //  get the sampling point first
     vec3 origin;
     vec3 direction;
     vec2 texCoord;
-    if (retrieveSample(origin, direction, texCoord) != 0)
+    if (retrieveSample(blockID, localID, origin, direction, texCoord) != 0)
         return;
 
     //  trace through depth map
     vec4 color = trace(origin, direction);
     imageStore(img_target, ivec2(texCoord * textureSize(u_gbufSpecular, 0)), color);
-}
\ No newline at end of file
+}
+
+#ifdef PERSISTENT_THREADS
+
+//  a fixed number of workgroups (enough to fill the GPU) pull the sampling points
+//  one subgroup-wide batch at a time, until all the blocks are traced.
+//  the lanes of rough or off-view samples move on to the next batch,
+//  instead of idling until their workgroup's longest march completes.
+void main()
+{
+    const ivec2 blockDim = ivec2(gl_WorkGroupSize.xy * u_params.samplingMapScale);
+    const ivec2 numBlocks = (u_params.viewExtent + blockDim - 1) / blockDim;
+    const uint blockSize = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+    const uint sampleCount = blockSize * uint(numBlocks.x * numBlocks.y);
+
+    for (;;)
+    {
+        uint queueBase = 0;
+        if (subgroupElect())
+            queueBase = atomicAdd(io_queueHead, gl_SubgroupSize);
+        queueBase = subgroupBroadcastFirst(queueBase);
+        if (queueBase >= sampleCount)
+            break; // uniform in the subgroup
+
+        //  the block & thread it would have run on (same sampling points as the per-block dispatch)
+        const uint sampleIdx = queueBase + gl_SubgroupInvocationID;
+        if (sampleIdx < sampleCount)
+        {
+            const uint blockIdx = sampleIdx / blockSize, threadIdx = sampleIdx % blockSize;
+            const ivec2 blockID = ivec2(blockIdx % uint(numBlocks.x), blockIdx / uint(numBlocks.x));
+            const uvec2 localID = uvec2(threadIdx % gl_WorkGroupSize.x, threadIdx / gl_WorkGroupSize.x);
+            traceSample(blockID, localID);
+        }
+    }
+}
+
+#else
+
+void main()
+{
+    traceSample(ivec2(gl_WorkGroupID.xy), gl_LocalInvocationID.xy);
+}
+
+#endif // PERSISTENT_THREADS
@@ -3,6 +3,11 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 #extension GL_ARB_compute_shader  : enable
+#if defined(PERSISTENT_THREADS) || defined(TRACE_STATS)
+#extension GL_KHR_shader_subgroup_basic : enable
+#extension GL_KHR_shader_subgroup_arithmetic : enable
+#extension GL_KHR_shader_subgroup_ballot : enable
+#endif
 
 //--------------------------------------------------------------------------------------
 //  CS workgroup definition
@@ -18,6 +23,16 @@ layout (local_size_x = 16, local_size_y = 16) in;
 layout (push_constant) uniform pushConstants
 {
     layout (offset = 0) int seed;
+    layout (offset = 4) int phase; // ocean phase, PHASE_CACHE only
+
+    //  amortization : only every blockStride-th emission block is traced in this dispatch,
+    //  starting from blockOffset. (1, 1) and (0, 0) when tracing them all.
+    layout (offset = 8) ivec2 blockStride;
+    layout (offset = 16) ivec2 blockOffset;
+
+    //  density feedback : each emission block traces as many photons as its caustics needed
+    //  on screen the last time it was traced (see DensityFeedback). 0 when tracing them all.
+    layout (offset = 24) int densityFeedback;
 };
 
 const int rsmLightIndex = 0;
@@ -33,6 +48,14 @@ struct CausticsParams
     float IOR;
     float rayThickness;
     float tMax;
+
+    //  RSM quarter the photons are emitted from, either rsmLightIndex
+    //  or a water-fitted one, rendered without the opaque geometry (see Renderer)
+    int emissionLightIndex;
+    int padding;
+
+    //  the view covers this many texels of the G-buffer, from its top-left corner
+    ivec2 viewExtent;
 };
 layout (std140, binding = ID_Params) uniform Params 
 {
@@ -71,15 +94,20 @@ ivec2 getRSMDepthSize(int mipLevel)
 
 layout (binding = ID_GBufDepth_0) uniform sampler2D u_gbufDepth0;
 layout (binding = ID_GBufDepth_1toN) uniform sampler2D u_gbufDepth1N;
+//  view coordinate -> G-buffer coordinate
+vec2 toGBufCoord(vec2 coord)
+{
+    return coord * vec2(u_params.viewExtent) / vec2(textureSize(u_gbufDepth0, 0));
+}
 float fetchGBufDepth(vec2 coord, int mipLevel)
 {
+    coord = toGBufCoord(coord);
     return mipLevel == 0 ? texture(u_gbufDepth0, coord).r :
         textureLod(u_gbufDepth1N, coord, float(mipLevel - 1)).r;
 }
 ivec2 getGBufDepthSize(int mipLevel)
 {
-    return mipLevel == 0 ? textureSize(u_gbufDepth0, 0) :
-        textureSize(u_gbufDepth1N, mipLevel - 1);
+    return max(u_params.viewExtent >> mipLevel, ivec2(1));
 }
 
 layout (binding = ID_GBufNormal) uniform sampler2D u_gbufNormal;
@@ -89,6 +117,60 @@ layout (std140, binding = ID_HitPosIrradiance) buffer HitPositionAndPackedIrradi
     vec4 out_hitPos_irradiance[];
 };
 
+//  ray parameter where each photon leaves the RSM, one slice (SEGMENT_SLICE_SIZE) per sampling seed.
+//  it does not depend on the camera, so the light-space stage (LIGHT_SPACE_STAGE) writes it
+//  only when the light or the RSM changes, and the camera-space stage reads it every frame.
+//  the fused tracer (FUSED_STAGES) marches the RSM itself, and leaves it untouched.
+layout (std430, binding = ID_LightSegment) buffer LightSegment
+{
+    float io_lightSegmentT[];
+};
+
+//  photons which hit in light space, compacted per ocean phase (PHASE_CACHE_CAPACITY each).
+//  xyz : world position, w : oct. direction (unorm8 x2) + power (f16), see packPhoton()
+//  with static light & receivers, the water animation loops, so does its caustics.
+//  each phase is filled once (PHASE_CACHE + LIGHT_SPACE_STAGE), then reprojected every frame (PHASE_CACHE).
+layout (std430, binding = ID_PhaseCache) buffer PhaseCache
+{
+    vec4 io_phaseCache[];
+};
+layout (std430, binding = ID_PhaseCacheCount) buffer PhaseCacheCount
+{
+    uint io_phaseCacheCount[];
+};
+
+//  photons to trace per emission block (DENSITY_MIN_PHOTONS to all of them).
+//  the camera-space stage reads its block's count, then writes the one for the next time
+//  from where its visible photons landed on screen.
+layout (std430, binding = ID_DensityFeedback) buffer DensityFeedback
+{
+    uint io_densityFeedback[];
+};
+
+//  persistent threads : emission indices of the photons still alive after the light-space stage,
+//  compacted by RAY_COMPACTION, then pulled in batches by the camera-space stage (PERSISTENT_THREADS).
+layout (std430, binding = ID_RayQueue) buffer RayQueue
+{
+    uint io_rayQueue[];
+};
+
+//  the head doubles as the indirect draw of the photon map (VkDrawIndirectCommand),
+//  so that only the queued photons are splatted.
+layout (std430, binding = ID_RayQueueHeader) buffer RayQueueHeader
+{
+    uint io_queuedCount;    // vertexCount
+    uint io_instanceCount;
+    uint io_firstVertex;
+    uint io_firstInstance;
+
+    uint io_queueHead;      // next queued photon to trace
+
+    //  SIMD utilization (TRACE_STATS) : traversal steps of all the lanes,
+    //  and the ones the subgroups spent waiting for their slowest lane
+    uint io_laneSteps;
+    uint io_subgroupSteps;
+};
+
 //--------------------------------------------------------------------------------------
 //  main function
 //--------------------------------------------------------------------------------------
@@ -101,32 +183,39 @@ const float epsilon = 1e-4;
 //const float fluxAmplifier = 2.5f; // for cornell box
 const float fluxAmplifier = 7.f; // for sponza
 
-vec2 sampleNoise()
+vec2 sampleNoise(uvec2 localID)
 {
-    const int offset_x[4] = {1, 0, -1, 0};
-    const int offset_y[4] = {0, -1, 0, 1};
-
-    vec2 coord = gl_LocalInvocationID.xy + 0.5f;
-
-    const int seed_x = int(mod(seed, 4));
-    coord.x += offset_x[seed_x];
-    coord.y += offset_y[seed_x];
-    const float noise_x = texture(u_samplingMap, coord).r;
+    //  the seed's slice of the spatiotemporal sequence (see SamplingSequence)
+    const vec2 coord = localID + vec2(0, seed * int(gl_WorkGroupSize.y)) + 0.5f;
+    return texture(u_samplingMap, coord).rg;
+}
 
-    const int seed_y = int(mod(seed_x + 1, 4));
-    coord.x += offset_x[seed_y];
-    coord.y += offset_y[seed_y];
-    const float noise_y = texture(u_samplingMap, coord).g;
+//  check if the point is hidden from the light by the opaque geometry of the RSM
+bool isOccludedFromLight(vec3 worldPos)
+{
+    const TransformParams light = u_params.lights[rsmLightIndex];
+    const vec4 clipPos = constructProjMatrix(light.invTanHalfFovH, light.invTanHalfFovV, light.nearPlane, light.farPlane) * 
+                            light.view * vec4(worldPos, 1.0f);
+    const vec3 ndcPos = clipPos.xyz / clipPos.w;
+    const vec2 coord = ndcPos.xy * vec2(0.5f, -0.5f) + 0.5f;
+    if (clipPos.w <= 0 || any(lessThan(coord, vec2(0))) || any(greaterThan(coord, vec2(1))))
+        return true; // out of the light's frustum
+
+    return fetchRSMDepth(coord, 0) < ndcPos.z - epsilon;
+}
 
-    return (seed / 4 < 1) ? vec2(noise_x, noise_y) : vec2(noise_y, noise_x);
+//  emission block (in the full grid) traced by this workgroup
+ivec2 getBlockID()
+{
+    return ivec2(gl_WorkGroupID.xy) * blockStride + blockOffset;
 }
 
-//  retrieve the sample point from RSM and construct ray payload
-int retrieveSample(out vec3 origin, out vec3 direction, out vec3 power)
+//  retrieve the sample point of the given thread of an emission block from RSM and construct ray payload
+int retrieveSample(ivec2 blockID, uvec2 localID, out vec3 origin, out vec3 direction, out vec3 power)
 {
     //  retrieve sampling coordinate (texture space, not normalized yet)
-    const vec2 localSamplingCoord = sampleNoise();
-    const vec2 samplingCoord = (localSamplingCoord + gl_WorkGroupID.xy) * ivec2(gl_WorkGroupSize.xy * u_params.samplingMapScale);
+    const vec2 localSamplingCoord = sampleNoise(localID);
+    const vec2 samplingCoord = (localSamplingCoord + blockID) * ivec2(gl_WorkGroupSize.xy * u_params.samplingMapScale);
     const ivec2 rsmDim = textureSize(u_rsmFlux, 0) / 2; // shadow map in 4 quarters 
     if (samplingCoord.x >= rsmDim.x || samplingCoord.y >= rsmDim.y)
         return 1; // out-of-bound coordinate
@@ -141,7 +230,8 @@ int retrieveSample(out vec3 origin, out vec3 direction, out vec3 power)
     // offsets of the center of the shadow map atlas
     const float offsetsX[4] = { 0.0, 0.5, 0.0, 0.5 };
     const float offsetsY[4] = { 0.0, 0.0, 0.5, 0.5 };
-    normSamplingCoord += vec2(offsetsX[rsmLightIndex], offsetsY[rsmLightIndex]);
+    const int emissionLightIndex = u_params.emissionLightIndex;
+    normSamplingCoord += vec2(offsetsX[emissionLightIndex], offsetsY[emissionLightIndex]);
 
     const vec3 worldPos = texture(u_rsmWorldCoord, normSamplingCoord).rgb;
     const vec3 normal = texture(u_rsmNormal, normSamplingCoord).rgb * 2.0f - 1.0f;
@@ -156,6 +246,10 @@ int retrieveSample(out vec3 origin, out vec3 direction, out vec3 power)
     if (getPerceivedBrightness(fluxAlpha.xyz) < 0.04f) // ref. f0 value from 'PixelParams.glsl'
         return 3;
 
+    //  the water-fitted quarter has no opaque geometry to hide the surface
+    if (emissionLightIndex != rsmLightIndex && isOccludedFromLight(worldPos))
+        return 4;
+
     //  determine the direction of the ray be Fresnel's equation
     vec3 bounceDir;
 
@@ -190,34 +284,237 @@ int retrieveSample(out vec3 origin, out vec3 direction, out vec3 power)
     direction = bounceDir;
     // workaround: area of pixel in view-space will be calculated on Photon Tracing part instead.
     const float pixelArea = (4 * distanceFromLight * distanceFromLight) / (rsmDim.x * rsmDim.y * 
-                                        u_params.lights[rsmLightIndex].invTanHalfFovH * u_params.lights[rsmLightIndex].invTanHalfFovV);
+                                        u_params.lights[emissionLightIndex].invTanHalfFovH * u_params.lights[emissionLightIndex].invTanHalfFovV);
     power = fluxAlpha.xyz * pixelArea;
     // workaround: compensate the intensity, since PBR shader overpowers the intensity
     power *= u_params.samplingMapScale * u_params.samplingMapScale * fluxAmplifier;
+    //  amortization : this photon stands for the ones of the skipped blocks also
+    power *= blockStride.x * blockStride.y;
 
     return 0;
 }
 
-//  trace the ray through the depth map and decay the input power in-place. 
+//  index of the photon in this dispatch (hitpoint buffer)
+uint getPhotonIndex()
+{
+    const uint threadIdx_linear = gl_LocalInvocationIndex;
+    const uint blockIdx_linear = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    return blockIdx_linear * (gl_WorkGroupSize.x * gl_WorkGroupSize.y) + threadIdx_linear;
+}
+
+//  width of the full emission grid (in blocks)
+uint getEmissionBlockCount_x()
+{
+    const ivec2 rsmDim = textureSize(u_rsmFlux, 0) / 2;
+    const ivec2 sampleDimPerBlock = ivec2(gl_WorkGroupSize.xy * u_params.samplingMapScale);
+    return (rsmDim.x + sampleDimPerBlock.x - 1) / sampleDimPerBlock.x;
+}
+
+//  index of the emission block in the full grid (density feedback)
+uint getEmissionBlockIndex()
+{
+    const ivec2 blockID = getBlockID();
+    return blockID.y * getEmissionBlockCount_x() + blockID.x;
+}
+
+//  index of the photon in the full emission grid (light segment buffer)
+uint getEmissionIndex()
+{
+    return getEmissionBlockIndex() * (gl_WorkGroupSize.x * gl_WorkGroupSize.y) + gl_LocalInvocationIndex;
+}
+
+//  check if the photon landing at pos (on screen at coord) is visible to the camera.
 //  return the hitpoint (transformed w/ z = depth), along with normalized power (irradiance).
-vec4 trace(vec3 origin, vec3 direction, vec3 power)
+vec4 shadeHit(vec3 pos, vec3 direction, vec3 power, vec2 coord)
 {
     vec3 hitPos = vec3(0);
     float irradiance_32b = uintBitsToFloat(0);
+
+    //  save hitpoint
+    const vec4 viewPos = u_params.camera.view * vec4(pos, 1.0f);
+
+    //  check normal and depth consistency
+    vec3 visibleNormal = texture(u_gbufNormal, toGBufCoord(coord)).rgb * 2.0f - 1.0f;
+    float visibleDepth = toViewDepth(fetchGBufDepth(coord, 0), 
+                            u_params.camera.nearPlane, u_params.camera.farPlane);
     
-    vec3 lastPos = origin;
-    float lastT = 0;
-    vec2 lastCoord = vec2(0);
-    bool bHit = false;
-    
-    //  trace on RSM first
+    AngularInfo angularInfo = getAngularInfo(-direction, visibleNormal, -viewPos.xyz);
+    //const float NdotL = dot(-direction, visibleNormal);
+    if (/*NdotL >= -epsilon*/ angularInfo.NdotL > 0 &&
+        abs(viewPos.z - visibleDepth) <= u_params.rayThickness) 
+    {
+        const vec2 projPos = vec2(2, -2) * (coord - 0.5f);
+        const float projConstA = u_params.camera.farPlane / (u_params.camera.nearPlane - u_params.camera.farPlane);
+        const float projConstB = projConstA * u_params.camera.nearPlane;
+        const float projDepth = -projConstA + projConstB / (-viewPos.z);
+
+        //  this finally guarantee that the ray hits, and the photon is visible to the camera
+        hitPos = vec3(projPos.x, projPos.y, projDepth);
+
+        //  calculate irradiance
+        const ivec2 screenSize = u_params.viewExtent;
+        const float distanceFromEye = length(viewPos.xyz);
+        const float invPixelArea = screenSize.x * screenSize.y * 
+                                    u_params.camera.invTanHalfFovH * u_params.camera.invTanHalfFovV / 
+                                    (4 * distanceFromEye * distanceFromEye);
+
+        //  assuming that the receiver surface is diffuse, 
+        //  apply lambertian BRDF and angle attenuation (due to rendering equation).
+        const vec3 irradiance = power * invPixelArea * angularInfo.NdotL / M_PI; 
+
+        //  compress irradiance
+        //irradiance_32b = uintBitsToFloat(float3ToRGBE(irradiance));
+        //  workaround: there's smth wrong with RGBE conversion
+        irradiance_32b = getPerceivedBrightness(irradiance);
+    }
+
+    return vec4(hitPos, irradiance_32b);
+}
+
+//  cached photons only keep the perceived brightness of their power,
+//  which is all the splat needs (see the RGBE workaround above).
+uint packPhoton(vec3 direction, float power)
+{
+    direction /= (abs(direction.x) + abs(direction.y) + abs(direction.z));
+    vec2 oct = direction.z >= 0.0 ? direction.xy : 
+        (1.0 - abs(direction.yx)) * vec2(direction.x >= 0.0 ? 1.0 : -1.0, direction.y >= 0.0 ? 1.0 : -1.0);
+
+    return (packHalf2x16(vec2(power, 0)) & 0xFFFFu) | (packUnorm4x8(vec4(oct * 0.5 + 0.5, 0, 0)) << 16);
+}
+void unpackPhoton(uint packed, out vec3 direction, out float power)
+{
+    power = unpackHalf2x16(packed & 0xFFFFu).x;
+
+    vec2 oct = unpackUnorm4x8(packed >> 16).xy * 2.0 - 1.0;
+    direction = vec3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+    if (direction.z < 0)
+        direction.xy = (1.0 - abs(direction.yx)) * vec2(direction.x >= 0.0 ? 1.0 : -1.0, direction.y >= 0.0 ? 1.0 : -1.0);
+    direction = normalize(direction);
+}
+
+#ifdef LIGHT_SPACE_STAGE
+
+void main()
+{
+    const uint photonIdx = getEmissionIndex();
+
+    //  get the sampling point first
+    //  (rejected samples are rejected again by the camera-space stage)
+    vec3 origin;
+    vec3 direction;
+    vec3 power;
+    if (retrieveSample(getBlockID(), gl_LocalInvocationID.xy, origin, direction, power) != 0)
+    {
+#ifndef PHASE_CACHE
+        //  mark the photon as dead, so that RAY_COMPACTION drops it
+        io_lightSegmentT[seed * SEGMENT_SLICE_SIZE + photonIdx] = -1.0f;
+#endif
+        return;
+    }
+
+    //  trace on RSM
     //  note : we ignore bHit and lastCoord from RSM tracing, 
     //         because we don't rule out hitting in this pass.
     float t;
-    traceOnView(lastPos, direction, u_params.lights[rsmLightIndex], false, u_params.tMax, t, lastCoord);
+    vec2 lastCoord;
+    bool bHit = traceOnView(origin, direction, u_params.lights[rsmLightIndex], false, u_params.tMax, t, lastCoord);
     //if(u_params.tMax < 0) t = 0;
-    lastPos = lastPos + direction * t;
-    lastT += t;
+
+#ifdef PHASE_CACHE
+    //  keep the photons landing on surfaces seen by the light only,
+    //  the ones continuing behind them are dropped in this mode.
+    if (!bHit)
+        return;
+
+    //  the count keeps every photon that tried to be stored, the capacity is sized to hold them all (see Caustics)
+    const uint cacheIdx = atomicAdd(io_phaseCacheCount[phase], 1);
+    if (cacheIdx >= PHASE_CACHE_CAPACITY)
+        return;
+
+    io_phaseCache[phase * PHASE_CACHE_CAPACITY + cacheIdx] = 
+        vec4(origin + direction * t, uintBitsToFloat(packPhoton(direction, getPerceivedBrightness(power))));
+#else
+    io_lightSegmentT[seed * SEGMENT_SLICE_SIZE + photonIdx] = t;
+#endif
+}
+
+#elif defined(RAY_COMPACTION)
+
+shared uint s_queuedCount;
+shared uint s_queueBase;
+
+void main()
+{
+    const uint photonIdx = getEmissionIndex();
+
+    if (gl_LocalInvocationIndex == 0)
+        s_queuedCount = 0;
+    barrier();
+
+    //  rejected samples were marked by the light-space stage
+    const bool bAlive = io_lightSegmentT[seed * SEGMENT_SLICE_SIZE + photonIdx] >= 0.0f;
+    uint localIdx = 0;
+    if (bAlive)
+        localIdx = atomicAdd(s_queuedCount, 1);
+    barrier();
+
+    //  one global atomic per workgroup
+    if (gl_LocalInvocationIndex == 0)
+        s_queueBase = atomicAdd(io_queuedCount, s_queuedCount);
+    barrier();
+
+    if (bAlive)
+        io_rayQueue[s_queueBase + localIdx] = photonIdx;
+}
+
+#elif defined(PHASE_CACHE)
+
+void main()
+{
+    const uint photonIdx = getPhotonIndex();
+
+    const uint attemptedCount = io_phaseCacheCount[phase];
+    const uint photonCount = min(attemptedCount, PHASE_CACHE_CAPACITY);
+    if (photonIdx >= photonCount)
+    {
+        out_hitPos_irradiance[photonIdx] = vec4(0);
+        return;
+    }
+
+    const vec4 photon = io_phaseCache[phase * PHASE_CACHE_CAPACITY + photonIdx];
+    vec3 direction;
+    float power;
+    unpackPhoton(floatBitsToUint(photon.w), direction, power);
+
+    //  the stored photons stand for the dropped ones also, had the capacity been exceeded
+    power *= float(attemptedCount) / float(photonCount);
+
+    //  reproject into the camera
+    const vec4 viewPos = u_params.camera.view * vec4(photon.xyz, 1.0f);
+    const vec2 projPos = viewPos.xy * vec2(u_params.camera.invTanHalfFovH, u_params.camera.invTanHalfFovV) / (-viewPos.z);
+    if (-viewPos.z < u_params.camera.nearPlane || -viewPos.z > u_params.camera.farPlane ||
+        abs(projPos.x) > 1.0f || abs(projPos.y) > 1.0f)
+    {
+        out_hitPos_irradiance[photonIdx] = vec4(0);
+        return;
+    }
+
+    const vec2 coord = projPos * vec2(0.5f, -0.5f) + 0.5f;
+    out_hitPos_irradiance[photonIdx] = shadeHit(photon.xyz, direction, vec3(power), coord);
+}
+
+#else
+
+//  trace the ray through the depth map and decay the input power in-place. 
+//  the ray starts where it left the RSM (see LIGHT_SPACE_STAGE).
+//  return the hitpoint (transformed w/ z = depth), along with normalized power (irradiance).
+vec4 trace(vec3 origin, vec3 direction, vec3 power, float lightT)
+{
+    vec3 lastPos = origin + direction * lightT;
+    float lastT = lightT;
+    vec2 lastCoord = vec2(0);
+    bool bHit = false;
+    float t;
 
     // continue tracing in screen space
     bHit = traceOnView(lastPos, direction, u_params.camera, true, u_params.tMax, t, lastCoord);
@@ -226,67 +523,187 @@ vec4 trace(vec3 origin, vec3 direction, vec3 power)
 
     //  calculate irradiance
     if (bHit)
+        return shadeHit(lastPos, direction, power, lastCoord);
+
+    return vec4(vec3(0), uintBitsToFloat(0));
+}
+
+#ifdef FUSED_STAGES
+//  ray parameter where the photon leaves the RSM, as the light-space stage computes it
+float traceLightSegment(vec3 origin, vec3 direction)
+{
+    float t;
+    vec2 lastCoord;
+    traceOnView(origin, direction, u_params.lights[rsmLightIndex], false, u_params.tMax, t, lastCoord);
+    return t;
+}
+#endif
+
+#ifdef TRACE_STATS
+//  accumulate the traversal steps of this subgroup's lanes, and the steps it took (its slowest lane's).
+//  must be called from uniform control flow.
+void accumulateTraceStats(uint steps, inout uint laneSteps, inout uint subgroupSteps)
+{
+    laneSteps += subgroupAdd(steps);
+    subgroupSteps += subgroupMax(steps) * gl_SubgroupSize;
+}
+void reportTraceStats(uint laneSteps, uint subgroupSteps)
+{
+    if (subgroupElect())
+    {
+        atomicAdd(io_laneSteps, laneSteps);
+        atomicAdd(io_subgroupSteps, subgroupSteps);
+    }
+}
+#endif
+
+#ifdef PERSISTENT_THREADS
+
+//  a fixed number of workgroups (enough to fill the GPU) pull the queued photons
+//  one subgroup-wide batch at a time, until the queue runs dry.
+//  the early-rejected photons are already gone, and no lane waits for a workgroup
+//  of long marches to finish before the next batch starts.
+void main()
+{
+    const uint queuedCount = io_queuedCount;
+    const uint numBlocks_x = getEmissionBlockCount_x();
+    const uint blockSize = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+
+#ifdef TRACE_STATS
+    uint laneSteps = 0, subgroupSteps = 0;
+#endif
+
+    for (;;)
     {
-        //  save hitpoint
-        const vec4 viewPos = u_params.camera.view * vec4(lastPos, 1.0f);
-
-        //  check normal and depth consistency
-        vec3 visibleNormal = texture(u_gbufNormal, lastCoord).rgb * 2.0f - 1.0f;
-        float visibleDepth = toViewDepth(fetchGBufDepth(lastCoord, 0), 
-                                u_params.camera.nearPlane, u_params.camera.farPlane);
-        
-        AngularInfo angularInfo = getAngularInfo(-direction, visibleNormal, -viewPos.xyz);
-        //const float NdotL = dot(-direction, visibleNormal);
-        if (/*NdotL >= -epsilon*/ angularInfo.NdotL > 0 &&
-            abs(viewPos.z - visibleDepth) <= u_params.rayThickness) 
+        uint queueBase = 0;
+        if (subgroupElect())
+            queueBase = atomicAdd(io_queueHead, gl_SubgroupSize);
+        queueBase = subgroupBroadcastFirst(queueBase);
+        if (queueBase >= queuedCount)
+            break; // uniform in the subgroup
+
+        const uint queueIdx = queueBase + gl_SubgroupInvocationID;
+        vec4 hitPos = vec4(0);
+#ifdef TRACE_STATS
+        g_traceSteps = 0;
+#endif
+        if (queueIdx < queuedCount)
         {
-            const vec2 projPos = vec2(2, -2) * (lastCoord - 0.5f);
-            const float projConstA = u_params.camera.farPlane / (u_params.camera.nearPlane - u_params.camera.farPlane);
-            const float projConstB = projConstA * u_params.camera.nearPlane;
-            const float projDepth = -projConstA + projConstB / (-viewPos.z);
-
-            //  this finally guarantee that the ray hits, and the photon is visible to the camera
-            hitPos = vec3(projPos.x, projPos.y, projDepth);
-
-            //  calculate irradiance
-            const ivec2 screenSize = textureSize(u_gbufNormal, 0);
-            const float distanceFromEye = length(viewPos.xyz);
-            const float invPixelArea = screenSize.x * screenSize.y * 
-                                        u_params.camera.invTanHalfFovH * u_params.camera.invTanHalfFovV / 
-                                        (4 * distanceFromEye * distanceFromEye);
-
-            //  assuming that the receiver surface is diffuse, 
-            //  apply lambertian BRDF and angle attenuation (due to rendering equation).
-            const vec3 irradiance = power * invPixelArea * angularInfo.NdotL / M_PI; 
-
-            //  compress irradiance
-            //irradiance_32b = uintBitsToFloat(float3ToRGBE(irradiance));
-            //  workaround: there's smth wrong with RGBE conversion
-            irradiance_32b = getPerceivedBrightness(irradiance);
+            //  the emission block & thread it was queued from (see getEmissionIndex)
+            const uint photonIdx = io_rayQueue[queueIdx];
+            const uint blockIdx = photonIdx / blockSize, threadIdx = photonIdx % blockSize;
+            const ivec2 blockID = ivec2(blockIdx % numBlocks_x, blockIdx / numBlocks_x);
+            const uvec2 localID = uvec2(threadIdx % gl_WorkGroupSize.x, threadIdx / gl_WorkGroupSize.x);
+
+            vec3 origin;
+            vec3 direction;
+            vec3 power;
+            if (retrieveSample(blockID, localID, origin, direction, power) == 0)
+            {
+                const float lightT = io_lightSegmentT[seed * SEGMENT_SLICE_SIZE + photonIdx];
+                hitPos = trace(origin, direction, power, lightT);
+            }
+
+            out_hitPos_irradiance[queueIdx] = hitPos;
         }
+#ifdef TRACE_STATS
+        accumulateTraceStats(g_traceSteps, laneSteps, subgroupSteps);
+#endif
     }
 
-    return vec4(hitPos, irradiance_32b);
+#ifdef TRACE_STATS
+    reportTraceStats(laneSteps, subgroupSteps);
+#endif
 }
 
+#else
+
+shared uint s_photonCount;
+shared uint s_visibleCount;
+shared uint s_visibleBounds[4]; // min x, min y, max x, max y (pixels)
+
 void main()
 {
-    const uint threadIdx_linear = gl_LocalInvocationIndex;
-    const uint blockIdx_linear = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
-    const uint writeIdx = blockIdx_linear * (gl_WorkGroupSize.x * gl_WorkGroupSize.y) + threadIdx_linear;
+    const uint writeIdx = getPhotonIndex();
+    const uint blockSize = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+
+    //  density feedback : trace the first photons of this block only.
+    //  thread i holds the point i of the frame's slice of an Owen-scrambled Sobol sequence (see SamplingSequence) :
+    //  a prefix of 2^k points is a (0,k,2)-net, any whole-subgroup prefix a union of such nets,
+    //  so the first photons still cover the block evenly (and unbiased, their power is scaled up below), 
+    //  and whole subgroups (SUBGROUP_SIZE, as reported by the device) retire at once.
+    if (gl_LocalInvocationIndex == 0)
+    {
+        s_photonCount = (densityFeedback != 0) ? io_densityFeedback[getEmissionBlockIndex()] : blockSize;
+        s_visibleCount = 0;
+        s_visibleBounds[0] = s_visibleBounds[1] = 0xFFFFFFFFu;
+        s_visibleBounds[2] = s_visibleBounds[3] = 0;
+    }
+    barrier();
+
+    vec4 hitPos = vec4(0);
 
     //  get the sampling point first
     vec3 origin;
     vec3 direction;
     vec3 power;
-    if (retrieveSample(origin, direction, power) != 0)
+#ifdef TRACE_STATS
+    g_traceSteps = 0;
+#endif
+    if (gl_LocalInvocationIndex < s_photonCount && retrieveSample(getBlockID(), gl_LocalInvocationID.xy, origin, direction, power) == 0)
     {
-        out_hitPos_irradiance[writeIdx] = vec4(0);
-        return;
+        //  the traced photons stand for the skipped ones also
+        power *= float(blockSize) / s_photonCount;
+
+        //  trace through depth map
+#ifdef FUSED_STAGES
+        const float lightT = traceLightSegment(origin, direction);
+#else
+        const float lightT = io_lightSegmentT[seed * SEGMENT_SLICE_SIZE + getEmissionIndex()];
+#endif
+        hitPos = trace(origin, direction, power, lightT);
     }
-
-    //  trace through depth map
-    vec4 hitPos = trace(origin, direction, power);
     
     out_hitPos_irradiance[writeIdx] = hitPos;
+
+#ifdef TRACE_STATS
+    uint laneSteps = 0, subgroupSteps = 0;
+    accumulateTraceStats(g_traceSteps, laneSteps, subgroupSteps);
+    reportTraceStats(laneSteps, subgroupSteps);
+#endif
+
+    if (densityFeedback == 0)
+        return;
+
+    //  record where the visible photons landed on screen
+    if (floatBitsToUint(hitPos.w) != 0)
+    {
+        const uvec2 pixel = uvec2((hitPos.xy * vec2(0.5f, -0.5f) + 0.5f) * u_params.viewExtent);
+        atomicAdd(s_visibleCount, 1);
+        atomicMin(s_visibleBounds[0], pixel.x);
+        atomicMin(s_visibleBounds[1], pixel.y);
+        atomicMax(s_visibleBounds[2], pixel.x);
+        atomicMax(s_visibleBounds[3], pixel.y);
+    }
+    barrier();
+
+    //  photons needed to cover the caustics' screen area at the target density,
+    //  from the visible ones at full density. a few keep tracing off-screen/occluded blocks, 
+    //  so that their caustics are caught once they come into view.
+    if (gl_LocalInvocationIndex == 0)
+    {
+        uint photonCount = DENSITY_MIN_PHOTONS;
+        if (s_visibleCount > 0)
+        {
+            const float visibleArea = float(s_visibleBounds[2] - s_visibleBounds[0] + 1) * float(s_visibleBounds[3] - s_visibleBounds[1] + 1);
+            const float fullVisibleCount = float(s_visibleCount) * blockSize / s_photonCount;
+            const float neededCount = blockSize * DENSITY_TARGET * visibleArea / fullVisibleCount;
+            photonCount = clamp(uint(ceil(min(neededCount, float(blockSize)) / float(SUBGROUP_SIZE))) * SUBGROUP_SIZE, DENSITY_MIN_PHOTONS, blockSize); // whole subgroups
+        }
+        io_densityFeedback[getEmissionBlockIndex()] = photonCount;
+    }
 }
+
+#endif // PERSISTENT_THREADS
+
+#endif
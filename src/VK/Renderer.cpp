@@ -6,7 +6,6 @@
 //	ToDo : let's experiment if 2 is sufficient.
 static const int backBufferCount = 3;
 static const uint32_t tonemappingMode = 5; // URQ
-static const float photonSampleScale = 2.f; // 1.45 / 2 / 2.9
 
 //  Shadow map size (the texture dimension is shadowmapSize * shadowmapSize)
 #ifdef USE_TEST_SCENE
@@ -17,9 +16,68 @@ static const uint32_t shadowmapSize = 1024;
 static const float waterIOR = 1.33f;
 #endif
 
+//  RSM quarter holding the water-fitted RSM (caustics only, see Caustics::Constants)
+static const int waterRSMIndex = 1;
+
+//  light projection of the RSM (ref from 'GltfCommon.cpp')
+static XMMATRIX getRSMLightProjection(const Light& light)
+{
+    if (light.type == LightType_Spot)
+        return XMMatrixPerspectiveFovRH(acosf(light.outerConeCos) * 2.0f, 1, .1f, 100.0f);
+    else if (light.type == LightType_Directional)
+        return XMMatrixOrthographicRH(30.0, 30.0, 0.1f, 100.0f);
+    return XMMatrixIdentity(); // no RSM
+}
+
+//  camera side of the caustics constants
+static void setCausticsCamera(Caustics::Constants* pConstants, const Camera& camera)
+{
+    pConstants->camera.view = camera.GetView();
+    pConstants->camera.position = camera.GetPosition();
+    pConstants->camera.invTanHalfFovH = XMVectorGetX(camera.GetProjection().r[0]);
+    pConstants->camera.invTanHalfFovV = XMVectorGetY(camera.GetProjection().r[1]);
+    pConstants->camera.nearPlane = camera.GetNearPlane();
+    pConstants->camera.farPlane = camera.GetFarPlane();
+}
+
+//  settings saved along the inputs of a captured pass (see PassCapture)
+//  replay always runs BIRT, for the ocean phase it was captured at.
+struct CausticsCapture
+{
+    Caustics::Constants constants;
+    uint32_t phaseCache;
+    uint32_t amortization;
+    uint32_t densityFeedback;
+    uint32_t persistentThreads;
+    uint32_t oceanPhase;
+    uint32_t denoiserIterations;
+};
+
+struct FresnelCapture
+{
+    Fresnel::Constants constants;
+    uint32_t persistentThreads;
+    uint32_t denoiserIterations;
+};
+
+//  bump along any change of the structures above (or of the constants they hold) : a capture is only replayed
+//  with the version & size it was saved with, the size alone misses reordered or retyped fields.
+static const uint32_t causticsCaptureVersion = 2;
+static const uint32_t fresnelCaptureVersion = 3;
+
+//  formats of the G-buffer & RSM targets, also those of the inputs of a captured pass (see getPassInputs)
+static const VkFormat depthFormat = VK_FORMAT_D32_SFLOAT_S8_UINT;
+static const VkFormat worldCoordFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+static const VkFormat normalFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+static const VkFormat specularRoughnessFormat = VK_FORMAT_R16G16B16A16_UNORM;
+static const VkFormat emissiveFluxFormat = VK_FORMAT_R8G8B8A8_UNORM;
+static const VkFormat motionVectorFormat = VK_FORMAT_R16G16_SFLOAT;
+static const VkFormat hdrFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
 void Renderer::OnCreate(Device* pDevice, SwapChain* pSwapChain)
 {
 	this->pDevice = pDevice;
+	this->pSwapChain = pSwapChain;
 
 	// Create a 'static' pool for vertices and indices 
 	const uint32_t staticGeometryMemSize = 32 * 1024 * 1024; // default = 128MB
@@ -32,7 +90,7 @@ void Renderer::OnCreate(Device* pDevice, SwapChain* pSwapChain)
 	//	create all the heaps for the resources views
 	const uint32_t cbvDescriptorCount = 2000;
 	const uint32_t srvDescriptorCount = 2000;
-	const uint32_t uavDescriptorCount = 10;
+	const uint32_t uavDescriptorCount = 100;
 	const uint32_t samplerDescriptorCount = 20;
 	this->resViewHeaps.OnCreate(pDevice, cbvDescriptorCount, srvDescriptorCount,
 		uavDescriptorCount, samplerDescriptorCount);
@@ -41,6 +99,16 @@ void Renderer::OnCreate(Device* pDevice, SwapChain* pSwapChain)
 	uint32_t commandListsPerBackBuffer = 8;
 	this->cmdBufferRing.OnCreate(pDevice, backBufferCount, commandListsPerBackBuffer);
 
+	//	opaque G-buffer, opaque RSM & transparent RSM are recorded on worker threads
+	this->jobSystem.OnCreate();
+	const uint32_t sectionsPerFrame = 3;
+	this->parallelRecorder.OnCreate(pDevice, &this->jobSystem, backBufferCount, sectionsPerFrame);
+	this->sections.reserve(sectionsPerFrame);
+
+	//	closures of the parallel sections
+	const size_t frameArenaSize = 64 * 1024;
+	this->frameArena.OnCreate(frameArenaSize);
+
 	// Quick helper to upload resources, it has it's own commandList and uses suballocation.
 	// for 4K textures we'll need 100Megs
 	const uint32_t uploadHeapMemSize = 128 * 1024 * 1024;
@@ -61,11 +129,11 @@ void Renderer::OnCreate(Device* pDevice, SwapChain* pSwapChain)
             &this->resViewHeaps,
             {
                 //  RSM
-                { GBUFFER_DEPTH, VK_FORMAT_D32_SFLOAT_S8_UINT},
-                { GBUFFER_WORLD_COORD, VK_FORMAT_R16G16B16A16_SFLOAT},
-                { GBUFFER_NORMAL_BUFFER, VK_FORMAT_R16G16B16A16_SFLOAT},
-                { GBUFFER_SPECULAR_ROUGHNESS, VK_FORMAT_R16G16B16A16_UNORM},
-                { GBUFFER_EMISSIVE_FLUX, VK_FORMAT_R8G8B8A8_UNORM},
+                { GBUFFER_DEPTH, depthFormat},
+                { GBUFFER_WORLD_COORD, worldCoordFormat},
+                { GBUFFER_NORMAL_BUFFER, normalFormat},
+                { GBUFFER_SPECULAR_ROUGHNESS, specularRoughnessFormat},
+                { GBUFFER_EMISSIVE_FLUX, emissiveFluxFormat},
             },
             1
             );
@@ -81,7 +149,7 @@ void Renderer::OnCreate(Device* pDevice, SwapChain* pSwapChain)
         this->rp_RSM_trans.OnCreateWindowSizeDependentResources(totalRSMSize, totalRSMSize);
 
         //  init cache
-        this->cache_rsmDepth.InitDepthStencil(this->pDevice, totalRSMSize, totalRSMSize, VK_FORMAT_D32_SFLOAT_S8_UINT, (VkSampleCountFlagBits)1, VK_IMAGE_USAGE_TRANSFER_DST_BIT, "RSM Depth Cache");
+        this->cache_rsmDepth.InitDepthStencil(this->pDevice, totalRSMSize, totalRSMSize, depthFormat, (VkSampleCountFlagBits)1, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, "RSM Depth Cache");
         this->cache_rsmDepth.CreateSRV(&cache_rsmDepthSRV);
     }
     //
@@ -93,15 +161,15 @@ void Renderer::OnCreate(Device* pDevice, SwapChain* pSwapChain)
             &this->resViewHeaps,
             {
                 //  g-buffer
-                { GBUFFER_DEPTH, VK_FORMAT_D32_SFLOAT_S8_UINT},
-                { GBUFFER_WORLD_COORD, VK_FORMAT_R16G16B16A16_SFLOAT},
-                { GBUFFER_NORMAL_BUFFER, VK_FORMAT_R16G16B16A16_SFLOAT},
+                { GBUFFER_DEPTH, depthFormat},
+                { GBUFFER_WORLD_COORD, worldCoordFormat},
+                { GBUFFER_NORMAL_BUFFER, normalFormat},
                 { GBUFFER_DIFFUSE, VK_FORMAT_R16G16B16A16_UNORM},
-                { GBUFFER_SPECULAR_ROUGHNESS, VK_FORMAT_R16G16B16A16_UNORM},
-                { GBUFFER_EMISSIVE_FLUX, VK_FORMAT_R8G8B8A8_UNORM},
-                { GBUFFER_MOTION_VECTORS, VK_FORMAT_R16G16_SFLOAT},
+                { GBUFFER_SPECULAR_ROUGHNESS, specularRoughnessFormat},
+                { GBUFFER_EMISSIVE_FLUX, emissiveFluxFormat},
+                { GBUFFER_MOTION_VECTORS, motionVectorFormat},
                 //  final rt
-                { GBUFFER_FORWARD, VK_FORMAT_R16G16B16A16_SFLOAT/*VK_FORMAT_R16G16B16A16_UNORM*/},
+                { GBUFFER_FORWARD, hdrFormat/*VK_FORMAT_R16G16B16A16_UNORM*/},
             },
             1
         );
@@ -138,6 +206,14 @@ void Renderer::OnCreate(Device* pDevice, SwapChain* pSwapChain)
             VK_FORMAT_D32_SFLOAT_S8_UINT);
     }
     //
+    //  culling of the opaque batches, against the depth caches of the previous frame
+    //
+    {
+        this->culling.OnCreate(this->pDevice, &this->resViewHeaps, &this->dBufferRing);
+        this->culling.createHiZ(GPUCulling::View::RSM, this->cache_rsmDepthSRV,
+            { { 0, 0 }, { shadowmapSize, shadowmapSize } });
+    }
+    //
     //  pass 2.1 : D-Light
     //
     {
@@ -154,6 +230,12 @@ void Renderer::OnCreate(Device* pDevice, SwapChain* pSwapChain)
         lightGB.stencilTransparent = this->pRSM->m_StencilBufferSRV;
         lightGB.depthOpaque = this->cache_rsmDepthSRV;
         this->dLighting->setLightGBuffer(&lightGB);
+
+        //  filtered once per pixel, shared by both D-light passes
+        this->shadowMask.OnCreate(this->pDevice,
+            &this->resViewHeaps,
+            &this->dBufferRing,
+            this->pRSM->m_DepthBufferSRV);
     }
     //
     //  pass 2.2 : I-Light
@@ -222,11 +304,15 @@ void Renderer::OnCreate(Device* pDevice, SwapChain* pSwapChain)
     }
 
     //  initialize post-processing handles
-    this->aggregator_1.OnCreate(this->pDevice, &this->resViewHeaps, &this->dBufferRing, 1); // should be 3 if includes AO and I1
+    //  note : caustics are composited in D-light pass, so only the transparent/glossy results need aggregation
     this->aggregator_2.OnCreate(this->pDevice, &this->resViewHeaps, &this->dBufferRing, 1);
     this->toneMapping.OnCreate(this->pDevice, pSwapChain->GetRenderPass(), 
         &this->resViewHeaps, &this->sBufferPool, &this->dBufferRing);
     this->tAA.OnCreate(this->pDevice, &this->resViewHeaps, &this->sBufferPool, &this->dBufferRing);
+    this->upscaler.OnCreate(this->pDevice, &this->resViewHeaps, &this->dBufferRing);
+
+    //  pass capture & replay
+    this->passCapture.OnCreate(this->pDevice, &this->resViewHeaps, &this->dBufferRing);
 
     // Initialize UI rendering resources
     this->gui.OnCreate(this->pDevice, pSwapChain->GetRenderPass(), &this->uploadHeap, &this->dBufferRing);
@@ -240,10 +326,14 @@ void Renderer::OnDestroy()
 {
     this->gui.OnDestroy();
 
+    this->passCapture.OnDestroy();
+
+    this->OnDestroyAuxViews();
+
+    this->upscaler.OnDestroy();
     this->tAA.OnDestroy();
     this->toneMapping.OnDestroy();
     this->aggregator_2.OnDestroy();
-    this->aggregator_1.OnDestroy();
 
     this->ocean.OnDestroy();
     this->skyDomeProc.OnDestroy();
@@ -262,6 +352,7 @@ void Renderer::OnDestroy()
     delete this->iLighting;
     this->iLighting = nullptr;*/
 
+    this->shadowMask.OnDestroy();
     this->dLighting->OnDestroy();
     delete this->dLighting;
     this->dLighting = nullptr;
@@ -272,6 +363,9 @@ void Renderer::OnDestroy()
     delete this->pGBuffer;
     this->pGBuffer = nullptr;
 
+    this->culling.destroyHiZ(GPUCulling::View::RSM);
+    this->culling.OnDestroy();
+
     this->cache_rsmDepthMipmap.OnDestroy();
     this->cache_rsmDepthMipmap.OnDestroyWindowSizeDependentResources();
     this->cache_gbufDepthMipmap.OnDestroy();
@@ -291,6 +385,9 @@ void Renderer::OnDestroy()
 
     this->gTimeStamps.OnDestroy();
     this->uploadHeap.OnDestroy();
+    this->parallelRecorder.OnDestroy();
+    this->jobSystem.OnDestroy();
+    this->frameArena.OnDestroy();
     this->cmdBufferRing.OnDestroy();
     this->resViewHeaps.OnDestroy();
     this->dBufferRing.OnDestroy();
@@ -298,9 +395,42 @@ void Renderer::OnDestroy()
 }
 
 void Renderer::OnCreateWindowSizeDependentResources(SwapChain* pSwapChain, uint32_t Width, uint32_t Height)
+{
+    this->outputWidth = Width;
+    this->outputHeight = Height;
+
+    //  the rendered image is stretched over the whole window (flipped, as the render viewport)
+    this->outputViewport.x = 0;
+    this->outputViewport.y = (float)Height;
+    this->outputViewport.width = (float)Width;
+    this->outputViewport.height = -(float)(Height);
+    this->outputViewport.minDepth = (float)0.0f;
+    this->outputViewport.maxDepth = (float)1.0f;
+
+    this->outputScissor.extent.width = Width;
+    this->outputScissor.extent.height = Height;
+    this->outputScissor.offset.x = 0;
+    this->outputScissor.offset.y = 0;
+
+    //  the swap chain's render pass was recreated along its images
+    this->toneMapping.UpdatePipelines(pSwapChain->GetRenderPass());
+    this->gui.UpdatePipeline(pSwapChain->GetRenderPass());
+    for (AuxiliaryView* pView : this->auxViews)
+        pView->UpdatePipelines(pSwapChain->GetRenderPass());
+}
+
+void Renderer::OnDestroyWindowSizeDependentResources()
+{
+    this->outputWidth = 0;
+    this->outputHeight = 0;
+}
+
+void Renderer::OnCreateRenderResources(uint32_t Width, uint32_t Height, uint32_t UpscaledWidth, uint32_t UpscaledHeight)
 {
     this->width = Width;
     this->height = Height;
+    this->upscaledWidth = UpscaledWidth;
+    this->upscaledHeight = UpscaledHeight;
 
     // Set the viewport
     this->viewport.x = 0;
@@ -316,21 +446,24 @@ void Renderer::OnCreateWindowSizeDependentResources(SwapChain* pSwapChain, uint3
     this->rectScissor.offset.x = 0;
     this->rectScissor.offset.y = 0;
 
-    this->pGBuffer->OnCreateWindowSizeDependentResources(pSwapChain, Width, Height);
+    this->pGBuffer->OnCreateWindowSizeDependentResources(this->pSwapChain, Width, Height);
     this->rp_gBuffer_opaq.OnCreateWindowSizeDependentResources(Width, Height);
     this->rp_gBuffer_trans.OnCreateWindowSizeDependentResources(Width, Height);
     this->rp_skyDome.OnCreateWindowSizeDependentResources(Width, Height);
 
+    this->passCapture.setExtent(Width, Height);
+
     //  init cache
-    this->cache_gbufDepth.InitDepthStencil(this->pDevice, Width, Height, VK_FORMAT_D32_SFLOAT_S8_UINT, (VkSampleCountFlagBits)1, VK_IMAGE_USAGE_TRANSFER_DST_BIT, "G-Buffer Depth Cache");
+    this->cache_gbufDepth.InitDepthStencil(this->pDevice, Width, Height, depthFormat, (VkSampleCountFlagBits)1, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, "G-Buffer Depth Cache");
     this->cache_gbufDepth.CreateSRV(&this->cache_gbufDepthSRV);
 
     const int numMipmaps = static_cast<int>(std::log2(Width > Height ? Height : Width)) - 1;
     this->cache_gbufDepthMipmap.OnCreateWindowSizeDependentResources(
         Width, Height, 
         &this->cache_gbufDepth, min(numMipmaps, 2));
+    this->culling.createHiZ(GPUCulling::View::GBuffer, this->cache_gbufDepthSRV, { { 0, 0 }, { Width, Height } });
 
-    this->cache_opaque.InitRenderTarget(this->pDevice, Width, Height, VK_FORMAT_R16G16B16A16_SFLOAT, (VkSampleCountFlagBits)1, VK_IMAGE_USAGE_TRANSFER_DST_BIT, false, "Opaque-only ColorRT");
+    this->cache_opaque.InitRenderTarget(this->pDevice, Width, Height, hdrFormat, (VkSampleCountFlagBits)1, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, false, "Opaque-only ColorRT");
     this->cache_opaque.CreateSRV(&this->cache_opaqueSRV);
 
     this->dLighting->OnCreateWindowSizeDependentResources(Width, Height, this->pGBuffer);
@@ -343,6 +476,7 @@ void Renderer::OnCreateWindowSizeDependentResources(SwapChain* pSwapChain, uint3
         camGB.emissive = this->pGBuffer->m_EmissiveFluxSRV;
         this->dLighting->setCameraGBuffer(&camGB);
     }
+    this->shadowMask.OnCreateWindowSizeDependentResources(Width, Height, this->pGBuffer);
 
     /*this->iLighting->OnCreateWindowSizeDependentResources(Width / 2, Height / 2);
     {
@@ -361,13 +495,14 @@ void Renderer::OnCreateWindowSizeDependentResources(SwapChain* pSwapChain, uint3
         this->pGBuffer, this->cache_gbufDepthSRV,
         this->cache_gbufDepthMipmap.GetTexture(), this->cache_opaqueSRV);
 
-    VkImageView fxSRVs[] = { this->caustics->GetTextureView(), VK_NULL_HANDLE, VK_NULL_HANDLE };
-    this->aggregator_1.UpdateInputs(
-        Width, Height,
-        this->pGBuffer->m_HDRSRV,
-        fxSRVs
-    );
-    fxSRVs[0] = this->fresnel->GetTextureView();
+    {
+        DLightInput::Composite composite;
+        composite.fx0 = this->caustics->GetTextureView();
+        composite.shadowMask = this->shadowMask.GetTextureView();
+        this->dLighting->setComposite(&composite);
+    }
+
+    VkImageView fxSRVs[] = { this->fresnel->GetTextureView(), VK_NULL_HANDLE, VK_NULL_HANDLE };
     this->aggregator_2.UpdateInputs(
         Width, Height,
         this->pGBuffer->m_HDRSRV,
@@ -375,25 +510,28 @@ void Renderer::OnCreateWindowSizeDependentResources(SwapChain* pSwapChain, uint3
     );
 
     this->tAA.OnCreateWindowSizeDependentResources(Width, Height, this->pGBuffer);
-    this->toneMapping.UpdatePipelines(pSwapChain->GetRenderPass());
-
-    this->gui.UpdatePipeline(pSwapChain->GetRenderPass());
+    if (this->isUpscaling())
+        this->upscaler.OnCreateWindowSizeDependentResources(Width, Height, UpscaledWidth, UpscaledHeight, this->pGBuffer);
 }
 
-void Renderer::OnDestroyWindowSizeDependentResources()
+void Renderer::OnDestroyRenderResources()
 {
+    if (this->isUpscaling())
+        this->upscaler.OnDestroyWindowSizeDependentResources();
     this->tAA.OnDestroyWindowSizeDependentResources();
 
     this->fresnel->OnDestroyWindowSizeDependentResources();
 
     this->caustics->OnDestroyWindowSizeDependentResources();
     //this->iLighting->OnDestroyWindowSizeDependentResources();
+    this->shadowMask.OnDestroyWindowSizeDependentResources();
     this->dLighting->OnDestroyWindowSizeDependentResources();
 
     vkDestroyImageView(this->pDevice->GetDevice(), this->cache_opaqueSRV, nullptr);
     this->cache_opaqueSRV = VK_NULL_HANDLE;
     this->cache_opaque.OnDestroy();
 
+    this->culling.destroyHiZ(GPUCulling::View::GBuffer);
     this->cache_gbufDepthMipmap.OnDestroyWindowSizeDependentResources();
 
     vkDestroyImageView(this->pDevice->GetDevice(), this->cache_gbufDepthSRV, nullptr);
@@ -404,6 +542,44 @@ void Renderer::OnDestroyWindowSizeDependentResources()
     this->rp_gBuffer_trans.OnDestroyWindowSizeDependentResources();
     this->rp_gBuffer_opaq.OnDestroyWindowSizeDependentResources();
     this->pGBuffer->OnDestroyWindowSizeDependentResources();
+
+    this->width = 0;
+    this->height = 0;
+    this->upscaledWidth = 0;
+    this->upscaledHeight = 0;
+}
+
+void Renderer::OnCreateAuxViews(uint32_t Count, uint32_t Width, uint32_t Height)
+{
+    assert(this->auxViews.empty() && Count <= MaxAuxViews);
+
+    for (uint32_t i = 0; i < Count; i++)
+    {
+        AuxiliaryView* pView = new AuxiliaryView();
+        pView->OnCreate(this->pDevice,
+            &this->uploadHeap,
+            &this->resViewHeaps,
+            &this->dBufferRing,
+            &this->sBufferPool,
+            this->pSwapChain->GetRenderPass(),
+            this->pRSM,
+            this->cache_rsmDepthSRV,
+            this->caustics);
+        pView->OnCreateWindowSizeDependentResources(this->pSwapChain, Width, Height);
+        this->auxViews.push_back(pView);
+    }
+}
+
+void Renderer::OnDestroyAuxViews()
+{
+    for (AuxiliaryView* pView : this->auxViews)
+    {
+        pView->OnDestroyWindowSizeDependentResources();
+        pView->OnDestroy();
+        delete pView;
+    }
+    this->auxViews.clear();
+    this->auxViewsRendered = 0;
 }
 
 void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State* pState)
@@ -417,12 +593,19 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
         if (iterFwd > 0)
         {
             this->accumTime = 0;
-            this->oceanIter = (this->oceanIter + iterFwd) % 20;
+            this->oceanIter = (this->oceanIter + iterFwd) % Ocean::PhaseCount;
         }
     }
     // for tests and captures
     //this->oceanIter = 15; 
 
+    this->recordStart = MillisecondsNow();
+    this->jobSystem.updateStats();
+    this->auxViewsRendered = 0;
+
+    //  the previous frame's sections were recorded (see submitAndPresent)
+    this->frameArena.reset();
+
     //  preparing for a new frame
     this->dBufferRing.OnBeginFrame();
 
@@ -441,6 +624,24 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
     //  start profiler
     this->gTimeStamps.OnBeginFrame(cmdBuf1, &this->timeStampRecords);
 
+    //  write a pending capture / measure the replay from the time stamps just read back
+    //  (the frame replays even if the replay just completed, its inputs are in the pass's layouts)
+    const bool replaying = this->passCapture.isReplaying();
+    this->passCapture.update(this->timeStampRecords);
+    if (replaying)
+    {
+        VkImageView outputSRV = this->renderReplay(cmdBuf1);
+        this->submitAndPresent(pSwapChain, cmdBuf1, outputSRV);
+        return;
+    }
+
+    //  culled counts read back
+    this->culling.update();
+
+    //  pick the quality of caustics + Fresnel from the time stamps just read back
+    this->updateBudget(pState);
+    const BudgetController::Settings& budgetSettings = this->budgetController.getSettings();
+
     //  predefine ocean
     Ocean::Constants oceanConst;
     //  config: test
@@ -459,34 +660,25 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
     static uint32_t seed;
     pCamera->SetProjectionJitter(this->width, this->height, seed);
 
+    //  jitter in render pixels, for the upscaler to place the samples : offset of the view axis, projected
+    //  with & without the jittered terms (the viewport is flipped, pixel rows go down)
+    {
+        XMMATRIX proj = pCamera->GetProjection();
+        const XMVECTOR jittered = XMVector4Transform(XMVectorSet(0.f, 0.f, -1.f, 1.f), proj);
+        proj.r[2] = XMVectorSetY(XMVectorSetX(proj.r[2], 0.f), 0.f);
+        const XMVECTOR centered = XMVector4Transform(XMVectorSet(0.f, 0.f, -1.f, 1.f), proj);
+        const XMVECTOR offsetNDC = XMVectorSubtract(
+            XMVectorDivide(jittered, XMVectorSplatW(jittered)),
+            XMVectorDivide(centered, XMVectorSplatW(centered)));
+        this->jitter[0] = XMVectorGetX(offsetNDC) * 0.5f * this->width;
+        this->jitter[1] = -XMVectorGetY(offsetNDC) * 0.5f * this->height;
+    }
+
     //  set per-frame data
     per_frame* pPerFrameData = nullptr;
     if (this->res_scene)
     {
-        //  set camera
-        pPerFrameData = this->res_scene->m_pGLTFCommon->SetPerFrameData(*pCamera);
-
-        //  set light properties
-        pPerFrameData->iblFactor = 0.36f;
-        pPerFrameData->emmisiveFactor = 1.f;
-        pPerFrameData->invScreenResolution[0] = 1.f / static_cast<float>(this->width);
-        pPerFrameData->invScreenResolution[1] = 1.f / static_cast<float>(this->height);
-
-        //  setup light render target
-        int lightIndex = 0;
-        pPerFrameData->lights[lightIndex].shadowMapIndex = 0;
-        if (pPerFrameData->lights[lightIndex].type == LightType_Directional)
-        {
-            pPerFrameData->lights[lightIndex].depthBias = 100.0f / 100000.0f;
-        }
-        else if (pPerFrameData->lights[lightIndex].type == LightType_Spot)
-        {
-            pPerFrameData->lights[lightIndex].depthBias = 70.0f / 100000.0f;
-        }
-        else
-            pPerFrameData->lights[lightIndex].shadowMapIndex = -1;
-        
-        this->res_scene->SetPerFrameConstants();
+        pPerFrameData = this->setPerFrameData(pCamera, this->width, this->height);
         this->res_scene->SetSkinningMatricesForSkeletons();
     }
 
@@ -494,42 +686,57 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
     if(pPerFrameData)
     {
         this->rp_skyDome.BeginPass(cmdBuf1, this->rectScissor);
-
-        SkyDomeProc::Constants skyDomeConstants;
-        skyDomeConstants.invViewProj = XMMatrixInverse(NULL, pPerFrameData->mCameraCurrViewProj);
-        skyDomeConstants.vSunDirection = XMVectorSet(1.0f, 0.05f, 0.0f, 0.0f); //pState->sunDir;
-        skyDomeConstants.turbidity = 10.0f;
-        skyDomeConstants.rayleigh = 2.0f;
-        skyDomeConstants.mieCoefficient = 0.005f;
-        skyDomeConstants.mieDirectionalG = 0.8f;
-        skyDomeConstants.luminance = 1.0f;
-        skyDomeConstants.sun = false; // ToDo : try false and see difference
-        this->skyDomeProc.Draw(cmdBuf1, skyDomeConstants);
-
+        this->drawSkyDome(cmdBuf1, pPerFrameData);
         this->rp_skyDome.EndPass(cmdBuf1);
     }
 
     using BatchList = GltfPbrPass::BatchList;
-    std::vector<BatchList> opaques, transparents;
+    std::vector<BatchList>& opaques = this->batches_opaque;
+    std::vector<BatchList>& transparents = this->batches_transparent;
+    std::vector<BatchList>& opaques_RSM = this->batches_opaqueRSM; // read by the sections recorded on worker threads
+    std::vector<BatchList>& transparents_RSM = this->batches_transparentRSM;
     bool gBufReady = false, rsmReady = false;
+    Caustics::Constants causticsConstants{}; // traced again by the auxiliary views
+
+    //  passes recorded concurrently, their constants & culling are recorded beforehand
+    std::vector<ParallelRecorder::Section>& sections = this->sections;
+    sections.clear();
 
     //  pass 1.1 : G-Buffer (opaque)
     if(this->pGltfPbrPass && pPerFrameData)
     {
         //  retrieve render batch lists of separated opaque meshes and transparent meshes
+        //  (built once a frame, pass 3.1 draws the transparent ones)
+        //  not cached across frames : BuildBatchLists writes each object's constants into this frame's
+        //  dynamic ring, a list kept past the ring's wrap would bind stale constants.
         opaques.clear();
-        this->pGltfPbrPass->BuildBatchLists(&opaques, NULL);
+        transparents.clear();
+        this->pGltfPbrPass->BuildBatchLists(&opaques, &transparents);
+
+        //  cull the batches against the camera
+        const bool gpuCulling = pState->gpuCulling;
+        if (gpuCulling)
+            this->culling.cull(cmdBuf1, GPUCulling::View::GBuffer, opaques,
+                pPerFrameData->mCameraCurrViewProj, pState->occlusionCulling);
 
         //  determine render area
         VkRect2D rectScissor_GBuffer = this->rectScissor;
 
         //  render scene (opaque objects)
-        this->rp_gBuffer_opaq.BeginPass(cmdBuf1, rectScissor_GBuffer);
+        sections.push_back(ParallelRecorder::Section::make("G-Buffer (Opaque)", &this->frameArena,
+            [this, &opaques, gpuCulling, rectScissor_GBuffer](VkCommandBuffer cmdBuf)
         {
-            vkCmdSetStencilReference(cmdBuf1, VK_STENCIL_FACE_FRONT_AND_BACK, 1); // need class design
-            this->pGltfPbrPass->DrawBatchList(cmdBuf1, &opaques);
-        }
-        this->rp_gBuffer_opaq.EndPass(cmdBuf1);
+            this->rp_gBuffer_opaq.BeginPass(cmdBuf, rectScissor_GBuffer);
+            {
+                vkCmdSetStencilReference(cmdBuf, VK_STENCIL_FACE_FRONT_AND_BACK, 1); // need class design
+                if (gpuCulling)
+                    this->culling.drawBatchList(cmdBuf, GPUCulling::View::GBuffer, opaques,
+                        [this](VkCommandBuffer cmdBuf, std::vector<BatchList>* pBatches) { this->pGltfPbrPass->DrawBatchList(cmdBuf, pBatches); });
+                else
+                    this->pGltfPbrPass->DrawBatchList(cmdBuf, &opaques);
+            }
+            this->rp_gBuffer_opaq.EndPass(cmdBuf);
+        }));
 
         gBufReady = true;
     }
@@ -540,15 +747,41 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
     const uint32_t viewportWidth = shadowmapSize;
     const uint32_t viewportHeight = shadowmapSize;
 
+    //  water-fitted RSM : caustic photons only leave the water surface, so it gets its own quarter,
+    //  seen from the same light through a projection fitted to the surface bounds.
+    //  it has no opaque geometry, the photon tracer tests the occlusion against the shadow RSM instead.
+    bool waterFitted = false;
+    XMMATRIX waterLightView, waterLightProj;
+#ifndef USE_TEST_SCENE
+    if (pState->causticsFitWater && pPerFrameData)
+    {
+        const Light& light = pPerFrameData->lights[0];
+        if (light.type == LightType_Spot || light.type == LightType_Directional)
+        {
+            const XMMATRIX lightProj = getRSMLightProjection(light);
+            waterLightView = light.mLightViewProj * XMMatrixInverse(nullptr, lightProj);
+            waterFitted = oceanConst.calculateLightProjection(waterLightView, lightProj, light.type == LightType_Spot,
+                .1f, 100.f, &waterLightProj);
+        }
+    }
+#endif
+
     //  Pass 1.2-O : reflective shadow map (opaque)
     if (this->pRSMPass && pPerFrameData)
     {
         //  ToDo : setup this pass to utilize multiple light src. (<=4)
         int rsmIndex = 0;
         
-        //  prepare batches
-        opaques.clear();
-        this->pRSMPass->BuildBatchLists(&opaques, NULL, rsmIndex);
+        //  prepare batches (pass 1.2-T draws the transparent ones)
+        opaques_RSM.clear();
+        transparents_RSM.clear();
+        this->pRSMPass->BuildBatchLists(&opaques_RSM, &transparents_RSM, rsmIndex);
+
+        //  cull the batches against the light (the pyramid covers this quarter only)
+        const bool gpuCulling = pState->gpuCulling;
+        if (gpuCulling)
+            this->culling.cull(cmdBuf1, GPUCulling::View::RSM, opaques_RSM,
+                pPerFrameData->lights[rsmIndex].mLightViewProj, pState->occlusionCulling && rsmIndex == 0);
 
         //  determine render area
         VkRect2D rectScissor_RSM;
@@ -556,15 +789,35 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
                                 (int32_t)(viewportOffsetsY[rsmIndex] * viewportHeight) };
         rectScissor_RSM.extent = { viewportWidth, viewportHeight };
 
-        //  render scene (opaque objects)
-        this->rp_RSM_opaq.BeginPass(cmdBuf1, rectScissor_RSM);
+        //  the water-fitted quarter (next to this one) is cleared along
+        VkRect2D rectClear_RSM = rectScissor_RSM;
+        if (waterFitted)
         {
-            vkCmdSetStencilReference(cmdBuf1, VK_STENCIL_FACE_FRONT_AND_BACK, 1);  // need class design
-            this->pRSMPass->DrawBatchList(cmdBuf1, &opaques, rsmIndex);
+            assert(viewportOffsetsX[waterRSMIndex] == viewportOffsetsX[rsmIndex] + 1 && viewportOffsetsY[waterRSMIndex] == viewportOffsetsY[rsmIndex]);
+            rectClear_RSM.extent.width += viewportWidth;
         }
-        this->rp_RSM_opaq.EndPass(cmdBuf1);
+
+        //  render scene (opaque objects)
+        sections.push_back(ParallelRecorder::Section::make("RSM (Opaque)", &this->frameArena,
+            [this, &opaques_RSM, gpuCulling, rsmIndex, rectScissor_RSM, rectClear_RSM](VkCommandBuffer cmdBuf)
+        {
+            this->rp_RSM_opaq.BeginPass(cmdBuf, rectClear_RSM);
+            {
+                SetViewportAndScissor(cmdBuf, rectScissor_RSM.offset.x, rectScissor_RSM.offset.y,
+                    rectScissor_RSM.extent.width, rectScissor_RSM.extent.height);
+                vkCmdSetStencilReference(cmdBuf, VK_STENCIL_FACE_FRONT_AND_BACK, 1);  // need class design
+                if (gpuCulling)
+                    this->culling.drawBatchList(cmdBuf, GPUCulling::View::RSM, opaques_RSM,
+                        [this, rsmIndex](VkCommandBuffer cmdBuf, std::vector<BatchList>* pBatches) { this->pRSMPass->DrawBatchList(cmdBuf, pBatches, rsmIndex); });
+                else
+                    this->pRSMPass->DrawBatchList(cmdBuf, &opaques_RSM, rsmIndex);
+            }
+            this->rp_RSM_opaq.EndPass(cmdBuf);
+        }));
     }
 
+    cmdBuf1 = this->recordSections(cmdBuf1, sections, pState->parallelRecording);
+
     this->barrier_Cache_GO_RO(cmdBuf1); //////////////////////////////////////////////////////////////////////////////////
 
     //  save depth caches
@@ -602,6 +855,13 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
         this->cache_gbufDepthMipmap.Draw(cmdBuf1);
     }
 
+    //  depth pyramids for the next frame's occlusion culling
+    if (pState->gpuCulling && pState->occlusionCulling && pPerFrameData)
+    {
+        this->culling.buildHiZ(cmdBuf1, GPUCulling::View::GBuffer, pPerFrameData->mCameraCurrViewProj);
+        this->culling.buildHiZ(cmdBuf1, GPUCulling::View::RSM, pPerFrameData->lights[0].mLightViewProj);
+    }
+
     this->barrier_RT(cmdBuf1); ///////////////////////////////////////////////////////////////////////////////////////////
 
     //  Pass 1.2-T : reflective shadow map (transparent)
@@ -611,10 +871,7 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
         //  ToDo : rsmIndex is not a light index ( e.g. selected lights could be 0,2,3,5)
         int rsmIndex = 0;
 
-        //  prepare batches
-        transparents.clear();
-        this->pRSMPass->BuildBatchLists(NULL, &transparents, rsmIndex);
-        std::sort(transparents.begin(), transparents.end());
+        //  transparent batches come sorted back to front from BuildBatchLists
 
         //  determine render area
         VkRect2D rectScissor_RSM;
@@ -622,19 +879,52 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
                                 (int32_t)(viewportOffsetsY[rsmIndex] * viewportHeight) };
         rectScissor_RSM.extent = { viewportWidth, viewportHeight };
 
-        //  render scene (transparent objects)
-        this->rp_RSM_trans.BeginPass(cmdBuf1, rectScissor_RSM);
+        VkRect2D rectScissor_Water = rectScissor_RSM;
+        rectScissor_Water.offset = { (int32_t)(viewportOffsetsX[waterRSMIndex] * viewportWidth),
+                                (int32_t)(viewportOffsetsY[waterRSMIndex] * viewportHeight) };
+
+        //  ocean constants of both quarters
+        VkDescriptorBufferInfo oceanCB_RSM{}, oceanCB_Water{};
+#ifndef USE_TEST_SCENE
+        oceanConst.currViewProj = pPerFrameData->lights[rsmIndex].mLightViewProj;
+        oceanConst.rsmLight = pPerFrameData->lights[rsmIndex];
+        oceanCB_RSM = this->ocean.SetConstants(oceanConst);
+        if (waterFitted)
         {
-            vkCmdSetStencilReference(cmdBuf1, VK_STENCIL_FACE_FRONT_AND_BACK, 0); // need class design
+            oceanConst.currViewProj = waterLightView * waterLightProj;
+            oceanCB_Water = this->ocean.SetConstants(oceanConst);
+        }
+#endif
+        const uint32_t oceanIter = this->oceanIter;
+
+        sections.clear();
+        sections.push_back(ParallelRecorder::Section::make("RSM (Transparent)", &this->frameArena,
+            [=, &transparents_RSM](VkCommandBuffer cmdBuf)
+        {
+            //  render scene (transparent objects)
+            this->rp_RSM_trans.BeginPass(cmdBuf, rectScissor_RSM);
+            {
+                vkCmdSetStencilReference(cmdBuf, VK_STENCIL_FACE_FRONT_AND_BACK, 0); // need class design
 #ifdef USE_TEST_SCENE
-            this->pRSMPass->DrawBatchList(cmdBuf1, &transparents, rsmIndex);
+                this->pRSMPass->DrawBatchList(cmdBuf, &transparents_RSM, rsmIndex);
 #else
-            oceanConst.currViewProj = pPerFrameData->lights[rsmIndex].mLightViewProj;
-            oceanConst.rsmLight = pPerFrameData->lights[rsmIndex];
-            this->ocean.Draw(cmdBuf1, oceanConst, this->oceanIter, rsmIndex);
+                this->ocean.Draw(cmdBuf, oceanCB_RSM, oceanIter, rsmIndex);
 #endif
-        }
-        this->rp_RSM_trans.EndPass(cmdBuf1);
+            }
+            this->rp_RSM_trans.EndPass(cmdBuf);
+
+            //  render water-fitted quarter
+            if (waterFitted)
+            {
+                this->rp_RSM_trans.BeginPass(cmdBuf, rectScissor_Water);
+                {
+                    vkCmdSetStencilReference(cmdBuf, VK_STENCIL_FACE_FRONT_AND_BACK, 0); // need class design
+                    this->ocean.Draw(cmdBuf, oceanCB_Water, oceanIter, waterRSMIndex);
+                }
+                this->rp_RSM_trans.EndPass(cmdBuf);
+            }
+        }));
+        cmdBuf1 = this->recordSections(cmdBuf1, sections, pState->parallelRecording);
 
         rsmReady = true;
     }
@@ -643,30 +933,19 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
 
     if (gBufReady && rsmReady)
     {
-        //  pass 2.1 : D-light
-        //
-        this->dLighting->Draw(cmdBuf1, &this->rectScissor, &this->res_scene->m_perFrameConstants);
-        
-        //  pass 2.2 : I-light
-        //
-        ////  set uniform data
-        //IndirectLighting::per_frame* iLightingPerFrameData = this->iLighting->SetPerFrameConstants();
-        //iLightingPerFrameData->light = pPerFrameData->lights[0];
+        this->gTimeStamps.GetTimeStamp(cmdBuf1, "Preliminaries");
 
-        //this->iLighting->Draw(cmdBuf1, &this->rectScissor, ACTIVATE_ILIGHT);
+        //  shadow mask of the opaque surfaces, for pass 2.1
+        //
+        this->shadowMask.Draw(cmdBuf1, &this->res_scene->m_perFrameConstants);
 
-        this->gTimeStamps.GetTimeStamp(cmdBuf1, "Preliminaries");
+        this->gTimeStamps.GetTimeStamp(cmdBuf1, "Shadow Mask");
 
         //  pass 2.3 : Caustics
+        //  (runs ahead of D-light, so that its result can be composited there)
         //
-        Caustics::Constants causticsConstants{};
-        causticsConstants.camera.view = pCamera->GetView();
-        causticsConstants.camera.position = pCamera->GetPosition();
-        causticsConstants.camera.invTanHalfFovH = XMVectorGetX(pCamera->GetProjection().r[0]);
-        causticsConstants.camera.invTanHalfFovV = XMVectorGetY(pCamera->GetProjection().r[1]);
-        causticsConstants.camera.nearPlane = pCamera->GetNearPlane();
-        causticsConstants.camera.farPlane = pCamera->GetFarPlane();
-        causticsConstants.samplingMapScale = photonSampleScale;
+        setCausticsCamera(&causticsConstants, *pCamera);
+        causticsConstants.samplingMapScale = budgetSettings.photonSampleScale;
         causticsConstants.IOR = waterIOR;
         causticsConstants.rayThickness = 0.015f;
         causticsConstants.tMax = 100.f;
@@ -674,11 +953,7 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
         //  ToDo : setup this pass to utilize multiple light src. (<=4)
         //  ToDo : rsmIndex is not a light index ( e.g. selected lights could be 0,2,3,5)
         int rsmIndex = 0;
-        XMMATRIX lightProj; // ref from 'GltfCommon.cpp'
-        if (pPerFrameData->lights[rsmIndex].type == LightType_Spot)
-            lightProj = XMMatrixPerspectiveFovRH(acosf(pPerFrameData->lights[rsmIndex].outerConeCos) * 2.0f, 1, .1f, 100.0f);
-        else if (pPerFrameData->lights[rsmIndex].type == LightType_Directional)
-            lightProj = XMMatrixOrthographicRH(30.0, 30.0, 0.1f, 100.0f);
+        XMMATRIX lightProj = getRSMLightProjection(pPerFrameData->lights[rsmIndex]);
         float* lightPos = pPerFrameData->lights[rsmIndex].position;
         causticsConstants.lights[rsmIndex].view = pPerFrameData->lights[rsmIndex].mLightViewProj * XMMatrixInverse(nullptr, lightProj);
         causticsConstants.lights[rsmIndex].position = XMVectorSet(lightPos[0], lightPos[1], lightPos[2], 1.0f);
@@ -687,17 +962,59 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
         causticsConstants.lights[rsmIndex].nearPlane = .1f;
         causticsConstants.lights[rsmIndex].farPlane = 100.f;
 
+        //  emit photons from the water-fitted quarter
+        //  (only its projection differs, and it's only used for the area of a texel)
+        if (waterFitted)
+        {
+            causticsConstants.lights[waterRSMIndex] = causticsConstants.lights[rsmIndex];
+            causticsConstants.lights[waterRSMIndex].invTanHalfFovH = XMVectorGetX(waterLightProj.r[0]);
+            causticsConstants.lights[waterRSMIndex].invTanHalfFovV = XMVectorGetY(waterLightProj.r[1]);
+            causticsConstants.emissionLightIndex = waterRSMIndex;
+        }
+
+        this->caustics->setBackend(pState->causticsBackend);
+        this->caustics->setPhaseCache(pState->causticsPhaseCache);
+        this->caustics->setAmortization(pState->causticsAmortization);
+        this->caustics->setDensityFeedback(pState->causticsDensityFeedback);
+        this->caustics->setPersistentThreads(pState->causticsPersistentThreads);
+        this->caustics->setOceanPhase(this->oceanIter);
+        if (pState->sceneMoved)
+            this->caustics->invalidateLightSegments();
+        this->caustics->setDenoiserIterations(budgetSettings.causticsIterCount);
+
+        if (this->passCapture.isCaptureRequested(PassCapture::Pass::Caustics))
+        {
+            CausticsCapture settings;
+            settings.constants = causticsConstants;
+            settings.phaseCache = pState->causticsPhaseCache;
+            settings.amortization = pState->causticsAmortization;
+            settings.densityFeedback = pState->causticsDensityFeedback;
+            settings.persistentThreads = pState->causticsPersistentThreads;
+            settings.oceanPhase = this->oceanIter;
+            settings.denoiserIterations = budgetSettings.causticsIterCount;
+
+            std::vector<PassCapture::Image> inputs;
+            this->getPassInputs(PassCapture::Pass::Caustics, &inputs);
+            this->passCapture.capture(cmdBuf1, inputs, &settings, sizeof(settings), causticsCaptureVersion);
+        }
+
         this->caustics->Draw(cmdBuf1, this->rectScissor, causticsConstants);
 
-        //this->gTimeStamps.GetTimeStamp(cmdBuf1, "Caustics");
-    }
+        //  pass 2.1 : D-light
+        //  caustics irradiance is added to the lighting result on the fly (no aggregation pass)
+        //
+        float weights[] = { 1.0, 1.0, 0.0, 0.0 };
+        this->dLighting->Draw(cmdBuf1, &this->rectScissor, &this->res_scene->m_perFrameConstants, nullptr, weights);
 
-    this->barrier_A1(cmdBuf1); ////////////////////////////////////////////////////////////////////////////////////////////
+        //  pass 2.2 : I-light
+        //
+        ////  set uniform data
+        //IndirectLighting::per_frame* iLightingPerFrameData = this->iLighting->SetPerFrameConstants();
+        //iLightingPerFrameData->light = pPerFrameData->lights[0];
 
-    //  aggregate multiple pipeline results (opaques)
-    {
-        float weights[] = {1.0, 1.0, 0.0, 0.0};
-        this->aggregator_1.Draw(cmdBuf1, weights);
+        //this->iLighting->Draw(cmdBuf1, &this->rectScissor, ACTIVATE_ILIGHT);
+
+        this->gTimeStamps.GetTimeStamp(cmdBuf1, "D-Light");
     }
 
     this->barrier_GT_Cache_D(cmdBuf1); ////////////////////////////////////////////////////////////////////////////////////
@@ -705,10 +1022,6 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
     //  pass 3.1 : G-Buffer (transparent)
     if (this->pGltfPbrPass && pPerFrameData)
     {
-        //  retrieve render batch lists of separated opaque meshes and transparent meshes
-        transparents.clear();
-        this->pGltfPbrPass->BuildBatchLists(NULL, &transparents);
-
         //  determine render area
         VkRect2D rectScissor_GBuffer = this->rectScissor;
 
@@ -748,8 +1061,24 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
     if (gBufReady && rsmReady)
     {
         //  pass 4.1 : D-light
+        //  only transparent pixels are re-shaded : stencil was reset by pass 2.1
+        //  and marked again by pass 3.1, so we also clip the pass to the water's bounds.
         //
-        this->dLighting->Draw(cmdBuf1, &this->rectScissor, &this->res_scene->m_perFrameConstants);
+#ifdef USE_TEST_SCENE
+        VkRect2D rectScissor_DLight = this->rectScissor;
+#else
+        //  1 px against rounding, plus the projection jitter of TAA / the upscaler
+        const uint32_t boundsPadding = 1 + (uint32_t)ceilf(max(fabsf(this->jitter[0]), fabsf(this->jitter[1])));
+        VkRect2D rectScissor_DLight = oceanConst.calculateScreenBounds(this->width, this->height, boundsPadding);
+#endif
+        if (rectScissor_DLight.extent.width > 0 && rectScissor_DLight.extent.height > 0)
+        {
+            //  the water surface replaced the opaque one in the G-buffer, so its mask is recomputed
+            this->shadowMask.Draw(cmdBuf1, &this->res_scene->m_perFrameConstants, &rectScissor_DLight);
+            this->dLighting->Draw(cmdBuf1, &this->rectScissor, &this->res_scene->m_perFrameConstants, &rectScissor_DLight);
+        }
+
+        this->gTimeStamps.GetTimeStamp(cmdBuf1, "D-Light (Trans)");
 
         //  pass 4.2 : Reflection / Refraction
         Fresnel::Constants fresnelConst{};
@@ -759,12 +1088,29 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
         fresnelConst.camera.invTanHalfFovV = XMVectorGetY(pCamera->GetProjection().r[1]);
         fresnelConst.camera.nearPlane = pCamera->GetNearPlane();
         fresnelConst.camera.farPlane = pCamera->GetFarPlane();
-        fresnelConst.samplingMapScale = 1.25f;
+        fresnelConst.samplingMapScale = budgetSettings.fresnelSampleScale;
         fresnelConst.IOR = waterIOR;
         fresnelConst.rayThickness = 0.015f;
         fresnelConst.tMax = 100.f;
 
+        this->fresnel->setDenoiserIterations(budgetSettings.fresnelIterCount);
+        this->fresnel->setPersistentThreads(pState->fresnelPersistentThreads);
+
+        if (this->passCapture.isCaptureRequested(PassCapture::Pass::Fresnel))
+        {
+            FresnelCapture settings;
+            settings.constants = fresnelConst;
+            settings.persistentThreads = pState->fresnelPersistentThreads;
+            settings.denoiserIterations = budgetSettings.fresnelIterCount;
+
+            std::vector<PassCapture::Image> inputs;
+            this->getPassInputs(PassCapture::Pass::Fresnel, &inputs);
+            this->passCapture.capture(cmdBuf1, inputs, &settings, sizeof(settings), fresnelCaptureVersion);
+        }
+
         this->fresnel->Draw(cmdBuf1, this->rectScissor, fresnelConst);
+
+        this->gTimeStamps.GetTimeStamp(cmdBuf1, "Fresnel");
     }
 
     //  image barrier (synchronization) before aggregation
@@ -778,25 +1124,191 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
 
     this->barrier_AA(cmdBuf1); ///////////////////////////////////////////////////////////////////////////////////////////
 
-    if (pPerFrameData)
+    //  Note : TAA already done transition on 'm_HDR' for us, so we don't need explicit transition
+    VkImageView outputSRV = this->pGBuffer->m_HDRSRV;
+    if (this->isUpscaling())
+    {
+        //  resolve + upscale to the output extent (replaces TAA)
+        this->upscaler.Draw(cmdBuf1, this->jitter);
+
+        this->gTimeStamps.GetTimeStamp(cmdBuf1, "Upscale");
+
+        outputSRV = this->upscaler.GetTextureView();
+    }
+    else if (pPerFrameData)
     {
         //  resolve TAA
         this->tAA.Draw(cmdBuf1);
+
+        this->gTimeStamps.GetTimeStamp(cmdBuf1, "TAA");
+    }
+
+    //  auxiliary views, reusing the RSM & its caches (+ this frame's BIRT light-space results)
+    if (gBufReady && rsmReady)
+        this->renderAuxViews(cmdBuf1, pState, &oceanConst,
+            (pState->causticsBackend == Caustics::Backend::BIRT) ? &causticsConstants : nullptr);
+
+    this->submitAndPresent(pSwapChain, cmdBuf1, outputSRV);
+}
+
+void Renderer::renderAuxViews(VkCommandBuffer cmdBuf, const State* pState, Ocean::Constants* pOceanConst, const Caustics::Constants* pCausticsConst)
+{
+    static const char* timeStampLabels[MaxAuxViews] = { "Aux View 0", "Aux View 1", "Aux View 2", "Aux View 3" };
+
+    const uint32_t viewCount = min(pState->auxViewCount, (uint32_t)this->auxViews.size());
+    if (viewCount == 0)
+    {
+        this->auxRecordTime = 0;
+        return;
+    }
+    const double start = MillisecondsNow();
+
+    //  the sections bind the main view's per-frame constants as they are recorded
+    this->parallelRecorder.wait();
+
+    for (uint32_t i = 0; i < viewCount; i++)
+    {
+        AuxiliaryView* pView = this->auxViews[i];
+        const per_frame* pPerFrameData = this->setPerFrameData(&pState->pAuxCameras[i], pView->getWidth(), pView->getHeight());
+
+        //  built after the per-frame constants are set : the lists are frustum-culled against this camera,
+        //  and bind its constants when drawn
+        std::vector<GltfPbrPass::BatchList>& opaques = pView->getOpaqueBatches();
+        std::vector<GltfPbrPass::BatchList>& transparents = pView->getTransparentBatches();
+        opaques.clear();
+        transparents.clear();
+        this->pGltfPbrPass->BuildBatchLists(&opaques, &transparents);
+
+        SetPerfMarkerBegin(cmdBuf, "Aux View");
+
+        pView->getSkyDomePass().BeginPass(cmdBuf, pView->getRect());
+        this->drawSkyDome(cmdBuf, pPerFrameData);
+        pView->getSkyDomePass().EndPass(cmdBuf);
+
+        pView->getOpaquePass().BeginPass(cmdBuf, pView->getRect());
+        {
+            vkCmdSetStencilReference(cmdBuf, VK_STENCIL_FACE_FRONT_AND_BACK, 1); // need class design
+            this->pGltfPbrPass->DrawBatchList(cmdBuf, &opaques);
+        }
+        pView->getOpaquePass().EndPass(cmdBuf);
+
+        //  caustics before the water is drawn, as in the main view
+        if (pCausticsConst)
+        {
+            Caustics::Constants viewCausticsConst = *pCausticsConst;
+            setCausticsCamera(&viewCausticsConst, pState->pAuxCameras[i]);
+            pView->drawCaustics(cmdBuf, viewCausticsConst);
+        }
+        else
+            pView->barrier_GO_GT(cmdBuf);
+
+        pView->getTransparentPass().BeginPass(cmdBuf, pView->getRect());
+        {
+            vkCmdSetStencilReference(cmdBuf, VK_STENCIL_FACE_FRONT_AND_BACK, 1);  // need class design
+#ifdef USE_TEST_SCENE
+            this->pGltfPbrPass->DrawBatchList(cmdBuf, &transparents);
+#else
+            pOceanConst->currViewProj = pPerFrameData->mCameraCurrViewProj;
+            pOceanConst->prevViewProj = pPerFrameData->mCameraPrevViewProj;
+            this->ocean.Draw(cmdBuf, *pOceanConst, this->oceanIter);
+#endif
+        }
+        pView->getTransparentPass().EndPass(cmdBuf);
+
+        pView->drawLighting(cmdBuf, &this->res_scene->m_perFrameConstants, pCausticsConst != nullptr);
+
+        SetPerfMarkerEnd(cmdBuf);
+
+        this->gTimeStamps.GetTimeStamp(cmdBuf, timeStampLabels[i]);
+    }
+
+    this->auxViewsRendered = viewCount;
+    this->auxRecordTime = MillisecondsNow() - start;
+}
+
+per_frame* Renderer::setPerFrameData(const Camera* pCamera, uint32_t Width, uint32_t Height)
+{
+    //  set camera
+    per_frame* pPerFrameData = this->res_scene->m_pGLTFCommon->SetPerFrameData(*pCamera);
+
+    //  set light properties
+    pPerFrameData->iblFactor = 0.36f;
+    pPerFrameData->emmisiveFactor = 1.f;
+    pPerFrameData->invScreenResolution[0] = 1.f / static_cast<float>(Width);
+    pPerFrameData->invScreenResolution[1] = 1.f / static_cast<float>(Height);
+
+    //  setup light render target
+    int lightIndex = 0;
+    pPerFrameData->lights[lightIndex].shadowMapIndex = 0;
+    if (pPerFrameData->lights[lightIndex].type == LightType_Directional)
+    {
+        pPerFrameData->lights[lightIndex].depthBias = 100.0f / 100000.0f;
+    }
+    else if (pPerFrameData->lights[lightIndex].type == LightType_Spot)
+    {
+        pPerFrameData->lights[lightIndex].depthBias = 70.0f / 100000.0f;
     }
+    else
+        pPerFrameData->lights[lightIndex].shadowMapIndex = -1;
+
+    this->res_scene->SetPerFrameConstants();
+    return pPerFrameData;
+}
+
+void Renderer::drawSkyDome(VkCommandBuffer cmdBuf, const per_frame* pPerFrameData)
+{
+    SkyDomeProc::Constants skyDomeConstants;
+    skyDomeConstants.invViewProj = XMMatrixInverse(NULL, pPerFrameData->mCameraCurrViewProj);
+    skyDomeConstants.vSunDirection = XMVectorSet(1.0f, 0.05f, 0.0f, 0.0f); //pState->sunDir;
+    skyDomeConstants.turbidity = 10.0f;
+    skyDomeConstants.rayleigh = 2.0f;
+    skyDomeConstants.mieCoefficient = 0.005f;
+    skyDomeConstants.mieDirectionalG = 0.8f;
+    skyDomeConstants.luminance = 1.0f;
+    skyDomeConstants.sun = false; // ToDo : try false and see difference
+    this->skyDomeProc.Draw(cmdBuf, skyDomeConstants);
+}
+
+VkCommandBuffer Renderer::recordSections(VkCommandBuffer cmdBuf, const std::vector<ParallelRecorder::Section>& sections, bool parallel)
+{
+    //  the sections are submitted between what was recorded so far and what follows
+    VkResult res = vkEndCommandBuffer(cmdBuf);
+    assert(res == VK_SUCCESS);
+    this->parallelRecorder.queue(cmdBuf);
+    this->parallelRecorder.record(sections, parallel);
 
-    //  submit cmd buffer for rendering
+    VkCommandBuffer nextCmdBuf = this->cmdBufferRing.GetNewCommandList();
+    {
+        VkCommandBufferBeginInfo cmd_buf_info;
+        cmd_buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        cmd_buf_info.pNext = NULL;
+        cmd_buf_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        cmd_buf_info.pInheritanceInfo = NULL;
+        res = vkBeginCommandBuffer(nextCmdBuf, &cmd_buf_info);
+        assert(res == VK_SUCCESS);
+    }
+    return nextCmdBuf;
+}
+
+void Renderer::submitAndPresent(SwapChain* pSwapChain, VkCommandBuffer cmdBuf1, VkImageView hdrSRV)
+{
+    //  submit cmd buffers for rendering, in the order they were queued
     {
         VkResult res = vkEndCommandBuffer(cmdBuf1);
         assert(res == VK_SUCCESS);
 
+        this->parallelRecorder.queue(cmdBuf1);
+        this->mainRecordTime = MillisecondsNow() - this->recordStart;
+        const std::vector<VkCommandBuffer>& cmdBufs = this->parallelRecorder.finish();
+
         VkSubmitInfo submit_info;
         submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
         submit_info.pNext = NULL;
         submit_info.waitSemaphoreCount = 0;
         submit_info.pWaitSemaphores = NULL;
         submit_info.pWaitDstStageMask = NULL;
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &cmdBuf1;
+        submit_info.commandBufferCount = (uint32_t)cmdBufs.size();
+        submit_info.pCommandBuffers = cmdBufs.data();
         submit_info.signalSemaphoreCount = 0;
         submit_info.pSignalSemaphores = NULL;
         res = vkQueueSubmit(this->pDevice->GetGraphicsQueue(), 1, &submit_info, VK_NULL_HANDLE);
@@ -808,6 +1320,7 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
 
     //  preparing for a new frame
     this->cmdBufferRing.OnBeginFrame();
+    this->parallelRecorder.OnBeginFrame();
 
     //  start recording cmd buffer for tone-maping & GUI
     VkCommandBuffer cmdBuf2 = this->cmdBufferRing.GetNewCommandList();
@@ -830,20 +1343,49 @@ void Renderer::OnRender(SwapChain* pSwapChain, Camera* pCamera, Renderer::State*
         rp_begin.framebuffer = pSwapChain->GetFramebuffer(imageIndex);
         rp_begin.renderArea.offset.x = 0;
         rp_begin.renderArea.offset.y = 0;
-        rp_begin.renderArea.extent.width = this->width;
-        rp_begin.renderArea.extent.height = this->height;
+        rp_begin.renderArea.extent.width = this->outputWidth;
+        rp_begin.renderArea.extent.height = this->outputHeight;
         rp_begin.clearValueCount = 0;
         rp_begin.pClearValues = NULL;
         vkCmdBeginRenderPass(cmdBuf2, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
 
-        vkCmdSetScissor(cmdBuf2, 0, 1, &this->rectScissor);
-        vkCmdSetViewport(cmdBuf2, 0, 1, &this->viewport);
+        vkCmdSetScissor(cmdBuf2, 0, 1, &this->outputScissor);
+        vkCmdSetViewport(cmdBuf2, 0, 1, &this->outputViewport);
     }
 
     //  do tonemapping
     {
-        //  Note : TAA already done transition on 'm_HDR' for us, so we don't need explicit transition
-        this->toneMapping.Draw(cmdBuf2, this->pGBuffer->m_HDRSRV, 1.f, tonemappingMode);
+        this->toneMapping.Draw(cmdBuf2, hdrSRV, 1.f, tonemappingMode);
+    }
+
+    //  auxiliary views as thumbnails along the bottom of the window (flipped, as the output)
+    if (this->auxViewsRendered > 0)
+    {
+        const uint32_t thumbWidth = this->outputWidth / MaxAuxViews;
+        for (uint32_t i = 0; i < this->auxViewsRendered; i++)
+        {
+            AuxiliaryView* pView = this->auxViews[i];
+            const uint32_t thumbHeight = min(this->outputHeight, thumbWidth * pView->getHeight() / pView->getWidth());
+
+            VkViewport viewport;
+            viewport.x = (float)(i * thumbWidth);
+            viewport.y = (float)this->outputHeight;
+            viewport.width = (float)thumbWidth;
+            viewport.height = -(float)thumbHeight;
+            viewport.minDepth = 0.0f;
+            viewport.maxDepth = 1.0f;
+
+            VkRect2D scissor;
+            scissor.offset = { (int32_t)(i * thumbWidth), (int32_t)(this->outputHeight - thumbHeight) };
+            scissor.extent = { thumbWidth, thumbHeight };
+
+            vkCmdSetScissor(cmdBuf2, 0, 1, &scissor);
+            vkCmdSetViewport(cmdBuf2, 0, 1, &viewport);
+            pView->drawToneMapped(cmdBuf2, tonemappingMode);
+        }
+
+        vkCmdSetScissor(cmdBuf2, 0, 1, &this->outputScissor);
+        vkCmdSetViewport(cmdBuf2, 0, 1, &this->outputViewport);
     }
 
     //  render GUI
@@ -950,6 +1492,8 @@ int Renderer::loadScene(GLTFCommon* pLoader, int stage)
         Profile p("Caustics->registerScene");
 
         this->caustics->registerScene(this->res_scene);
+        this->caustics->invalidateLightSegments();
+        this->culling.registerScene(this->res_scene);
     }
     else if (stage == 5)
     {
@@ -977,6 +1521,7 @@ void Renderer::unloadScene()
     {
         this->caustics->deregisterScene();
     }
+    this->culling.deregisterScene();
 
     if (this->pGltfPbrPass)
     {
@@ -1000,6 +1545,167 @@ void Renderer::unloadScene()
     }
 }
 
+float Renderer::getCausticsTime() const
+{
+    //  caustics are recorded right after "Shadow Mask" and before "D-Light",
+    //  and each time stamp holds the time since the previous one.
+    float time = 0.f;
+    bool inCaustics = false;
+    for (const TimeStamp& timeStamp : this->timeStampRecords)
+    {
+        if (timeStamp.m_label == "D-Light")
+            break;
+        if (inCaustics)
+            time += timeStamp.m_microseconds;
+        if (timeStamp.m_label == "Shadow Mask")
+            inCaustics = true;
+    }
+    return time;
+}
+
+void Renderer::getViewTimes(float* pMainTime, float* pAuxTime) const
+{
+    //  auxiliary views are recorded last, each time stamp holds the time since the previous one
+    float mainTime = 0.f, auxTime = 0.f;
+    bool inAuxViews = false;
+    for (const TimeStamp& timeStamp : this->timeStampRecords)
+    {
+        if (timeStamp.m_label.compare(0, 8, "Aux View") == 0)
+        {
+            auxTime += timeStamp.m_microseconds;
+            inAuxViews = true;
+        }
+        else if (!inAuxViews)
+            mainTime += timeStamp.m_microseconds;
+    }
+    *pMainTime = mainTime;
+    *pAuxTime = auxTime;
+}
+
+float Renderer::getFresnelTime() const
+{
+    //  each time stamp holds the time since the previous one
+    for (const TimeStamp& timeStamp : this->timeStampRecords)
+    {
+        if (timeStamp.m_label == "Fresnel")
+            return timeStamp.m_microseconds;
+    }
+    return 0.f;
+}
+
+void Renderer::getPassInputs(PassCapture::Pass pass, std::vector<PassCapture::Image>* pImages)
+{
+    //  G-buffer & RSM targets are copied by shaders (GBuffer doesn't let them be transferred),
+    //  depth caches by transfers : depth aspect only (d32), mipmaps are generated again on replay
+    const VkImageAspectFlags color = VK_IMAGE_ASPECT_COLOR_BIT;
+    const VkImageAspectFlags depth = VK_IMAGE_ASPECT_DEPTH_BIT;
+    const VkImageLayout readLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    const VkImageLayout depthLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    if (pass == PassCapture::Pass::Caustics)
+    {
+        *pImages = {
+            { &this->pRSM->m_WorldCoord, this->pRSM->m_WorldCoordSRV, worldCoordFormat, color, readLayout },
+            { &this->pRSM->m_NormalBuffer, this->pRSM->m_NormalBufferSRV, normalFormat, color, readLayout },
+            { &this->pRSM->m_SpecularRoughness, this->pRSM->m_SpecularRoughnessSRV, specularRoughnessFormat, color, readLayout },
+            { &this->pRSM->m_EmissiveFlux, this->pRSM->m_EmissiveFluxSRV, emissiveFluxFormat, color, readLayout },
+            { &this->cache_rsmDepth, this->cache_rsmDepthSRV, depthFormat, depth, depthLayout },
+            { &this->cache_gbufDepth, this->cache_gbufDepthSRV, depthFormat, depth, depthLayout },
+            { &this->pGBuffer->m_NormalBuffer, this->pGBuffer->m_NormalBufferSRV, normalFormat, color, readLayout },
+            { &this->pGBuffer->m_MotionVectors, this->pGBuffer->m_MotionVectorsSRV, motionVectorFormat, color, readLayout },
+        };
+    }
+    else
+    {
+        *pImages = {
+            { &this->pGBuffer->m_WorldCoord, this->pGBuffer->m_WorldCoordSRV, worldCoordFormat, color, readLayout },
+            { &this->pGBuffer->m_NormalBuffer, this->pGBuffer->m_NormalBufferSRV, normalFormat, color, readLayout },
+            { &this->pGBuffer->m_SpecularRoughness, this->pGBuffer->m_SpecularRoughnessSRV, specularRoughnessFormat, color, readLayout },
+            { &this->pGBuffer->m_MotionVectors, this->pGBuffer->m_MotionVectorsSRV, motionVectorFormat, color, readLayout },
+            { &this->cache_gbufDepth, this->cache_gbufDepthSRV, depthFormat, depth, depthLayout },
+            { &this->cache_opaque, this->cache_opaqueSRV, hdrFormat, color, readLayout },
+        };
+    }
+}
+
+VkImageView Renderer::renderReplay(VkCommandBuffer cmdBuf)
+{
+    const PassCapture::Pass pass = this->passCapture.getReplayPass();
+
+    std::vector<PassCapture::Image> inputs;
+    this->getPassInputs(pass, &inputs);
+    this->passCapture.upload(cmdBuf, inputs);
+
+    if (pass == PassCapture::Pass::Caustics)
+    {
+        this->cache_rsmDepthMipmap.Draw(cmdBuf);
+        this->cache_gbufDepthMipmap.Draw(cmdBuf);
+        this->passCapture.beginPass(cmdBuf, &this->gTimeStamps);
+
+        CausticsCapture settings;
+        if (this->passCapture.getReplaySettings(&settings, sizeof(settings), causticsCaptureVersion))
+        {
+            this->caustics->setBackend(Caustics::Backend::BIRT);
+            this->caustics->setPhaseCache(settings.phaseCache != 0);
+            this->caustics->setAmortization(settings.amortization);
+            this->caustics->setDensityFeedback(settings.densityFeedback != 0);
+            this->caustics->setPersistentThreads(settings.persistentThreads != 0);
+            this->caustics->setOceanPhase(settings.oceanPhase);
+            this->caustics->setDenoiserIterations(settings.denoiserIterations);
+            this->caustics->Draw(cmdBuf, this->rectScissor, settings.constants);
+        }
+        return this->caustics->GetTextureView();
+    }
+    else
+    {
+        this->cache_gbufDepthMipmap.Draw(cmdBuf);
+        this->passCapture.beginPass(cmdBuf, &this->gTimeStamps);
+
+        FresnelCapture settings;
+        if (this->passCapture.getReplaySettings(&settings, sizeof(settings), fresnelCaptureVersion))
+        {
+            this->fresnel->setPersistentThreads(settings.persistentThreads != 0);
+            this->fresnel->setDenoiserIterations(settings.denoiserIterations);
+            this->fresnel->Draw(cmdBuf, this->rectScissor, settings.constants);
+        }
+        return this->fresnel->GetTextureView();
+    }
+}
+
+void Renderer::updateBudget(const State* pState)
+{
+    //  without a budget, stick to the hand-tuned settings
+    if (!pState->qualityBudget)
+    {
+        if (this->budgetEnabled)
+            this->budgetController.reset();
+        this->budgetEnabled = false;
+        return;
+    }
+
+    //  start from the hand-tuned settings
+    if (!this->budgetEnabled)
+        this->budgetController.reset();
+    this->budgetEnabled = true;
+
+    //  nothing measured yet (scene loading)
+    if (this->timeStampRecords.empty())
+        return;
+
+    const float timeMs = (this->getCausticsTime() + this->getFresnelTime()) * 1e-3f;
+    this->budgetController.update(timeMs, pState->qualityBudgetMs);
+
+    if (pState->qualityBudgetLog)
+    {
+        const BudgetController::Settings& settings = this->budgetController.getSettings();
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Budget: %.2f / %.2f ms (filtered %.2f), level %u : photon scale %.2f, caustics iter %u, fresnel scale %.2f, fresnel iter %u\n",
+            timeMs, pState->qualityBudgetMs, this->budgetController.getFilteredTime(), this->budgetController.getLevel(),
+            settings.photonSampleScale, settings.causticsIterCount, settings.fresnelSampleScale, settings.fresnelIterCount);
+        Trace(msg);
+    }
+}
+
 void Renderer::setupRenderPass()
 {
 }
@@ -1091,7 +1797,7 @@ void Renderer::barrier_DS(VkCommandBuffer cmdBuf)
 
     vkCmdPipelineBarrier(cmdBuf,
         VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
         0, 0, NULL, 0, NULL,
         numBarriers, barriers);
 }
@@ -1187,38 +1893,6 @@ void Renderer::barrier_D_C(VkCommandBuffer cmdBuf)
         5, barriers + 6);
 }
 
-void Renderer::barrier_A1(VkCommandBuffer cmdBuf)
-{
-    //  transition images
-    const uint32_t numBarriers = 1;
-    VkImageMemoryBarrier barriers[numBarriers];
-    barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barriers[0].pNext = NULL;
-    barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT; // no RAW or WAW hazard for sure, so this works
-    barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barriers[0].subresourceRange.baseMipLevel = 0;
-    barriers[0].subresourceRange.levelCount = 1;
-    barriers[0].subresourceRange.baseArrayLayer = 0;
-    barriers[0].subresourceRange.layerCount = 1;
-
-    //  barrier 0 : d-light
-    barriers[0].oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    barriers[0].newLayout = VK_IMAGE_LAYOUT_GENERAL;
-    barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barriers[0].image = this->pGBuffer->m_HDR.Resource();
-
-    //  barrier 1 : caustics
-    //  implicit barrier by its subpass dependency
-
-    vkCmdPipelineBarrier(cmdBuf,
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-        0, 0, NULL, 0, NULL,
-        numBarriers, barriers);
-}
-
 void Renderer::barrier_GT_Cache_D(VkCommandBuffer cmdBuf)
 {
     //  transition images
@@ -1274,9 +1948,9 @@ void Renderer::barrier_GT_Cache_D(VkCommandBuffer cmdBuf)
     {
         //  barrier 6 : HDR
         barriers[6] = barriers[0];
-        barriers[6].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barriers[6].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT; // written by D-light (+ caustics)
         barriers[6].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT; // ToDo : decomment when D-cache ready
-        barriers[6].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barriers[6].oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
         barriers[6].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL; // ToDo : decomment when D-cache ready
         barriers[6].image = this->pGBuffer->m_HDR.Resource(); 
 
@@ -1290,7 +1964,7 @@ void Renderer::barrier_GT_Cache_D(VkCommandBuffer cmdBuf)
     }
 
     vkCmdPipelineBarrier(cmdBuf,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
         VK_PIPELINE_STAGE_TRANSFER_BIT, // ToDo : decomment when D-cache ready
         0, 0, NULL, 0, NULL,
         2, &barriers[6]);
@@ -1343,7 +2017,7 @@ void Renderer::barrier_DT_RF(VkCommandBuffer cmdBuf)
 
     vkCmdPipelineBarrier(cmdBuf,
         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, // shadow mask reads world coord
         0, 0, NULL, 0, NULL,
         numBarriers - 2, barriers);
 
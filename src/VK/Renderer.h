@@ -1,11 +1,18 @@
 #pragma once
 
 #include "DirectLighting.h"
+#include "ShadowMask.h"
+#include "GPUCulling.h"
 #include "Caustics.h"
 #include "Fresnel.h"
 //#include "IndirectLighting.h"
 #include "Ocean.h"
 #include "Aggregator.h"
+#include "TemporalUpscaler.h"
+#include "AuxiliaryView.h"
+#include "BudgetController.h"
+#include "PassCapture.h"
+#include "ParallelRecorder.h"
 
 //#define USE_TEST_SCENE
 
@@ -19,13 +26,56 @@ public:
 
 		XMVECTOR sunDir;
 		float DIWeight = 0.5f; // 0 = full dLight, 1 = full iLight
+
+		Caustics::Backend causticsBackend = Caustics::Backend::BIRT;
+		bool causticsPhaseCache = false; // static light & receivers only
+		uint32_t causticsAmortization = 1; // 1, 2 or 4
+		bool causticsFitWater = false; // emit photons from an RSM fitted to the water surface
+		bool causticsDensityFeedback = false; // view-dependent photon density
+		bool causticsPersistentThreads = false; // trace the compacted photons with persistent threads
+		bool fresnelPersistentThreads = false; // trace the Fresnel samples with persistent threads
+
+		//	world matrices of the scene changed this frame (see SceneTransforms) : the light-space caches are stale
+		bool sceneMoved = false;
+
+		//	GPU time budget of caustics + Fresnel, see BudgetController
+		bool qualityBudget = false;
+		float qualityBudgetMs = 4.f;
+		bool qualityBudgetLog = false; // trace the chosen settings every frame
+
+		//	GPU culling of the opaque G-buffer & RSM batches, see GPUCulling
+		bool gpuCulling = true;
+		//	single pass against the previous frame's depth : batches culled by it aren't re-tested against this frame's,
+		//	so disoccluded geometry (and RSM casters) show up a frame late. off unless traded for the saved draws.
+		bool occlusionCulling = false;
+
+		//	record the opaque G-buffer & RSM passes on worker threads, see ParallelRecorder
+		bool parallelRecording = true;
+
+		//	cameras of the auxiliary views rendered this frame (up to the created ones), see AuxiliaryView
+		const Camera* pAuxCameras = nullptr;
+		uint32_t auxViewCount = 0;
 	};
 
+	static const uint32_t MaxAuxViews = 4;
+
 	//	mandatory methods
 	void OnCreate(Device* pDevice, SwapChain* pSwapChain);
 	void OnDestroy();
+	//	window side only : the tone-mapped image is stretched over the swap chain, nothing else is reallocated
 	void OnCreateWindowSizeDependentResources(SwapChain* pSwapChain, uint32_t Width, uint32_t Height);
 	void OnDestroyWindowSizeDependentResources();
+	//	targets of every pass (G-buffer, caches, effects, TAA), at the extent the scene is rendered at.
+	//	below UpscaledWidth x UpscaledHeight, the temporal upscaler replaces TAA and outputs at that extent.
+	//	the GPU must be idle : any change of the render extent (window or render scale) is a flush + full re-allocation.
+	//	the tracing, SVGF and caustics-map passes take the view extent as a constant (from the render area), but
+	//	Cauldron's TAA, tone mapping and depth downsampler still read whole targets, so these stay sized at the extent.
+	void OnCreateRenderResources(uint32_t Width, uint32_t Height, uint32_t UpscaledWidth, uint32_t UpscaledHeight);
+	void OnDestroyRenderResources();
+	//	views rendered after the main one, sharing its light-side work, shown as thumbnails over it.
+	//	the GPU must be idle.
+	void OnCreateAuxViews(uint32_t Count, uint32_t Width, uint32_t Height);
+	void OnDestroyAuxViews();
 	void OnRender(SwapChain* pSwapChain, Camera* pCamera, State* pState);
 
 	int loadScene(GLTFCommon* pLoader, int stage);
@@ -34,19 +84,103 @@ public:
 	const std::vector<TimeStamp>& getTimeStamps() const
 	{ return this->timeStampRecords; }
 
+	//	0 x 0 if the render resources are not created
+	uint32_t getRenderWidth() const
+	{ return this->width; }
+	uint32_t getRenderHeight() const
+	{ return this->height; }
+	uint32_t getUpscaledWidth() const
+	{ return this->upscaledWidth; }
+	uint32_t getUpscaledHeight() const
+	{ return this->upscaledHeight; }
+
+	//	GPU time (us.) spent in caustics, from the latest time stamps
+	float getCausticsTime() const;
+	//	GPU time (us.) spent in Fresnel, from the latest time stamps
+	float getFresnelTime() const;
+	//	GPU time (us.) of the main view, and of all the auxiliary views, from the latest time stamps
+	void getViewTimes(float* pMainTime, float* pAuxTime) const;
+
+	uint32_t getAuxViewCount() const
+	{ return (uint32_t)this->auxViews.size(); }
+	//	CPU time spent recording the auxiliary views, last frame (ms.)
+	double getAuxRecordTime() const
+	{ return this->auxRecordTime; }
+
+	const BudgetController& getBudgetController() const
+	{ return this->budgetController; }
+	VkDeviceSize getCausticsMemoryFootprint(Caustics::Backend backend) const
+	{ return this->caustics ? this->caustics->getMemoryFootprint(backend) : 0; }
+	float getLightSegmentReuse() const
+	{ return this->caustics ? this->caustics->getLightSegmentReuse() : 0.f; }
+	bool isPersistentThreadsSupported() const
+	{ return this->caustics && this->caustics->isPersistentThreadsSupported(); }
+	bool isFresnelPersistentThreadsSupported() const
+	{ return this->fresnel && this->fresnel->isPersistentThreadsSupported(); }
+
+	//	restart the ocean animation, so that replayed frames see the same water surface
+	void resetAnimation()
+	{ this->accumTime = 0; this->oceanIter = 0; }
+
+	//	save the inputs of a pass into a file, the next time it runs (see PassCapture)
+	void requestCapture(PassCapture::Pass pass, const char* path)
+	{ this->passCapture.requestCapture(pass, path); }
+	//	run only the pass of a capture file, frameCount times after warm-up, then trace its timings.
+	//	the window must have the extent it was captured with.
+	bool startReplay(const char* path, uint32_t frameCount)
+	{ return this->passCapture.startReplay(path, frameCount); }
+	bool isReplaying() const
+	{ return this->passCapture.isReplaying(); }
+
+	//	CPU time spent recording the last frame : by the main thread, then by each parallel section
+	double getMainRecordTime() const
+	{ return this->mainRecordTime; }
+	const std::vector<ParallelRecorder::RecordTime>& getSectionRecordTimes() const
+	{ return this->parallelRecorder.getRecordTimes(); }
+	const std::vector<JobSystem::WorkerStats>& getWorkerStats() const
+	{ return this->jobSystem.getWorkerStats(); }
+	JobSystem* getJobSystem()
+	{ return &this->jobSystem; }
+
+	//	batches culled a few frames ago
+	const GPUCulling::Stats& getCullingStats(GPUCulling::View view) const
+	{ return this->culling.getStats(view); }
+
 protected:
 
 	//	pointer to device
 	Device* pDevice = nullptr;
+	SwapChain* pSwapChain = nullptr;
 
-	uint32_t width, height;
+	//	render extent
+	uint32_t width = 0, height = 0;
+	//	extent of the temporally resolved image, the render extent's if not upscaled
+	uint32_t upscaledWidth = 0, upscaledHeight = 0;
 
 	//	viewport & rectangle scissor
 	VkViewport viewport;
 	VkRect2D rectScissor;
 
+	//	window extent, tone mapping & GUI
+	uint32_t outputWidth = 0, outputHeight = 0;
+	VkViewport outputViewport;
+	VkRect2D outputScissor;
+
+	//	copied every frame : the labels stay within std::string's small buffer (15 chars with MSVC) not to allocate
 	std::vector<TimeStamp> timeStampRecords;
 
+	//	quality knobs of caustics + Fresnel
+	BudgetController budgetController;
+	bool budgetEnabled = false;
+
+	void updateBudget(const State* pState);
+
+	//	pass-level capture & replay
+	PassCapture passCapture;
+
+	void getPassInputs(PassCapture::Pass pass, std::vector<PassCapture::Image>* pImages);
+	VkImageView renderReplay(VkCommandBuffer cmdBuf);
+
 	//	animation
 	double accumTime{ 0 };
 	uint32_t oceanIter{ 0 };
@@ -60,9 +194,12 @@ protected:
 	DynamicBufferRing dBufferRing;	// uniform buffers
 	ResourceViewHeaps resViewHeaps;	// descriptor sets
 	CommandListRing cmdBufferRing;	// command buffers
+	ParallelRecorder parallelRecorder; // command buffers recorded on worker threads
+	FrameArena frameArena;			// data living one frame
 	UploadHeap uploadHeap;			// staging buffers
 	GPUTimestamps gTimeStamps;
-	AsyncPool asyncPool;
+	AsyncPool asyncPool;			// Cauldron's loaders
+	JobSystem jobSystem;			// engine-side CPU tasks
 
 	//	resources handles
 	GLTFTexturesAndBuffers* res_scene = nullptr;
@@ -85,9 +222,18 @@ protected:
 
 	//	caches mipmap
 	DownSamplePS cache_rsmDepthMipmap, cache_gbufDepthMipmap;
+
+	//	visibility of the opaque batches
+	GPUCulling culling;
+
+	//	batch lists & parallel sections, kept across frames so that their storage is reused
+	std::vector<GltfPbrPass::BatchList> batches_opaque, batches_transparent,
+		batches_opaqueRSM, batches_transparentRSM;
+	std::vector<ParallelRecorder::Section> sections;
 	
 	//	lighting passes
 	DirectLighting* dLighting = nullptr;
+	ShadowMask shadowMask;
 
 	//	GI effects
 	Fresnel* fresnel = nullptr;
@@ -101,18 +247,41 @@ protected:
 	GBufferRenderPass rp_skyDome;
 
 	//	post-processing handle
-	Aggregator aggregator_1, aggregator_2;
+	Aggregator aggregator_2;
 	ToneMapping toneMapping;
 	TAA tAA;
+	TemporalUpscaler upscaler;
+	float jitter[2] = { 0.f, 0.f }; // of the current frame, in render pixels
+
+	bool isUpscaling() const
+	{ return this->upscaledWidth != this->width || this->upscaledHeight != this->height; }
+
+	//	auxiliary views
+	std::vector<AuxiliaryView*> auxViews;
+	uint32_t auxViewsRendered = 0; // this frame
+	double auxRecordTime = 0;
+
+	//	pCausticsConst : the main view's caustics constants if BIRT ran this frame, nullptr otherwise
+	void renderAuxViews(VkCommandBuffer cmdBuf, const State* pState, Ocean::Constants* pOceanConst, const Caustics::Constants* pCausticsConst);
+
+	//	set the camera & lights of the per-frame constants (drawn passes read them when recorded)
+	per_frame* setPerFrameData(const Camera* pCamera, uint32_t Width, uint32_t Height);
+	void drawSkyDome(VkCommandBuffer cmdBuf, const per_frame* pPerFrameData);
 	
 	//	ToDo : setup renderpass containing multiple subpasses instead
 	void setupRenderPass();
 
+	//	submit the main cmd buffer, then tone-map the HDR image + GUI into the next swapchain image
+	void submitAndPresent(SwapChain* pSwapChain, VkCommandBuffer cmdBuf1, VkImageView hdrSRV);
+
+	//	queue the sections after cmdBuf, returns the cmd buffer the main thread continues in
+	VkCommandBuffer recordSections(VkCommandBuffer cmdBuf, const std::vector<ParallelRecorder::Section>& sections, bool parallel);
+	double recordStart = 0, mainRecordTime = 0;
+
 	void barrier_Cache_GO_RO(VkCommandBuffer cmdBuf);
 	void barrier_DS(VkCommandBuffer cmdBuf); // future : DS_AO_I1
 	void barrier_RT(VkCommandBuffer cmdBuf); // future : RT_I2
 	void barrier_D_C(VkCommandBuffer cmdBuf);
-	void barrier_A1(VkCommandBuffer cmdBuf);
 	void barrier_GT_Cache_D(VkCommandBuffer cmdBuf);
 	void barrier_DT_RF(VkCommandBuffer cmdBuf);
 	void barrier_A2(VkCommandBuffer cmdBuf);
@@ -1,13 +1,55 @@
 #include "SVGF.h"
 
+#ifdef SVGF_ERROR_REPORT
+#include <DirectXPackedVector.h>
+
+//	frames between two reports. the readback is consumed this many frames after it was recorded,
+//	which must be larger than the number of frames in flight.
+static const uint32_t errorReportInterval = 240;
+static const uint32_t errorReportLatency = 4;
+#endif
+
+//	storage support of the packed formats is optional (only r16g16b16a16f is required of the full ones)
+static bool isStorageSupported(Device* pDevice, SVGF::Formats formats)
+{
+	if (formats == SVGF::Formats::Full)
+		return true;
+
+	const VkFormat packedFormats[] = {
+		VK_FORMAT_B10G11R11_UFLOAT_PACK32,
+		VK_FORMAT_R16_SFLOAT,
+		VK_FORMAT_R16G16_SFLOAT,
+		VK_FORMAT_R8_UINT
+	};
+	for (VkFormat format : packedFormats)
+	{
+		VkFormatProperties props;
+		vkGetPhysicalDeviceFormatProperties(pDevice->GetPhysicalDevice(), format, &props);
+		if ((props.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) == 0)
+			return false;
+	}
+	return true;
+}
+
 void SVGF::OnCreate(Device* pDevice, 
 	ResourceViewHeaps* pResourceViewHeaps, 
-	DynamicBufferRing* pDynamicBufferRing)
+	DynamicBufferRing* pDynamicBufferRing,
+	SVGF::Formats formats,
+	const char* name)
 {
 	this->pDevice = pDevice;
 	this->pResourceViewHeaps = pResourceViewHeaps;
 	this->pDynamicBufferRing = pDynamicBufferRing;
 
+	this->formats = formats;
+	this->name = name;
+
+	if (!isStorageSupported(pDevice, formats))
+	{
+		Trace("SVGF [" + this->name + "] : packed formats not supported as storage images, falling back to full ones\n");
+		this->formats = SVGF::Formats::Full;
+	}
+
 	//  create default sampler
 	{
 		VkSamplerCreateInfo info = {};
@@ -25,86 +67,28 @@ void SVGF::OnCreate(Device* pDevice,
 		assert(res == VK_SUCCESS);
 	}
 
-	//	temporal accumulation pass
-	{
-		//	create renderr pass
-		//	render targets refer to intermediate buffers
-		VkAttachmentDescription att_desc[3];
-		AttachNoClearBeforeUse(
-			VK_FORMAT_R16G16B16A16_SFLOAT/*VK_FORMAT_R16G16B16A16_UNORM*/,
-			(VkSampleCountFlagBits)1,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			&att_desc[0]);
-		AttachNoClearBeforeUse(
-			VK_FORMAT_R16G16B16A16_SFLOAT/*VK_FORMAT_R16G16B16A16_UNORM*/,
-			(VkSampleCountFlagBits)1,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			&att_desc[1]);
-		AttachNoClearBeforeUse(
-			VK_FORMAT_R8_UINT/*VK_FORMAT_R16G16B16A16_UNORM*/,
-			(VkSampleCountFlagBits)1,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			&att_desc[2]);
-		this->ta_renderPass = CreateRenderPassOptimal(this->pDevice->GetDevice(), 3, att_desc, NULL);
-
+	//	temporal accumulation + variance estimation pass
+	{
 		DefineList defines;
+		if (this->formats == SVGF::Formats::Packed)
+			defines["SVGF_PACKED_FORMATS"] = "1";
 		this->createTADescriptors(defines);
-
-		VkPipelineColorBlendAttachmentState att_state[3];
-		att_state[0].colorWriteMask = 0xf;
-		att_state[0].blendEnable = VK_FALSE;
-		att_state[0].alphaBlendOp = VK_BLEND_OP_ADD;
-		att_state[0].colorBlendOp = VK_BLEND_OP_ADD;
-		att_state[0].srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-		att_state[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-		att_state[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-		att_state[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-		att_state[1] = att_state[0];
-		att_state[2] = att_state[0];
-
-		VkPipelineColorBlendStateCreateInfo cb;
-		cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		cb.flags = 0;
-		cb.pNext = NULL;
-		cb.attachmentCount = 3;
-		cb.pAttachments = att_state;
-		cb.logicOpEnable = VK_FALSE;
-		cb.logicOp = VK_LOGIC_OP_NO_OP;
-		cb.blendConstants[0] = 1.0f;
-		cb.blendConstants[1] = 1.0f;
-		cb.blendConstants[2] = 1.0f;
-		cb.blendConstants[3] = 1.0f;
 		this->tmpAccum.OnCreate(
 			this->pDevice, 
-			this->ta_renderPass,
 			"SVGFReproject.glsl", "main", "", 
-			NULL, pDynamicBufferRing, 
-			this->ta_descriptorSetLayout, &cb, VK_SAMPLE_COUNT_1_BIT, 
+			this->ta_descriptorSetLayout, 0, 0, 0, 
 			&defines);
 
 		//	update descsciptors
-		this->pDynamicBufferRing->SetDescriptorSet(0, sizeof(SVGF::Constants), this->ta_descriptorSet);
-	}
-
-	//	variance estimation pass
-	{
-		DefineList defines;
-		this->createVEDescriptors(defines);
-		this->varEst.OnCreate(
-			this->pDevice, 
-			"SVGFStabilityBoost.glsl", "main", "", 
-			this->ve_descriptorSetLayout, 0, 0, 0, 
-			&defines);
-
-		this->pDynamicBufferRing->SetDescriptorSet(0, sizeof(SVGF::Constants), this->ve_descriptorSet);
+		for (uint32_t i = 0; i < 2; i++)
+			this->pDynamicBufferRing->SetDescriptorSet(0, sizeof(SVGF::Constants), this->ta_descriptorSet[i]);
 	}
 
 	//	a-trous wavelet transform pass
 	{
 		DefineList defines;
+		if (this->formats == SVGF::Formats::Packed)
+			defines["SVGF_PACKED_FORMATS"] = "1";
 		this->createATDescriptors(defines);
 		this->aTrous.OnCreate(
 			this->pDevice, 
@@ -112,23 +96,39 @@ void SVGF::OnCreate(Device* pDevice,
 			this->at_descriptorSetLayout, 0, 0, 0, 
 			&defines, sizeof(uint32_t));
 
-		this->pDynamicBufferRing->SetDescriptorSet(0, sizeof(SVGF::Constants), this->at_descriptorSet);
+		for (uint32_t i = 0; i < 2; i++)
+			this->pDynamicBufferRing->SetDescriptorSet(0, sizeof(SVGF::Constants), this->at_descriptorSet[i]);
 	}
+
+#ifdef SVGF_ERROR_REPORT
+	//	full-precision reference
+	if (this->formats != SVGF::Formats::Full)
+	{
+		this->pReference = new SVGF();
+		this->pReference->OnCreate(pDevice, pResourceViewHeaps, pDynamicBufferRing, SVGF::Formats::Full, "reference");
+	}
+#endif
 }
 
 void SVGF::OnDestroy()
 {
+#ifdef SVGF_ERROR_REPORT
+	if (this->pReference)
+	{
+		this->pReference->OnDestroy();
+		delete this->pReference;
+		this->pReference = nullptr;
+	}
+#endif
+
 	this->aTrous.OnDestroy();
-	this->pResourceViewHeaps->FreeDescriptor(this->at_descriptorSet);
+	for (uint32_t i = 0; i < 2; i++)
+		this->pResourceViewHeaps->FreeDescriptor(this->at_descriptorSet[i]);
 	vkDestroyDescriptorSetLayout(this->pDevice->GetDevice(), this->at_descriptorSetLayout, nullptr);
 
-	this->varEst.OnDestroy();
-	this->pResourceViewHeaps->FreeDescriptor(this->ve_descriptorSet);
-	vkDestroyDescriptorSetLayout(this->pDevice->GetDevice(), this->ve_descriptorSetLayout, nullptr);
-
 	this->tmpAccum.OnDestroy();
-	vkDestroyRenderPass(this->pDevice->GetDevice(), this->ta_renderPass, nullptr);
-	this->pResourceViewHeaps->FreeDescriptor(this->ta_descriptorSet);
+	for (uint32_t i = 0; i < 2; i++)
+		this->pResourceViewHeaps->FreeDescriptor(this->ta_descriptorSet[i]);
 	vkDestroyDescriptorSetLayout(this->pDevice->GetDevice(), this->ta_descriptorSetLayout, nullptr);
 
 	vkDestroySampler(this->pDevice->GetDevice(), this->sampler_default, nullptr);
@@ -146,12 +146,16 @@ void SVGF::OnCreateWindowSizeDependentResources(
 	this->inputHDRSRV = targetSRV;
 	this->pInputGBuffer = pGBuffer;
 
+	const bool packed = (this->formats == SVGF::Formats::Packed);
+	const VkFormat colorFormat = packed ? VK_FORMAT_B10G11R11_UFLOAT_PACK32 : VK_FORMAT_R16G16B16A16_SFLOAT;
+	const VkFormat momentFormat = packed ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R16G16B16A16_SFLOAT;
+
 	//	cache buffer (previous frame)
 	{
 		this->cache_HDR.InitRenderTarget(
 			this->pDevice,
 			this->outWidth, this->outHeight,
-			VK_FORMAT_R16G16B16A16_SFLOAT/*VK_FORMAT_R16G16B16A16_UNORM*/,
+			colorFormat,
 			VK_SAMPLE_COUNT_1_BIT,
 			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
 			false,
@@ -159,38 +163,58 @@ void SVGF::OnCreateWindowSizeDependentResources(
 		);
 		this->cache_HDR.CreateSRV(&this->cache_HDRSRV);
 
-		this->cache_Normal.InitRenderTarget(
-			this->pDevice,
-			this->outWidth, this->outHeight,
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			VK_SAMPLE_COUNT_1_BIT,
-			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
-			false,
-			"SVGF Cached Normal"
-		);
-		this->cache_Normal.CreateSRV(&this->cache_NormalSRV);
-
-		this->cache_DepthMoment.InitRenderTarget(
-			this->pDevice,
-			this->outWidth, this->outHeight,
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			VK_SAMPLE_COUNT_1_BIT,
-			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
-			false,
-			"SVGF Cached DepthMoment"
-		);
-		this->cache_DepthMoment.CreateSRV(&this->cache_DepthMomentSRV);
+		if (packed)
+		{
+			this->cache_Variance.InitRenderTarget(
+				this->pDevice,
+				this->outWidth, this->outHeight,
+				VK_FORMAT_R16_SFLOAT,
+				VK_SAMPLE_COUNT_1_BIT,
+				VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+				false,
+				"SVGF Cached Variance"
+			);
+			this->cache_Variance.CreateSRV(&this->cache_VarianceSRV);
+		}
 
-		this->cache_History.InitRenderTarget(
-			this->pDevice,
-			this->outWidth, this->outHeight,
-			VK_FORMAT_R8_UINT,
-			VK_SAMPLE_COUNT_1_BIT,
-			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
-			false,
-			"SVGF Cached History"
-		);
-		this->cache_History.CreateSRV(&this->cache_HistorySRV);
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			this->cache_Guide[i].InitRenderTarget(
+				this->pDevice,
+				this->outWidth, this->outHeight,
+				VK_FORMAT_R16G16B16A16_SFLOAT,
+				VK_SAMPLE_COUNT_1_BIT,
+				VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+				false,
+				"SVGF Cached Guide"
+			);
+			this->cache_Guide[i].CreateSRV(&this->cache_GuideSRV[i]);
+
+			this->cache_MomentHistory[i].InitRenderTarget(
+				this->pDevice,
+				this->outWidth, this->outHeight,
+				momentFormat,
+				VK_SAMPLE_COUNT_1_BIT,
+				VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+				false,
+				"SVGF Cached MomentHistory"
+			);
+			this->cache_MomentHistory[i].CreateSRV(&this->cache_MomentHistorySRV[i]);
+
+			if (packed)
+			{
+				this->cache_History[i].InitRenderTarget(
+					this->pDevice,
+					this->outWidth, this->outHeight,
+					VK_FORMAT_R8_UINT,
+					VK_SAMPLE_COUNT_1_BIT,
+					VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+					false,
+					"SVGF Cached History"
+				);
+				this->cache_History[i].CreateSRV(&this->cache_HistorySRV[i]);
+			}
+		}
 	}
 
 	//	intermediate buffer
@@ -198,163 +222,214 @@ void SVGF::OnCreateWindowSizeDependentResources(
 		this->imd_HDR.InitRenderTarget(
 			this->pDevice,
 			this->outWidth, this->outHeight,
-			VK_FORMAT_R16G16B16A16_SFLOAT/*VK_FORMAT_R16G16B16A16_UNORM*/,
+			colorFormat,
 			VK_SAMPLE_COUNT_1_BIT,
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
 			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
 			false,
 			"SVGF Intermediate HDR"
 		);
 		this->imd_HDR.CreateSRV(&this->imd_HDRSRV);
 
-		this->imd_DepthMoment.InitRenderTarget(
-			this->pDevice,
-			this->outWidth, this->outHeight,
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			VK_SAMPLE_COUNT_1_BIT,
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-			false,
-			"SVGF Intermediate DepthMoment"
-		);
-		this->imd_DepthMoment.CreateSRV(&this->imd_DepthMomentSRV);
-
-		this->imd_History.InitRenderTarget(
-			this->pDevice,
-			this->outWidth, this->outHeight,
-			VK_FORMAT_R8_UINT,
-			VK_SAMPLE_COUNT_1_BIT,
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-			false,
-			"SVGF Intermediate History"
-		);
-		this->imd_History.CreateSRV(&this->imd_HistorySRV);
+		if (packed)
+		{
+			this->imd_Variance.InitRenderTarget(
+				this->pDevice,
+				this->outWidth, this->outHeight,
+				VK_FORMAT_R16_SFLOAT,
+				VK_SAMPLE_COUNT_1_BIT,
+				VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+				false,
+				"SVGF Intermediate Variance"
+			);
+			this->imd_Variance.CreateSRV(&this->imd_VarianceSRV);
+		}
 	}
 
 	//	update descriptor for each pass
-	//	temporal accumulation
+	//	(one set per frame parity, since the guide & moment caches are ping-ponged)
+	for (uint32_t cur = 0; cur < 2; cur++)
 	{
-		SetDescriptorSet(this->pDevice->GetDevice(), 1, targetSRV, &this->sampler_default, this->ta_descriptorSet);
-		SetDescriptorSet(this->pDevice->GetDevice(), 2, pGBuffer->m_NormalBufferSRV, &this->sampler_default, this->ta_descriptorSet);
-		SetDescriptorSetForDepth(this->pDevice->GetDevice(), 3, depthSRV, &this->sampler_default, this->ta_descriptorSet);
-		SetDescriptorSet(this->pDevice->GetDevice(), 4, pGBuffer->m_MotionVectorsSRV, &this->sampler_default, this->ta_descriptorSet);
+		const uint32_t prev = cur ^ 1;
 
-		SetDescriptorSet(this->pDevice->GetDevice(), 5, this->cache_HDRSRV, &this->sampler_default, this->ta_descriptorSet);
-		SetDescriptorSet(this->pDevice->GetDevice(), 6, this->cache_NormalSRV, &this->sampler_default, this->ta_descriptorSet);
-		SetDescriptorSet(this->pDevice->GetDevice(), 7, this->cache_DepthMomentSRV, &this->sampler_default, this->ta_descriptorSet);
+		//	temporal accumulation + variance estimation
+		{
+			VkDescriptorSet descSet = this->ta_descriptorSet[cur];
+
+			SetDescriptorSet(this->pDevice->GetDevice(), 1, targetSRV, &this->sampler_default, descSet);
+			SetDescriptorSet(this->pDevice->GetDevice(), 2, pGBuffer->m_NormalBufferSRV, &this->sampler_default, descSet);
+			SetDescriptorSetForDepth(this->pDevice->GetDevice(), 3, depthSRV, &this->sampler_default, descSet);
+			SetDescriptorSet(this->pDevice->GetDevice(), 4, pGBuffer->m_MotionVectorsSRV, &this->sampler_default, descSet);
+
+			SetDescriptorSet(this->pDevice->GetDevice(), 5, this->cache_HDRSRV, &this->sampler_default, descSet);
+			SetDescriptorSet(this->pDevice->GetDevice(), 6, this->cache_GuideSRV[prev], &this->sampler_default, descSet);
+			SetDescriptorSet(this->pDevice->GetDevice(), 7, this->cache_MomentHistorySRV[prev], &this->sampler_default, descSet);
+
+			uint32_t bindingIdx = 8;
+			if (packed)
+				SetDescriptorSet(this->pDevice->GetDevice(), bindingIdx++, this->cache_HistorySRV[prev], &this->sampler_default, descSet);
+
+			//	for writable outputs
+			const uint32_t numWrites = packed ? 5 : 3;
+			VkDescriptorImageInfo imgInfos[5];
+			VkWriteDescriptorSet writes[5];
+
+			imgInfos[0].sampler = VK_NULL_HANDLE;
+			imgInfos[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			imgInfos[0].imageView = this->imd_HDRSRV;
+
+			writes[0] = {};
+			writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[0].pNext = NULL;
+			writes[0].dstSet = descSet;
+			writes[0].descriptorCount = 1;
+			writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			writes[0].pImageInfo = &imgInfos[0];
+			writes[0].dstBinding = bindingIdx;
+			writes[0].dstArrayElement = 0;
+
+			for (uint32_t i = 1; i < numWrites; i++)
+			{
+				imgInfos[i] = imgInfos[0];
+				writes[i] = writes[0];
+				writes[i].pImageInfo = &imgInfos[i];
+				writes[i].dstBinding = bindingIdx + i;
+			}
+			imgInfos[1].imageView = this->cache_GuideSRV[cur];
+			imgInfos[2].imageView = this->cache_MomentHistorySRV[cur];
+			if (packed)
+			{
+				imgInfos[3].imageView = this->imd_VarianceSRV;
+				imgInfos[4].imageView = this->cache_HistorySRV[cur];
+			}
+
+			vkUpdateDescriptorSets(this->pDevice->GetDevice(), numWrites, writes, 0, NULL);
+		}
 
-		SetDescriptorSet(this->pDevice->GetDevice(), 8, this->cache_HistorySRV, &this->sampler_default, this->ta_descriptorSet);
+		//	a-trous wavelet transform
+		{
+			VkDescriptorSet descSet = this->at_descriptorSet[cur];
+
+			SetDescriptorSet(this->pDevice->GetDevice(), 1, this->cache_GuideSRV[cur], &this->sampler_default, descSet);
+
+			//	for writable outputs
+			const uint32_t numWrites = packed ? 5 : 3;
+			VkDescriptorImageInfo imgInfos[5];
+			VkWriteDescriptorSet writes[5];
+
+			imgInfos[0].sampler = VK_NULL_HANDLE;
+			imgInfos[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			imgInfos[0].imageView = this->inputHDRSRV;
+
+			writes[0] = {};
+			writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[0].pNext = NULL;
+			writes[0].dstSet = descSet;
+			writes[0].descriptorCount = 1;
+			writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			writes[0].pImageInfo = &imgInfos[0];
+			writes[0].dstBinding = 2;
+			writes[0].dstArrayElement = 0;
+
+			for (uint32_t i = 1; i < numWrites; i++)
+			{
+				imgInfos[i] = imgInfos[0];
+				writes[i] = writes[0];
+				writes[i].pImageInfo = &imgInfos[i];
+				writes[i].dstBinding = 2 + i;
+			}
+			imgInfos[1].imageView = this->imd_HDRSRV;
+			imgInfos[2].imageView = this->cache_HDRSRV;
+			if (packed)
+			{
+				imgInfos[3].imageView = this->imd_VarianceSRV;
+				imgInfos[4].imageView = this->cache_VarianceSRV;
+			}
+
+			vkUpdateDescriptorSets(this->pDevice->GetDevice(), numWrites, writes, 0, NULL);
+		}
 	}
 
-	//	variance estimation
+#ifdef SVGF_ERROR_REPORT
+	if (this->pReference)
 	{
-		SetDescriptorSet(this->pDevice->GetDevice(), 1, this->imd_HDRSRV, &this->sampler_default, this->ve_descriptorSet);
-		SetDescriptorSet(this->pDevice->GetDevice(), 2, pGBuffer->m_NormalBufferSRV, &this->sampler_default, this->ve_descriptorSet);
-		SetDescriptorSet(this->pDevice->GetDevice(), 3, this->imd_DepthMomentSRV, &this->sampler_default, this->ve_descriptorSet);
-		SetDescriptorSet(this->pDevice->GetDevice(), 4, this->imd_HistorySRV, &this->sampler_default, this->ve_descriptorSet);
+		//	copy of the input, denoised by the reference
+		this->ref_Input.InitRenderTarget(
+			this->pDevice,
+			this->outWidth, this->outHeight,
+			VK_FORMAT_R16G16B16A16_SFLOAT,
+			VK_SAMPLE_COUNT_1_BIT,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
+			VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+			false,
+			"SVGF Reference Input"
+		);
+		this->ref_Input.CreateSRV(&this->ref_InputSRV);
 
-		//	for writable outputs
-		VkDescriptorImageInfo imgInfos[4];
-		VkWriteDescriptorSet writes[4];
-		
-		imgInfos[0].sampler = VK_NULL_HANDLE;
-		imgInfos[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-		imgInfos[0].imageView = targetSRV;
-
-		writes[0] = {};
-		writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writes[0].pNext = NULL;
-		writes[0].dstSet = this->ve_descriptorSet;
-		writes[0].descriptorCount = 1;
-		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-		writes[0].pImageInfo = &imgInfos[0];
-		writes[0].dstBinding = 5;
-		writes[0].dstArrayElement = 0;
-
-		for (uint32_t i = 1; i < 4; i++)
+		this->pReference->OnCreateWindowSizeDependentResources(
+			this->outWidth, this->outHeight,
+			&this->ref_Input, this->ref_InputSRV,
+			depthSRV, pGBuffer);
+
+		//	readback buffer (both outputs, r16g16b16a16f)
 		{
-			imgInfos[i] = imgInfos[0];
-			writes[i] = writes[0];
-			writes[i].pImageInfo = &imgInfos[i];
+			VkBufferCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			info.size = 2 * (VkDeviceSize)this->outWidth * this->outHeight * 4 * sizeof(uint16_t);
+			info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			VkResult res = vkCreateBuffer(this->pDevice->GetDevice(), &info, NULL, &this->ref_Readback);
+			assert(res == VK_SUCCESS);
+
+			VkMemoryRequirements memReqs;
+			vkGetBufferMemoryRequirements(this->pDevice->GetDevice(), this->ref_Readback, &memReqs);
+
+			VkMemoryAllocateInfo allocInfo = {};
+			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocInfo.allocationSize = memReqs.size;
+			VkPhysicalDeviceMemoryProperties memProps = this->pDevice->GetPhysicalDeviceMemoryProperties();
+			bool pass = memory_type_from_properties(memProps, memReqs.memoryTypeBits,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&allocInfo.memoryTypeIndex);
+			assert(pass);
+
+			res = vkAllocateMemory(this->pDevice->GetDevice(), &allocInfo, NULL, &this->ref_ReadbackMemory);
+			assert(res == VK_SUCCESS);
+			res = vkBindBufferMemory(this->pDevice->GetDevice(), this->ref_Readback, this->ref_ReadbackMemory, 0);
+			assert(res == VK_SUCCESS);
 		}
-		imgInfos[1].imageView = this->cache_NormalSRV;
-		writes[1].dstBinding = 6;
-		imgInfos[2].imageView = this->cache_DepthMomentSRV;
-		writes[2].dstBinding = 7;
-		imgInfos[3].imageView = this->cache_HistorySRV;
-		writes[3].dstBinding = 8;
-
-		vkUpdateDescriptorSets(this->pDevice->GetDevice(), 4, writes, 0, NULL);
+		this->ref_ReadbackFrame = UINT32_MAX;
 	}
-
-	//	a-trous wavelet transform
-	{
-		SetDescriptorSet(this->pDevice->GetDevice(), 1, pGBuffer->m_NormalBufferSRV, &this->sampler_default, this->at_descriptorSet);
-		SetDescriptorSet(this->pDevice->GetDevice(), 2, this->imd_DepthMomentSRV, &this->sampler_default, this->at_descriptorSet);
-		
-		//	for writable outputs
-		VkDescriptorImageInfo imgInfos[3];
-		VkWriteDescriptorSet writes[3];
-
-		imgInfos[0].sampler = VK_NULL_HANDLE;
-		imgInfos[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-		imgInfos[0].imageView = this->inputHDRSRV;
-
-		writes[0] = {};
-		writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writes[0].pNext = NULL;
-		writes[0].dstSet = this->at_descriptorSet;
-		writes[0].descriptorCount = 1;
-		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-		writes[0].pImageInfo = &imgInfos[0];
-		writes[0].dstBinding = 3;
-		writes[0].dstArrayElement = 0;
-
-		imgInfos[1] = imgInfos[0];
-		imgInfos[1].imageView = this->imd_HDRSRV;
-
-		writes[1] = writes[0];
-		writes[1].pImageInfo = &imgInfos[1];
-		writes[1].dstBinding = 4;
-
-		imgInfos[2] = imgInfos[0];
-		imgInfos[2].imageView = this->cache_HDRSRV;
-
-		writes[2] = writes[0];
-		writes[2].pImageInfo = &imgInfos[2];
-		writes[2].dstBinding = 5;
-
-		vkUpdateDescriptorSets(this->pDevice->GetDevice(), 3, writes, 0, NULL);
-	}
-
-	//	create framebuffer (only for Temp Accum)
-	std::vector<VkImageView> attachments = {
-		this->imd_HDRSRV,
-		this->imd_DepthMomentSRV,
-		this->imd_HistorySRV
-	};
-
-	this->ta_framebuffer = CreateFrameBuffer(
-		this->pDevice->GetDevice(),
-		this->ta_renderPass,
-		&attachments,
-		this->outWidth, this->outHeight
-	);
+#endif
 }
 
 void SVGF::OnDestroyWindowSizeDependentResources()
 {
-	vkDestroyFramebuffer(this->pDevice->GetDevice(), this->ta_framebuffer, nullptr);
-	this->ta_framebuffer = VK_NULL_HANDLE;
+#ifdef SVGF_ERROR_REPORT
+	if (this->pReference)
+	{
+		vkDestroyBuffer(this->pDevice->GetDevice(), this->ref_Readback, nullptr);
+		this->ref_Readback = VK_NULL_HANDLE;
+		vkFreeMemory(this->pDevice->GetDevice(), this->ref_ReadbackMemory, nullptr);
+		this->ref_ReadbackMemory = VK_NULL_HANDLE;
+
+		this->pReference->OnDestroyWindowSizeDependentResources();
+
+		vkDestroyImageView(this->pDevice->GetDevice(), this->ref_InputSRV, nullptr);
+		this->ref_InputSRV = VK_NULL_HANDLE;
+		this->ref_Input.OnDestroy();
+	}
+#endif
+
+	const bool packed = (this->formats == SVGF::Formats::Packed);
 
 	//	intermediate buffer
 	{
-		vkDestroyImageView(this->pDevice->GetDevice(), this->imd_HistorySRV, nullptr);
-		this->imd_HistorySRV = VK_NULL_HANDLE;
-		this->imd_History.OnDestroy();
-
-		vkDestroyImageView(this->pDevice->GetDevice(), this->imd_DepthMomentSRV, nullptr);
-		this->imd_DepthMomentSRV = VK_NULL_HANDLE;
-		this->imd_DepthMoment.OnDestroy();
+		if (packed)
+		{
+			vkDestroyImageView(this->pDevice->GetDevice(), this->imd_VarianceSRV, nullptr);
+			this->imd_VarianceSRV = VK_NULL_HANDLE;
+			this->imd_Variance.OnDestroy();
+		}
 
 		vkDestroyImageView(this->pDevice->GetDevice(), this->imd_HDRSRV, nullptr);
 		this->imd_HDRSRV = VK_NULL_HANDLE;
@@ -363,17 +438,30 @@ void SVGF::OnDestroyWindowSizeDependentResources()
 
 	//	cache buffer (previous frame)
 	{
-		vkDestroyImageView(this->pDevice->GetDevice(), this->cache_HistorySRV, nullptr);
-		this->cache_HistorySRV = VK_NULL_HANDLE;
-		this->cache_History.OnDestroy();
-
-		vkDestroyImageView(this->pDevice->GetDevice(), this->cache_DepthMomentSRV, nullptr);
-		this->cache_DepthMomentSRV = VK_NULL_HANDLE;
-		this->cache_DepthMoment.OnDestroy();
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			if (packed)
+			{
+				vkDestroyImageView(this->pDevice->GetDevice(), this->cache_HistorySRV[i], nullptr);
+				this->cache_HistorySRV[i] = VK_NULL_HANDLE;
+				this->cache_History[i].OnDestroy();
+			}
+
+			vkDestroyImageView(this->pDevice->GetDevice(), this->cache_MomentHistorySRV[i], nullptr);
+			this->cache_MomentHistorySRV[i] = VK_NULL_HANDLE;
+			this->cache_MomentHistory[i].OnDestroy();
+
+			vkDestroyImageView(this->pDevice->GetDevice(), this->cache_GuideSRV[i], nullptr);
+			this->cache_GuideSRV[i] = VK_NULL_HANDLE;
+			this->cache_Guide[i].OnDestroy();
+		}
 
-		vkDestroyImageView(this->pDevice->GetDevice(), this->cache_NormalSRV, nullptr);
-		this->cache_NormalSRV = VK_NULL_HANDLE;
-		this->cache_Normal.OnDestroy();
+		if (packed)
+		{
+			vkDestroyImageView(this->pDevice->GetDevice(), this->cache_VarianceSRV, nullptr);
+			this->cache_VarianceSRV = VK_NULL_HANDLE;
+			this->cache_Variance.OnDestroy();
+		}
 
 		vkDestroyImageView(this->pDevice->GetDevice(), this->cache_HDRSRV, nullptr);
 		this->cache_HDRSRV = VK_NULL_HANDLE;
@@ -387,6 +475,8 @@ void SVGF::Draw(VkCommandBuffer commandBuffer, const SVGF::Constants& constants)
 {
 	SetPerfMarkerBegin(commandBuffer, "SVGF");
 
+	const uint32_t cur = this->frameIdx & 1;
+
 	//  update constants
 	VkDescriptorBufferInfo descInfo_constants;
 	{
@@ -395,63 +485,43 @@ void SVGF::Draw(VkCommandBuffer commandBuffer, const SVGF::Constants& constants)
 		*pAllocData = constants;
 	}
 
-	this->barrier_TA(commandBuffer);
-
-	//	temporal accumulation pass
+#ifdef SVGF_ERROR_REPORT
+	//	denoise the same input at full precision first, since this instance overwrites it
+	if (this->pReference)
 	{
-		//  begin render pass
-		{
-			VkRenderPassBeginInfo rp_begin;
-			rp_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			rp_begin.pNext = NULL;
-			rp_begin.renderPass = this->ta_renderPass;
-			rp_begin.framebuffer = this->ta_framebuffer;
-			rp_begin.renderArea.offset.x = 0;
-			rp_begin.renderArea.offset.y = 0;
-			rp_begin.renderArea.extent.width = this->outWidth;
-			rp_begin.renderArea.extent.height = this->outHeight;
-			rp_begin.pClearValues = NULL;
-			rp_begin.clearValueCount = 0;
-			vkCmdBeginRenderPass(commandBuffer, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
-		}
-
-		SetPerfMarkerBegin(commandBuffer, "Temporal Accum");
-
-		//  set viewport to be rendered
-		SetViewportAndScissor(commandBuffer, 0, 0, this->outWidth, this->outHeight);
-
-		this->tmpAccum.Draw(commandBuffer, &descInfo_constants, this->ta_descriptorSet);
-
-		SetPerfMarkerEnd(commandBuffer);
-
-		//  end render pass
-		vkCmdEndRenderPass(commandBuffer);
+		this->reportError();
+		this->copyToReference(commandBuffer);
+		this->pReference->Draw(commandBuffer, constants);
 	}
+#endif
 
-	const uint32_t numBlocks_x = (this->outWidth + 32 - 1) / 32,
-					numBlocks_y = (this->outHeight + 32 - 1) / 32;
-
-	this->barrier_VE(commandBuffer);
+	this->barrier_TA(commandBuffer);
 
-	//	variance estimation pass
+	//	temporal accumulation + variance estimation pass
 	{
-		SetPerfMarkerBegin(commandBuffer, "Variance Est");
+		SetPerfMarkerBegin(commandBuffer, "Temporal Accum");
 
-		//  dispatch
+		//  dispatch (16x16 px. per block, see SVGFReproject.glsl)
 		//
-		this->varEst.Draw(commandBuffer, &descInfo_constants, this->ve_descriptorSet, numBlocks_x, numBlocks_y, 1);
+		const uint32_t numBlocks_x = (constants.viewExtent[0] + 16 - 1) / 16,
+						numBlocks_y = (constants.viewExtent[1] + 16 - 1) / 16;
+		this->tmpAccum.Draw(commandBuffer, &descInfo_constants, this->ta_descriptorSet[cur], numBlocks_x, numBlocks_y, 1);
 
 		SetPerfMarkerEnd(commandBuffer);
 	}
 
+	const uint32_t numBlocks_x = (constants.viewExtent[0] + 32 - 1) / 32,
+					numBlocks_y = (constants.viewExtent[1] + 32 - 1) / 32;
+
 	this->barrier_AT(commandBuffer);
 
 	//	a-trous wavelet transform pass
 	{
 		SetPerfMarkerBegin(commandBuffer, "A-trous WT");
 
-		//	determine a-Trous level count
-		const uint32_t iterCount = 4;
+		//	a-Trous level count
+		//	(must be even to end up in the input color buffer, see SVGFAtrousWT.glsl)
+		const uint32_t iterCount = this->iterCount;
 		
 		//  dispatch
 		//
@@ -459,7 +529,7 @@ void SVGF::Draw(VkCommandBuffer commandBuffer, const SVGF::Constants& constants)
 		{
 			this->barrier_AT_PerIter(commandBuffer, i);
 
-			this->aTrous.Draw(commandBuffer, &descInfo_constants, this->at_descriptorSet, numBlocks_x, numBlocks_y, 1, &i);
+			this->aTrous.Draw(commandBuffer, &descInfo_constants, this->at_descriptorSet[cur], numBlocks_x, numBlocks_y, 1, &i);
 		}
 
 		SetPerfMarkerEnd(commandBuffer);
@@ -467,12 +537,22 @@ void SVGF::Draw(VkCommandBuffer commandBuffer, const SVGF::Constants& constants)
 
 	this->barrier_Out(commandBuffer);
 
+#ifdef SVGF_ERROR_REPORT
+	if (this->pReference && this->ref_ReadbackFrame == UINT32_MAX && (this->frameIdx % errorReportInterval) == 0)
+		this->readbackOutputs(commandBuffer);
+#endif
+
+	this->frameIdx++;
+
 	SetPerfMarkerEnd(commandBuffer);
 }
 
 void SVGF::createTADescriptors(DefineList& defines)
 {
-	const uint32_t bindingCount = 9;
+	//	packed formats split history & variance into their own buffers
+	const bool packed = (this->formats == SVGF::Formats::Packed);
+	const uint32_t textureCount = packed ? 9 : 8;
+	const uint32_t bindingCount = packed ? 14 : 11;
 	std::vector<VkDescriptorSetLayoutBinding> layoutBindings(bindingCount);
 	uint32_t bindingIdx = 0;
 
@@ -480,19 +560,19 @@ void SVGF::createTADescriptors(DefineList& defines)
 	layoutBindings[bindingIdx].binding = bindingIdx;
 	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	layoutBindings[bindingIdx].descriptorCount = 1;
-	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
 	defines["ID_Params"] = std::to_string(bindingIdx++);
 	//	1. Color Buffer (current frame)
 	layoutBindings[bindingIdx].binding = bindingIdx;
 	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	layoutBindings[bindingIdx].descriptorCount = 1;
-	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
 	defines["ID_HDR"] = std::to_string(bindingIdx++);
 
 	//	copy texture binding signature to the remaining
-	for (uint32_t i = bindingIdx; i < bindingCount; i++)
+	for (uint32_t i = bindingIdx; i < textureCount; i++)
 	{
 		layoutBindings[i] = layoutBindings[1];
 		layoutBindings[i].binding = i;
@@ -506,56 +586,22 @@ void SVGF::createTADescriptors(DefineList& defines)
 	defines["ID_MotionVec"] = std::to_string(bindingIdx++);
 	//	5. Color Buffer (previous frame)
 	defines["ID_CacheHDR"] = std::to_string(bindingIdx++);
-	//	6. Normal (previous frame)
-	defines["ID_CacheNormal"] = std::to_string(bindingIdx++);
-	//	7. Depth + Depth Gradient + Moments (L and L^2) (previous frame)
-	defines["ID_CacheDepthMoment"] = std::to_string(bindingIdx++);
-	//	8. History Buffer (previous frame)
-	defines["ID_CacheHistory"] = std::to_string(bindingIdx++);
-
-	assert(bindingIdx == bindingCount);
-	this->pResourceViewHeaps->CreateDescriptorSetLayoutAndAllocDescriptorSet(
-		&layoutBindings,
-		&this->ta_descriptorSetLayout,
-		&this->ta_descriptorSet);
-}
-
-void SVGF::createVEDescriptors(DefineList& defines)
-{
-	const uint32_t bindingCount = 9;
-	std::vector<VkDescriptorSetLayoutBinding> layoutBindings(bindingCount);
-	uint32_t bindingIdx = 0;
-
-	//	0. per-frame data
-	layoutBindings[bindingIdx].binding = bindingIdx;
-	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	layoutBindings[bindingIdx].descriptorCount = 1;
-	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
-	defines["ID_Params"] = std::to_string(bindingIdx++);
-	//	1. Color Buffer (intermediate)
-	layoutBindings[bindingIdx].binding = bindingIdx;
-	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	layoutBindings[bindingIdx].descriptorCount = 1;
-	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
-	defines["ID_InHDR"] = std::to_string(bindingIdx++);
-
-	//	copy texture binding signature to the remaining
-	for (uint32_t i = bindingIdx; i < 5; i++)
+	//	6. Oct. Normal + Depth + Depth Gradient (previous frame)
+	defines["ID_CacheGuide"] = std::to_string(bindingIdx++);
+	if (packed)
 	{
-		layoutBindings[i] = layoutBindings[1];
-		layoutBindings[i].binding = i;
+		//	7. Moments (L and L^2) (previous frame)
+		defines["ID_CacheMoment"] = std::to_string(bindingIdx++);
+		//	8. History (previous frame)
+		defines["ID_CacheHistory"] = std::to_string(bindingIdx++);
+	}
+	else
+	{
+		//	7. Moments (L and L^2) + History (previous frame)
+		defines["ID_CacheMomentHistory"] = std::to_string(bindingIdx++);
 	}
 
-	//	2. Normal (intermediate)
-	defines["ID_Normal"] = std::to_string(bindingIdx++);
-	//	3. Depth + Depth Gradient + Moments (L and L^2) (intermediate) 
-	defines["ID_DepthMoment"] = std::to_string(bindingIdx++);
-	//	4. History Buffer (intermediate)
-	defines["ID_History"] = std::to_string(bindingIdx++);
-
-	//	5. Color Buffer (target)
+	//	8 (9). Color Buffer (intermediate)
 	layoutBindings[bindingIdx].binding = bindingIdx;
 	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 	layoutBindings[bindingIdx].descriptorCount = 1;
@@ -566,27 +612,39 @@ void SVGF::createVEDescriptors(DefineList& defines)
 	//	copy storage image binding signature to the remaining
 	for (uint32_t i = bindingIdx; i < bindingCount; i++)
 	{
-		layoutBindings[i] = layoutBindings[5];
+		layoutBindings[i] = layoutBindings[textureCount];
 		layoutBindings[i].binding = i;
 	}
 
-	//	6. Normal (target)
-	defines["ID_CacheNormal"] = std::to_string(bindingIdx++);
-	//	7. Depth + Depth Gradient + Moments (L and L^2) (target)
-	defines["ID_CacheDepthMoment"] = std::to_string(bindingIdx++);
-	//	8. History Buffer (target)
-	defines["ID_CacheHistory"] = std::to_string(bindingIdx++);
+	//	9 (10). Oct. Normal + Depth + Depth Gradient (current frame, also the guide for a-trous)
+	defines["ID_OutGuide"] = std::to_string(bindingIdx++);
+	if (packed)
+	{
+		//	11. Moments (L and L^2) (current frame)
+		defines["ID_OutMoment"] = std::to_string(bindingIdx++);
+		//	12. Variance (intermediate)
+		defines["ID_OutVariance"] = std::to_string(bindingIdx++);
+		//	13. History (current frame)
+		defines["ID_OutHistory"] = std::to_string(bindingIdx++);
+	}
+	else
+	{
+		//	10. Moments (L and L^2) + History (current frame)
+		defines["ID_OutMomentHistory"] = std::to_string(bindingIdx++);
+	}
 
 	assert(bindingIdx == bindingCount);
 	this->pResourceViewHeaps->CreateDescriptorSetLayoutAndAllocDescriptorSet(
 		&layoutBindings,
-		&this->ve_descriptorSetLayout,
-		&this->ve_descriptorSet);
+		&this->ta_descriptorSetLayout,
+		&this->ta_descriptorSet[0]);
+	this->pResourceViewHeaps->AllocDescriptor(this->ta_descriptorSetLayout, &this->ta_descriptorSet[1]);
 }
 
 void SVGF::createATDescriptors(DefineList& defines)
 {
-	const uint32_t bindingCount = 6;
+	const bool packed = (this->formats == SVGF::Formats::Packed);
+	const uint32_t bindingCount = packed ? 7 : 5;
 	std::vector<VkDescriptorSetLayoutBinding> layoutBindings(bindingCount);
 	uint32_t bindingIdx = 0;
 
@@ -598,19 +656,15 @@ void SVGF::createATDescriptors(DefineList& defines)
 	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
 	defines["ID_Params"] = std::to_string(bindingIdx++);
 
-	//	1. Normal (intermediate) 
+	//	1. Oct. Normal + Depth + Depth Gradient (current frame), one fetch per tap
 	layoutBindings[bindingIdx].binding = bindingIdx;
 	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	layoutBindings[bindingIdx].descriptorCount = 1;
 	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
-	defines["ID_Normal"] = std::to_string(bindingIdx++);
-	//	2. Depth + Depth Gradient + Moments (L and L^2) (intermediate) 
-	layoutBindings[bindingIdx] = layoutBindings[1];
-	layoutBindings[bindingIdx].binding = bindingIdx;
-	defines["ID_DepthMoment"] = std::to_string(bindingIdx++);
+	defines["ID_Guide"] = std::to_string(bindingIdx++);
 
-	//	3. Color Buffer (target)
+	//	2. Color Buffer (target)
 	layoutBindings[bindingIdx].binding = bindingIdx;
 	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 	layoutBindings[bindingIdx].descriptorCount = 1;
@@ -621,30 +675,40 @@ void SVGF::createATDescriptors(DefineList& defines)
 	//	copy storage image binding signature to the remaining
 	for (uint32_t i = bindingIdx; i < bindingCount; i++)
 	{
-		layoutBindings[i] = layoutBindings[3];
+		layoutBindings[i] = layoutBindings[2];
 		layoutBindings[i].binding = i;
 	}
 
-	//	4. Color Buffer (intermediate)
+	//	3. Color Buffer (intermediate)
 	defines["ID_ImdHDR"] = std::to_string(bindingIdx++);
-	//	5. Color Buffer (cache. only used in 1st iter.)
+	//	4. Color Buffer (cache. only written in 1st iter.)
 	defines["ID_CacheHDR"] = std::to_string(bindingIdx++);
+	if (packed)
+	{
+		//	5. Variance (intermediate)
+		defines["ID_ImdVariance"] = std::to_string(bindingIdx++);
+		//	6. Variance (cache. only written in 1st iter.)
+		defines["ID_CacheVariance"] = std::to_string(bindingIdx++);
+	}
 
 	assert(bindingIdx == bindingCount);
 	this->pResourceViewHeaps->CreateDescriptorSetLayoutAndAllocDescriptorSet(
 		&layoutBindings,
 		&this->at_descriptorSetLayout,
-		&this->at_descriptorSet);
+		&this->at_descriptorSet[0]);
+	this->pResourceViewHeaps->AllocDescriptor(this->at_descriptorSetLayout, &this->at_descriptorSet[1]);
 }
 
-void SVGF::setATInOutHDR(VkCommandBuffer cmdBuf, uint32_t atrousIter)
+void SVGF::barrier_TA(VkCommandBuffer cmdBuf)
 {
-	bool toInput = (atrousIter % 2 != 0);
+	const uint32_t cur = this->frameIdx & 1;
+	const uint32_t prev = cur ^ 1;
+	const bool packed = (this->formats == SVGF::Formats::Packed);
 
-	//	transition input & output
+	//	transition caches
 	//
-	const uint32_t numBarriers = 2;
-	VkImageMemoryBarrier barriers[numBarriers];
+	const uint32_t numBarriers = packed ? 8 : 5;
+	VkImageMemoryBarrier barriers[8];
 	uint32_t barrierIdx = 0;
 
 	barriers[barrierIdx].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -658,19 +722,58 @@ void SVGF::setATInOutHDR(VkCommandBuffer cmdBuf, uint32_t atrousIter)
 	barriers[barrierIdx].subresourceRange.baseArrayLayer = 0;
 	barriers[barrierIdx].subresourceRange.layerCount = 1;
 
-	//  barrier 0 : in
+	//  barrier 0 : color buffer (previous frame)
 	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
 	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	barriers[barrierIdx].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barriers[barrierIdx++].image = toInput ? this->imd_HDR.Resource() : this->pInputHDR->Resource();
+	barriers[barrierIdx++].image = this->cache_HDR.Resource();
 
-	//  barrier 1 : out
+	//  barrier 1 : moment + history (previous frame)
+	//  (the previous guide is already readable, a-trous read it)
+	barriers[barrierIdx] = barriers[0];
+	barriers[barrierIdx++].image = this->cache_MomentHistory[prev].Resource();
+
+	//  barrier 1' : history (previous frame)
+	if (packed)
+	{
+		barriers[barrierIdx] = barriers[0];
+		barriers[barrierIdx++].image = this->cache_History[prev].Resource();
+	}
+
+	//	transition current frame's caches + intermediate buffer to be written
+	//
+	const uint32_t writeIdx = barrierIdx;
 	barriers[barrierIdx] = barriers[0];
 	barriers[barrierIdx].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
 	barriers[barrierIdx].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+	//  barrier 2 : guide (current frame)
 	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_GENERAL;
-	barriers[barrierIdx++].image = toInput ? this->pInputHDR->Resource() : this->imd_HDR.Resource();
+	barriers[barrierIdx++].image = this->cache_Guide[cur].Resource();
+
+	//  barrier 3 : moment + history (current frame)
+	barriers[barrierIdx] = barriers[writeIdx];
+	barriers[barrierIdx++].image = this->cache_MomentHistory[cur].Resource();
+
+	//  barrier 3' : history (current frame)
+	if (packed)
+	{
+		barriers[barrierIdx] = barriers[writeIdx];
+		barriers[barrierIdx++].image = this->cache_History[cur].Resource();
+	}
+
+	//  barrier 4 : color buffer (intermediate)
+	barriers[barrierIdx] = barriers[writeIdx];
+	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[barrierIdx++].image = this->imd_HDR.Resource();
+
+	//  barrier 4' : variance (intermediate)
+	if (packed)
+	{
+		barriers[barrierIdx] = barriers[barrierIdx - 1];
+		barriers[barrierIdx++].image = this->imd_Variance.Resource();
+	}
 
 	assert(barrierIdx == numBarriers);
 	vkCmdPipelineBarrier(cmdBuf,
@@ -678,53 +781,17 @@ void SVGF::setATInOutHDR(VkCommandBuffer cmdBuf, uint32_t atrousIter)
 		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 		0, 0, NULL, 0, NULL,
 		numBarriers, barriers);
-
-	//	update descriptor
-	//
-	VkDescriptorImageInfo imgInfos[2];
-	VkWriteDescriptorSet writes[2];
-
-	//	set input
-	imgInfos[0].sampler = this->sampler_default;
-	imgInfos[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	imgInfos[0].imageView = toInput ? this->imd_HDRSRV : this->inputHDRSRV;
-
-	writes[0] = {};
-	writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writes[0].pNext = NULL;
-	writes[0].dstSet = this->at_descriptorSet;
-	writes[0].descriptorCount = 1;
-	writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	writes[0].pImageInfo = &imgInfos[0];
-	writes[0].dstBinding = 1;
-	writes[0].dstArrayElement = 0;
-
-	//	set output
-	imgInfos[1].sampler = VK_NULL_HANDLE;
-	imgInfos[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-	imgInfos[1].imageView = toInput ? this->inputHDRSRV : this->imd_HDRSRV;
-
-	writes[1] = {};
-	writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writes[1].pNext = NULL;
-	writes[1].dstSet = this->at_descriptorSet;
-	writes[1].descriptorCount = 1;
-	writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-	writes[1].pImageInfo = &imgInfos[1];
-	writes[1].dstBinding = 4;
-	writes[1].dstArrayElement = 0;
-
-	vkUpdateDescriptorSets(this->pDevice->GetDevice(), 2, writes, 0, NULL);
 }
 
-void SVGF::barrier_TA(VkCommandBuffer cmdBuf)
+void SVGF::barrier_AT(VkCommandBuffer cmdBuf)
 {
-	//	transition caches
+	const uint32_t cur = this->frameIdx & 1;
+
+	//	transition guide
 	//
-	const uint32_t numBarriers = 7;
+	const uint32_t numBarriers = 1;
 	VkImageMemoryBarrier barriers[numBarriers];
 	uint32_t barrierIdx = 0;
-
 	barriers[barrierIdx].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barriers[barrierIdx].pNext = NULL;
 	barriers[barrierIdx].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
@@ -736,70 +803,61 @@ void SVGF::barrier_TA(VkCommandBuffer cmdBuf)
 	barriers[barrierIdx].subresourceRange.baseArrayLayer = 0;
 	barriers[barrierIdx].subresourceRange.layerCount = 1;
 
-	//  barrier 0 : color buffer
+	//  barrier 0 : guide (written by reprojection)
 	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
 	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	barriers[barrierIdx].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barriers[barrierIdx++].image = this->cache_HDR.Resource();
-
-	//  barrier 1 : normal
-	barriers[barrierIdx] = barriers[0];
-	barriers[barrierIdx++].image = this->cache_Normal.Resource();
-
-	//  barrier 2 : dpeht + moment
-	barriers[barrierIdx] = barriers[0];
-	barriers[barrierIdx++].image = this->cache_DepthMoment.Resource();
-
-	//  barrier 3 : history
-	barriers[barrierIdx] = barriers[0];
-	barriers[barrierIdx++].image = this->cache_History.Resource();
-
-	assert(barrierIdx == 4);
-	vkCmdPipelineBarrier(cmdBuf,
-		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-		0, 0, NULL, 0, NULL,
-		4, barriers);
-
-	//	transition intermediate buffers
-	//
-	barriers[barrierIdx] = barriers[0];
-	barriers[barrierIdx].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	barriers[barrierIdx].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-	//  barrier 4 : color buffer
-	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	barriers[barrierIdx++].image = this->imd_HDR.Resource();
-
-	//  barrier 5 : depth + moment
-	barriers[barrierIdx] = barriers[4];
-	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	barriers[barrierIdx++].image = this->imd_DepthMoment.Resource();
-
-	//  barrier 6 : history
-	barriers[barrierIdx] = barriers[5];
-	barriers[barrierIdx++].image = this->imd_History.Resource();
+	barriers[barrierIdx++].image = this->cache_Guide[cur].Resource();
 
 	assert(barrierIdx == numBarriers);
 	vkCmdPipelineBarrier(cmdBuf,
 		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 		0, 0, NULL, 0, NULL,
-		3, barriers + 4);
+		numBarriers, barriers);
 }
 
-void SVGF::barrier_VE(VkCommandBuffer cmdBuf)
+void SVGF::barrier_AT_PerIter(VkCommandBuffer cmdBuf, uint32_t atrousIter)
 {
-	//	transition input HDR + cache
+	//  determine the input & output of this a-trous iteration (see SVGFAtrousWT.glsl)
+	//  iter 0 : imd -> cache, iter 1 : cache -> in, iter 2 : in -> imd, iter 3 : imd -> in ...
+	Texture* pIn, * pOut;
+	if (atrousIter == 0)
+	{
+		pIn = &this->imd_HDR;
+		pOut = &this->cache_HDR;
+	}
+	else if (atrousIter == 1)
+	{
+		pIn = &this->cache_HDR;
+		pOut = this->pInputHDR;
+	}
+	else
+	{
+		bool toInput = (atrousIter & 1) != 0;
+		pIn = toInput ? &this->imd_HDR : this->pInputHDR;
+		pOut = toInput ? this->pInputHDR : &this->imd_HDR;
+	}
+
+	//  packed formats keep the variance of imd / cache in a separate texture,
+	//  while the input target stores it in its alpha channel.
+	Texture* pInVariance = nullptr, * pOutVariance = nullptr;
+	if (this->formats == SVGF::Formats::Packed)
+	{
+		if (pIn == &this->imd_HDR) pInVariance = &this->imd_Variance;
+		else if (pIn == &this->cache_HDR) pInVariance = &this->cache_Variance;
+		if (pOut == &this->imd_HDR) pOutVariance = &this->imd_Variance;
+		else if (pOut == &this->cache_HDR) pOutVariance = &this->cache_Variance;
+	}
+
+	//	transition input & output
 	//
-	const uint32_t numBarriers = 4;
-	VkImageMemoryBarrier barriers[numBarriers];
+	const uint32_t numBarriers = 2 + (pInVariance ? 1 : 0) + (pOutVariance ? 1 : 0);
+	VkImageMemoryBarrier barriers[4];
 	uint32_t barrierIdx = 0;
+
 	barriers[barrierIdx].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barriers[barrierIdx].pNext = NULL;
-	barriers[barrierIdx].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	barriers[barrierIdx].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
 	barriers[barrierIdx].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barriers[barrierIdx].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barriers[barrierIdx].subresourceRange.baseMipLevel = 0;
@@ -807,43 +865,55 @@ void SVGF::barrier_VE(VkCommandBuffer cmdBuf)
 	barriers[barrierIdx].subresourceRange.baseArrayLayer = 0;
 	barriers[barrierIdx].subresourceRange.layerCount = 1;
 
-	//  barrier 0 : color buffer (input)
-	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	//  barrier 0 : in
+	barriers[barrierIdx].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[barrierIdx].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
 	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_GENERAL;
 	barriers[barrierIdx].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barriers[barrierIdx++].image = this->pInputHDR->Resource();
-
-	//  barrier 1 : normal
-	barriers[barrierIdx] = barriers[0];
-	barriers[barrierIdx++].image = this->cache_Normal.Resource();
+	barriers[barrierIdx++].image = pIn->Resource();
 
-	//  barrier 2 : depth + moment
+	//  barrier 1 : out
+	//  (cache and input were sampled by reprojection, until they are written for the first time)
 	barriers[barrierIdx] = barriers[0];
-	barriers[barrierIdx++].image = this->cache_DepthMoment.Resource();
+	barriers[barrierIdx].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[barrierIdx].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[barrierIdx].oldLayout = (atrousIter <= 1) ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[barrierIdx++].image = pOut->Resource();
 
-	//  barrier 3 : history
-	barriers[barrierIdx] = barriers[0];
-	barriers[barrierIdx++].image = this->cache_History.Resource();
+	//  barrier 2, 3 : variance of in / out (packed only, never sampled)
+	if (pInVariance)
+	{
+		barriers[barrierIdx] = barriers[0];
+		barriers[barrierIdx++].image = pInVariance->Resource();
+	}
+	if (pOutVariance)
+	{
+		barriers[barrierIdx] = barriers[1];
+		barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barriers[barrierIdx++].image = pOutVariance->Resource();
+	}
 
 	assert(barrierIdx == numBarriers);
 	vkCmdPipelineBarrier(cmdBuf,
-		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 		0, 0, NULL, 0, NULL,
 		numBarriers, barriers);
 }
 
-void SVGF::barrier_AT(VkCommandBuffer cmdBuf)
+void SVGF::barrier_Out(VkCommandBuffer cmdBuf)
 {
-	//	transition intermediate buffer + cache
+	//	transition output (input itself)
 	//
 	const uint32_t numBarriers = 1;
 	VkImageMemoryBarrier barriers[numBarriers];
 	uint32_t barrierIdx = 0;
 	barriers[barrierIdx].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barriers[barrierIdx].pNext = NULL;
-	barriers[barrierIdx].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	barriers[barrierIdx].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[barrierIdx].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[barrierIdx].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 	barriers[barrierIdx].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barriers[barrierIdx].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barriers[barrierIdx].subresourceRange.baseMipLevel = 0;
@@ -851,33 +921,31 @@ void SVGF::barrier_AT(VkCommandBuffer cmdBuf)
 	barriers[barrierIdx].subresourceRange.baseArrayLayer = 0;
 	barriers[barrierIdx].subresourceRange.layerCount = 1;
 
-	//  barrier 0 : color buffer (cache)
-	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	//  barrier 0 : color buffer
+	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	barriers[barrierIdx].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barriers[barrierIdx++].image = this->cache_HDR.Resource();
+	barriers[barrierIdx++].image = this->pInputHDR->Resource();
 
 	assert(barrierIdx == numBarriers);
 	vkCmdPipelineBarrier(cmdBuf,
-		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
 		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
 		0, 0, NULL, 0, NULL,
 		numBarriers, barriers);
 }
-
-void SVGF::barrier_AT_PerIter(VkCommandBuffer cmdBuf, uint32_t atrousIter)
+#ifdef SVGF_ERROR_REPORT
+void SVGF::copyToReference(VkCommandBuffer cmdBuf)
 {
-	//  determine if the output for this a-trous iteration is the input color buffer itself.
-	bool toInput = (atrousIter & 1) != 0;
-
-	//	transition input & output
+	//	transition input & reference input for the copy
 	//
 	const uint32_t numBarriers = 2;
 	VkImageMemoryBarrier barriers[numBarriers];
 	uint32_t barrierIdx = 0;
-
 	barriers[barrierIdx].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barriers[barrierIdx].pNext = NULL;
+	barriers[barrierIdx].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[barrierIdx].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 	barriers[barrierIdx].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barriers[barrierIdx].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barriers[barrierIdx].subresourceRange.baseMipLevel = 0;
@@ -885,41 +953,64 @@ void SVGF::barrier_AT_PerIter(VkCommandBuffer cmdBuf, uint32_t atrousIter)
 	barriers[barrierIdx].subresourceRange.baseArrayLayer = 0;
 	barriers[barrierIdx].subresourceRange.layerCount = 1;
 
-	//  barrier 0 : in
-	barriers[barrierIdx].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-	barriers[barrierIdx].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	//  barrier 0 : input
+	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 	barriers[barrierIdx].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barriers[barrierIdx++].image = toInput ? this->imd_HDR.Resource() : this->pInputHDR->Resource();
+	barriers[barrierIdx++].image = this->pInputHDR->Resource();
 
-	//  barrier 1 : out
+	//  barrier 1 : reference input
 	barriers[barrierIdx] = barriers[0];
 	barriers[barrierIdx].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	barriers[barrierIdx].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-	barriers[barrierIdx].oldLayout = (atrousIter == 0) ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
-	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_GENERAL;
-	barriers[barrierIdx++].image = toInput ? this->pInputHDR->Resource() : this->imd_HDR.Resource();
+	barriers[barrierIdx].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[barrierIdx++].image = this->ref_Input.Resource();
 
 	assert(barrierIdx == numBarriers);
 	vkCmdPipelineBarrier(cmdBuf,
-		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, NULL, 0, NULL,
+		numBarriers, barriers);
+
+	VkImageCopy region = {};
+	region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.srcSubresource.layerCount = 1;
+	region.dstSubresource = region.srcSubresource;
+	region.extent = { this->outWidth, this->outHeight, 1 };
+	vkCmdCopyImage(cmdBuf,
+		this->pInputHDR->Resource(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		this->ref_Input.Resource(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1, &region);
+
+	//	back to be sampled by reprojection
+	//
+	barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
 		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 		0, 0, NULL, 0, NULL,
 		numBarriers, barriers);
 }
 
-void SVGF::barrier_Out(VkCommandBuffer cmdBuf)
+void SVGF::readbackOutputs(VkCommandBuffer cmdBuf)
 {
-	//	transition output (input itself)
+	//	transition both outputs for the copy
 	//
-	const uint32_t numBarriers = 1;
+	const uint32_t numBarriers = 2;
 	VkImageMemoryBarrier barriers[numBarriers];
 	uint32_t barrierIdx = 0;
 	barriers[barrierIdx].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barriers[barrierIdx].pNext = NULL;
 	barriers[barrierIdx].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-	barriers[barrierIdx].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[barrierIdx].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 	barriers[barrierIdx].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barriers[barrierIdx].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barriers[barrierIdx].subresourceRange.baseMipLevel = 0;
@@ -927,16 +1018,100 @@ void SVGF::barrier_Out(VkCommandBuffer cmdBuf)
 	barriers[barrierIdx].subresourceRange.baseArrayLayer = 0;
 	barriers[barrierIdx].subresourceRange.layerCount = 1;
 
-	//  barrier 0 : color buffer
-	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	//  barrier 0 : output
+	barriers[barrierIdx].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[barrierIdx].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 	barriers[barrierIdx].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	barriers[barrierIdx++].image = this->pInputHDR->Resource();
 
+	//  barrier 1 : reference output
+	barriers[barrierIdx] = barriers[0];
+	barriers[barrierIdx++].image = this->ref_Input.Resource();
+
 	assert(barrierIdx == numBarriers);
 	vkCmdPipelineBarrier(cmdBuf,
 		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
 		0, 0, NULL, 0, NULL,
 		numBarriers, barriers);
-}
\ No newline at end of file
+
+	//  this output first, then the reference's (r16g16b16a16f, tightly packed)
+	VkBufferImageCopy region = {};
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = { this->outWidth, this->outHeight, 1 };
+	vkCmdCopyImageToBuffer(cmdBuf, this->pInputHDR->Resource(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, this->ref_Readback, 1, &region);
+	region.bufferOffset = (VkDeviceSize)this->outWidth * this->outHeight * 4 * sizeof(uint16_t);
+	vkCmdCopyImageToBuffer(cmdBuf, this->ref_Input.Resource(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, this->ref_Readback, 1, &region);
+
+	//	back to be sampled by the consumers
+	//
+	barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[1] = barriers[0];
+	barriers[1].image = this->ref_Input.Resource();
+
+	VkBufferMemoryBarrier bufferBarrier = {};
+	bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.buffer = this->ref_Readback;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0, 0, NULL, 1, &bufferBarrier,
+		numBarriers, barriers);
+
+	this->ref_ReadbackFrame = this->frameIdx;
+}
+
+void SVGF::reportError()
+{
+	//  wait until the command buffer which recorded the readback has surely completed
+	if (this->ref_ReadbackFrame == UINT32_MAX || this->frameIdx - this->ref_ReadbackFrame < errorReportLatency)
+		return;
+
+	const size_t pixelCount = (size_t)this->outWidth * this->outHeight;
+
+	uint16_t* pData = nullptr;
+	VkResult res = vkMapMemory(this->pDevice->GetDevice(), this->ref_ReadbackMemory, 0, VK_WHOLE_SIZE, 0, (void**)&pData);
+	assert(res == VK_SUCCESS);
+
+	const uint16_t* pOut = pData;
+	const uint16_t* pRef = pData + pixelCount * 4;
+
+	double sqErr = 0.0;
+	float maxErr = 0.0f;
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		//  rgb only, alpha holds the variance
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			float out = DirectX::PackedVector::XMConvertHalfToFloat(pOut[i * 4 + c]);
+			float ref = DirectX::PackedVector::XMConvertHalfToFloat(pRef[i * 4 + c]);
+			float err = fabsf(out - ref);
+
+			sqErr += (double)err * err;
+			maxErr = std::max(maxErr, err);
+		}
+	}
+
+	vkUnmapMemory(this->pDevice->GetDevice(), this->ref_ReadbackMemory);
+
+	const double rmse = sqrt(sqErr / (pixelCount * 3));
+	const double psnr = (rmse > 0.0) ? 20.0 * log10(1.0 / rmse) : INFINITY;
+
+	char msg[256];
+	snprintf(msg, sizeof(msg), "SVGF [%s] packed vs full : RMSE %.6f, max %.6f, PSNR %.2f dB\n",
+		this->name.c_str(), rmse, maxErr, psnr);
+	Trace(msg);
+
+	this->ref_ReadbackFrame = UINT32_MAX;
+}
+#endif
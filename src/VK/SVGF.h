@@ -1,5 +1,9 @@
 #pragma once
 
+//  uncomment to run a full-precision reference denoiser next to every packed one,
+//  and periodically print the difference of their outputs (computed on CPU).
+//#define SVGF_ERROR_REPORT
+
 class SVGF
 {
 public:
@@ -15,12 +19,26 @@ public:
         float sigmaNormal;
         float sigmaLuminance;
         float padding;
+
+        //  extent of the view, from the targets' top-left corner (see Caustics/Fresnel::Draw)
+        int viewExtent[2];
+        int padding1[2];
     };
 
+    //  format set of history & intermediate buffers
+    enum class Formats
+    {
+        Full,   // color + variance, moments + history in r16g16b16a16f (48 B/px.)
+        Packed  // r11g11b10f color + r16f variance, r16g16f moments + r8ui history (38 B/px.)
+    };
+
+    //  falls back to the full formats if the packed ones can't be storage images on this device
     void OnCreate(
         Device* pDevice,
         ResourceViewHeaps* pResourceViewHeaps,
-        DynamicBufferRing* pDynamicBufferRing);
+        DynamicBufferRing* pDynamicBufferRing,
+        SVGF::Formats formats = SVGF::Formats::Full,
+        const char* name = "SVGF");
     void OnDestroy();
 
     void OnCreateWindowSizeDependentResources(
@@ -31,60 +49,91 @@ public:
 
     void Draw(VkCommandBuffer commandBuffer, const SVGF::Constants& constants);
 
+    //  a-trous level count, must be even (see SVGFAtrousWT.glsl)
+    void setIterationCount(uint32_t count)
+    {
+        assert(count >= 2 && (count & 1) == 0);
+        this->iterCount = count;
+    }
+
+    //  device memory (bytes) of history & intermediate buffers (see SVGF::Formats)
+    VkDeviceSize getMemoryFootprint() const
+    {
+        const VkDeviceSize bytesPerPixel = (this->formats == SVGF::Formats::Packed) ? 38 : 48;
+        return bytesPerPixel * this->outWidth * this->outHeight;
+    }
+
 private:
 
     Device* pDevice;
     ResourceViewHeaps* pResourceViewHeaps;
     DynamicBufferRing* pDynamicBufferRing;
 
+    SVGF::Formats         formats = SVGF::Formats::Full;
+    std::string           name;
+
     uint32_t              outWidth = 0, outHeight = 0;
+    uint32_t              iterCount = 4;
 
     Texture*              pInputHDR = nullptr;
     VkImageView           inputHDRSRV = VK_NULL_HANDLE;
     GBuffer*              pInputGBuffer = nullptr;
 
-    Texture               cache_HDR, // r16g16b16a16f
-                          cache_Normal, // r16g16b16a16f
-                          cache_DepthMoment, // d16 + f16 (can d16 cuz it's linear depth) + r16g16
-                          cache_History; //r8u
+    Texture               cache_HDR, // r16g16b16a16f (packed : r11g11b10f)
+                          cache_Variance; // packed only : r16f
     VkImageView           cache_HDRSRV = VK_NULL_HANDLE,
-                          cache_NormalSRV = VK_NULL_HANDLE,
-                          cache_DepthMomentSRV = VK_NULL_HANDLE,
-                          cache_HistorySRV = VK_NULL_HANDLE;
-
-    Texture               imd_HDR, // r16g16b16a16
-                          imd_DepthMoment, // d16 + f16 (can d16 cuz it's linear depth) + r16g16
-                          imd_History; //r8u
+                          cache_VarianceSRV = VK_NULL_HANDLE;
+
+    //  ping-ponged every frame : reprojection reads the previous frame's while writing the current one's.
+    //  the guide is also read by a-trous passes as their edge-stopping input.
+    //  each instance keeps its own : Caustics denoises the opaque receivers, Fresnel the water surface
+    //  the transparent G-buffer pass draws over them, so their normals & motion vectors differ.
+    Texture               cache_Guide[2], // r16g16 (oct. normal) + f16 (linear depth) + f16 (depth gradient)
+                          cache_MomentHistory[2], // r16g16 (moments) + f16 (history length) (packed : r16g16f moments only)
+                          cache_History[2]; // packed only : r8ui
+    VkImageView           cache_GuideSRV[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE },
+                          cache_MomentHistorySRV[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE },
+                          cache_HistorySRV[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+    uint32_t              frameIdx = 0;
+
+    Texture               imd_HDR, // r16g16b16a16 (packed : r11g11b10f)
+                          imd_Variance; // packed only : r16f
     VkImageView           imd_HDRSRV = VK_NULL_HANDLE,
-                          imd_DepthMomentSRV = VK_NULL_HANDLE,
-                          imd_HistorySRV = VK_NULL_HANDLE;
+                          imd_VarianceSRV = VK_NULL_HANDLE;
 
     VkSampler             sampler_default;
 
-    VkDescriptorSet       ta_descriptorSet;
+    //  temporal accumulation + variance estimation (fused)
+    VkDescriptorSet       ta_descriptorSet[2];
     VkDescriptorSetLayout ta_descriptorSetLayout;
-    VkRenderPass          ta_renderPass;
-    VkFramebuffer         ta_framebuffer;
-    PostProcPS            tmpAccum;
+    PostProcCS            tmpAccum;
 
     void createTADescriptors(DefineList& defines);
     void barrier_TA(VkCommandBuffer cmdBuf);
 
-    VkDescriptorSet       ve_descriptorSet;
-    VkDescriptorSetLayout ve_descriptorSetLayout;
-    PostProcCS            varEst;
-
-    void createVEDescriptors(DefineList& defines);
-    void barrier_VE(VkCommandBuffer cmdBuf);
-
-    VkDescriptorSet       at_descriptorSet;
+    VkDescriptorSet       at_descriptorSet[2];
     VkDescriptorSetLayout at_descriptorSetLayout;
     PostProcCS            aTrous;
 
     void createATDescriptors(DefineList& defines);
-    void setATInOutHDR(VkCommandBuffer cmdBuf, uint32_t atrousIter);
     void barrier_AT(VkCommandBuffer cmdBuf);
     void barrier_AT_PerIter(VkCommandBuffer cmdBuf, uint32_t atrousIter);
 
     void barrier_Out(VkCommandBuffer cmdBuf);
-};
\ No newline at end of file
+
+#ifdef SVGF_ERROR_REPORT
+    //  full-precision reference, fed with a copy of the same input
+    SVGF*                 pReference = nullptr;
+    Texture               ref_Input;
+    VkImageView           ref_InputSRV = VK_NULL_HANDLE;
+
+    //  host-visible copy of both outputs (this one first, then the reference)
+    VkBuffer              ref_Readback = VK_NULL_HANDLE;
+    VkDeviceMemory        ref_ReadbackMemory = VK_NULL_HANDLE;
+    uint32_t              ref_ReadbackFrame = UINT32_MAX;
+
+    void copyToReference(VkCommandBuffer cmdBuf);
+    void readbackOutputs(VkCommandBuffer cmdBuf);
+    void reportError();
+#endif
+};
@@ -32,32 +32,60 @@ struct SVGFParams
     float phiNormal;
     float phiLuminance;
     float padding;
+
+    ivec2 viewExtent;
 };
 layout (std140, binding = ID_Params) uniform Params 
 {
     SVGFParams u_params;
 };
 
-layout (binding = ID_Normal) uniform sampler2D u_normal;
-layout (binding = ID_DepthMoment) uniform sampler2D u_depthMoment;
+//  packed guide : oct. normal (xy), linear depth (z), depth gradient (w)
+layout (binding = ID_Guide) uniform sampler2D u_guide;
 
 layout (rgba16f, binding = ID_InHDR) uniform image2D in_HDR;
+#ifdef SVGF_PACKED_FORMATS
+//  color (r11g11b10f) and variance (r16f) are split
+layout (r11f_g11f_b10f, binding = ID_ImdHDR) uniform image2D imd_HDR;
+layout (r16f, binding = ID_ImdVariance) uniform image2D imd_variance;
+layout (r11f_g11f_b10f, binding = ID_CacheHDR) uniform image2D cache_HDR;
+layout (r16f, binding = ID_CacheVariance) uniform image2D cache_variance;
+
+vec4 loadImd(ivec2 texCoord) { return vec4(imageLoad(imd_HDR, texCoord).rgb, imageLoad(imd_variance, texCoord).r); }
+vec4 loadCache(ivec2 texCoord) { return vec4(imageLoad(cache_HDR, texCoord).rgb, imageLoad(cache_variance, texCoord).r); }
+void storeImd(ivec2 texCoord, vec4 val) { imageStore(imd_HDR, texCoord, val); imageStore(imd_variance, texCoord, val.aaaa); }
+void storeCache(ivec2 texCoord, vec4 val) { imageStore(cache_HDR, texCoord, val); imageStore(cache_variance, texCoord, val.aaaa); }
+#else
 layout (rgba16f, binding = ID_ImdHDR) uniform image2D imd_HDR;
-vec4 loadHDR(bool toInput, ivec2 texCoord)
+layout (rgba16f, binding = ID_CacheHDR) uniform image2D cache_HDR;
+
+vec4 loadImd(ivec2 texCoord) { return imageLoad(imd_HDR, texCoord); }
+vec4 loadCache(ivec2 texCoord) { return imageLoad(cache_HDR, texCoord); }
+void storeImd(ivec2 texCoord, vec4 val) { imageStore(imd_HDR, texCoord, val); }
+void storeCache(ivec2 texCoord, vec4 val) { imageStore(cache_HDR, texCoord, val); }
+#endif
+
+//  reprojection leaves its result in the intermediate buffer. the 1st iteration writes
+//  straight to the cache, so the (even) iteration count still ends in the input buffer.
+//  iter 0 : imd -> cache, iter 1 : cache -> in, iter 2 : in -> imd, iter 3 : imd -> in ...
+vec4 loadHDR(ivec2 texCoord)
 {
-    if (toInput)
-        return imageLoad(imd_HDR, texCoord);
+    if (atrousIterCount == 1)
+        return loadCache(texCoord);
+    else if (atrousIterCount == 0 || (atrousIterCount & 1) != 0)
+        return loadImd(texCoord);
     else
         return imageLoad(in_HDR, texCoord);
 }
-void storeHDR(bool toInput, ivec2 texCoord, vec4 val)
+void storeHDR(ivec2 texCoord, vec4 val)
 {
-    if (toInput)
+    if (atrousIterCount == 0)
+        storeCache(texCoord, val);
+    else if ((atrousIterCount & 1) != 0)
         imageStore(in_HDR, texCoord, val);
     else
-        imageStore(imd_HDR, texCoord, val);
+        storeImd(texCoord, val);
 }
-layout (rgba16f, binding = ID_CacheHDR) uniform image2D out_cacheHDR;
 
 //--------------------------------------------------------------------------------------
 //  main function
@@ -68,7 +96,7 @@ layout (rgba16f, binding = ID_CacheHDR) uniform image2D out_cacheHDR;
 
 // computes a 3x3 gaussian blur of the variance, centered around
 // the current pixel
-float computeVarianceCenter(bool toInput, ivec2 ipos)
+float computeVarianceCenter(ivec2 ipos)
 {
     float sum = 0;
 
@@ -86,7 +114,7 @@ float computeVarianceCenter(bool toInput, ivec2 ipos)
 
             const float k = kernel[abs(xx)][abs(yy)];
 
-            sum += loadHDR(toInput, p).a * k;
+            sum += loadHDR(p).a * k;
         }
     }
 
@@ -95,11 +123,8 @@ float computeVarianceCenter(bool toInput, ivec2 ipos)
 
 void main()
 {
-    //  determine if the output for this a-trous iteration is the input color buffer itself.
-    bool toInput = (atrousIterCount & 1) != 0;
-
     //  retrieve working coordinate
-    const ivec2 texSize = textureSize(u_normal, 0);
+    const ivec2 texSize = u_params.viewExtent;
     const ivec2 texCoord = ivec2(gl_GlobalInvocationID.xy);
 
     const float epsVariance      = 1e-10;
@@ -107,32 +132,22 @@ void main()
 
     // constant samplers to prevent the compiler from generating code which
     // fetches the sampler descriptor from memory for each texture access
-    const vec4  ctrColorVariance = loadHDR(toInput, texCoord);
+    const vec4  ctrColorVariance = loadHDR(texCoord);
     const float ctrLuminance = getPerceivedBrightness(ctrColorVariance.xyz);
 
     // variance for direct and indirect, filtered using 3x3 gaussin blur
-    const float ctrVariance = computeVarianceCenter(toInput, texCoord);
-
-    const vec3 ctrNormal = texelFetch(u_normal, texCoord, 0).rgb * 2.0f - 1.0f;
+    const float ctrVariance = computeVarianceCenter(texCoord);
 
-    const vec4 ctrPackedDepthMoment = texelFetch(u_depthMoment, texCoord, 0);
-    const float ctrDepth = ctrPackedDepthMoment.x;
-    const float fWidthZ = ctrPackedDepthMoment.y;
-    const vec2 ctrMoments = ctrPackedDepthMoment.zw;
+    const vec4 ctrGuide = texelFetch(u_guide, texCoord, 0);
+    const vec3 ctrNormal = unpackNormalOct(ctrGuide.xy);
+    const float ctrDepth = ctrGuide.z;
+    const float fWidthZ = ctrGuide.w;
 
     if (ctrDepth < -u_params.far || ctrDepth > -u_params.near) // might be envmap
     {
         //  just pass the color (and variance) data
         //out_HDR = ctrColorVariance;
-        storeHDR(toInput, texCoord, ctrColorVariance);
-        
-        //  store color in cache if this is the first iteration
-        if(atrousIterCount == 0)
-        {
-            //out_cacheHDR = sum_colorVariance;
-            imageStore(out_cacheHDR, texCoord, ctrColorVariance);
-        }
-
+        storeHDR(texCoord, ctrColorVariance);
         return;
     }
 
@@ -157,14 +172,12 @@ void main()
 
             if (inside && (xx != 0 || yy != 0)) // skip center pixel, it is already accumulated
             {
-                const vec4 pColorVariance = loadHDR(toInput, p);
+                const vec4 pColorVariance = loadHDR(p);
                 const float pLuminance = getPerceivedBrightness(pColorVariance.xyz);
 
-                const vec3 pNormal = texelFetch(u_normal, p, 0).rgb * 2.0f - 1.0f;
-
-                const vec4 pPackedDepthMoment = texelFetch(u_depthMoment, p, 0);
-                const float pDepth = pPackedDepthMoment.x;
-                const vec2 pMoments = pPackedDepthMoment.zw;
+                const vec4 pGuide = texelFetch(u_guide, p, 0);
+                const vec3 pNormal = unpackNormalOct(pGuide.xy);
+                const float pDepth = pGuide.z;
 
                 // compute the edge-stopping functions
                 const float w = computeEdgeStoppingWeight(
@@ -182,13 +195,6 @@ void main()
     // renormalization is different for variance, check paper for the formula
     sum_colorVariance /= vec4(vec3(sum_w), sum_w * sum_w);
 
-    //out_HDR = sum_colorVariance;
-    storeHDR(toInput, texCoord, sum_colorVariance);
-
-    //  store color in cache if this is the first iteration
-    if(atrousIterCount == 0)
-    {
-        //out_cacheHDR = sum_colorVariance;
-        imageStore(out_cacheHDR, texCoord, sum_colorVariance);
-    }
+    //  (1st iteration goes to the cache for the next frame's reprojection)
+    storeHDR(texCoord, sum_colorVariance);
 }
\ No newline at end of file
@@ -1,3 +1,20 @@
+//  octahedral normal encoding, so that the whole filter guide (normal + depth + gradient)
+//  fits in a single rgba16f texel
+vec2 packNormalOct(vec3 n)
+{
+    n /= (abs(n.x) + abs(n.y) + abs(n.z));
+    vec2 p = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return p;
+}
+
+vec3 unpackNormalOct(vec2 p)
+{
+    vec3 n = vec3(p.xy, 1.0 - abs(p.x) - abs(p.y));
+    if (n.z < 0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
 float normalDistanceCos(vec3 n1, vec3 n2, float power)
 {
 	return pow(clamp(dot(n1,n2), 0, 1), power);
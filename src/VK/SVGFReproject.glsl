@@ -2,14 +2,24 @@
 
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
+#extension GL_ARB_compute_shader  : enable
 
 precision highp float;
 
 //--------------------------------------------------------------------------------------
-//  FS inputs
+//  CS workgroup definition
 //--------------------------------------------------------------------------------------
 
-layout (location = 0) in vec2 UV;
+//  temporal accumulation and variance estimation are fused into this single kernel.
+//  each invocation reprojects the pixel it owns, and the workgroup keeps a (GROUP_SIZE + 2 * APRON)^2 tile
+//  in LDS, so that screen-space derivatives and the 7x7 spatial variance estimation never leave the chip.
+//  the apron is only reprojected by the groups owning a pixel short of history, the only ones estimating
+//  its variance spatially : every tap then reads accumulated data, as the unfused passes did.
+#define GROUP_SIZE 16
+#define APRON 4 // 7x7 footprint needs 3, rounded up to keep 2x2 quads aligned for derivatives
+#define TILE_SIZE (GROUP_SIZE + 2 * APRON)
+
+layout (local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
 
 //--------------------------------------------------------------------------------------
 //  uniform data
@@ -28,8 +38,10 @@ struct SVGFParams
     float phiNormal;
     float phiLuminance;
     float padding;
+
+    ivec2 viewExtent;
 };
-layout (std140, binding = ID_Params) uniform Params 
+layout (std140, binding = ID_Params) uniform Params
 {
     SVGFParams u_params;
 };
@@ -40,30 +52,97 @@ layout (binding = ID_Depth) uniform sampler2D u_depth;
 layout (binding = ID_MotionVec) uniform sampler2D u_motionVec;
 
 layout (binding = ID_CacheHDR) uniform sampler2D u_cacheHDR;
-layout (binding = ID_CacheNormal) uniform sampler2D u_cacheNormal;
-layout (binding = ID_CacheDepthMoment) uniform sampler2D u_cacheDepthMoment;
-
+//  packed guide : oct. normal (xy), linear depth (z), depth gradient (w)
+layout (binding = ID_CacheGuide) uniform sampler2D u_cacheGuide;
+#ifdef SVGF_PACKED_FORMATS
+//  moments (L and L^2) (rg16f), history length (r8ui)
+layout (binding = ID_CacheMoment) uniform sampler2D u_cacheMoment;
 layout (binding = ID_CacheHistory) uniform usampler2D u_cacheHistory;
 
+vec2 loadPrevMoments(ivec2 texCoord) { return texelFetch(u_cacheMoment, texCoord, 0).xy; }
+uint loadPrevHistory(ivec2 texCoord) { return texelFetch(u_cacheHistory, texCoord, 0).r; }
+#else
+//  moments (L and L^2) (xy), history length (z)
+layout (binding = ID_CacheMomentHistory) uniform sampler2D u_cacheMomentHistory;
+
+vec2 loadPrevMoments(ivec2 texCoord) { return texelFetch(u_cacheMomentHistory, texCoord, 0).xy; }
+uint loadPrevHistory(ivec2 texCoord) { return uint(texelFetch(u_cacheMomentHistory, texCoord, 0).z); }
+#endif
+
+//--------------------------------------------------------------------------------------
+//  CS outputs
+//--------------------------------------------------------------------------------------
+
+layout (rgba16f, binding = ID_OutGuide) uniform image2D out_guide;
+#ifdef SVGF_PACKED_FORMATS
+//  color (r11g11b10f) and variance (r16f) are split
+layout (r11f_g11f_b10f, binding = ID_OutHDR) uniform image2D out_HDR;
+layout (r16f, binding = ID_OutVariance) uniform image2D out_variance;
+layout (rg16f, binding = ID_OutMoment) uniform image2D out_moment;
+layout (r8ui, binding = ID_OutHistory) uniform uimage2D out_history;
+
+void storeColorVariance(ivec2 texCoord, vec4 colorVariance)
+{
+    imageStore(out_HDR, texCoord, colorVariance);
+    imageStore(out_variance, texCoord, colorVariance.aaaa);
+}
+void storeMomentHistory(ivec2 texCoord, vec2 moments, uint historyLength)
+{
+    imageStore(out_moment, texCoord, vec4(moments, 0, 0));
+    imageStore(out_history, texCoord, uvec4(historyLength));
+}
+#else
+layout (rgba16f, binding = ID_OutHDR) uniform image2D out_HDR;
+layout (rgba16f, binding = ID_OutMomentHistory) uniform image2D out_momentHistory;
+
+void storeColorVariance(ivec2 texCoord, vec4 colorVariance)
+{
+    imageStore(out_HDR, texCoord, colorVariance);
+}
+void storeMomentHistory(ivec2 texCoord, vec2 moments, uint historyLength)
+{
+    imageStore(out_momentHistory, texCoord, vec4(moments, historyLength, 0));
+}
+#endif
+
 //--------------------------------------------------------------------------------------
-//  FS outputs
+//  shared memory
 //--------------------------------------------------------------------------------------
 
-layout (location = 0) out vec4 out_HDR;
-layout (location = 1) out vec4 out_DepthMoment;
-layout (location = 2) out uint out_History;
+//  24^2 x 24 B (13.5 KB), within the 16 KB of maxComputeSharedMemorySize every device supports
+shared uint  sh_normal[TILE_SIZE * TILE_SIZE]; // oct. (snorm16 x 2)
+shared float sh_depth[TILE_SIZE * TILE_SIZE];
+shared uvec2 sh_color[TILE_SIZE * TILE_SIZE]; // rgb (half x 3)
+shared vec2  sh_moments[TILE_SIZE * TILE_SIZE]; // full precision, the variance is their difference
+shared bool  sh_reprojectApron;
 
 //--------------------------------------------------------------------------------------
 //  main function
 //--------------------------------------------------------------------------------------
 
 #include "functions.glsl"
+#include "SVGFEdgeStoppingFunc.h"
 
 const float epsilon = 1e-4;
 
 float toViewDepth(float projDepth, float nearPlane, float farPlane)
 { return -nearPlane * farPlane / (projDepth * (nearPlane - farPlane) + farPlane); }
 
+uint tileIndex(ivec2 tileCoord)
+{ return tileCoord.y * TILE_SIZE + tileCoord.x; }
+
+vec3 loadNormal(uint idx)
+{ return unpackNormalOct(unpackSnorm2x16(sh_normal[idx])); }
+
+vec3 loadColor(uint idx)
+{ return vec3(unpackHalf2x16(sh_color[idx].x), unpackHalf2x16(sh_color[idx].y).x); }
+
+void storeColorMoments(uint idx, vec3 color, vec2 moments)
+{
+    sh_color[idx] = uvec2(packHalf2x16(color.rg), packHalf2x16(vec2(color.b, 0)));
+    sh_moments[idx] = moments;
+}
+
 bool isConsistent(float Z, float Zprev, float fwidthZ, vec3 normal, vec3 normalPrev, float fwidthNormal)
 {
     // check if deviation of depths is acceptable
@@ -77,27 +156,21 @@ bool isConsistent(float Z, float Zprev, float fwidthZ, vec3 normal, vec3 normalP
     return true;
 }
 
-bool loadPrevData(ivec2 texCoord, ivec2 texSize, out vec3 prevItgColor, out vec2 prevMoments, out vec2 packedDepthGradient, out uint historyLength)
+bool loadPrevData(ivec2 texCoord, ivec2 texSize, vec3 normal, float linearDepth, float fWidthNormal, float fWidthZ,
+    out vec3 prevItgColor, out vec2 prevMoments, out uint historyLength)
 {
     //  initialize returned values
     prevItgColor = vec3(0);
     prevMoments = vec2(0);
     historyLength = 0;
 
-    //  retrieve current frame's geometric data
-    const vec3 normal = texelFetch(u_normal, texCoord, 0).rgb * 2.0f - 1.0f;
-    const float fWidthNormal = length(fwidth(normal));
-    const float linearDepth = toViewDepth(texelFetch(u_depth, texCoord, 0).r, u_params.near, u_params.far);
-    const float fWidthZ = max(abs(dFdx(linearDepth)), abs(dFdy(linearDepth)));
-    packedDepthGradient = vec2(linearDepth, fWidthZ);
-
     //  determine corresp. data coordinate in the previous frame
     const vec2 motionVec = texelFetch(u_motionVec, texCoord, 0).rg * vec2(0.5, -0.5);
     const vec2 prevUnnormCoord = texCoord - motionVec * texSize - vec2(0.5, 0.5); // since we assume that the integer coord is at the center of the px
     const ivec2 prevTexCoord = ivec2(round(prevUnnormCoord.x), round(prevUnnormCoord.y));
 
     // check whether reprojected pixel is inside of the screen
-    if(any(lessThan(prevTexCoord, ivec2(0))) || any(greaterThan(prevTexCoord, texSize - ivec2(1)))) 
+    if(any(lessThan(prevTexCoord, ivec2(0))) || any(greaterThan(prevTexCoord, texSize - ivec2(1))))
         return false;
 
     //  examine 2x2 tap
@@ -106,12 +179,11 @@ bool loadPrevData(ivec2 texCoord, ivec2 texSize, out vec3 prevItgColor, out vec2
 
     bool valid = false;
     for (int sampleIdx = 0; sampleIdx < 4; sampleIdx++)
-    { 
+    {
         const ivec2 loc = ivec2(prevUnnormCoord) + offsets[sampleIdx];
-        const vec3 prevNormal = texelFetch(u_cacheNormal, loc, 0).rgb * 2.0f - 1.0f;
-        const float prevLinearDepth = texelFetch(u_cacheDepthMoment, loc, 0).r;
+        const vec4 prevGuide = texelFetch(u_cacheGuide, loc, 0);
 
-        v[sampleIdx] = isConsistent(linearDepth, prevLinearDepth, fWidthZ, normal, prevNormal, fWidthNormal);
+        v[sampleIdx] = isConsistent(linearDepth, prevGuide.z, fWidthZ, normal, unpackNormalOct(prevGuide.xy), fWidthNormal);
 
         valid = valid || v[sampleIdx];
     }
@@ -120,19 +192,19 @@ bool loadPrevData(ivec2 texCoord, ivec2 texSize, out vec3 prevItgColor, out vec2
     {
         const float x = fract(prevUnnormCoord.x);
         const float y = fract(prevUnnormCoord.y);
-        const float w[4] = { (1 - x) * (1 - y), 
-                             x       * (1 - y), 
+        const float w[4] = { (1 - x) * (1 - y),
+                             x       * (1 - y),
                              (1 - x) * y,
                              x       * y };
 
         float sum_w = 0;
         for (int sampleIdx = 0; sampleIdx < 4; sampleIdx++)
         {
-            const ivec2 loc = ivec2(prevUnnormCoord) + offsets[sampleIdx];           
+            const ivec2 loc = ivec2(prevUnnormCoord) + offsets[sampleIdx];
             if (v[sampleIdx])
             {
                 prevItgColor += w[sampleIdx] * texelFetch(u_cacheHDR, loc, 0).rgb;
-                prevMoments += w[sampleIdx] * texelFetch(u_cacheDepthMoment, loc, 0).ba;
+                prevMoments += w[sampleIdx] * loadPrevMoments(loc);
                 sum_w += w[sampleIdx];
             }
         }
@@ -151,13 +223,12 @@ bool loadPrevData(ivec2 texCoord, ivec2 texSize, out vec3 prevItgColor, out vec2
             for (int xx = -radius; xx <= radius; xx++)
             {
                 const ivec2 loc = prevTexCoord + ivec2(xx, yy);
-                const vec3 prevNormal = texelFetch(u_cacheNormal, loc, 0).rgb * 2.0f - 1.0f;
-                const float prevLinearDepth = texelFetch(u_cacheDepthMoment, loc, 0).r;
+                const vec4 prevGuide = texelFetch(u_cacheGuide, loc, 0);
 
-                if (isConsistent(linearDepth, prevLinearDepth, fWidthZ, normal, prevNormal, fWidthNormal))
+                if (isConsistent(linearDepth, prevGuide.z, fWidthZ, normal, unpackNormalOct(prevGuide.xy), fWidthNormal))
                 {
 					prevItgColor += texelFetch(u_cacheHDR, loc, 0).rgb;
-					prevMoments += texelFetch(u_cacheDepthMoment, loc, 0).ba;
+					prevMoments += loadPrevMoments(loc);
                     v_count++;
                 }
             }
@@ -172,25 +243,40 @@ bool loadPrevData(ivec2 texCoord, ivec2 texSize, out vec3 prevItgColor, out vec2
 
     //  retrieve history length if there is no disocclusion
     if (valid)
-        historyLength = texelFetch(u_cacheHistory, prevTexCoord, 0).r;
+        historyLength = loadPrevHistory(prevTexCoord);
 
     return valid;
 }
 
-void main()
+//  temporal accumulation of a texel of the tile, from the current data in LDS :
+//  returns the accumulated color & moments (L, L^2), the history length and the depth gradient.
+void accumulate(ivec2 tileCoord, ivec2 texCoord, ivec2 texSize,
+    out vec3 itgColor, out vec2 moments, out uint historyLength, out float fWidthZ)
 {
+    const uint idx = tileIndex(tileCoord);
+
+    //  fine derivatives within the 2x2 quad, as the rasterizer would do (the tile origin stays even)
+    const uint idxX0 = tileIndex(ivec2(tileCoord.x & ~1, tileCoord.y));
+    const uint idx0Y = tileIndex(ivec2(tileCoord.x, tileCoord.y & ~1));
+
+    const vec3 normal = loadNormal(idx);
+    const float linearDepth = sh_depth[idx];
+
+    const vec3 dNdx = loadNormal(idxX0 + 1) - loadNormal(idxX0);
+    const vec3 dNdy = loadNormal(idx0Y + TILE_SIZE) - loadNormal(idx0Y);
+    const float fWidthNormal = length(abs(dNdx) + abs(dNdy));
+    //  max(|dFdx|, |dFdy|), as the fragment pass this kernel replaced (and Falcor's SVGF) : phiDepth is tuned for it
+    fWidthZ = max(
+        abs(sh_depth[idxX0 + 1] - sh_depth[idxX0]),
+        abs(sh_depth[idx0Y + TILE_SIZE] - sh_depth[idx0Y]));
+
     //  retrieve current pixel color
-    const ivec2 texSize = textureSize(u_HDR, 0);
-    // const ivec2 texCoord = gl_WorkGroupID.xy * gl_WorkGroupSize.xy + gl_LocalInvocationID.xy;
-    const ivec2 texCoord = ivec2(floor(vec2(UV.x, /*1.0 - */UV.y) * texSize));
-    const vec3 color = clamp(texelFetch(u_HDR, texCoord, 0).rgb, 0.0f, 1.0f);
+    const vec3 color = loadColor(idx);
 
     //  rretrieve previous frame's data
     vec3 prevItgColor;
     vec2 prevMoments;
-    vec2 packedDepthGradient;
-    uint historyLength;
-    bool success = loadPrevData(texCoord, texSize, prevItgColor, prevMoments, packedDepthGradient, historyLength);
+    bool success = loadPrevData(texCoord, texSize, normal, linearDepth, fWidthNormal, fWidthZ, prevItgColor, prevMoments, historyLength);
 
     //  increment history length if no disocclusion happens (if not, success = true)
     historyLength = min(32, success ? historyLength + 1 : 1);
@@ -202,17 +288,182 @@ void main()
     const float alphaMoments = success ? max(u_params.alphaMoments, 1.0 / historyLength) : 1.0;
 
     //  perform temporal accumulation on color
-    const vec3 itgColor = mix(prevItgColor, color, alphaColor);
+    itgColor = mix(prevItgColor, color, alphaColor);
 
     //  perform temporal accumulation on luminance (both L and L^2)
     const float luminance = getPerceivedBrightness(color);
-    const vec2 moments = mix(prevMoments, vec2(/* L */luminance, /* L^2 */luminance * luminance), alphaMoments);
+    moments = mix(prevMoments, vec2(/* L */luminance, /* L^2 */luminance * luminance), alphaMoments);
+}
+
+void main()
+{
+    const ivec2 texSize = u_params.viewExtent;
+    const ivec2 groupOrigin = ivec2(gl_WorkGroupID.xy) * GROUP_SIZE;
+    const ivec2 tileOrigin = groupOrigin - ivec2(APRON); // stays even, so 2x2 quads never straddle the tile border
+
+    if (gl_LocalInvocationIndex == 0)
+        sh_reprojectApron = false;
+
+    //  1. load the current frame's data of the whole tile
+    //
+    for (uint i = gl_LocalInvocationIndex; i < TILE_SIZE * TILE_SIZE; i += GROUP_SIZE * GROUP_SIZE)
+    {
+        const ivec2 texCoord = clamp(tileOrigin + ivec2(i % TILE_SIZE, i / TILE_SIZE), ivec2(0), texSize - ivec2(1));
+
+        sh_normal[i] = packSnorm2x16(packNormalOct(texelFetch(u_normal, texCoord, 0).rgb * 2.0f - 1.0f));
+        sh_depth[i] = toViewDepth(texelFetch(u_depth, texCoord, 0).r, u_params.near, u_params.far);
+
+        const vec3 color = clamp(texelFetch(u_HDR, texCoord, 0).rgb, 0.0f, 1.0f);
+        const float luminance = getPerceivedBrightness(color);
+        storeColorMoments(i, color, vec2(luminance, luminance * luminance));
+    }
+
+    barrier();
+
+    //  2. temporal accumulation of the pixel owned by this invocation
+    //
+    const ivec2 texCoord = ivec2(gl_GlobalInvocationID.xy);
+    const bool inside = all(lessThan(texCoord, texSize));
+    const ivec2 ctrTileCoord = ivec2(gl_LocalInvocationID.xy) + ivec2(APRON);
+    const uint ctrTileIdx = tileIndex(ctrTileCoord);
+
+    const vec3 ctrNormal = loadNormal(ctrTileIdx);
+    const float ctrDepth = sh_depth[ctrTileIdx];
+
+    vec3 itgColor;
+    vec2 ctrMoments;
+    uint historyLength;
+    float fWidthZ;
+    accumulate(ctrTileCoord, min(texCoord, texSize - ivec2(1)), texSize, itgColor, ctrMoments, historyLength, fWidthZ);
 
     //  calculate variance
-    const float variance = max(0, moments.y - moments.x * moments.x);
+    const vec4 colorVariance = vec4(itgColor, max(0, ctrMoments.y - ctrMoments.x * ctrMoments.x));
 
-    //  save integrated values and variance
-    out_HDR = vec4(itgColor, variance);
-    out_DepthMoment = vec4(packedDepthGradient, moments);
-    out_History = historyLength;
-}
\ No newline at end of file
+    //  write the caches for the next frame
+    if (inside)
+    {
+        imageStore(out_guide, texCoord, vec4(packNormalOct(ctrNormal), ctrDepth, fWidthZ));
+        storeMomentHistory(texCoord, ctrMoments, historyLength);
+
+        if (historyLength < 4)
+            sh_reprojectApron = true;
+    }
+
+    //  the derivatives above only read normals & depths, which stay as loaded
+    storeColorMoments(ctrTileIdx, itgColor, ctrMoments);
+
+    barrier();
+
+    //  2.1 temporal accumulation of the apron, for the spatial estimation of the pixels short of history.
+    //  a group whose pixels all have history (the steady state) skips it.
+    //
+    if (sh_reprojectApron)
+    {
+        const uint apronCount = TILE_SIZE * TILE_SIZE - GROUP_SIZE * GROUP_SIZE;
+        for (uint i = gl_LocalInvocationIndex; i < apronCount; i += GROUP_SIZE * GROUP_SIZE)
+        {
+            //  rows above & below the group span the whole tile, rows alongside it only the APRON columns each side
+            ivec2 tileCoord;
+            if (i < APRON * TILE_SIZE)
+                tileCoord = ivec2(i % TILE_SIZE, i / TILE_SIZE);
+            else if (i < 2 * APRON * TILE_SIZE)
+                tileCoord = ivec2((i - APRON * TILE_SIZE) % TILE_SIZE, APRON + GROUP_SIZE + (i - APRON * TILE_SIZE) / TILE_SIZE);
+            else
+            {
+                const uint j = i - 2 * APRON * TILE_SIZE;
+                const uint column = j % (2 * APRON);
+                tileCoord = ivec2(column < APRON ? column : column + GROUP_SIZE, APRON + j / (2 * APRON));
+            }
+
+            vec3 apronColor;
+            vec2 apronMoments;
+            uint apronHistory;
+            float apronFWidthZ;
+            accumulate(tileCoord, clamp(tileOrigin + tileCoord, ivec2(0), texSize - ivec2(1)), texSize,
+                apronColor, apronMoments, apronHistory, apronFWidthZ);
+            storeColorMoments(tileIndex(tileCoord), apronColor, apronMoments);
+        }
+
+        barrier();
+    }
+
+    //  3. variance estimation of the pixel owned by this invocation
+    //
+    if (!inside)
+        return;
+
+    if (historyLength < 4) // not enough temporal history available
+    {
+		const float ctrLuminance = getPerceivedBrightness(colorVariance.xyz);
+
+        if (ctrDepth < -u_params.far || ctrDepth > -u_params.near) // might be envmap
+        {
+            //  just pass the color (and variance) data
+            storeColorVariance(texCoord, colorVariance);
+            return;
+        }
+
+        const float phiLuminance = u_params.phiLuminance;
+        const float phiDepth = u_params.phiDepth * max(fWidthZ, 1e-8f) * 3.0f;
+
+        // explicitly store/accumulate center pixel with weight 1 to prevent issues
+        // with the edge-stopping functions
+        float sum_w = 1.0;
+        vec3  sum_color = colorVariance.xyz;
+        vec2  sum_moments = ctrMoments;
+
+        // compute first and second moment spatially. This code also applies cross-bilateral
+        // filtering on the input color samples
+        const int radius = 3;
+        for (int yy = -radius; yy <= radius; yy++)
+        {
+            for (int xx = -radius; xx <= radius; xx++)
+            {
+                const ivec2 p = texCoord + ivec2(xx, yy);
+                const bool inside = all(greaterThanEqual(p, ivec2(0,0))) && all(lessThan(p, texSize));
+
+                if (inside && (xx != 0 || yy != 0))  // skip center pixel, it is already accumulated
+                {
+                    const uint pIdx = tileIndex(ctrTileCoord + ivec2(xx, yy));
+
+                    const vec3 pColor = loadColor(pIdx);
+		            const float pLuminance = getPerceivedBrightness(pColor);
+
+                    const vec3 pNormal = loadNormal(pIdx);
+
+                    const float pDepth = sh_depth[pIdx];
+                    const vec2 pMoments = sh_moments[pIdx];
+
+                    const float w = computeEdgeStoppingWeight(
+                        ctrDepth, pDepth, phiDepth * length(vec2(xx, yy)),
+						ctrNormal, pNormal, u_params.phiNormal,
+                        ctrLuminance, pLuminance, phiLuminance);
+
+                    sum_w  += w;
+
+                    sum_color   += pColor * w;
+					sum_moments += pMoments * w;
+                }
+            }
+        }
+
+        // Clamp sums to >0 to avoid NaNs.
+		sum_w = max(sum_w, 1e-6f);
+
+        sum_color /= sum_w;
+        sum_moments /= sum_w;
+
+        //  calculate variance
+        float variance = max(0, sum_moments.y - sum_moments.x * sum_moments.x);
+
+        // give the variance a boost for the first frames
+        variance *= 4.0f / historyLength;
+
+        storeColorVariance(texCoord, vec4(sum_color, variance));
+    }
+    else
+    {
+        //  just pass the color (and variance) data
+        storeColorVariance(texCoord, colorVariance);
+    }
+}
@@ -0,0 +1,86 @@
+#include "SamplingSequence.h"
+
+static uint32_t reverseBits(uint32_t x)
+{
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+	x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+//	first two dimensions of Sobol's sequence (32-bit fixed point)
+//	ref : Joe & Kuo, "Constructing Sobol sequences with better two-dimensional projections"
+static uint32_t sobol(uint32_t index, uint32_t dim)
+{
+	if (dim == 0)
+		return reverseBits(index); // van der Corput
+
+	uint32_t result = 0;
+	for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+	{
+		if (index & 1)
+			result ^= v;
+	}
+	return result;
+}
+
+//	hash-based Owen scrambling (nested uniform), which keeps the sequence's stratification.
+//	ref : Burley, "Practical Hash-based Owen Scrambling", JCGT 2020
+static uint32_t owenScramble(uint32_t x, uint32_t seed)
+{
+	x = reverseBits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverseBits(x);
+}
+
+static uint32_t hashSeed(uint32_t seed)
+{
+	//	ref : https://nullprogram.com/blog/2018/07/31/ (lowbias32)
+	seed ^= seed >> 16;
+	seed *= 0x7feb352du;
+	seed ^= seed >> 15;
+	seed *= 0x846ca68bu;
+	seed ^= seed >> 16;
+	return seed;
+}
+
+void SamplingSequence::getPoint(uint32_t index, uint32_t scrambleSeed, float point[2])
+{
+	for (uint32_t dim = 0; dim < 2; dim++)
+	{
+		//	each dimension gets its own scramble
+		const uint32_t bits = owenScramble(sobol(index, dim), hashSeed(scrambleSeed * 2 + dim));
+
+		//	24 bits, to stay below 1 in single precision
+		point[dim] = (bits >> 8) * (1.0f / (1u << 24));
+	}
+}
+
+void SamplingSequence::createTexture(Device* pDevice, UploadHeap& uploadHeap, 
+	uint32_t blockDim, uint32_t period, uint32_t scrambleSeed,
+	Texture* pTexture, const char* name)
+{
+	assert(period > 0 && (period & (period - 1)) == 0);
+
+	//	slice t holds the points [t * blockSize, (t + 1) * blockSize), in thread order (row-major)
+	const uint32_t pointCount = blockDim * blockDim * period;
+	std::vector<float> points(pointCount * 2);
+	for (uint32_t i = 0; i < pointCount; i++)
+		SamplingSequence::getPoint(i, scrambleSeed, &points[i * 2]);
+
+	IMG_INFO texInfo;
+	texInfo.width = blockDim;
+	texInfo.height = blockDim * period;
+	texInfo.depth = 1;
+	texInfo.mipMapCount = 1;
+	texInfo.arraySize = 1;
+	texInfo.format = DXGI_FORMAT_R32G32_FLOAT;
+	texInfo.bitCount = 64;
+
+	pTexture->InitFromData(pDevice, uploadHeap, texInfo, points.data(), name);
+}
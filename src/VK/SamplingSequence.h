@@ -0,0 +1,20 @@
+#pragma once
+
+//  spatiotemporal low-discrepancy sampling points of the tracers' emission blocks.
+//  frame (seed) t gives the thread i of a block the point t * blockSize + i of an Owen-scrambled 2D Sobol sequence :
+//  - every frame is a stratified set (a (0,m,2)-net), so is any whole-subgroup prefix of it (see density feedback)
+//  - frames accumulated by the denoiser over a power-of-two period are stratified as a whole
+class SamplingSequence
+{
+public:
+
+    //  blockDim x (blockDim * period) texture (r32g32f) : one blockDim x blockDim slice per frame, stacked vertically.
+    //  period must be a power of two.
+    //  tracers sampling from the same scene should use different scramble seeds, to decorrelate their noise.
+    static void createTexture(Device* pDevice, UploadHeap& uploadHeap, 
+        uint32_t blockDim, uint32_t period, uint32_t scrambleSeed, 
+        Texture* pTexture, const char* name);
+
+    //  index-th point of the scrambled sequence, in [0, 1)^2
+    static void getPoint(uint32_t index, uint32_t scrambleSeed, float point[2]);
+};
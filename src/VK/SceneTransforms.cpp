@@ -0,0 +1,383 @@
+#include "SceneTransforms.h"
+
+#include <sstream>
+
+//	levels split over the job system from this many blocks (of 4 nodes), in ranges of this many
+#define PARALLEL_MIN_BLOCKS 512
+#define PARALLEL_GRAIN_BLOCKS 256
+
+void SceneTransforms::OnCreate(SceneLoader* pScene, uint32_t sceneIndex, JobSystem* pJobSystem)
+{
+	this->pScene = pScene;
+	this->sceneIndex = sceneIndex;
+	this->pJobSystem = pJobSystem;
+
+	const uint32_t nodeCount = (uint32_t)pScene->m_nodes.size();
+	pScene->m_worldSpaceMats.resize(nodeCount);
+
+	//	flatten the hierarchy breadth first, from the roots of the scene
+	this->slotNodes.clear();
+	this->slotParents.clear();
+	this->levelOffsets.clear();
+	this->nodeSlots.assign(nodeCount, UINT32_MAX);
+
+	std::vector<std::pair<uint32_t, uint32_t>> level, nextLevel; // node, parent slot
+	for (int node : pScene->m_scenes[sceneIndex].m_nodes)
+		level.push_back(std::make_pair((uint32_t)node, UINT32_MAX));
+
+	while (!level.empty())
+	{
+		this->levelOffsets.push_back((uint32_t)this->slotNodes.size());
+
+		nextLevel.clear();
+		for (const std::pair<uint32_t, uint32_t>& entry : level)
+		{
+			//	a glTF node has one parent at most
+			assert(this->nodeSlots[entry.first] == UINT32_MAX);
+			if (this->nodeSlots[entry.first] != UINT32_MAX)
+				continue;
+
+			const uint32_t slot = (uint32_t)this->slotNodes.size();
+			this->slotNodes.push_back(entry.first);
+			this->slotParents.push_back(entry.second);
+			this->nodeSlots[entry.first] = slot;
+
+			for (int child : pScene->m_nodes[entry.first].m_children)
+				nextLevel.push_back(std::make_pair((uint32_t)child, slot));
+		}
+
+		//	pad the level to whole blocks, under any parent of the level
+		const uint32_t padParent = this->slotParents[this->levelOffsets.back()];
+		while (this->slotNodes.size() % 4 != 0)
+		{
+			this->slotNodes.push_back(UINT32_MAX);
+			this->slotParents.push_back(padParent);
+		}
+
+		level.swap(nextLevel);
+	}
+
+	const uint32_t slotCount = (uint32_t)this->slotNodes.size();
+	this->levelOffsets.push_back(slotCount);
+
+	//	everything is computed by the first update
+	this->localBlocks.resize(slotCount / 4);
+	for (uint32_t slot = 0; slot < slotCount; slot++)
+	{
+		const uint32_t node = this->slotNodes[slot];
+		this->writeLocal(slot, (node != UINT32_MAX) ? pScene->m_animatedMats[node] : XMMatrixIdentity());
+	}
+	this->worlds.assign(slotCount, XMMatrixIdentity());
+	this->dirty.assign(slotCount, 1);
+	this->updated.assign(slotCount, 0);
+	this->moved.assign(slotCount, 0);
+
+	this->root = XMMatrixIdentity();
+	this->rootDirty = true;
+	this->anyDirty = true;
+	this->anyMoved = false;
+
+	this->stats = SceneTransforms::Stats();
+	this->stats.nodeCount = nodeCount;
+	this->stats.levelCount = (uint32_t)this->levelOffsets.size() - 1;
+}
+
+void SceneTransforms::OnDestroy()
+{
+	this->slotNodes.clear();
+	this->slotParents.clear();
+	this->localBlocks.clear();
+	this->worlds.clear();
+	this->dirty.clear();
+	this->updated.clear();
+	this->moved.clear();
+	this->levelOffsets.clear();
+	this->nodeSlots.clear();
+	this->pScene = nullptr;
+}
+
+void SceneTransforms::setLocalTransform(uint32_t nodeIndex, const XMMATRIX& local)
+{
+	//	kept in sync for TransformScene & other readers
+	this->pScene->m_animatedMats[nodeIndex] = local;
+
+	const uint32_t slot = this->nodeSlots[nodeIndex];
+	if (slot == UINT32_MAX)
+		return; // not in the scene
+
+	this->writeLocal(slot, local);
+	this->dirty[slot] = 1;
+	this->anyDirty = true;
+}
+
+void SceneTransforms::setRootTransform(const XMMATRIX& world)
+{
+	this->root = world;
+	this->rootDirty = true;
+	this->anyDirty = true;
+}
+
+void SceneTransforms::update()
+{
+	const double start = MillisecondsNow();
+	this->stats.updatedCount = 0;
+
+	//	still scene
+	if (!this->anyDirty && !this->anyMoved)
+	{
+		this->stats.milliseconds = MillisecondsNow() - start;
+		return;
+	}
+
+	//	skinned scene : the skinning matrices are only computed by TransformScene
+	if (!this->pScene->m_skins.empty())
+	{
+		this->pScene->TransformScene(this->sceneIndex, this->root);
+
+		std::fill(this->dirty.begin(), this->dirty.end(), (uint8_t)0);
+		this->anyMoved = this->anyDirty;
+		this->anyDirty = false;
+		this->rootDirty = false;
+		this->stats.updatedCount = this->stats.nodeCount;
+		this->stats.milliseconds = MillisecondsNow() - start;
+		return;
+	}
+
+	//	a level after the other : a node is recomputed if it or one of its ancestors changed
+	if (this->anyDirty)
+	{
+		for (uint32_t l = 0; l + 1 < this->levelOffsets.size(); l++)
+		{
+			const uint32_t beginBlock = this->levelOffsets[l] / 4;
+			const uint32_t blockCount = this->levelOffsets[l + 1] / 4 - beginBlock;
+
+			if (this->pJobSystem && blockCount >= PARALLEL_MIN_BLOCKS)
+			{
+				this->pJobSystem->parallelFor(blockCount, PARALLEL_GRAIN_BLOCKS, [this, beginBlock](uint32_t begin, uint32_t end)
+				{
+					this->updateBlocks(beginBlock + begin, beginBlock + end);
+				});
+			}
+			else
+			{
+				this->updateBlocks(beginBlock, beginBlock + blockCount);
+			}
+		}
+	}
+
+	//	publish : recomputed nodes get their new matrix, those recomputed last update get it again
+	//	(their previous matrix catches up, motion vectors go back to 0)
+	bool anyUpdated = false;
+	for (uint32_t slot = 0; slot < this->slotNodes.size(); slot++)
+	{
+		const uint32_t node = this->slotNodes[slot];
+		if (node != UINT32_MAX && (this->updated[slot] || this->moved[slot]))
+		{
+			this->pScene->m_worldSpaceMats[node].Set(this->worlds[slot]);
+			if (this->updated[slot])
+				this->stats.updatedCount++;
+		}
+
+		anyUpdated |= (this->updated[slot] != 0);
+		this->moved[slot] = this->updated[slot];
+		this->updated[slot] = 0;
+		this->dirty[slot] = 0;
+	}
+
+	this->anyMoved = anyUpdated;
+	this->anyDirty = false;
+	this->rootDirty = false;
+	this->stats.milliseconds = MillisecondsNow() - start;
+}
+
+void SceneTransforms::updateBlocks(uint32_t beginBlock, uint32_t endBlock)
+{
+	for (uint32_t block = beginBlock; block < endBlock; block++)
+	{
+		const uint32_t slot = block * 4;
+
+		uint8_t anyUpdated = 0;
+		for (uint32_t lane = 0; lane < 4; lane++)
+		{
+			const uint32_t parent = this->slotParents[slot + lane];
+			const uint8_t parentUpdated = (parent == UINT32_MAX) ? (uint8_t)this->rootDirty : this->updated[parent];
+			this->updated[slot + lane] = this->dirty[slot + lane] | parentUpdated;
+			anyUpdated |= this->updated[slot + lane];
+		}
+		if (!anyUpdated)
+			continue;
+
+		//	parents in SoA : parents[k * 4 + c] holds element (k, c) of every lane
+		XMVECTOR parents[16];
+		for (uint32_t k = 0; k < 4; k++)
+		{
+			XMVECTOR rows[4];
+			for (uint32_t lane = 0; lane < 4; lane++)
+			{
+				const uint32_t parent = this->slotParents[slot + lane];
+				rows[lane] = (parent == UINT32_MAX) ? this->root.r[k] : this->worlds[parent].r[k];
+			}
+			const XMMATRIX columns = XMMatrixTranspose(XMMATRIX(rows[0], rows[1], rows[2], rows[3]));
+			for (uint32_t c = 0; c < 4; c++)
+				parents[k * 4 + c] = columns.r[c];
+		}
+
+		//	world = local * parent, for the 4 lanes at once, then back to one matrix per node
+		const SceneTransforms::MatrixBlock& local = this->localBlocks[block];
+		for (uint32_t r = 0; r < 4; r++)
+		{
+			const XMVECTOR l0 = XMLoadFloat4A((const XMFLOAT4A*)local.m[r * 4 + 0]);
+			const XMVECTOR l1 = XMLoadFloat4A((const XMFLOAT4A*)local.m[r * 4 + 1]);
+			const XMVECTOR l2 = XMLoadFloat4A((const XMFLOAT4A*)local.m[r * 4 + 2]);
+			const XMVECTOR l3 = XMLoadFloat4A((const XMFLOAT4A*)local.m[r * 4 + 3]);
+
+			XMVECTOR row[4];
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				XMVECTOR sum = XMVectorMultiply(l0, parents[0 * 4 + c]);
+				sum = XMVectorMultiplyAdd(l1, parents[1 * 4 + c], sum);
+				sum = XMVectorMultiplyAdd(l2, parents[2 * 4 + c], sum);
+				sum = XMVectorMultiplyAdd(l3, parents[3 * 4 + c], sum);
+				row[c] = sum;
+			}
+
+			const XMMATRIX lanes = XMMatrixTranspose(XMMATRIX(row[0], row[1], row[2], row[3]));
+			for (uint32_t lane = 0; lane < 4; lane++)
+				this->worlds[slot + lane].r[r] = lanes.r[lane];
+		}
+	}
+}
+
+void SceneTransforms::writeLocal(uint32_t slot, const XMMATRIX& local)
+{
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, local);
+
+	SceneTransforms::MatrixBlock& block = this->localBlocks[slot / 4];
+	for (uint32_t r = 0; r < 4; r++)
+		for (uint32_t c = 0; c < 4; c++)
+			block.m[r * 4 + c][slot % 4] = m.m[r][c];
+}
+
+//	benchmark
+//
+std::vector<SceneTransforms::BenchmarkResult> SceneTransforms::runBenchmark(JobSystem* pJobSystem)
+{
+	//	wide & shallow to narrow & deep
+	const uint32_t hierarchies[][2] = { { 32, 3 }, { 4, 8 }, { 2, 16 } }; // branching, depth
+	const uint32_t iterations = 32;
+
+	std::vector<SceneTransforms::BenchmarkResult> results;
+	for (const uint32_t* hierarchy : hierarchies)
+	{
+		SceneTransforms::BenchmarkResult result;
+		result.branching = hierarchy[0];
+		result.depth = hierarchy[1];
+
+		//	full tree, created breadth first
+		SceneLoader scene;
+		std::vector<uint32_t> depths(1, 0);
+		for (uint32_t node = 0; node < depths.size(); node++)
+		{
+			if (depths[node] == result.depth)
+				continue;
+			for (uint32_t i = 0; i < result.branching; i++)
+				depths.push_back(depths[node] + 1);
+		}
+		result.nodeCount = (uint32_t)depths.size();
+
+		scene.m_nodes.resize(result.nodeCount);
+		scene.m_animatedMats.resize(result.nodeCount);
+		scene.m_worldSpaceMats.resize(result.nodeCount);
+		uint32_t nextChild = 1;
+		for (uint32_t node = 0; node < result.nodeCount; node++)
+		{
+			if (depths[node] < result.depth)
+			{
+				for (uint32_t i = 0; i < result.branching; i++)
+					scene.m_nodes[node].m_children.push_back((int)nextChild++);
+			}
+			scene.m_animatedMats[node] = XMMatrixRotationY(0.1f * (node % 7)) * XMMatrixTranslation(1.f, 0.f, 0.5f);
+		}
+		scene.m_scenes.resize(1);
+		scene.m_scenes[0].m_nodes.push_back(0);
+
+		//	GLTFCommon::TransformScene, recursive from the root
+		double start = MillisecondsNow();
+		for (uint32_t i = 0; i < iterations; i++)
+			scene.TransformScene(0, XMMatrixIdentity());
+		result.recursive = (MillisecondsNow() - start) / iterations;
+
+		std::vector<XMMATRIX> reference(result.nodeCount);
+		for (uint32_t node = 0; node < result.nodeCount; node++)
+			reference[node] = scene.m_worldSpaceMats[node].GetCurrent();
+
+		//	every node
+		SceneTransforms serial, jobs;
+		serial.OnCreate(&scene, 0);
+		jobs.OnCreate(&scene, 0, pJobSystem);
+
+		start = MillisecondsNow();
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			serial.setRootTransform(XMMatrixIdentity());
+			serial.update();
+		}
+		result.full = (MillisecondsNow() - start) / iterations;
+
+		start = MillisecondsNow();
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			jobs.setRootTransform(XMMatrixIdentity());
+			jobs.update();
+		}
+		result.fullJobs = (MillisecondsNow() - start) / iterations;
+
+		for (uint32_t node = 0; node < result.nodeCount; node++)
+		{
+			const XMMATRIX world = scene.m_worldSpaceMats[node].GetCurrent();
+			for (uint32_t r = 0; r < 4; r++)
+				result.maxError = max(result.maxError, XMVectorGetX(XMVector4LengthSq(XMVectorSubtract(world.r[r], reference[node].r[r]))));
+		}
+		result.maxError = sqrtf(result.maxError);
+
+		//	1% of the nodes moved, anywhere in the tree
+		serial.update(); // settles the full updates
+		uint32_t seed = 12345;
+		uint32_t incrementalNodes = 0;
+		start = MillisecondsNow();
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			for (uint32_t j = 0; j < max(1u, result.nodeCount / 100); j++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				const uint32_t node = (seed >> 8) % result.nodeCount;
+				serial.setLocalTransform(node, XMMatrixRotationX(0.01f) * scene.m_animatedMats[node]);
+			}
+			serial.update();
+			incrementalNodes += serial.getStats().updatedCount;
+		}
+		result.incremental = (MillisecondsNow() - start) / iterations;
+		result.incrementalNodes = (float)incrementalNodes / iterations;
+
+		//	nothing moved
+		serial.update();
+		start = MillisecondsNow();
+		for (uint32_t i = 0; i < iterations; i++)
+			serial.update();
+		result.still = (MillisecondsNow() - start) / iterations;
+
+		serial.OnDestroy();
+		jobs.OnDestroy();
+
+		std::stringstream msg;
+		msg << "Transform benchmark [" << result.branching << "^" << result.depth << ", " << result.nodeCount << " nodes] : "
+			<< "recursive " << result.recursive << " ms, full " << result.full << " ms, full (jobs) " << result.fullJobs
+			<< " ms, incremental " << result.incremental << " ms (" << result.incrementalNodes << " nodes), still "
+			<< result.still << " ms, max. error " << result.maxError << "\n";
+		Trace(msg.str());
+
+		results.push_back(result);
+	}
+	return results;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "JobSystem.h"
+
+//  incremental replacement of GLTFCommon::TransformScene : only the subtrees under a changed local transform
+//  are recomputed into the scene's world matrices, and nothing is done while the scene holds still.
+//  the hierarchy is flattened breadth first (a level after the other, every level padded to a multiple of 4),
+//  so a level only depends on the previous one, and the local matrices are stored in SoA blocks of 4 nodes
+//  multiplied with their parents' matrices 4 at a time.
+//  scenes with skins fall back to TransformScene (skinning matrices are computed there) whenever something changed.
+class SceneTransforms
+{
+public:
+
+    struct Stats
+    {
+        uint32_t nodeCount = 0;
+        uint32_t levelCount = 0;
+        uint32_t updatedCount = 0; // world matrices recomputed, last update
+        double   milliseconds = 0; // last update
+    };
+
+    //  time per update on a synthetic hierarchy (ms.)
+    struct BenchmarkResult
+    {
+        uint32_t branching = 0, depth = 0, nodeCount = 0;
+        double   recursive = 0;       // GLTFCommon::TransformScene
+        double   full = 0;            // every node, on the calling thread
+        double   fullJobs = 0;        // every node, levels split over the job system
+        double   incremental = 0;     // 1% of the nodes moved
+        double   still = 0;           // nothing moved
+        float    incrementalNodes = 0; // world matrices recomputed per incremental update
+        float    maxError = 0;        // against TransformScene
+    };
+
+    //  the hierarchy of the scene must not change afterwards. pJobSystem splits large levels, if given.
+    void OnCreate(SceneLoader* pScene, uint32_t sceneIndex, JobSystem* pJobSystem = nullptr);
+    void OnDestroy();
+
+    //  local transform of a node (glTF index), also written to m_animatedMats
+    void setLocalTransform(uint32_t nodeIndex, const XMMATRIX& local);
+    //  transform of the whole scene
+    void setRootTransform(const XMMATRIX& world);
+
+    //  call once a frame : refresh the world matrices of the moved subtrees (and settle the previous matrices
+    //  of those moved the frame before, as TransformScene does for every node)
+    void update();
+
+    const SceneTransforms::Stats& getStats() const
+    { return this->stats; }
+
+    //  compares the update paths on synthetic hierarchies, then traces the results
+    static std::vector<SceneTransforms::BenchmarkResult> runBenchmark(JobSystem* pJobSystem);
+
+private:
+
+    //  local matrices of 4 consecutive slots : element (row, column) of every lane
+    struct alignas(16) MatrixBlock
+    {
+        float m[16][4];
+    };
+
+    SceneLoader*          pScene = nullptr;
+    uint32_t              sceneIndex = 0;
+    JobSystem*            pJobSystem = nullptr;
+
+    //  per slot, breadth first (padding slots have no node)
+    std::vector<uint32_t>    slotNodes;   // glTF index, UINT32_MAX for padding
+    std::vector<uint32_t>    slotParents; // slot, UINT32_MAX for roots
+    std::vector<MatrixBlock> localBlocks; // slot / 4
+    std::vector<XMMATRIX>    worlds;
+    std::vector<uint8_t>     dirty;       // local transform changed
+    std::vector<uint8_t>     updated;     // world recomputed, this update
+    std::vector<uint8_t>     moved;       // world recomputed, last update
+    std::vector<uint32_t>    levelOffsets; // level l spans [levelOffsets[l], levelOffsets[l + 1]) slots
+    std::vector<uint32_t>    nodeSlots;   // per glTF index, UINT32_MAX if not in the scene
+
+    XMMATRIX              root = XMMatrixIdentity();
+    bool                  rootDirty = true;
+    bool                  anyDirty = true;
+    bool                  anyMoved = false;
+
+    SceneTransforms::Stats stats;
+
+    void writeLocal(uint32_t slot, const XMMATRIX& local);
+    void updateBlocks(uint32_t beginBlock, uint32_t endBlock);
+};
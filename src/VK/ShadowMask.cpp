@@ -0,0 +1,221 @@
+#include "ShadowMask.h"
+
+#define GROUP_SIZE 8
+
+void ShadowMask::OnCreate(
+	Device* pDevice,
+	ResourceViewHeaps* pResourceViewHeaps,
+	DynamicBufferRing* pDynamicBufferRing,
+	VkImageView shadowMapSRV)
+{
+	this->pDevice = pDevice;
+	this->pResourceViewHeaps = pResourceViewHeaps;
+	this->pDynamicBufferRing = pDynamicBufferRing;
+
+	//  create default sampler
+	this->sampler_default = CreateSampler(pDevice->GetDevice(), false);
+
+	//  create sampler for sampling RSM (depth), same as D-light's
+	{
+		VkSamplerCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		info.magFilter = VK_FILTER_LINEAR;
+		info.minFilter = VK_FILTER_LINEAR;
+		info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		info.compareEnable = VK_TRUE;
+		info.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		info.minLod = -1000;
+		info.maxLod = 1000;
+		info.maxAnisotropy = 1.0f;
+		VkResult res = vkCreateSampler(pDevice->GetDevice(), &info, NULL, &this->sampler_shadow);
+		assert(res == VK_SUCCESS);
+	}
+
+	DefineList defines;
+	this->createDescriptors(defines);
+
+	//	offset & extent of the updated region
+	this->maskPass.OnCreate(this->pDevice, "ShadowMask.glsl", "main", "", this->descriptorSetLayout,
+		0, 0, 0, &defines, 4 * sizeof(int));
+
+	//	update desc set (except g-buffer & target)
+	this->pDynamicBufferRing->SetDescriptorSet(0, sizeof(per_frame), this->descriptorSet);
+	SetDescriptorSetForDepth(this->pDevice->GetDevice(), 1, shadowMapSRV, &this->sampler_shadow, this->descriptorSet);
+}
+
+void ShadowMask::OnDestroy()
+{
+	this->maskPass.OnDestroy();
+
+	this->pResourceViewHeaps->FreeDescriptor(this->descriptorSet);
+	vkDestroyDescriptorSetLayout(this->pDevice->GetDevice(), this->descriptorSetLayout, nullptr);
+
+	vkDestroySampler(this->pDevice->GetDevice(), this->sampler_default, nullptr);
+	vkDestroySampler(this->pDevice->GetDevice(), this->sampler_shadow, nullptr);
+}
+
+void ShadowMask::OnCreateWindowSizeDependentResources(uint32_t Width, uint32_t Height, GBuffer* pGBuffer)
+{
+	this->outWidth = Width;
+	this->outHeight = Height;
+
+	//	create render target
+	this->mask.InitRenderTarget(
+		this->pDevice,
+		this->outWidth, this->outHeight,
+		VK_FORMAT_R8G8B8A8_UNORM,
+		VK_SAMPLE_COUNT_1_BIT,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+		false,
+		"Shadow Mask"
+	);
+	this->mask.CreateSRV(&this->maskSRV);
+
+	//	update desc set
+	SetDescriptorSet(this->pDevice->GetDevice(), 2, pGBuffer->m_WorldCoordSRV, &this->sampler_default, this->descriptorSet);
+	{
+		VkDescriptorImageInfo imgInfo;
+		imgInfo.sampler = VK_NULL_HANDLE;
+		imgInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imgInfo.imageView = this->maskSRV;
+
+		VkWriteDescriptorSet write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write.pNext = NULL;
+		write.dstSet = this->descriptorSet;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		write.pImageInfo = &imgInfo;
+		write.dstBinding = 3;
+		write.dstArrayElement = 0;
+
+		vkUpdateDescriptorSets(this->pDevice->GetDevice(), 1, &write, 0, NULL);
+	}
+}
+
+void ShadowMask::OnDestroyWindowSizeDependentResources()
+{
+	//  destroy texture and its image view
+	vkDestroyImageView(this->pDevice->GetDevice(), this->maskSRV, nullptr);
+	this->maskSRV = VK_NULL_HANDLE;
+	this->mask.OnDestroy();
+}
+
+void ShadowMask::Draw(VkCommandBuffer commandBuffer, VkDescriptorBufferInfo* perFrameDesc, const VkRect2D* pRect)
+{
+	SetPerfMarkerBegin(commandBuffer, "Shadow Mask");
+
+	VkRect2D rect;
+	if (pRect)
+		rect = *pRect;
+	else
+		rect = { { 0, 0 }, { this->outWidth, this->outHeight } };
+
+	//	offset & extent
+	int region[4] = { rect.offset.x, rect.offset.y, (int)rect.extent.width, (int)rect.extent.height };
+
+	//	a partial update keeps the mask outside of the region
+	this->barrier_In(commandBuffer, pRect != nullptr);
+
+	this->maskPass.Draw(commandBuffer, perFrameDesc, this->descriptorSet,
+		(rect.extent.width + GROUP_SIZE - 1) / GROUP_SIZE,
+		(rect.extent.height + GROUP_SIZE - 1) / GROUP_SIZE,
+		1, region);
+
+	this->barrier_Out(commandBuffer);
+
+	SetPerfMarkerEnd(commandBuffer);
+}
+
+void ShadowMask::createDescriptors(DefineList& defines)
+{
+	const uint32_t bindingCount = 4;
+	std::vector<VkDescriptorSetLayoutBinding> layoutBindings(bindingCount);
+	uint32_t bindingIdx = 0;
+
+	//	0. per-frame data (lights)
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	defines["ID_PER_FRAME"] = std::to_string(bindingIdx++);
+	//	1. Shadow map (RSM depth)
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	defines["ID_shadowMap"] = std::to_string(bindingIdx++);
+	//	2. World Coord
+	layoutBindings[bindingIdx] = layoutBindings[1];
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	defines["ID_GBufWorldCoord"] = std::to_string(bindingIdx++);
+
+	//	3. Target buffer
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	defines["ID_Target"] = std::to_string(bindingIdx++);
+
+	assert(bindingIdx == bindingCount);
+	this->pResourceViewHeaps->CreateDescriptorSetLayoutAndAllocDescriptorSet(
+		&layoutBindings,
+		&this->descriptorSetLayout,
+		&this->descriptorSet);
+}
+
+void ShadowMask::barrier_In(VkCommandBuffer cmdBuf, bool keepContents)
+{
+	VkImageMemoryBarrier barriers[1];
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].pNext = NULL;
+	barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].subresourceRange.baseMipLevel = 0;
+	barriers[0].subresourceRange.levelCount = 1;
+	barriers[0].subresourceRange.baseArrayLayer = 0;
+	barriers[0].subresourceRange.layerCount = 1;
+	barriers[0].oldLayout = keepContents ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barriers[0].image = this->mask.Resource();
+
+	//	the previous D-light pass reads the mask
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, NULL, 0, NULL,
+		1, barriers);
+}
+
+void ShadowMask::barrier_Out(VkCommandBuffer cmdBuf)
+{
+	VkImageMemoryBarrier barriers[1];
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].pNext = NULL;
+	barriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].subresourceRange.baseMipLevel = 0;
+	barriers[0].subresourceRange.levelCount = 1;
+	barriers[0].subresourceRange.baseArrayLayer = 0;
+	barriers[0].subresourceRange.layerCount = 1;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barriers[0].image = this->mask.Resource();
+
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 0, NULL, 0, NULL,
+		1, barriers);
+}
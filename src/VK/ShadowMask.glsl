@@ -0,0 +1,64 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_ARB_compute_shader  : enable
+
+precision highp float;
+
+//--------------------------------------------------------------------------------------
+//  CS workgroup definition
+//--------------------------------------------------------------------------------------
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+//--------------------------------------------------------------------------------------
+//  uniform data
+//  set 0 : input data
+//--------------------------------------------------------------------------------------
+
+layout (push_constant) uniform pushConstants
+{
+    layout (offset = 0) ivec2 u_offset; // updated region
+    layout (offset = 8) ivec2 u_extent;
+};
+
+#include "perFrameStruct.h"
+
+layout (std140, binding = ID_PER_FRAME) uniform perFrame
+{
+    PerFrame myPerFrame;
+};
+
+layout (binding = ID_shadowMap) uniform sampler2DShadow u_shadowMap;
+layout (binding = ID_GBufWorldCoord) uniform sampler2D u_gbufWorldCoord;
+
+//  filtered visibility, one channel per shadow map quarter (see Light::shadowMapIndex)
+layout (rgba8, binding = ID_Target) uniform writeonly image2D img_shadowMask;
+
+//--------------------------------------------------------------------------------------
+//  main function
+//--------------------------------------------------------------------------------------
+
+#include "functions.glsl"
+#include "PBRLighting.h"
+
+void main()
+{
+    if (any(greaterThanEqual(gl_GlobalInvocationID.xy, uvec2(u_extent))))
+        return;
+
+    const ivec2 pixel = u_offset + ivec2(gl_GlobalInvocationID.xy);
+    const vec3 worldPos = texelFetch(u_gbufWorldCoord, pixel, 0).xyz;
+
+    //  quarters without a light stay lit
+    vec4 mask = vec4(1.0f);
+    for (int i = 0; i < myPerFrame.u_lightCount; ++i)
+    {
+        Light light = myPerFrame.u_lights[i];
+        if (light.shadowMapIndex >= 0 && light.shadowMapIndex < 4)
+            mask[light.shadowMapIndex] = DoSpotShadow(worldPos, light);
+    }
+
+    imageStore(img_shadowMask, pixel, mask);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+//  screen-space shadow mask : the filtered shadow map visibility of every pixel,
+//  one channel per shadow map quarter (see Light::shadowMapIndex).
+//  computed once before a D-light pass, so that the PCF filtering is not repeated per light evaluation.
+class ShadowMask
+{
+public:
+
+    void OnCreate(
+        Device* pDevice,
+        ResourceViewHeaps* pResourceViewHeaps,
+        DynamicBufferRing* pDynamicBufferRing,
+        VkImageView shadowMapSRV);
+    void OnDestroy();
+
+    void OnCreateWindowSizeDependentResources(uint32_t Width, uint32_t Height, GBuffer* pGBuffer);
+    void OnDestroyWindowSizeDependentResources();
+
+    //  update the mask of the pixels in pRect (whole screen if null), from the current G-buffer world coord.
+    //  the mask is left in SHADER_READ_ONLY layout for the fragment shaders.
+    void Draw(VkCommandBuffer commandBuffer, VkDescriptorBufferInfo* perFrameDesc, const VkRect2D* pRect = nullptr);
+
+    VkImageView GetTextureView() { return this->maskSRV; }
+
+protected:
+
+    Device* pDevice = nullptr;
+
+    ResourceViewHeaps* pResourceViewHeaps = nullptr;
+    DynamicBufferRing* pDynamicBufferRing = nullptr;
+
+    uint32_t              outWidth = 0, outHeight = 0;
+
+    Texture               mask;
+    VkImageView           maskSRV = VK_NULL_HANDLE;
+
+    VkSampler             sampler_default = VK_NULL_HANDLE;
+    VkSampler             sampler_shadow = VK_NULL_HANDLE;
+
+    PostProcCS maskPass;
+
+    VkDescriptorSet       descriptorSet;
+    VkDescriptorSetLayout descriptorSetLayout;
+
+    void createDescriptors(DefineList& defines);
+
+    void barrier_In(VkCommandBuffer cmdBuf, bool keepContents);
+    void barrier_Out(VkCommandBuffer cmdBuf);
+};
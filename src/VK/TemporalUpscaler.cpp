@@ -0,0 +1,265 @@
+#include "TemporalUpscaler.h"
+
+#define GROUP_SIZE 8
+
+//	weight of a current sample landing on the pixel center, the history holds the rest
+static const float BLEND_FACTOR = 0.1f;
+
+void TemporalUpscaler::OnCreate(
+	Device* pDevice,
+	ResourceViewHeaps* pResourceViewHeaps,
+	DynamicBufferRing* pDynamicBufferRing)
+{
+	this->pDevice = pDevice;
+	this->pResourceViewHeaps = pResourceViewHeaps;
+	this->pDynamicBufferRing = pDynamicBufferRing;
+
+	//	create samplers : current samples are fetched, the history is filtered
+	{
+		VkSamplerCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		info.magFilter = VK_FILTER_NEAREST;
+		info.minFilter = VK_FILTER_NEAREST;
+		info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		info.minLod = -1000;
+		info.maxLod = 1000;
+		info.maxAnisotropy = 1.0f;
+		VkResult res = vkCreateSampler(pDevice->GetDevice(), &info, NULL, &this->sampler_point);
+		assert(res == VK_SUCCESS);
+
+		info.magFilter = VK_FILTER_LINEAR;
+		info.minFilter = VK_FILTER_LINEAR;
+		res = vkCreateSampler(pDevice->GetDevice(), &info, NULL, &this->sampler_linear);
+		assert(res == VK_SUCCESS);
+	}
+
+	DefineList defines;
+	this->createDescriptors(defines);
+
+	this->upscalePass.OnCreate(this->pDevice, "TemporalUpscaler.glsl", "main", "", this->descriptorSetLayout,
+		0, 0, 0, &defines);
+
+	//	update desc sets (except inputs & outputs)
+	for (uint32_t i = 0; i < 2; i++)
+		this->pDynamicBufferRing->SetDescriptorSet(0, sizeof(TemporalUpscaler::Constants), this->descriptorSet[i]);
+}
+
+void TemporalUpscaler::OnDestroy()
+{
+	this->upscalePass.OnDestroy();
+
+	for (uint32_t i = 0; i < 2; i++)
+		this->pResourceViewHeaps->FreeDescriptor(this->descriptorSet[i]);
+	vkDestroyDescriptorSetLayout(this->pDevice->GetDevice(), this->descriptorSetLayout, nullptr);
+
+	vkDestroySampler(this->pDevice->GetDevice(), this->sampler_point, nullptr);
+	vkDestroySampler(this->pDevice->GetDevice(), this->sampler_linear, nullptr);
+}
+
+void TemporalUpscaler::OnCreateWindowSizeDependentResources(
+	uint32_t Width, uint32_t Height,
+	uint32_t OutputWidth, uint32_t OutputHeight,
+	GBuffer* pGBuffer)
+{
+	this->inWidth = Width;
+	this->inHeight = Height;
+	this->outWidth = OutputWidth;
+	this->outHeight = OutputHeight;
+
+	//	create outputs
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		this->history[i].InitRenderTarget(
+			this->pDevice,
+			this->outWidth, this->outHeight,
+			VK_FORMAT_R16G16B16A16_SFLOAT,
+			VK_SAMPLE_COUNT_1_BIT,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+			false,
+			"Upscaler History"
+		);
+		this->history[i].CreateSRV(&this->historySRV[i]);
+	}
+	this->historyValid = false;
+
+	//	update desc sets : each writes an output while reading the other
+	for (uint32_t cur = 0; cur < 2; cur++)
+	{
+		const uint32_t prev = cur ^ 1;
+		VkDescriptorSet descSet = this->descriptorSet[cur];
+
+		SetDescriptorSet(this->pDevice->GetDevice(), 1, pGBuffer->m_HDRSRV, &this->sampler_point, descSet);
+		SetDescriptorSet(this->pDevice->GetDevice(), 2, pGBuffer->m_MotionVectorsSRV, &this->sampler_point, descSet);
+		SetDescriptorSet(this->pDevice->GetDevice(), 3, this->historySRV[prev], &this->sampler_linear, descSet);
+		{
+			VkDescriptorImageInfo imgInfo;
+			imgInfo.sampler = VK_NULL_HANDLE;
+			imgInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			imgInfo.imageView = this->historySRV[cur];
+
+			VkWriteDescriptorSet write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+			write.pNext = NULL;
+			write.dstSet = descSet;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			write.pImageInfo = &imgInfo;
+			write.dstBinding = 4;
+			write.dstArrayElement = 0;
+
+			vkUpdateDescriptorSets(this->pDevice->GetDevice(), 1, &write, 0, NULL);
+		}
+	}
+}
+
+void TemporalUpscaler::OnDestroyWindowSizeDependentResources()
+{
+	//  destroy textures and their image views
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		vkDestroyImageView(this->pDevice->GetDevice(), this->historySRV[i], nullptr);
+		this->historySRV[i] = VK_NULL_HANDLE;
+		this->history[i].OnDestroy();
+	}
+}
+
+void TemporalUpscaler::Draw(VkCommandBuffer commandBuffer, const float jitter[2])
+{
+	SetPerfMarkerBegin(commandBuffer, "Temporal Upscaler");
+
+	const uint32_t cur = ++this->frameIdx & 1;
+
+	//  update constants
+	VkDescriptorBufferInfo descInfo_constants;
+	{
+		TemporalUpscaler::Constants* pAllocData;
+		this->pDynamicBufferRing->AllocConstantBuffer(sizeof(TemporalUpscaler::Constants), (void**)&pAllocData, &descInfo_constants);
+		pAllocData->renderSize[0] = (float)this->inWidth;
+		pAllocData->renderSize[1] = (float)this->inHeight;
+		pAllocData->outputSize[0] = (float)this->outWidth;
+		pAllocData->outputSize[1] = (float)this->outHeight;
+		pAllocData->jitter[0] = jitter[0];
+		pAllocData->jitter[1] = jitter[1];
+		pAllocData->blend = BLEND_FACTOR;
+		pAllocData->reset = this->historyValid ? 0 : 1;
+	}
+
+	this->barrier_In(commandBuffer, cur);
+
+	this->upscalePass.Draw(commandBuffer, &descInfo_constants, this->descriptorSet[cur],
+		(this->outWidth + GROUP_SIZE - 1) / GROUP_SIZE,
+		(this->outHeight + GROUP_SIZE - 1) / GROUP_SIZE,
+		1);
+
+	this->barrier_Out(commandBuffer, cur);
+	this->historyValid = true;
+
+	SetPerfMarkerEnd(commandBuffer);
+}
+
+void TemporalUpscaler::createDescriptors(DefineList& defines)
+{
+	const uint32_t bindingCount = 5;
+	std::vector<VkDescriptorSetLayoutBinding> layoutBindings(bindingCount);
+	uint32_t bindingIdx = 0;
+
+	//	0. constants
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	defines["ID_Params"] = std::to_string(bindingIdx++);
+	//	1. HDR color (render extent)
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	defines["ID_Color"] = std::to_string(bindingIdx++);
+	//	2. Motion vectors (render extent)
+	layoutBindings[bindingIdx] = layoutBindings[1];
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	defines["ID_MotionVec"] = std::to_string(bindingIdx++);
+	//	3. History (output extent)
+	layoutBindings[bindingIdx] = layoutBindings[1];
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	defines["ID_History"] = std::to_string(bindingIdx++);
+
+	//	4. Target buffer (output extent)
+	layoutBindings[bindingIdx].binding = bindingIdx;
+	layoutBindings[bindingIdx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	layoutBindings[bindingIdx].descriptorCount = 1;
+	layoutBindings[bindingIdx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layoutBindings[bindingIdx].pImmutableSamplers = NULL;
+	defines["ID_Target"] = std::to_string(bindingIdx++);
+
+	assert(bindingIdx == bindingCount);
+	this->pResourceViewHeaps->CreateDescriptorSetLayoutAndAllocDescriptorSet(
+		&layoutBindings,
+		&this->descriptorSetLayout,
+		&this->descriptorSet[0]);
+	this->pResourceViewHeaps->AllocDescriptor(this->descriptorSetLayout, &this->descriptorSet[1]);
+}
+
+void TemporalUpscaler::barrier_In(VkCommandBuffer cmdBuf, uint32_t cur)
+{
+	VkImageMemoryBarrier barriers[2];
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].pNext = NULL;
+	barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].subresourceRange.baseMipLevel = 0;
+	barriers[0].subresourceRange.levelCount = 1;
+	barriers[0].subresourceRange.baseArrayLayer = 0;
+	barriers[0].subresourceRange.layerCount = 1;
+	barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+	//	barrier 0 : target, overwritten (tone-mapped the frame before last)
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[0].image = this->history[cur].Resource();
+
+	//	barrier 1 : history, only once after creation (afterwards left readable by the previous frame)
+	barriers[1] = barriers[0];
+	barriers[1].srcAccessMask = 0;
+	barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[1].image = this->history[cur ^ 1].Resource();
+
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, NULL, 0, NULL,
+		this->historyValid ? 1 : 2, barriers);
+}
+
+void TemporalUpscaler::barrier_Out(VkCommandBuffer cmdBuf, uint32_t cur)
+{
+	VkImageMemoryBarrier barriers[1];
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].pNext = NULL;
+	barriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].subresourceRange.baseMipLevel = 0;
+	barriers[0].subresourceRange.levelCount = 1;
+	barriers[0].subresourceRange.baseArrayLayer = 0;
+	barriers[0].subresourceRange.layerCount = 1;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barriers[0].image = this->history[cur].Resource();
+
+	//	tone mapping reads it this frame, the upscaler the next one
+	vkCmdPipelineBarrier(cmdBuf,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, NULL, 0, NULL,
+		1, barriers);
+}
@@ -0,0 +1,181 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_ARB_compute_shader  : enable
+
+precision highp float;
+
+//--------------------------------------------------------------------------------------
+//  CS workgroup definition
+//--------------------------------------------------------------------------------------
+
+//  one invocation per output pixel
+layout (local_size_x = 8, local_size_y = 8) in;
+
+//--------------------------------------------------------------------------------------
+//  uniform data
+//  set 0 : input data
+//--------------------------------------------------------------------------------------
+
+layout (std140, binding = ID_Params) uniform Params
+{
+    vec2  u_renderSize;
+    vec2  u_outputSize;
+    vec2  u_jitter;     // render pixels, +y downwards
+    float u_blend;
+    uint  u_reset;
+};
+
+layout (binding = ID_Color) uniform sampler2D u_color;
+layout (binding = ID_MotionVec) uniform sampler2D u_motionVec;
+layout (binding = ID_History) uniform sampler2D u_history;
+
+layout (rgba16f, binding = ID_Target) uniform writeonly image2D img_target;
+
+//--------------------------------------------------------------------------------------
+//  helpers
+//--------------------------------------------------------------------------------------
+
+//  colors are accumulated tone-mapped, so that a few bright samples don't dominate the filter
+float luma(vec3 c)
+{
+    return dot(c, vec3(0.299f, 0.587f, 0.114f));
+}
+
+vec3 tonemap(vec3 c)
+{
+    return c / (1.0f + luma(c));
+}
+
+vec3 invTonemap(vec3 c)
+{
+    return c / max(1.0f - luma(c), 1.0e-4f);
+}
+
+vec3 RGBToYCoCg(vec3 c)
+{
+    return vec3(
+        0.25f * c.r + 0.5f * c.g + 0.25f * c.b,
+        0.5f * c.r - 0.5f * c.b,
+        -0.25f * c.r + 0.5f * c.g - 0.25f * c.b);
+}
+
+vec3 YCoCgToRGB(vec3 c)
+{
+    return vec3(c.x + c.y - c.z, c.x + c.z, c.x - c.y - c.z);
+}
+
+//  Catmull-Rom filtered history, with 9 bilinear taps (uv in output texels)
+vec3 sampleHistory(vec2 uv)
+{
+    const vec2 samplePos = uv * u_outputSize;
+    const vec2 texPos1 = floor(samplePos - 0.5f) + 0.5f;
+    const vec2 f = samplePos - texPos1;
+
+    const vec2 w0 = f * (-0.5f + f * (1.0f - 0.5f * f));
+    const vec2 w1 = 1.0f + f * f * (-2.5f + 1.5f * f);
+    const vec2 w2 = f * (0.5f + f * (2.0f - 1.5f * f));
+    const vec2 w3 = f * f * (-0.5f + 0.5f * f);
+
+    const vec2 w12 = w1 + w2;
+    const vec2 offset12 = w2 / w12;
+
+    const vec2 texPos0 = (texPos1 - 1.0f) / u_outputSize;
+    const vec2 texPos3 = (texPos1 + 2.0f) / u_outputSize;
+    const vec2 texPos12 = (texPos1 + offset12) / u_outputSize;
+
+    vec3 result = vec3(0.0f);
+    result += textureLod(u_history, vec2(texPos0.x,  texPos0.y), 0).rgb * w0.x * w0.y;
+    result += textureLod(u_history, vec2(texPos12.x, texPos0.y), 0).rgb * w12.x * w0.y;
+    result += textureLod(u_history, vec2(texPos3.x,  texPos0.y), 0).rgb * w3.x * w0.y;
+
+    result += textureLod(u_history, vec2(texPos0.x,  texPos12.y), 0).rgb * w0.x * w12.y;
+    result += textureLod(u_history, vec2(texPos12.x, texPos12.y), 0).rgb * w12.x * w12.y;
+    result += textureLod(u_history, vec2(texPos3.x,  texPos12.y), 0).rgb * w3.x * w12.y;
+
+    result += textureLod(u_history, vec2(texPos0.x,  texPos3.y), 0).rgb * w0.x * w3.y;
+    result += textureLod(u_history, vec2(texPos12.x, texPos3.y), 0).rgb * w12.x * w3.y;
+    result += textureLod(u_history, vec2(texPos3.x,  texPos3.y), 0).rgb * w3.x * w3.y;
+
+    //  the negative lobes may overshoot
+    return max(result, vec3(0.0f));
+}
+
+//  clip the history towards the center of the neighborhood's box
+vec3 clipToBox(vec3 history, vec3 boxMin, vec3 boxMax)
+{
+    const vec3 center = 0.5f * (boxMax + boxMin);
+    const vec3 extent = 0.5f * (boxMax - boxMin) + 1.0e-4f;
+
+    const vec3 v = history - center;
+    const vec3 units = abs(v / extent);
+    const float maxUnit = max(units.x, max(units.y, units.z));
+    return (maxUnit > 1.0f) ? center + v / maxUnit : history;
+}
+
+//--------------------------------------------------------------------------------------
+//  main function
+//--------------------------------------------------------------------------------------
+
+void main()
+{
+    const ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, ivec2(u_outputSize))))
+        return;
+
+    const vec2 uv = (vec2(pixel) + 0.5f) / u_outputSize;
+
+    //  the sample of render pixel p lies at p + 0.5 + jitter
+    const vec2 renderPos = uv * u_renderSize - u_jitter;
+    const ivec2 center = ivec2(floor(renderPos));
+    const ivec2 maxCoord = ivec2(u_renderSize) - 1;
+
+    //  gather the 3x3 current samples around the pixel center :
+    //  gaussian-weighted reconstruction + moments of the neighborhood for clipping
+    vec3 sum = vec3(0.0f);
+    float weightSum = 0.0f, maxWeight = 0.0f;
+    vec3 m1 = vec3(0.0f), m2 = vec3(0.0f);
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            const ivec2 coord = clamp(center + ivec2(x, y), ivec2(0), maxCoord);
+            const vec3 color = RGBToYCoCg(tonemap(texelFetch(u_color, coord, 0).rgb));
+
+            const vec2 d = vec2(center + ivec2(x, y)) + 0.5f - renderPos;
+            const float w = exp(-2.29f * dot(d, d));
+
+            sum += color * w;
+            weightSum += w;
+            maxWeight = max(maxWeight, w);
+
+            m1 += color;
+            m2 += color * color;
+        }
+    }
+    const vec3 current = sum / weightSum;
+
+    //  history, reprojected with the motion vector of the nearest render pixel
+    const ivec2 nearest = clamp(ivec2(floor(uv * u_renderSize)), ivec2(0), maxCoord);
+    const vec2 motionVec = texelFetch(u_motionVec, nearest, 0).rg * vec2(0.5f, -0.5f);
+    const vec2 prevUV = uv - motionVec;
+
+    vec3 result = current;
+    if (u_reset == 0 && all(greaterThanEqual(prevUV, vec2(0.0f))) && all(lessThanEqual(prevUV, vec2(1.0f))))
+    {
+        //  variance box, tighter than the min/max one
+        const float gamma = 1.25f;
+        const vec3 mean = m1 / 9.0f;
+        const vec3 sigma = sqrt(abs(m2 / 9.0f - mean * mean));
+
+        vec3 history = RGBToYCoCg(tonemap(sampleHistory(prevUV)));
+        history = clipToBox(history, mean - gamma * sigma, mean + gamma * sigma);
+
+        //  samples far from the pixel center contribute less
+        const float alpha = clamp(u_blend * maxWeight, 0.01f, 1.0f);
+        result = mix(history, current, alpha);
+    }
+
+    imageStore(img_target, pixel, vec4(invTonemap(YCoCgToRGB(result)), 1.0f));
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+//  temporal upscaler : resolves the jittered HDR image rendered at a lower extent into an image at the output extent,
+//  taking TAA's place when the scene is rendered below the window extent.
+//  every output pixel gathers the current samples around it (weighted by their distance to its center, jitter included)
+//  and blends them with the reprojected history, clipped to the current neighborhood's color box.
+class TemporalUpscaler
+{
+public:
+
+    struct Constants
+    {
+        float renderSize[2];
+        float outputSize[2];
+        float jitter[2];    // of the current frame, in render pixels (+y downwards)
+        float blend;        // weight of a current sample landing on the pixel center
+        uint32_t reset;     // 1 : ignore the history
+    };
+
+    void OnCreate(
+        Device* pDevice,
+        ResourceViewHeaps* pResourceViewHeaps,
+        DynamicBufferRing* pDynamicBufferRing);
+    void OnDestroy();
+
+    //  input at Width x Height (color & motion vectors of the G-buffer), output at OutputWidth x OutputHeight
+    void OnCreateWindowSizeDependentResources(
+        uint32_t Width, uint32_t Height,
+        uint32_t OutputWidth, uint32_t OutputHeight,
+        GBuffer* pGBuffer);
+    void OnDestroyWindowSizeDependentResources();
+
+    //  the G-buffer's color & motion vectors must be in SHADER_READ_ONLY layout.
+    //  the output is left in SHADER_READ_ONLY layout.
+    void Draw(VkCommandBuffer commandBuffer, const float jitter[2]);
+
+    //  the output of the latest Draw
+    VkImageView GetTextureView() { return this->historySRV[this->frameIdx & 1]; }
+
+private:
+
+    Device* pDevice = nullptr;
+
+    ResourceViewHeaps* pResourceViewHeaps = nullptr;
+    DynamicBufferRing* pDynamicBufferRing = nullptr;
+
+    uint32_t              inWidth = 0, inHeight = 0;
+    uint32_t              outWidth = 0, outHeight = 0;
+
+    //  ping-ponged every frame : the previous output is the history of the current one
+    Texture               history[2]; // r16g16b16a16f
+    VkImageView           historySRV[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+    uint32_t              frameIdx = 0;
+    bool                  historyValid = false;
+
+    VkSampler             sampler_point = VK_NULL_HANDLE;
+    VkSampler             sampler_linear = VK_NULL_HANDLE;
+
+    PostProcCS            upscalePass;
+
+    VkDescriptorSet       descriptorSet[2]; // by output index
+    VkDescriptorSetLayout descriptorSetLayout;
+
+    void createDescriptors(DefineList& defines);
+
+    void barrier_In(VkCommandBuffer cmdBuf, uint32_t cur);
+    void barrier_Out(VkCommandBuffer cmdBuf, uint32_t cur);
+};
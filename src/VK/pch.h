@@ -7,6 +7,7 @@
 
 // C RunTime Header Files
 #include <vector>
+#include <map>
 #include <fstream>
 
 #include "vulkan/vulkan.h"